@@ -37,7 +37,10 @@
 #include <linux/videodev2.h>
 #include <sync/sync.h>
 #include <utils/Trace.h>
+#include <algorithm>
 #include <deque>
+#include <numeric>
+#include <thread>
 
 #define HAVE_JPEG  // required for libyuv.h to export MJPEG decode APIs
 #include <libyuv.h>
@@ -89,6 +92,42 @@ bool tryLock(std::mutex& mutex) {
     return locked;
 }
 
+// Returns the number of output rows that stripes scaled by scaleI420Rows must be a multiple of,
+// for them to sample the same input rows as scaling the whole image at once, or outHeight if the
+// scale cannot be split exactly. The scale of both planes must be exact in the 16.16 fixed point
+// of libyuv, and each stripe must start on whole input rows, aligned for the 2/4/8 row patterns
+// of the libyuv special cases, in both the luma and the chroma planes.
+int32_t getScaleStripeRows(int32_t inHeight, int32_t outHeight) {
+    if (inHeight % 2 != 0 || outHeight % 2 != 0 ||
+        (int64_t{inHeight / 2} << 16) % (outHeight / 2) != 0) {
+        return outHeight;
+    }
+    return 16 * (outHeight / std::gcd(inHeight, outHeight));
+}
+
+// Scales the output rows [top, bottom) of an I420 image, from the matching rows of the input.
+// top and bottom must be multiples of getScaleStripeRows, or the image edges.
+int scaleI420Rows(const YCbCrLayout& in, const Size& inSz, const YCbCrLayout& out,
+                  const Size& outSz, int32_t top, int32_t bottom) {
+    int32_t inTop = static_cast<int32_t>(int64_t{top} * inSz.height / outSz.height);
+    int32_t inBottom = static_cast<int32_t>(int64_t{bottom} * inSz.height / outSz.height);
+    int ret = libyuv::I420Scale(
+            static_cast<uint8_t*>(in.y) + inTop * in.yStride, in.yStride,
+            static_cast<uint8_t*>(in.cb) + inTop / 2 * in.cStride, in.cStride,
+            static_cast<uint8_t*>(in.cr) + inTop / 2 * in.cStride, in.cStride, inSz.width,
+            inBottom - inTop, static_cast<uint8_t*>(out.y) + top * out.yStride, out.yStride,
+            static_cast<uint8_t*>(out.cb) + top / 2 * out.cStride, out.cStride,
+            static_cast<uint8_t*>(out.cr) + top / 2 * out.cStride, out.cStride, outSz.width,
+            bottom - top,
+            // TODO: b/72261744 see if we can use better filter without losing too much perf
+            libyuv::FilterMode::kFilterNone);
+    if (ret != 0) {
+        ALOGE("%s: failed to scale buffer from %dx%d to %dx%d, rows %d-%d. Ret %d", __FUNCTION__,
+              inSz.width, inSz.height, outSz.width, outSz.height, top, bottom, ret);
+    }
+    return ret;
+}
+
 }  // anonymous namespace
 
 using ::aidl::android::hardware::camera::device::BufferRequestStatus;
@@ -221,6 +260,7 @@ void ExternalCameraDeviceSession::initOutputThread() {
     mBufferRequestThread->run();
     mOutputThread = std::make_shared<OutputThread>(/*parent=*/thiz, mCroppingType,
                                                    mCameraCharacteristics, mBufferRequestThread);
+    mOutputThread->startPipeline();
 }
 
 void ExternalCameraDeviceSession::closeOutputThread() {
@@ -2131,21 +2171,35 @@ ExternalCameraDeviceSession::OutputThread::OutputThread(
       mCameraCharacteristics(chars),
       mBufferRequestThread(bufReqThread) {}
 
-ExternalCameraDeviceSession::OutputThread::~OutputThread() {}
+ExternalCameraDeviceSession::OutputThread::~OutputThread() {
+    stopPipeline();
+}
+
+void ExternalCameraDeviceSession::OutputThread::startPipeline() {
+    size_t threadCount = std::clamp<size_t>(std::thread::hardware_concurrency(), 1,
+                                            kMaxConvertThreads);
+    mConvertWorkers = std::make_unique<WorkerPool>(threadCount - 1);
+    mConvertThread = std::make_unique<StageThread>(this, &OutputThread::convertStage);
+    mEncodeThread = std::make_unique<StageThread>(this, &OutputThread::encodeStage);
+    mEncodeThread->run();
+    mConvertThread->run();
+}
 
 Status ExternalCameraDeviceSession::OutputThread::allocateIntermediateBuffers(
         const Size& v4lSize, const Size& thumbSize, const std::vector<Stream>& streams,
         uint32_t blobBufferSize) {
-    std::lock_guard<std::mutex> lk(mBufferLock);
-    if (!mScaledYu12Frames.empty()) {
+    std::lock_guard<std::shared_mutex> lk(mBufferLock);
+    if (!mScaledYu12Frames.empty() || !mJpegScaledYu12Frames.empty()) {
         ALOGE("%s: intermediate buffer pool has %zu inflight buffers! (expect 0)", __FUNCTION__,
-              mScaledYu12Frames.size());
+              mScaledYu12Frames.size() + mJpegScaledYu12Frames.size());
         return Status::INTERNAL_ERROR;
     }
 
-    // Allocating intermediate YU12 frame
-    if (mYu12Frame == nullptr || mYu12Frame->mWidth != v4lSize.width ||
-        mYu12Frame->mHeight != v4lSize.height) {
+    // Allocating intermediate YU12 frame, which the pipeline replaces with mYu12FramePool
+    if (mConvertThread != nullptr) {
+        mYu12Frame.reset();
+    } else if (mYu12Frame == nullptr || mYu12Frame->mWidth != v4lSize.width ||
+               mYu12Frame->mHeight != v4lSize.height) {
         mYu12Frame.reset();
         mYu12Frame = std::make_shared<AllocatedFrame>(v4lSize.width, v4lSize.height);
         int ret = mYu12Frame->allocate(&mYu12FrameLayout);
@@ -2167,46 +2221,81 @@ Status ExternalCameraDeviceSession::OutputThread::allocateIntermediateBuffers(
         }
     }
 
-    // Allocating scaled buffers
-    for (const auto& stream : streams) {
-        Size sz = {stream.width, stream.height};
-        if (sz == v4lSize) {
-            continue;  // Don't need an intermediate buffer same size as v4lBuffer
-        }
-        if (mIntermediateBuffers.count(sz) == 0) {
-            // Create new intermediate buffer
-            std::shared_ptr<AllocatedFrame> buf =
-                    std::make_shared<AllocatedFrame>(stream.width, stream.height);
-            int ret = buf->allocate();
-            if (ret != 0) {
-                ALOGE("%s: allocating intermediate YU12 frame %dx%d failed!", __FUNCTION__,
-                      stream.width, stream.height);
-                return Status::INTERNAL_ERROR;
+    // Allocating the YU12 frames decoded by the pipeline
+    if (mConvertThread != nullptr) {
+        std::lock_guard<std::mutex> poolLk(mYu12FramePoolLock);
+        if (mYu12FramePool.size() != kYu12FramePoolSize ||
+            mYu12FramePool[0]->mWidth != v4lSize.width ||
+            mYu12FramePool[0]->mHeight != v4lSize.height) {
+            mYu12FramePool.clear();
+            for (size_t i = 0; i < kYu12FramePoolSize; i++) {
+                std::shared_ptr<AllocatedFrame> frame =
+                        std::make_shared<AllocatedFrame>(v4lSize.width, v4lSize.height);
+                int ret = frame->allocate();
+                if (ret != 0) {
+                    ALOGE("%s: allocating pipeline YU12 frame failed!", __FUNCTION__);
+                    return Status::INTERNAL_ERROR;
+                }
+                mYu12FramePool.push_back(frame);
             }
-            mIntermediateBuffers[sz] = buf;
         }
     }
 
-    // Remove unconfigured buffers
-    auto it = mIntermediateBuffers.begin();
-    while (it != mIntermediateBuffers.end()) {
-        bool configured = false;
-        auto sz = it->first;
+    // Allocating scaled buffers, of all the stream sizes for the convert stage and of the BLOB
+    // stream sizes for the encode stage
+    auto allocateScaledBuffers = [&](bool isBlobOnly, SizedFrames& intermediateBuffers) {
         for (const auto& stream : streams) {
-            if (stream.width == sz.width && stream.height == sz.height) {
-                configured = true;
-                break;
+            Size sz = {stream.width, stream.height};
+            if (sz == v4lSize || (isBlobOnly && stream.format != PixelFormat::BLOB)) {
+                continue;  // Don't need an intermediate buffer same size as v4lBuffer
+            }
+            if (intermediateBuffers.count(sz) == 0) {
+                // Create new intermediate buffer
+                std::shared_ptr<AllocatedFrame> buf =
+                        std::make_shared<AllocatedFrame>(stream.width, stream.height);
+                int ret = buf->allocate();
+                if (ret != 0) {
+                    ALOGE("%s: allocating intermediate YU12 frame %dx%d failed!", __FUNCTION__,
+                          stream.width, stream.height);
+                    return Status::INTERNAL_ERROR;
+                }
+                intermediateBuffers[sz] = buf;
             }
         }
-        if (configured) {
-            it++;
-        } else {
-            it = mIntermediateBuffers.erase(it);
+
+        // Remove unconfigured buffers
+        auto it = intermediateBuffers.begin();
+        while (it != intermediateBuffers.end()) {
+            bool configured = false;
+            auto sz = it->first;
+            for (const auto& stream : streams) {
+                if (stream.width == sz.width && stream.height == sz.height &&
+                    (!isBlobOnly || stream.format == PixelFormat::BLOB)) {
+                    configured = true;
+                    break;
+                }
+            }
+            if (configured) {
+                it++;
+            } else {
+                it = intermediateBuffers.erase(it);
+            }
+        }
+        return Status::OK;
+    };
+    Status status = allocateScaledBuffers(/*isBlobOnly*/ false, mIntermediateBuffers);
+    if (status != Status::OK) {
+        return status;
+    }
+    if (mConvertThread != nullptr) {
+        status = allocateScaledBuffers(/*isBlobOnly*/ true, mJpegIntermediateBuffers);
+        if (status != Status::OK) {
+            return status;
         }
     }
 
     // Allocate mute test pattern frame
-    mMuteTestPatternFrame.resize(mYu12Frame->mWidth * mYu12Frame->mHeight * 3);
+    mMuteTestPatternFrame.resize(v4lSize.width * v4lSize.height * 3);
 
     mBlobBufferSize = blobBufferSize;
     return Status::OK;
@@ -2232,12 +2321,12 @@ void ExternalCameraDeviceSession::OutputThread::flush() {
     std::unique_lock<std::mutex> lk(mRequestListLock);
     std::list<std::shared_ptr<HalRequest>> reqs = std::move(mRequestList);
     mRequestList.clear();
-    if (mProcessingRequest) {
-        auto timeout = std::chrono::seconds(kFlushWaitTimeoutSec);
-        auto st = mRequestDoneCond.wait_for(lk, timeout);
-        if (st == std::cv_status::timeout) {
-            ALOGE("%s: wait for inflight request finish timeout!", __FUNCTION__);
-        }
+    // Wait for the requests in the pipeline to finish
+    auto timeout = std::chrono::seconds(kFlushWaitTimeoutSec);
+    bool isDone = mRequestDoneCond.wait_for(lk, timeout,
+                                            [this] { return mProcessingFrameNumbers.empty(); });
+    if (!isDone) {
+        ALOGE("%s: wait for inflight requests finish timeout!", __FUNCTION__);
     }
 
     ALOGV("%s: flushing inflight requests", __FUNCTION__);
@@ -2248,17 +2337,27 @@ void ExternalCameraDeviceSession::OutputThread::flush() {
 }
 
 void ExternalCameraDeviceSession::OutputThread::dump(int fd) {
-    std::lock_guard<std::mutex> lk(mRequestListLock);
-    if (mProcessingRequest) {
-        dprintf(fd, "OutputThread processing frame %d\n", mProcessingFrameNumber);
-    } else {
-        dprintf(fd, "OutputThread not processing any frames\n");
+    {
+        std::lock_guard<std::mutex> lk(mRequestListLock);
+        if (!mProcessingFrameNumbers.empty()) {
+            dprintf(fd, "OutputThread processing frame: ");
+            for (int32_t frameNumber : mProcessingFrameNumbers) {
+                dprintf(fd, "%d, ", frameNumber);
+            }
+            dprintf(fd, "\n");
+        } else {
+            dprintf(fd, "OutputThread not processing any frames\n");
+        }
+        dprintf(fd, "OutputThread request list contains frame: ");
+        for (const auto& req : mRequestList) {
+            dprintf(fd, "%d, ", req->frameNumber);
+        }
+        dprintf(fd, "\n");
     }
-    dprintf(fd, "OutputThread request list contains frame: ");
-    for (const auto& req : mRequestList) {
-        dprintf(fd, "%d, ", req->frameNumber);
+    if (mConvertThread != nullptr) {
+        mConvertThread->dump(fd, "convert");
+        mEncodeThread->dump(fd, "encode");
     }
-    dprintf(fd, "\n");
 }
 
 void ExternalCameraDeviceSession::OutputThread::setExifMakeModel(const std::string& make,
@@ -2279,12 +2378,12 @@ ExternalCameraDeviceSession::OutputThread::switchToOffline() {
     std::unique_lock<std::mutex> lk(mRequestListLock);
     std::list<std::shared_ptr<HalRequest>> reqs = std::move(mRequestList);
     mRequestList.clear();
-    if (mProcessingRequest) {
-        auto timeout = std::chrono::seconds(kFlushWaitTimeoutSec);
-        auto st = mRequestDoneCond.wait_for(lk, timeout);
-        if (st == std::cv_status::timeout) {
-            ALOGE("%s: wait for inflight request finish timeout!", __FUNCTION__);
-        }
+    // Wait for the requests in the pipeline to finish
+    auto timeout = std::chrono::seconds(kFlushWaitTimeoutSec);
+    bool isDone = mRequestDoneCond.wait_for(lk, timeout,
+                                            [this] { return mProcessingFrameNumbers.empty(); });
+    if (!isDone) {
+        ALOGE("%s: wait for inflight requests finish timeout!", __FUNCTION__);
     }
     lk.unlock();
     clearIntermediateBuffers();
@@ -2334,20 +2433,80 @@ void ExternalCameraDeviceSession::OutputThread::waitForNextRequest(
     }
     *out = mRequestList.front();
     mRequestList.pop_front();
-    mProcessingRequest = true;
-    mProcessingFrameNumber = (*out)->frameNumber;
+    mProcessingFrameNumbers.push_back((*out)->frameNumber);
 }
 
 void ExternalCameraDeviceSession::OutputThread::signalRequestDone() {
     std::unique_lock<std::mutex> lk(mRequestListLock);
-    mProcessingRequest = false;
-    mProcessingFrameNumber = 0;
+    if (!mProcessingFrameNumbers.empty()) {
+        mProcessingFrameNumbers.pop_front();
+    }
     lk.unlock();
-    mRequestDoneCond.notify_one();
+    mRequestDoneCond.notify_all();
+}
+
+void ExternalCameraDeviceSession::OutputThread::signalRequestDone(int32_t frameNumber) {
+    std::unique_lock<std::mutex> lk(mRequestListLock);
+    mProcessingFrameNumbers.remove(frameNumber);
+    lk.unlock();
+    mRequestDoneCond.notify_all();
+}
+
+void ExternalCameraDeviceSession::OutputThread::stopPipeline() {
+    if (mConvertThread != nullptr) {
+        mConvertThread->stop();
+    }
+    if (mEncodeThread != nullptr) {
+        mEncodeThread->stop();
+    }
+    mConvertWorkers.reset();
+}
+
+std::shared_ptr<AllocatedFrame> ExternalCameraDeviceSession::OutputThread::acquireYu12Frame() {
+    ATRACE_CALL();
+    std::unique_lock<std::mutex> lk(mYu12FramePoolLock);
+    while (mYu12FramePool.empty()) {
+        if (exitPending()) {
+            return nullptr;
+        }
+        mYu12FramePoolCond.wait_for(lk, std::chrono::milliseconds(kReqWaitTimeoutMs));
+    }
+    std::shared_ptr<AllocatedFrame> frame = std::move(mYu12FramePool.back());
+    mYu12FramePool.pop_back();
+    return frame;
+}
+
+void ExternalCameraDeviceSession::OutputThread::releaseYu12Frame(
+        std::shared_ptr<AllocatedFrame>& frame) {
+    if (frame == nullptr) {
+        return;
+    }
+    std::unique_lock<std::mutex> lk(mYu12FramePoolLock);
+    mYu12FramePool.push_back(std::move(frame));
+    frame.reset();
+    lk.unlock();
+    mYu12FramePoolCond.notify_one();
+}
+
+void ExternalCameraDeviceSession::OutputThread::failPipelineRequest(PipelineRequest& request) {
+    auto parent = mParent.lock();
+    if (parent != nullptr) {
+        parent->notifyError(request.req->frameNumber, /*stream*/ -1, ErrorCode::ERROR_DEVICE);
+    }
+    releaseYu12Frame(request.yu12Frame);
+    signalRequestDone(request.req->frameNumber);
+    // Like a device error of a serial output thread, it stops taking new requests.
+    mDeviceError = true;
 }
 
 int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
         std::shared_ptr<AllocatedFrame>& in, const Size& outSz, YCbCrLayout* out) {
+    return cropAndScaleLocked(in, outSz, mIntermediateBuffers, mScaledYu12Frames, out);
+}
+
+int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
+        std::shared_ptr<AllocatedFrame>& in, const Size& outSz, SizedFrames& intermediateBuffers,
+        SizedFrames& scaledYu12Frames, YCbCrLayout* out) {
     Size inSz = {in->mWidth, in->mHeight};
 
     int ret;
@@ -2384,13 +2543,13 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
         return 0;
     }
 
-    auto it = mScaledYu12Frames.find(outSz);
+    auto it = scaledYu12Frames.find(outSz);
     std::shared_ptr<AllocatedFrame> scaledYu12Buf;
-    if (it != mScaledYu12Frames.end()) {
+    if (it != scaledYu12Frames.end()) {
         scaledYu12Buf = it->second;
     } else {
-        it = mIntermediateBuffers.find(outSz);
-        if (it == mIntermediateBuffers.end()) {
+        it = intermediateBuffers.find(outSz);
+        if (it == intermediateBuffers.end()) {
             ALOGE("%s: failed to find intermediate buffer size %dx%d", __FUNCTION__, outSz.width,
                   outSz.height);
             return -1;
@@ -2422,7 +2581,7 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
     }
 
     *out = outLayout;
-    mScaledYu12Frames.insert({outSz, scaledYu12Buf});
+    scaledYu12Frames.insert({outSz, scaledYu12Buf});
     return 0;
 }
 
@@ -2551,6 +2710,13 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleThumbLocked(
 
 int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
         HalStreamBuffer& halBuf, const common::V1_0::helper::CameraMetadata& setting) {
+    return createJpegLocked(mYu12Frame, mIntermediateBuffers, mScaledYu12Frames, halBuf, setting);
+}
+
+int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
+        std::shared_ptr<AllocatedFrame>& in, SizedFrames& intermediateBuffers,
+        SizedFrames& scaledYu12Frames, HalStreamBuffer& halBuf,
+        const common::V1_0::helper::CameraMetadata& setting) {
     ATRACE_CALL();
     int ret;
     auto lfail = [&](auto... args) {
@@ -2568,7 +2734,7 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
           static_cast<uint64_t>(halBuf.bufferId), halBuf.width, halBuf.height);
     ALOGV("%s: HAL buffer fmt: %x usage: %" PRIx64 " ptr: %p", __FUNCTION__, halBuf.format,
           static_cast<uint64_t>(halBuf.usage), halBuf.bufPtr);
-    ALOGV("%s: YV12 buffer %d x %d", __FUNCTION__, mYu12Frame->mWidth, mYu12Frame->mHeight);
+    ALOGV("%s: YV12 buffer %d x %d", __FUNCTION__, in->mWidth, in->mHeight);
 
     int jpegQuality, thumbQuality;
     Size thumbSize;
@@ -2623,7 +2789,7 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
 
     YCbCrLayout yu12Thumb;
     if (outputThumbnail) {
-        ret = cropAndScaleThumbLocked(mYu12Frame, thumbSize, &yu12Thumb);
+        ret = cropAndScaleThumbLocked(in, thumbSize, &yu12Thumb);
 
         if (ret != 0) {
             return lfail("%s: crop and scale thumbnail failed!", __FUNCTION__);
@@ -2631,7 +2797,7 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     }
 
     /* Scale and crop main jpeg */
-    ret = cropAndScaleLocked(mYu12Frame, jpegSize, &yu12Main);
+    ret = cropAndScaleLocked(in, jpegSize, intermediateBuffers, scaledYu12Frames, &yu12Main);
 
     if (ret != 0) {
         return lfail("%s: crop and scale main failed!", __FUNCTION__);
@@ -2708,10 +2874,15 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
 }
 
 void ExternalCameraDeviceSession::OutputThread::clearIntermediateBuffers() {
-    std::lock_guard<std::mutex> lk(mBufferLock);
+    std::lock_guard<std::shared_mutex> lk(mBufferLock);
     mYu12Frame.reset();
     mYu12ThumbFrame.reset();
     mIntermediateBuffers.clear();
+    mJpegIntermediateBuffers.clear();
+    {
+        std::lock_guard<std::mutex> poolLk(mYu12FramePoolLock);
+        mYu12FramePool.clear();
+    }
     mMuteTestPatternFrame.clear();
     mBlobBufferSize = 0;
 }
@@ -2723,6 +2894,10 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
         ALOGE("%s: session has been disconnected!", __FUNCTION__);
         return false;
     }
+    if (mDeviceError) {
+        ALOGE("%s: stopping after a device error in the pipeline", __FUNCTION__);
+        return false;
+    }
 
     // TODO: maybe we need to setup a sensor thread to dq/enq v4l frames
     //       regularly to prevent v4l buffer queue filled with stale buffers
@@ -2733,10 +2908,10 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
         return true;
     }
 
+    PipelineRequest request{.req = req};
     auto onDeviceError = [&](auto... args) {
         ALOGE(args...);
-        parent->notifyError(req->frameNumber, /*stream*/ -1, ErrorCode::ERROR_DEVICE);
-        signalRequestDone();
+        failPipelineRequest(request);
         return false;
     };
 
@@ -2753,7 +2928,19 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
         return onDeviceError("%s: failed to send buffer request!", __FUNCTION__);
     }
 
-    std::unique_lock<std::mutex> lk(mBufferLock);
+    if (req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG) {
+        // Blocks while the later stages hold all the frames
+        request.yu12Frame = acquireYu12Frame();
+        if (request.yu12Frame == nullptr) {
+            ALOGW("%s: exiting while waiting for a free YU12 frame", __FUNCTION__);
+            waitForBufferRequestDone(&req->buffers);
+            parent->processCaptureRequestError(req);
+            signalRequestDone(req->frameNumber);
+            return false;
+        }
+    }
+
+    std::shared_lock<std::shared_mutex> lk(mBufferLock);
     // Convert input V4L2 frame to YU12 of the same size
     // TODO: see if we can save some computation by converting to YV12 here
     uint8_t* inData;
@@ -2789,43 +2976,37 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
 
     // TODO: in some special case maybe we can decode jpg directly to gralloc output?
     if (req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG) {
-        ATRACE_BEGIN("MJPGtoI420");
-        res = 0;
-        if (mCameraMuted) {
-            res = libyuv::ConvertToI420(
-                    mMuteTestPatternFrame.data(), mMuteTestPatternFrame.size(),
-                    static_cast<uint8_t*>(mYu12FrameLayout.y), mYu12FrameLayout.yStride,
-                    static_cast<uint8_t*>(mYu12FrameLayout.cb), mYu12FrameLayout.cStride,
-                    static_cast<uint8_t*>(mYu12FrameLayout.cr), mYu12FrameLayout.cStride, 0, 0,
-                    mYu12Frame->mWidth, mYu12Frame->mHeight, mYu12Frame->mWidth,
-                    mYu12Frame->mHeight, libyuv::kRotate0, libyuv::FOURCC_RAW);
-        } else {
-            res = libyuv::MJPGToI420(
-                    inData, inDataSize, static_cast<uint8_t*>(mYu12FrameLayout.y),
-                    mYu12FrameLayout.yStride, static_cast<uint8_t*>(mYu12FrameLayout.cb),
-                    mYu12FrameLayout.cStride, static_cast<uint8_t*>(mYu12FrameLayout.cr),
-                    mYu12FrameLayout.cStride, mYu12Frame->mWidth, mYu12Frame->mHeight,
-                    mYu12Frame->mWidth, mYu12Frame->mHeight);
+        std::shared_ptr<AllocatedFrame>& yu12Frame = request.yu12Frame;
+        YCbCrLayout yu12Layout;
+        res = yu12Frame->getLayout(&yu12Layout);
+        if (res == 0) {
+            ATRACE_BEGIN("MJPGtoI420");
+            if (mCameraMuted) {
+                res = libyuv::ConvertToI420(
+                        mMuteTestPatternFrame.data(), mMuteTestPatternFrame.size(),
+                        static_cast<uint8_t*>(yu12Layout.y), yu12Layout.yStride,
+                        static_cast<uint8_t*>(yu12Layout.cb), yu12Layout.cStride,
+                        static_cast<uint8_t*>(yu12Layout.cr), yu12Layout.cStride, 0, 0,
+                        yu12Frame->mWidth, yu12Frame->mHeight, yu12Frame->mWidth,
+                        yu12Frame->mHeight, libyuv::kRotate0, libyuv::FOURCC_RAW);
+            } else {
+                res = libyuv::MJPGToI420(
+                        inData, inDataSize, static_cast<uint8_t*>(yu12Layout.y),
+                        yu12Layout.yStride, static_cast<uint8_t*>(yu12Layout.cb),
+                        yu12Layout.cStride, static_cast<uint8_t*>(yu12Layout.cr),
+                        yu12Layout.cStride, yu12Frame->mWidth, yu12Frame->mHeight,
+                        yu12Frame->mWidth, yu12Frame->mHeight);
+            }
+            ATRACE_END();
         }
-        ATRACE_END();
 
         if (res != 0) {
             // For some webcam, the first few V4L2 frames might be malformed...
             ALOGE("%s: Convert V4L2 frame to YU12 failed! res %d", __FUNCTION__, res);
-
-            ATRACE_BEGIN("Wait for BufferRequest done");
-            res = waitForBufferRequestDone(&req->buffers);
-            ATRACE_END();
-
-            lk.unlock();
-            Status st = parent->processCaptureRequestError(req);
-            if (st != Status::OK) {
-                return onDeviceError("%s: failed to process capture request error!", __FUNCTION__);
-            }
-            signalRequestDone();
-            return true;
+            request.isError = true;
         }
     }
+    lk.unlock();
 
     ATRACE_BEGIN("Wait for BufferRequest done");
     res = waitForBufferRequestDone(&req->buffers);
@@ -2834,124 +3015,430 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
     if (res != 0) {
         // HAL buffer management buffer request can fail
         ALOGE("%s: wait for BufferRequest done failed! res %d", __FUNCTION__, res);
-        lk.unlock();
-        Status st = parent->processCaptureRequestError(req);
-        if (st != Status::OK) {
-            return onDeviceError("%s: failed to process capture request error!", __FUNCTION__);
-        }
-        signalRequestDone();
-        return true;
+        request.isError = true;
     }
 
-    ALOGV("%s processing new request", __FUNCTION__);
-    const int kSyncWaitTimeoutMs = 500;
-    for (auto& halBuf : req->buffers) {
-        if (*(halBuf.bufPtr) == nullptr) {
-            ALOGW("%s: buffer for stream %d missing", __FUNCTION__, halBuf.streamId);
-            halBuf.fenceTimeout = true;
-        } else if (halBuf.acquireFence >= 0) {
-            int ret = sync_wait(halBuf.acquireFence, kSyncWaitTimeoutMs);
-            if (ret) {
+    // Blocks while the convert stage is behind
+    if (!mConvertThread->push(std::move(request))) {
+        return onDeviceError("%s: convert stage stopped!", __FUNCTION__);
+    }
+    return true;
+}
+
+void ExternalCameraDeviceSession::OutputThread::convertStage(PipelineRequest& request) {
+    ATRACE_CALL();
+    std::shared_ptr<HalRequest>& req = request.req;
+    if (mDeviceError) {
+        // The requests left in the pipeline after a device error are returned as errors, like
+        // the ones left in the request list at flush.
+        request.isError = true;
+    }
+    if (!request.isError) {
+        std::shared_lock<std::shared_mutex> lk(mBufferLock);
+        ALOGV("%s processing new request", __FUNCTION__);
+        const int kSyncWaitTimeoutMs = 500;
+        std::vector<ConvertOutput> outputs;
+        auto unlockOutputs = [&outputs]() {
+            for (auto& output : outputs) {
+                int relFence = sHandleImporter.unlock(*(output.halBuf->bufPtr));
+                if (relFence >= 0) {
+                    output.halBuf->acquireFence = relFence;
+                }
+            }
+        };
+        for (auto& halBuf : req->buffers) {
+            if (*(halBuf.bufPtr) == nullptr) {
+                ALOGW("%s: buffer for stream %d missing", __FUNCTION__, halBuf.streamId);
                 halBuf.fenceTimeout = true;
-            } else {
-                ::close(halBuf.acquireFence);
-                halBuf.acquireFence = -1;
+            } else if (halBuf.acquireFence >= 0) {
+                int ret = sync_wait(halBuf.acquireFence, kSyncWaitTimeoutMs);
+                if (ret) {
+                    halBuf.fenceTimeout = true;
+                } else {
+                    ::close(halBuf.acquireFence);
+                    halBuf.acquireFence = -1;
+                }
             }
+
+            if (halBuf.fenceTimeout) {
+                continue;
+            }
+
+            // Gralloc lockYCbCr the buffer
+            switch (halBuf.format) {
+                case PixelFormat::BLOB:
+                    // Encoded by the encode stage
+                    break;
+                case PixelFormat::Y16: {
+                    uint8_t* inData;
+                    size_t inDataSize;
+                    if (req->frameIn->getData(&inData, &inDataSize) != 0) {
+                        ALOGE("%s: V4L2 buffer map failed", __FUNCTION__);
+                        unlockOutputs();
+                        failPipelineRequest(request);
+                        return;
+                    }
+
+                    void* outLayout = sHandleImporter.lock(
+                            *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), inDataSize);
+
+                    std::memcpy(outLayout, inData, inDataSize);
+
+                    int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+                    if (relFence >= 0) {
+                        halBuf.acquireFence = relFence;
+                    }
+                } break;
+                case PixelFormat::YCBCR_420_888:
+                case PixelFormat::YV12: {
+                    android::Rect outRect{0, 0, static_cast<int32_t>(halBuf.width),
+                                          static_cast<int32_t>(halBuf.height)};
+                    android_ycbcr result = sHandleImporter.lockYCbCr(
+                            *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), outRect);
+                    ALOGV("%s: outLayout y %p cb %p cr %p y_str %zu c_str %zu c_step %zu",
+                          __FUNCTION__, result.y, result.cb, result.cr, result.ystride,
+                          result.cstride, result.chroma_step);
+                    if (result.ystride > UINT32_MAX || result.cstride > UINT32_MAX ||
+                        result.chroma_step > UINT32_MAX) {
+                        ALOGE("%s: lockYCbCr failed. Unexpected values!", __FUNCTION__);
+                        unlockOutputs();
+                        failPipelineRequest(request);
+                        return;
+                    }
+                    YCbCrLayout outLayout = {
+                            .y = result.y,
+                            .cb = result.cb,
+                            .cr = result.cr,
+                            .yStride = static_cast<uint32_t>(result.ystride),
+                            .cStride = static_cast<uint32_t>(result.cstride),
+                            .chromaStep = static_cast<uint32_t>(result.chroma_step)};
+
+                    // Converted to output buffer size/format below, with the other outputs
+                    uint32_t outputFourcc = getFourCcFromLayout(outLayout);
+                    ALOGV("%s: converting to format %c%c%c%c", __FUNCTION__, outputFourcc & 0xFF,
+                          (outputFourcc >> 8) & 0xFF, (outputFourcc >> 16) & 0xFF,
+                          (outputFourcc >> 24) & 0xFF);
+                    outputs.push_back({&halBuf, outLayout, outputFourcc});
+                } break;
+                default:
+                    ALOGE("%s: unknown output format %x", __FUNCTION__, halBuf.format);
+                    unlockOutputs();
+                    failPipelineRequest(request);
+                    return;
+            }
+        }  // for each buffer
+
+        int ret = outputs.empty() ? 0 : convertOutputsLocked(request.yu12Frame, outputs);
+        unlockOutputs();
+        if (ret != 0) {
+            failPipelineRequest(request);
+            return;
         }
+    }
+
+    // Blocks while the encode stage is behind
+    if (!mEncodeThread->push(std::move(request))) {
+        ALOGE("%s: encode stage stopped!", __FUNCTION__);
+        failPipelineRequest(request);
+    }
+}
 
-        if (halBuf.fenceTimeout) {
+int ExternalCameraDeviceSession::OutputThread::convertOutputsLocked(
+        std::shared_ptr<AllocatedFrame>& in, const std::vector<ConvertOutput>& outputs) {
+    ATRACE_CALL();
+    Size inSz{in->mWidth, in->mHeight};
+    YCbCrLayout inLayout;
+    int ret = in->getLayout(&inLayout);
+    if (ret != 0) {
+        ALOGE("%s: failed to get input image layout", __FUNCTION__);
+        return ret;
+    }
+
+    // Crop and scale once per output size. Each size has its own intermediate buffer, so the
+    // sizes are scaled in parallel, and the large ones in several stripes.
+    std::unordered_map<Size, YCbCrLayout, SizeHasher> scaledLayouts;
+    std::vector<std::function<int()>> tasks;
+    for (const auto& output : outputs) {
+        Size outSz{output.halBuf->width, output.halBuf->height};
+        if (scaledLayouts.count(outSz) != 0) {
+            continue;
+        }
+        if (inSz == outSz) {
+            scaledLayouts[outSz] = inLayout;
             continue;
         }
 
-        // Gralloc lockYCbCr the buffer
-        switch (halBuf.format) {
-            case PixelFormat::BLOB: {
-                int ret = createJpegLocked(halBuf, req->setting);
+        // Cropping to output aspect ratio
+        IMapper::Rect inputCrop;
+        ret = getCropRect(mCroppingType, inSz, outSz, &inputCrop);
+        if (ret != 0) {
+            ALOGE("%s: failed to compute crop rect for output size %dx%d", __FUNCTION__,
+                  outSz.width, outSz.height);
+            return ret;
+        }
 
-                if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: createJpegLocked failed with %d", __FUNCTION__, ret);
-                }
-            } break;
-            case PixelFormat::Y16: {
-                void* outLayout = sHandleImporter.lock(
-                        *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), inDataSize);
+        YCbCrLayout croppedLayout;
+        ret = in->getCroppedLayout(inputCrop, &croppedLayout);
+        if (ret != 0) {
+            ALOGE("%s: failed to crop input image %dx%d to output size %dx%d", __FUNCTION__,
+                  inSz.width, inSz.height, outSz.width, outSz.height);
+            return ret;
+        }
 
-                std::memcpy(outLayout, inData, inDataSize);
+        if ((mCroppingType == VERTICAL && inSz.width == outSz.width) ||
+            (mCroppingType == HORIZONTAL && inSz.height == outSz.height)) {
+            // No scale is needed
+            scaledLayouts[outSz] = croppedLayout;
+            continue;
+        }
 
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
-                if (relFence >= 0) {
-                    halBuf.acquireFence = relFence;
-                }
-            } break;
-            case PixelFormat::YCBCR_420_888:
-            case PixelFormat::YV12: {
-                android::Rect outRect{0, 0, static_cast<int32_t>(halBuf.width),
-                                      static_cast<int32_t>(halBuf.height)};
-                android_ycbcr result = sHandleImporter.lockYCbCr(
-                        *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), outRect);
-                ALOGV("%s: outLayout y %p cb %p cr %p y_str %zu c_str %zu c_step %zu", __FUNCTION__,
-                      result.y, result.cb, result.cr, result.ystride, result.cstride,
-                      result.chroma_step);
-                if (result.ystride > UINT32_MAX || result.cstride > UINT32_MAX ||
-                    result.chroma_step > UINT32_MAX) {
-                    return onDeviceError("%s: lockYCbCr failed. Unexpected values!", __FUNCTION__);
-                }
-                YCbCrLayout outLayout = {.y = result.y,
-                                         .cb = result.cb,
-                                         .cr = result.cr,
-                                         .yStride = static_cast<uint32_t>(result.ystride),
-                                         .cStride = static_cast<uint32_t>(result.cstride),
-                                         .chromaStep = static_cast<uint32_t>(result.chroma_step)};
-
-                // Convert to output buffer size/format
-                uint32_t outputFourcc = getFourCcFromLayout(outLayout);
-                ALOGV("%s: converting to format %c%c%c%c", __FUNCTION__, outputFourcc & 0xFF,
-                      (outputFourcc >> 8) & 0xFF, (outputFourcc >> 16) & 0xFF,
-                      (outputFourcc >> 24) & 0xFF);
-
-                YCbCrLayout cropAndScaled;
-                ATRACE_BEGIN("cropAndScaleLocked");
-                int ret = cropAndScaleLocked(mYu12Frame, Size{halBuf.width, halBuf.height},
-                                             &cropAndScaled);
-                ATRACE_END();
-                if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: crop and scale failed!", __FUNCTION__);
-                }
+        auto it = mIntermediateBuffers.find(outSz);
+        if (it == mIntermediateBuffers.end()) {
+            ALOGE("%s: failed to find intermediate buffer size %dx%d", __FUNCTION__, outSz.width,
+                  outSz.height);
+            return -1;
+        }
+        YCbCrLayout outLayout;
+        ret = it->second->getLayout(&outLayout);
+        if (ret != 0) {
+            ALOGE("%s: failed to get output buffer layout", __FUNCTION__);
+            return ret;
+        }
+        scaledLayouts[outSz] = outLayout;
+
+        Size cropSz{inputCrop.width, inputCrop.height};
+        // Only split the scale where the stripes give the same image as a single scale
+        int32_t stripeRows = getScaleStripeRows(cropSz.height, outSz.height);
+        int32_t stripes = std::clamp<int32_t>(
+                outSz.width * outSz.height / kScaleStripePixels, 1,
+                static_cast<int32_t>(mConvertWorkers->getThreadCount()));
+        stripes = std::max(1, std::min(stripes, outSz.height / stripeRows));
+        for (int32_t i = 0; i < stripes; i++) {
+            int32_t top = outSz.height * i / stripes / stripeRows * stripeRows;
+            int32_t bottom = i == stripes - 1
+                                     ? outSz.height
+                                     : outSz.height * (i + 1) / stripes / stripeRows * stripeRows;
+            tasks.push_back([croppedLayout, cropSz, outLayout, outSz, top, bottom]() {
+                return scaleI420Rows(croppedLayout, cropSz, outLayout, outSz, top, bottom);
+            });
+        }
+    }
+    ATRACE_BEGIN("cropAndScale");
+    ret = mConvertWorkers->run(tasks);
+    ATRACE_END();
+    if (ret != 0) {
+        ALOGE("%s: crop and scale failed!", __FUNCTION__);
+        return ret;
+    }
 
-                Size sz{halBuf.width, halBuf.height};
-                ATRACE_BEGIN("formatConvert");
-                ret = formatConvert(cropAndScaled, outLayout, sz, outputFourcc);
-                ATRACE_END();
-                if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: format conversion failed!", __FUNCTION__);
-                }
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
-                if (relFence >= 0) {
-                    halBuf.acquireFence = relFence;
-                }
-            } break;
-            default:
-                lk.unlock();
-                return onDeviceError("%s: unknown output format %x", __FUNCTION__, halBuf.format);
+    // Convert to output buffer size/format
+    tasks.clear();
+    for (const auto& output : outputs) {
+        Size sz{output.halBuf->width, output.halBuf->height};
+        const YCbCrLayout& scaledLayout = scaledLayouts.at(sz);
+        tasks.push_back([&output, &scaledLayout, sz]() {
+            return formatConvert(scaledLayout, output.layout, sz, output.fourcc);
+        });
+    }
+    ATRACE_BEGIN("formatConvert");
+    ret = mConvertWorkers->run(tasks);
+    ATRACE_END();
+    if (ret != 0) {
+        ALOGE("%s: format conversion failed!", __FUNCTION__);
+        return ret;
+    }
+    return 0;
+}
+
+void ExternalCameraDeviceSession::OutputThread::encodeStage(PipelineRequest& request) {
+    ATRACE_CALL();
+    std::shared_ptr<HalRequest>& req = request.req;
+    auto parent = mParent.lock();
+    if (parent == nullptr) {
+        ALOGE("%s: session has been disconnected!", __FUNCTION__);
+        releaseYu12Frame(request.yu12Frame);
+        signalRequestDone(req->frameNumber);
+        return;
+    }
+
+    if (mDeviceError) {
+        // Set by a later request failing in an earlier stage.
+        request.isError = true;
+    }
+    if (!request.isError) {
+        std::shared_lock<std::shared_mutex> lk(mBufferLock);
+        for (auto& halBuf : req->buffers) {
+            if (halBuf.fenceTimeout || halBuf.format != PixelFormat::BLOB) {
+                continue;
+            }
+            int ret = request.yu12Frame == nullptr
+                              ? -1
+                              : createJpegLocked(request.yu12Frame, mJpegIntermediateBuffers,
+                                                 mJpegScaledYu12Frames, halBuf, req->setting);
+            if (ret != 0) {
+                ALOGE("%s: createJpegLocked failed with %d", __FUNCTION__, ret);
+                mJpegScaledYu12Frames.clear();
+                failPipelineRequest(request);
+                return;
+            }
         }
-    }  // for each buffer
-    mScaledYu12Frames.clear();
+        mJpegScaledYu12Frames.clear();
+    }
+    releaseYu12Frame(request.yu12Frame);
 
-    // Don't hold the lock while calling back to parent
-    lk.unlock();
-    Status st = parent->processCaptureResult(req);
+    // The stages before hand the requests over in order, so results are sent in order.
+    Status st = request.isError ? parent->processCaptureRequestError(req)
+                                : parent->processCaptureResult(req);
     if (st != Status::OK) {
-        return onDeviceError("%s: failed to process capture result!", __FUNCTION__);
+        ALOGE("%s: failed to process capture %s!", __FUNCTION__,
+              request.isError ? "request error" : "result");
+        failPipelineRequest(request);
+        return;
     }
-    signalRequestDone();
-    return true;
+    signalRequestDone(req->frameNumber);
 }
 
 // End ExternalCameraDeviceSession::OutputThread functions
 
+// Start ExternalCameraDeviceSession::OutputThread::StageThread functions
+
+ExternalCameraDeviceSession::OutputThread::StageThread::StageThread(OutputThread* outputThread,
+                                                                    Process process)
+    : mOutputThread(outputThread), mProcess(process) {}
+
+ExternalCameraDeviceSession::OutputThread::StageThread::~StageThread() {
+    stop();
+}
+
+bool ExternalCameraDeviceSession::OutputThread::StageThread::push(PipelineRequest&& request) {
+    std::unique_lock<std::mutex> lk(mQueueLock);
+    mQueueCond.wait(lk, [this] { return mStopping || mQueue.size() < kQueueSize; });
+    if (mStopping) {
+        return false;
+    }
+    mQueue.push_back(std::move(request));
+    lk.unlock();
+    mQueueCond.notify_all();
+    return true;
+}
+
+void ExternalCameraDeviceSession::OutputThread::StageThread::stop() {
+    {
+        std::lock_guard<std::mutex> lk(mQueueLock);
+        mStopping = true;
+    }
+    mQueueCond.notify_all();
+    requestExitAndWait();
+}
+
+void ExternalCameraDeviceSession::OutputThread::StageThread::dump(int fd, const char* name) {
+    std::lock_guard<std::mutex> lk(mQueueLock);
+    dprintf(fd, "OutputThread %s stage queue contains frame: ", name);
+    for (const auto& request : mQueue) {
+        dprintf(fd, "%d, ", request.req->frameNumber);
+    }
+    dprintf(fd, "\n");
+}
+
+bool ExternalCameraDeviceSession::OutputThread::StageThread::threadLoop() {
+    std::unique_lock<std::mutex> lk(mQueueLock);
+    mQueueCond.wait(lk, [this] { return mStopping || !mQueue.empty(); });
+    if (mStopping) {
+        return false;
+    }
+    PipelineRequest request = std::move(mQueue.front());
+    mQueue.pop_front();
+    lk.unlock();
+    mQueueCond.notify_all();
+
+    (mOutputThread->*mProcess)(request);
+    return true;
+}
+
+// End ExternalCameraDeviceSession::OutputThread::StageThread functions
+
+// Start ExternalCameraDeviceSession::OutputThread::WorkerPool functions
+
+ExternalCameraDeviceSession::OutputThread::WorkerPool::WorkerPool(size_t workerCount) {
+    for (size_t i = 0; i < workerCount; i++) {
+        mWorkers.push_back(std::make_unique<WorkerThread>(this));
+        mWorkers.back()->run();
+    }
+}
+
+ExternalCameraDeviceSession::OutputThread::WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        mStopping = true;
+    }
+    mTaskCond.notify_all();
+    for (auto& worker : mWorkers) {
+        worker->requestExitAndWait();
+    }
+}
+
+int ExternalCameraDeviceSession::OutputThread::WorkerPool::run(
+        std::vector<std::function<int()>>& tasks) {
+    if (tasks.empty()) {
+        return 0;
+    }
+    std::unique_lock<std::mutex> lk(mLock);
+    mTasks = &tasks;
+    mNextTask = 0;
+    mPendingTasks = tasks.size();
+    mResult = 0;
+    lk.unlock();
+    mTaskCond.notify_all();
+
+    // The calling thread takes its share of the tasks too
+    while (runNextTask()) {
+    }
+
+    lk.lock();
+    mDoneCond.wait(lk, [this] { return mPendingTasks == 0; });
+    mTasks = nullptr;
+    return mResult;
+}
+
+bool ExternalCameraDeviceSession::OutputThread::WorkerPool::hasNextTaskLocked() const {
+    return mTasks != nullptr && mNextTask < mTasks->size();
+}
+
+bool ExternalCameraDeviceSession::OutputThread::WorkerPool::runNextTask() {
+    std::unique_lock<std::mutex> lk(mLock);
+    if (!hasNextTaskLocked()) {
+        return false;
+    }
+    std::function<int()>& task = (*mTasks)[mNextTask++];
+    lk.unlock();
+
+    int ret = task();
+
+    lk.lock();
+    if (ret != 0 && mResult == 0) {
+        mResult = ret;
+    }
+    if (--mPendingTasks == 0) {
+        lk.unlock();
+        mDoneCond.notify_all();
+    }
+    return true;
+}
+
+bool ExternalCameraDeviceSession::OutputThread::WorkerPool::WorkerThread::threadLoop() {
+    std::unique_lock<std::mutex> lk(mPool->mLock);
+    mPool->mTaskCond.wait(lk, [this] { return mPool->mStopping || mPool->hasNextTaskLocked(); });
+    if (mPool->mStopping) {
+        return false;
+    }
+    lk.unlock();
+    while (mPool->runNextTask()) {
+    }
+    return true;
+}
+
+// End ExternalCameraDeviceSession::OutputThread::WorkerPool functions
+
 }  // namespace implementation
 }  // namespace device
 }  // namespace camera
@@ -30,7 +30,9 @@
 #include <fmq/AidlMessageQueue.h>
 #include <utils/Thread.h>
 #include <deque>
+#include <functional>
 #include <list>
+#include <shared_mutex>
 
 namespace android {
 namespace hardware {
@@ -161,6 +163,16 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
         std::condition_variable mRequestDoneCond;  // signaled when a request is done
     };
 
+    // The output thread processes the requests in a pipeline of three stages, each running on
+    // its own thread:
+    //   decode:  V4L2 frame (MJPG decode)-> YU12 frame from mYu12FramePool, buffer requests
+    //   convert: YU12 frame (Scale)-> mIntermediateBuffers (Format convert)-> output gralloc
+    //            frames, in parallel on mConvertWorkers
+    //   encode:  YU12 frame (Scale)-> mJpegScaledYu12Frames (JPEG encode)-> output BLOB buffers,
+    //            then the capture result
+    // The OutputThread itself runs the decode stage. The number of frames in the pipeline is
+    // bounded by mYu12FramePool, and results are sent in request order. The stages only exist
+    // once startPipeline() is called, so the offline session runs without them.
     class OutputThread : public SimpleThread {
       public:
         OutputThread(std::weak_ptr<OutputThreadInterface> parent, CroppingType,
@@ -168,6 +180,9 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
                      std::shared_ptr<BufferRequestThread> bufReqThread);
         ~OutputThread();
 
+        // Starts the convert and encode stages. Must be called before allocateIntermediateBuffers
+        // and run.
+        void startPipeline();
         Status allocateIntermediateBuffers(const Size& v4lSize, const Size& thumbSize,
                                            const std::vector<Stream>& streams,
                                            uint32_t blobBufferSize);
@@ -185,6 +200,102 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
         static const int kFlushWaitTimeoutSec = 3;  // 3 sec
         static const int kReqWaitTimeoutMs = 33;    // 33ms
         static const int kReqWaitTimesMax = 90;     // 33ms * 90 ~= 3 sec
+        // One frame being decoded, one being converted and one being encoded
+        static const size_t kYu12FramePoolSize = 3;
+        // Threads converting the outputs of a request, including the convert stage thread
+        static const size_t kMaxConvertThreads = 4;
+        // Outputs of at least twice this size are scaled in several stripes, if the scale splits
+        // exactly
+        static const int32_t kScaleStripePixels = 640 * 360;
+
+        using SizedFrames = std::unordered_map<Size, std::shared_ptr<AllocatedFrame>, SizeHasher>;
+
+        // A request moving through the stages of the pipeline
+        struct PipelineRequest {
+            std::shared_ptr<HalRequest> req;
+            // The input frame decoded to YU12, taken from mYu12FramePool. Not set for Z16 input.
+            std::shared_ptr<AllocatedFrame> yu12Frame;
+            // The request failed before its buffers were filled. It is returned as an error by
+            // the encode stage, so that the results stay in order.
+            bool isError = false;
+        };
+
+        // A pipeline stage after the decode stage. Requests are handed over through a bounded
+        // queue, so that a stage falling behind holds back the stages before it.
+        class StageThread : public SimpleThread {
+          public:
+            using Process = void (OutputThread::*)(PipelineRequest&);
+
+            StageThread(OutputThread* outputThread, Process process);
+            ~StageThread();
+
+            // Blocks while the queue is full. Returns false if the stage stopped.
+            bool push(PipelineRequest&& request);
+            // Wakes the stage and waits for it to exit. Queued requests are left unprocessed.
+            void stop();
+            void dump(int fd, const char* name);
+
+          protected:
+            bool threadLoop() override;
+
+          private:
+            static const size_t kQueueSize = 1;
+
+            OutputThread* const mOutputThread;
+            const Process mProcess;
+
+            std::mutex mQueueLock;
+            std::condition_variable mQueueCond;  // signaled when the queue changes or on stop
+            std::deque<PipelineRequest> mQueue;
+            bool mStopping = false;
+        };
+
+        // Runs batches of tasks in parallel, on the calling thread and on worker threads
+        class WorkerPool {
+          public:
+            explicit WorkerPool(size_t workerCount);
+            ~WorkerPool();
+
+            size_t getThreadCount() const { return mWorkers.size() + 1; }
+            // Returns once all the tasks ran: 0 if they all returned 0, else the first error.
+            int run(std::vector<std::function<int()>>& tasks);
+
+          private:
+            class WorkerThread : public SimpleThread {
+              public:
+                explicit WorkerThread(WorkerPool* pool) : mPool(pool) {}
+
+              protected:
+                bool threadLoop() override;
+
+              private:
+                WorkerPool* const mPool;
+            };
+
+            // Runs the next task of the batch. Returns false if no task is left to start.
+            bool runNextTask();
+
+            // Returns whether a task of the batch is left to start. Must hold mLock.
+            bool hasNextTaskLocked() const;
+
+            std::mutex mLock;                   // Protect access to the batch below
+            std::condition_variable mTaskCond;  // signaled when a batch is started or on stop
+            std::condition_variable mDoneCond;  // signaled when the last task of a batch is done
+            std::vector<std::function<int()>>* mTasks = nullptr;
+            size_t mNextTask = 0;
+            size_t mPendingTasks = 0;
+            int mResult = 0;
+            bool mStopping = false;
+
+            std::vector<std::unique_ptr<WorkerThread>> mWorkers;
+        };
+
+        // A YUV output of a request, locked for the convert stage
+        struct ConvertOutput {
+            HalStreamBuffer* halBuf;
+            YCbCrLayout layout;
+            uint32_t fourcc;
+        };
 
         // Methods to request output buffer in parallel
         int requestBufferStart(const std::vector<HalStreamBuffer>&);
@@ -192,16 +303,37 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
                 /*out*/ std::vector<HalStreamBuffer>*);
 
         void waitForNextRequest(std::shared_ptr<HalRequest>* out);
+        // Marks the oldest processing request done
         void signalRequestDone();
+        void signalRequestDone(int32_t frameNumber);
+
+        // Pipeline stages
+        void stopPipeline();
+        // Blocks until a frame is free. Returns nullptr if the thread is exiting.
+        std::shared_ptr<AllocatedFrame> acquireYu12Frame();
+        void releaseYu12Frame(std::shared_ptr<AllocatedFrame>& frame);
+        void convertStage(PipelineRequest& request);
+        void encodeStage(PipelineRequest& request);
+        void failPipelineRequest(PipelineRequest& request);
+        // Crops and scales the input to each output size once, then converts each output, in
+        // parallel on mConvertWorkers
+        int convertOutputsLocked(std::shared_ptr<AllocatedFrame>& in,
+                                 const std::vector<ConvertOutput>& outputs);
 
         int cropAndScaleLocked(std::shared_ptr<AllocatedFrame>& in, const Size& outSize,
                                YCbCrLayout* out);
+        int cropAndScaleLocked(std::shared_ptr<AllocatedFrame>& in, const Size& outSize,
+                               SizedFrames& intermediateBuffers, SizedFrames& scaledYu12Frames,
+                               YCbCrLayout* out);
 
         int cropAndScaleThumbLocked(std::shared_ptr<AllocatedFrame>& in, const Size& outSize,
                                     YCbCrLayout* out);
 
         int createJpegLocked(HalStreamBuffer& halBuf,
                              const common::V1_0::helper::CameraMetadata& settings);
+        int createJpegLocked(std::shared_ptr<AllocatedFrame>& in, SizedFrames& intermediateBuffers,
+                             SizedFrames& scaledYu12Frames, HalStreamBuffer& halBuf,
+                             const common::V1_0::helper::CameraMetadata& settings);
 
         void clearIntermediateBuffers();
 
@@ -209,23 +341,29 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
         const CroppingType mCroppingType;
         const common::V1_0::helper::CameraMetadata mCameraCharacteristics;
 
-        mutable std::mutex mRequestListLock;       // Protect access to mRequestList,
-                                                   // mProcessingRequest and mProcessingFrameNumber
+        mutable std::mutex mRequestListLock;       // Protect access to mRequestList and
+                                                   // mProcessingFrameNumbers
         std::condition_variable mRequestCond;      // signaled when a new request is submitted
         std::condition_variable mRequestDoneCond;  // signaled when a request is done processing
         std::list<std::shared_ptr<HalRequest>> mRequestList;
-        bool mProcessingRequest = false;
-        uint32_t mProcessingFrameNumber = 0;
+        // Requests taken from mRequestList and not done yet, in request order
+        std::list<int32_t> mProcessingFrameNumbers;
 
+        // Without the pipeline, as in an offline session:
         // V4L2 frameIn
         // (MJPG decode)-> mYu12Frame
         // (Scale)-> mScaledYu12Frames
         // (Format convert) -> output gralloc frames
-        mutable std::mutex mBufferLock;  // Protect access to intermediate buffers
+        // The pipeline stages hold mBufferLock shared as each uses its own buffers, the offline
+        // threadLoop and the (de)allocation hold it exclusive.
+        mutable std::shared_mutex mBufferLock;  // Protect access to intermediate buffers
         std::shared_ptr<AllocatedFrame> mYu12Frame;
         std::shared_ptr<AllocatedFrame> mYu12ThumbFrame;
-        std::unordered_map<Size, std::shared_ptr<AllocatedFrame>, SizeHasher> mIntermediateBuffers;
-        std::unordered_map<Size, std::shared_ptr<AllocatedFrame>, SizeHasher> mScaledYu12Frames;
+        SizedFrames mIntermediateBuffers;
+        SizedFrames mScaledYu12Frames;
+        // Intermediate buffers of the encode stage, for the BLOB stream sizes
+        SizedFrames mJpegIntermediateBuffers;
+        SizedFrames mJpegScaledYu12Frames;
         YCbCrLayout mYu12FrameLayout;
         YCbCrLayout mYu12ThumbFrameLayout;
         std::vector<uint8_t> mMuteTestPatternFrame;
@@ -233,6 +371,17 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
         bool mCameraMuted = false;
         uint32_t mBlobBufferSize = 0;  // 0 -> HAL derive buffer size, else: use given size
 
+        // Free decoded frames of the pipeline
+        std::mutex mYu12FramePoolLock;
+        std::condition_variable mYu12FramePoolCond;  // signaled when a frame is released
+        std::vector<std::shared_ptr<AllocatedFrame>> mYu12FramePool;
+
+        std::unique_ptr<WorkerPool> mConvertWorkers;
+        std::unique_ptr<StageThread> mConvertThread;
+        std::unique_ptr<StageThread> mEncodeThread;
+        // Set when a stage hits a device error, which stops the decode stage
+        std::atomic<bool> mDeviceError = false;
+
         std::string mExifMake;
         std::string mExifModel;
 
@@ -76,6 +76,10 @@ class CommandWriterBase {
         mTemporaryHandles.clear();
     }
 
+    // the commands written since the last reset()
+    const uint32_t* getData() const { return mData.get(); }
+    uint32_t getDataLength() const { return mDataWritten; }
+
     IComposerClient::Command getCommand(uint32_t offset) {
         uint32_t val = (offset < mDataWritten) ? mData[offset] : 0;
         return static_cast<IComposerClient::Command>(
@@ -675,6 +679,13 @@ class CommandReaderBase {
         mCommandEnd = 0;
     }
 
+    // go back to the first command, to read the commands again
+    void rewind() {
+        mDataRead = 0;
+        mCommandBegin = 0;
+        mCommandEnd = 0;
+    }
+
     uint32_t getCommandLoc() const { return mCommandBegin; }
 
     uint32_t read() { return mData[mDataRead++]; }
@@ -83,6 +83,15 @@ class ComposerClientImpl : public Interface {
         mOnClientDestroyed = onClientDestroyed;
     }
 
+    // Records the command stream of this client, e.g., with a
+    // ComposerCommandCapture.  Pass nullptr to stop recording.
+    void setCommandRecorder(std::shared_ptr<ComposerCommandRecorder> recorder) {
+        std::lock_guard<std::mutex> lock(mCommandEngineMutex);
+        if (mCommandEngine) {
+            mCommandEngine->setCommandRecorder(std::move(recorder));
+        }
+    }
+
     // IComposerClient 2.1 interface
 
     class HalEventCallback : public Hal::EventCallback {
@@ -20,9 +20,15 @@
 #warning "ComposerCommandEngine.h included without LOG_TAG"
 #endif
 
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <tuple>
 #include <vector>
 
 #include <composer-command-buffer/2.1/ComposerCommandBuffer.h>
+#include <composer-hal/2.1/ComposerCommandRecorder.h>
 #include <composer-hal/2.1/ComposerHal.h>
 #include <composer-resources/2.1/ComposerResources.h>
 // TODO remove hwcomposer_defs.h dependency
@@ -56,6 +62,14 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return Error::BAD_PARAMETER;
         }
 
+        // hold a reference so that the recorder outlives this frame
+        std::shared_ptr<ComposerCommandRecorder> recorder = mRecorder;
+        if (recorder) {
+            recorder->onExecuteBegin(mData.get(), inLength, inHandles.size());
+        }
+
+        importNewBuffers();
+
         IComposerClient::Command command;
         uint16_t length = 0;
         while (!isEmpty()) {
@@ -63,19 +77,41 @@ class ComposerCommandEngine : protected CommandReaderBase {
                 break;
             }
 
+            std::chrono::steady_clock::time_point start;
+            if (recorder) {
+                start = std::chrono::steady_clock::now();
+            }
+
             bool parsed = executeCommand(command, length);
             endCommand();
 
+            if (recorder) {
+                recorder->onCommandExecuted(command, length,
+                                            std::chrono::steady_clock::now() - start);
+            }
+
             if (!parsed) {
                 ALOGE("failed to parse command 0x%x, length %" PRIu16, command, length);
                 break;
             }
         }
 
+        // free the buffers of the commands that were not executed
+        mImportedBuffers.clear();
+        pruneCachedBuffers();
+
         if (!isEmpty()) {
+            if (recorder) {
+                recorder->onExecuteEnd(Error::BAD_PARAMETER, mWriter->getData(),
+                                       mWriter->getDataLength());
+            }
             return Error::BAD_PARAMETER;
         }
 
+        if (recorder) {
+            recorder->onExecuteEnd(Error::NONE, mWriter->getData(), mWriter->getDataLength());
+        }
+
         return mWriter->writeQueue(outQueueChanged, outCommandLength, outCommandHandles)
                        ? Error::NONE
                        : Error::NO_RESOURCES;
@@ -88,7 +124,88 @@ class ComposerCommandEngine : protected CommandReaderBase {
         mWriter->reset();
     }
 
+    // Sets the recorder that observes the executed commands, or nullptr to
+    // stop recording.  Commands are only timed while a recorder is set.
+    void setCommandRecorder(std::shared_ptr<ComposerCommandRecorder> recorder) {
+        mRecorder = std::move(recorder);
+    }
+
    protected:
+    // Imports the new buffers of the client target and layer buffer commands
+    // in one pass before the commands are executed, so that executing them
+    // only stores the buffers in their slots.
+    void importNewBuffers() {
+        mNewBufferHandles.clear();
+
+        IComposerClient::Command command;
+        uint16_t length = 0;
+        while (!isEmpty() && beginCommand(&command, &length)) {
+            const uint32_t commandEnd = mDataRead + length;
+            // both commands start with the slot and the buffer handle
+            if ((command == IComposerClient::Command::SET_LAYER_BUFFER &&
+                 length == CommandWriterBase::kSetLayerBufferLength) ||
+                (command == IComposerClient::Command::SET_CLIENT_TARGET && length >= 4 &&
+                 length % 4 == 0)) {
+                read();
+                bool useCache = false;
+                auto rawHandle = readHandle(&useCache);
+                if (!useCache) {
+                    mNewBufferHandles.push_back(rawHandle);
+                }
+            }
+            mDataRead = commandEnd;
+            endCommand();
+        }
+        rewind();
+
+        if (!mNewBufferHandles.empty()) {
+            mResources->importBuffers(mNewBufferHandles, &mImportedBuffers);
+        }
+    }
+
+    // Finds the buffer of a client target (layer is ignored) or layer buffer
+    // slot of the current display, or stores a new buffer in it.  A buffer
+    // found before is used again, without calling into mResources and taking
+    // its lock, as long as the slot generation says it is still current.
+    Error getBuffer(bool isClientTarget, Layer layer, uint32_t slot, bool useCache,
+                    const native_handle_t* rawHandle, const native_handle_t** outBuffer,
+                    ComposerResources::ReplacedHandle* outReplacedBuffer) {
+        const BufferSlot bufferSlot{mCurrentDisplay, isClientTarget ? 0 : layer, slot,
+                                    isClientTarget};
+        if (useCache) {
+            auto iter = mCachedBuffers.find(bufferSlot);
+            if (iter != mCachedBuffers.end() && iter->second.isCurrent()) {
+                *outBuffer = iter->second.get();
+                return Error::NONE;
+            }
+        }
+
+        ComposerCachedHandle cachedBuffer;
+        auto err = isClientTarget
+                           ? mResources->getDisplayClientTarget(
+                                     mCurrentDisplay, slot, useCache, rawHandle, outBuffer,
+                                     outReplacedBuffer, &mImportedBuffers, &cachedBuffer)
+                           : mResources->getLayerBuffer(mCurrentDisplay, layer, slot, useCache,
+                                                        rawHandle, outBuffer, outReplacedBuffer,
+                                                        &mImportedBuffers, &cachedBuffer);
+        if (err == Error::NONE && cachedBuffer.isCurrent()) {
+            mCachedBuffers[bufferSlot] = std::move(cachedBuffer);
+        }
+        return err;
+    }
+
+    // Forgets the buffers of the slots that changed or were destroyed, once
+    // enough of them have accumulated.
+    void pruneCachedBuffers() {
+        if (mCachedBuffers.size() < mCachedBuffersPruneSize) {
+            return;
+        }
+        for (auto iter = mCachedBuffers.begin(); iter != mCachedBuffers.end();) {
+            iter = iter->second.isCurrent() ? std::next(iter) : mCachedBuffers.erase(iter);
+        }
+        mCachedBuffersPruneSize = std::max(kMinCachedBuffersPruneSize, 2 * mCachedBuffers.size());
+    }
+
     virtual bool executeCommand(IComposerClient::Command command, uint16_t length) {
         switch (command) {
             case IComposerClient::Command::SELECT_DISPLAY:
@@ -221,8 +338,8 @@ class ComposerCommandEngine : protected CommandReaderBase {
 
         const native_handle_t* clientTarget;
         ComposerResources::ReplacedHandle replacedClientTarget(true);
-        auto err = mResources->getDisplayClientTarget(mCurrentDisplay, slot, useCache, rawHandle,
-                                                      &clientTarget, &replacedClientTarget);
+        auto err = getBuffer(/*isClientTarget*/ true, 0, slot, useCache, rawHandle, &clientTarget,
+                             &replacedClientTarget);
         if (err == Error::NONE) {
             err = mHal->setClientTarget(mCurrentDisplay, clientTarget, fence, dataspace, damage);
             if (err == Error::NONE) {
@@ -367,8 +484,8 @@ class ComposerCommandEngine : protected CommandReaderBase {
 
         const native_handle_t* buffer;
         ComposerResources::ReplacedHandle replacedBuffer(true);
-        auto err = mResources->getLayerBuffer(mCurrentDisplay, mCurrentLayer, slot, useCache,
-                                              rawHandle, &buffer, &replacedBuffer);
+        auto err = getBuffer(/*isClientTarget*/ false, mCurrentLayer, slot, useCache, rawHandle,
+                             &buffer, &replacedBuffer);
         if (err == Error::NONE) {
             err = mHal->setLayerBuffer(mCurrentDisplay, mCurrentLayer, buffer, fence);
             if (err == Error::NONE) {
@@ -582,9 +699,21 @@ class ComposerCommandEngine : protected CommandReaderBase {
     ComposerHal* mHal;
     ComposerResources* mResources;
     std::unique_ptr<CommandWriterBase> mWriter;
+    std::shared_ptr<ComposerCommandRecorder> mRecorder;
 
     Display mCurrentDisplay = 0;
     Layer mCurrentLayer = 0;
+
+    // the raw handles of the new buffers of the commands being executed, and
+    // the buffers imported from them
+    std::vector<const native_handle_t*> mNewBufferHandles;
+    ComposerResources::ImportedBuffers mImportedBuffers;
+
+    // display, layer, slot, and whether the slot is a client target slot
+    using BufferSlot = std::tuple<Display, Layer, uint32_t, bool>;
+    static constexpr size_t kMinCachedBuffersPruneSize = 256;
+    std::map<BufferSlot, ComposerCachedHandle> mCachedBuffers;
+    size_t mCachedBuffersPruneSize = kMinCachedBuffersPruneSize;
 };
 
 }  // namespace hal
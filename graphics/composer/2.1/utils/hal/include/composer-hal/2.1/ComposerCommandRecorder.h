@@ -0,0 +1,208 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include <android/hardware/graphics/composer/2.1/IComposerClient.h>
+#include <log/log.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace composer {
+namespace V2_1 {
+namespace hal {
+
+// ComposerCommandRecorder observes the command stream executed by a
+// ComposerCommandEngine.  All callbacks are made from inside
+// ComposerCommandEngine::execute, on the thread executing the commands.
+class ComposerCommandRecorder {
+   public:
+    virtual ~ComposerCommandRecorder() = default;
+
+    // Called with the commands of a frame before any of them is executed.
+    // handleCount is the number of handles that came with the commands.
+    virtual void onExecuteBegin(const uint32_t* commands, uint32_t length,
+                                size_t handleCount) = 0;
+
+    // Called after each command is parsed and executed.  duration covers
+    // parsing, the HAL call and encoding its results.
+    virtual void onCommandExecuted(IComposerClient::Command command, uint16_t length,
+                                   std::chrono::nanoseconds duration) = 0;
+
+    // Called with the encoded results once all commands are executed, before
+    // the results are written to the output queue.
+    virtual void onExecuteEnd(Error error, const uint32_t* results, uint32_t length) = 0;
+};
+
+// The file format written by ComposerCommandCapture and read by
+// ComposerCommandCaptureReader.  All values are in host byte order.
+//
+//   ComposerCaptureFileHeader
+//   { ComposerCaptureFrameHeader, commands[], results[] } ...
+//
+// Handles are not captured; only their number is recorded so that handle
+// indices in the commands stay valid on replay.
+struct ComposerCaptureFileHeader {
+    static constexpr uint32_t kMagic = 0x52435748;  // "HWCR"
+    static constexpr uint32_t kVersion = 1;
+
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct ComposerCaptureFrameHeader {
+    // CLOCK_MONOTONIC time at which execute() was called
+    int64_t timestampNs;
+    // time spent executing the commands, excluding the output queue write
+    int64_t durationNs;
+    uint32_t commandLength;
+    uint32_t handleCount;
+    uint32_t resultLength;
+    int32_t error;
+};
+
+// ComposerCommandCapture writes every executed frame to a file.
+class ComposerCommandCapture : public ComposerCommandRecorder {
+   public:
+    static std::unique_ptr<ComposerCommandCapture> create(const char* path) {
+        FILE* file = fopen(path, "we");
+        if (!file) {
+            ALOGE("failed to open %s for capture", path);
+            return nullptr;
+        }
+
+        const ComposerCaptureFileHeader header = {ComposerCaptureFileHeader::kMagic,
+                                                  ComposerCaptureFileHeader::kVersion};
+        if (fwrite(&header, sizeof(header), 1, file) != 1) {
+            ALOGE("failed to write capture header to %s", path);
+            fclose(file);
+            return nullptr;
+        }
+
+        return std::unique_ptr<ComposerCommandCapture>(new ComposerCommandCapture(file));
+    }
+
+    ~ComposerCommandCapture() override { fclose(mFile); }
+
+    void onExecuteBegin(const uint32_t* commands, uint32_t length, size_t handleCount) override {
+        mFrame.timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count();
+        mFrame.commandLength = length;
+        mFrame.handleCount = static_cast<uint32_t>(handleCount);
+        mCommands.assign(commands, commands + length);
+    }
+
+    void onCommandExecuted(IComposerClient::Command, uint16_t, std::chrono::nanoseconds) override {}
+
+    void onExecuteEnd(Error error, const uint32_t* results, uint32_t length) override {
+        const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now().time_since_epoch())
+                                    .count();
+        mFrame.durationNs = now - mFrame.timestampNs;
+        mFrame.resultLength = length;
+        mFrame.error = static_cast<int32_t>(error);
+
+        if (mFailed) {
+            return;
+        }
+
+        if (fwrite(&mFrame, sizeof(mFrame), 1, mFile) != 1 ||
+            fwrite(mCommands.data(), sizeof(uint32_t), mCommands.size(), mFile) !=
+                    mCommands.size() ||
+            fwrite(results, sizeof(uint32_t), length, mFile) != length) {
+            ALOGE("failed to write captured frame; capture stopped");
+            mFailed = true;
+        }
+    }
+
+    void flush() { fflush(mFile); }
+
+   private:
+    explicit ComposerCommandCapture(FILE* file) : mFile(file) {}
+
+    FILE* const mFile;
+    bool mFailed = false;
+
+    ComposerCaptureFrameHeader mFrame{};
+    std::vector<uint32_t> mCommands;
+};
+
+// ComposerCommandCaptureReader reads back the frames written by
+// ComposerCommandCapture.
+class ComposerCommandCaptureReader {
+   public:
+    struct Frame {
+        ComposerCaptureFrameHeader header;
+        std::vector<uint32_t> commands;
+        std::vector<uint32_t> results;
+    };
+
+    static std::unique_ptr<ComposerCommandCaptureReader> open(const char* path) {
+        FILE* file = fopen(path, "re");
+        if (!file) {
+            ALOGE("failed to open capture %s", path);
+            return nullptr;
+        }
+
+        ComposerCaptureFileHeader header;
+        if (fread(&header, sizeof(header), 1, file) != 1 ||
+            header.magic != ComposerCaptureFileHeader::kMagic ||
+            header.version != ComposerCaptureFileHeader::kVersion) {
+            ALOGE("%s is not a composer capture", path);
+            fclose(file);
+            return nullptr;
+        }
+
+        return std::unique_ptr<ComposerCommandCaptureReader>(
+                new ComposerCommandCaptureReader(file));
+    }
+
+    ~ComposerCommandCaptureReader() { fclose(mFile); }
+
+    // Returns false at the end of the capture or when the capture is truncated.
+    bool readFrame(Frame* outFrame) {
+        if (fread(&outFrame->header, sizeof(outFrame->header), 1, mFile) != 1) {
+            return false;
+        }
+
+        outFrame->commands.resize(outFrame->header.commandLength);
+        outFrame->results.resize(outFrame->header.resultLength);
+        return fread(outFrame->commands.data(), sizeof(uint32_t), outFrame->commands.size(),
+                     mFile) == outFrame->commands.size() &&
+               fread(outFrame->results.data(), sizeof(uint32_t), outFrame->results.size(),
+                     mFile) == outFrame->results.size();
+    }
+
+   private:
+    explicit ComposerCommandCaptureReader(FILE* file) : mFile(file) {}
+
+    FILE* const mFile;
+};
+
+}  // namespace hal
+}  // namespace V2_1
+}  // namespace composer
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
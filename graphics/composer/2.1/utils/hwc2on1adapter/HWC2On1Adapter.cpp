@@ -25,10 +25,12 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
 #include <sstream>
 
+#include <cutils/properties.h>
 #include <hardware/hwcomposer.h>
 #include <log/log.h>
 #include <utils/Trace.h>
@@ -96,17 +98,18 @@ HWC2On1Adapter::HWC2On1Adapter(hwc_composer_device_1_t* hwc1Device)
     mHwc1MinorVersion(getMinorVersion(hwc1Device)),
     mHwc1SupportsVirtualDisplays(false),
     mHwc1SupportsBackgroundColor(false),
+    mHwc1IndependentDisplays(
+            property_get_bool("ro.vendor.hwc2on1.independent_displays", false)),
     mHwc1Callbacks(std::make_unique<Callbacks>(*this)),
     mCapabilities(),
-    mLayers(),
     mHwc1VirtualDisplay(),
     mStateMutex(),
+    mHwc1Mutex(),
+    mDisplayTable(std::make_shared<DisplayTable>()),
     mCallbacks(),
     mHasPendingInvalidate(false),
     mPendingVsyncs(),
-    mPendingHotplugs(),
-    mDisplays(),
-    mHwc1DisplayMap()
+    mPendingHotplugs()
 {
     common.close = closeHook;
     getCapabilities = getCapabilitiesHook;
@@ -315,7 +318,7 @@ hwc2_function_pointer_t HWC2On1Adapter::doGetFunction(
 
 Error HWC2On1Adapter::createVirtualDisplay(uint32_t width,
         uint32_t height, hwc2_display_t* outDisplay) {
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+    std::unique_lock<std::timed_mutex> lock(mStateMutex);
 
     if (mHwc1VirtualDisplay) {
         // We have already allocated our only HWC1 virtual display
@@ -327,24 +330,30 @@ Error HWC2On1Adapter::createVirtualDisplay(uint32_t width,
             HWC2::DisplayType::Virtual);
     mHwc1VirtualDisplay->populateConfigs(width, height);
     const auto displayId = mHwc1VirtualDisplay->getId();
-    mHwc1DisplayMap[HWC_DISPLAY_VIRTUAL] = displayId;
     mHwc1VirtualDisplay->setHwc1Id(HWC_DISPLAY_VIRTUAL);
-    mDisplays.emplace(displayId, mHwc1VirtualDisplay);
+
+    auto table = std::make_shared<DisplayTable>(*getDisplayTable());
+    table->hwc1DisplayMap[HWC_DISPLAY_VIRTUAL] = displayId;
+    table->displays.emplace(displayId, mHwc1VirtualDisplay);
+    setDisplayTable(std::move(table));
     *outDisplay = displayId;
 
     return Error::None;
 }
 
 Error HWC2On1Adapter::destroyVirtualDisplay(hwc2_display_t displayId) {
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+    std::unique_lock<std::timed_mutex> lock(mStateMutex);
 
     if (!mHwc1VirtualDisplay || (mHwc1VirtualDisplay->getId() != displayId)) {
         return Error::BadDisplay;
     }
 
     mHwc1VirtualDisplay.reset();
-    mHwc1DisplayMap.erase(HWC_DISPLAY_VIRTUAL);
-    mDisplays.erase(displayId);
+
+    auto table = std::make_shared<DisplayTable>(*getDisplayTable());
+    table->hwc1DisplayMap.erase(HWC_DISPLAY_VIRTUAL);
+    table->displays.erase(displayId);
+    setDisplayTable(std::move(table));
 
     return Error::None;
 }
@@ -365,8 +374,7 @@ void HWC2On1Adapter::dump(uint32_t* outSize, char* outBuffer) {
 
     // Attempt to acquire the lock for 1 second, but proceed without the lock
     // after that, so we can still get some information if we're deadlocked
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex,
-            std::defer_lock);
+    std::unique_lock<std::timed_mutex> lock(mStateMutex, std::defer_lock);
     lock.try_lock_for(1s);
 
     if (mCapabilities.empty()) {
@@ -378,15 +386,17 @@ void HWC2On1Adapter::dump(uint32_t* outSize, char* outBuffer) {
         }
     }
 
+    output << "Commit mode: " << (mHwc1IndependentDisplays ?
+            "independent" : "joint") << '\n';
+
     output << "Displays:\n";
-    for (const auto& element : mDisplays) {
+    for (const auto& element : getDisplayTable()->displays) {
         const auto& display = element.second;
         output << display->dump();
     }
     output << '\n';
 
-    // Release the lock before calling into HWC1, and since we no longer require
-    // mutual exclusion to access mCapabilities or mDisplays
+    // Release the lock before calling into HWC1
     lock.unlock();
 
     if (mHwc1Device->dump) {
@@ -415,6 +425,12 @@ static bool isValid(Callback descriptor) {
     }
 }
 
+HWC2On1Adapter::CallbackInfo& HWC2On1Adapter::getCallbackInfo(
+        Callback descriptor) {
+    // Callback values start at 1 (Hotplug) and isValid() bounds them
+    return mCallbacks[static_cast<size_t>(descriptor) - 1];
+}
+
 Error HWC2On1Adapter::registerCallback(Callback descriptor,
         hwc2_callback_data_t callbackData, hwc2_function_pointer_t pointer) {
     if (!isValid(descriptor)) {
@@ -424,82 +440,68 @@ Error HWC2On1Adapter::registerCallback(Callback descriptor,
     ALOGV("registerCallback(%s, %p, %p)", to_string(descriptor).c_str(),
             callbackData, pointer);
 
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
-
+    auto& callbackInfo = getCallbackInfo(descriptor);
     if (pointer != nullptr) {
-        mCallbacks[descriptor] = {callbackData, pointer};
+        callbackInfo.data.store(callbackData, std::memory_order_relaxed);
+        callbackInfo.pointer.store(pointer, std::memory_order_release);
     } else {
         ALOGI("unregisterCallback(%s)", to_string(descriptor).c_str());
-        mCallbacks.erase(descriptor);
+        callbackInfo.pointer.store(nullptr, std::memory_order_release);
         return Error::None;
     }
 
-    bool hasPendingInvalidate = false;
-    std::vector<hwc2_display_t> displayIds;
-    std::vector<std::pair<hwc2_display_t, int64_t>> pendingVsyncs;
-    std::vector<std::pair<hwc2_display_t, int>> pendingHotplugs;
-
+    // Deliver events that arrived before the callback was registered
     if (descriptor == Callback::Refresh) {
-        hasPendingInvalidate = mHasPendingInvalidate;
-        if (hasPendingInvalidate) {
-            for (auto& displayPair : mDisplays) {
-                displayIds.emplace_back(displayPair.first);
+        if (mHasPendingInvalidate.exchange(false)) {
+            auto refresh = reinterpret_cast<HWC2_PFN_REFRESH>(pointer);
+            for (const auto& displayPair : getDisplayTable()->displays) {
+                refresh(callbackData, displayPair.first);
             }
         }
-        mHasPendingInvalidate = false;
     } else if (descriptor == Callback::Vsync) {
-        for (auto pending : mPendingVsyncs) {
-            auto hwc1DisplayId = pending.first;
-            if (mHwc1DisplayMap.count(hwc1DisplayId) == 0) {
-                ALOGE("hwc1Vsync: Couldn't find display for HWC1 id %d",
-                        hwc1DisplayId);
-                continue;
-            }
-            auto displayId = mHwc1DisplayMap[hwc1DisplayId];
-            auto timestamp = pending.second;
-            pendingVsyncs.emplace_back(displayId, timestamp);
-        }
-        mPendingVsyncs.clear();
+        flushPendingVsyncs();
     } else if (descriptor == Callback::Hotplug) {
         // Hotplug the primary display
-        pendingHotplugs.emplace_back(mHwc1DisplayMap[HWC_DISPLAY_PRIMARY],
-                static_cast<int32_t>(Connection::Connected));
-
-        for (auto pending : mPendingHotplugs) {
-            auto hwc1DisplayId = pending.first;
-            if (mHwc1DisplayMap.count(hwc1DisplayId) == 0) {
-                ALOGE("hwc1Hotplug: Couldn't find display for HWC1 id %d",
-                        hwc1DisplayId);
-                continue;
-            }
-            auto displayId = mHwc1DisplayMap[hwc1DisplayId];
-            auto connected = pending.second;
-            pendingHotplugs.emplace_back(displayId, connected);
+        auto table = getDisplayTable();
+        auto primary = table->hwc1DisplayMap.find(HWC_DISPLAY_PRIMARY);
+        if (primary != table->hwc1DisplayMap.end()) {
+            auto hotplug = reinterpret_cast<HWC2_PFN_HOTPLUG>(pointer);
+            hotplug(callbackData, primary->second,
+                    static_cast<int32_t>(Connection::Connected));
         }
+        flushPendingHotplugs();
     }
 
-    // Call pending callbacks without the state lock held
-    lock.unlock();
+    return Error::None;
+}
 
-    if (hasPendingInvalidate) {
-        auto refresh = reinterpret_cast<HWC2_PFN_REFRESH>(pointer);
-        for (auto displayId : displayIds) {
-            refresh(callbackData, displayId);
-        }
-    }
-    if (!pendingVsyncs.empty()) {
-        auto vsync = reinterpret_cast<HWC2_PFN_VSYNC>(pointer);
-        for (auto& pendingVsync : pendingVsyncs) {
-            vsync(callbackData, pendingVsync.first, pendingVsync.second);
-        }
+HWC2On1Adapter::PendingEventQueue::~PendingEventQueue() {
+    takeAll();
+}
+
+void HWC2On1Adapter::PendingEventQueue::push(hwc2_display_t displayId,
+        int64_t value) {
+    auto event = new Event{displayId, value,
+            mHead.load(std::memory_order_relaxed)};
+    while (!mHead.compare_exchange_weak(event->next, event,
+            std::memory_order_release, std::memory_order_relaxed)) {
     }
-    if (!pendingHotplugs.empty()) {
-        auto hotplug = reinterpret_cast<HWC2_PFN_HOTPLUG>(pointer);
-        for (auto& pendingHotplug : pendingHotplugs) {
-            hotplug(callbackData, pendingHotplug.first, pendingHotplug.second);
-        }
+}
+
+std::vector<std::pair<hwc2_display_t, int64_t>>
+        HWC2On1Adapter::PendingEventQueue::takeAll() {
+    auto event = mHead.exchange(nullptr, std::memory_order_acquire);
+
+    // The list is newest first
+    std::vector<std::pair<hwc2_display_t, int64_t>> events;
+    while (event != nullptr) {
+        events.emplace_back(event->displayId, event->value);
+        auto next = event->next;
+        delete event;
+        event = next;
     }
-    return Error::None;
+    std::reverse(events.begin(), events.end());
+    return events;
 }
 
 // Display functions
@@ -525,6 +527,7 @@ HWC2On1Adapter::Display::Display(HWC2On1Adapter& device, HWC2::DisplayType type)
     mOutputBuffer(),
     mHasColorTransform(false),
     mLayers(),
+    mLayersById(),
     mHwc1LayerMap(),
     mNumAvailableRects(0),
     mNextAvailableRect(nullptr),
@@ -544,14 +547,14 @@ Error HWC2On1Adapter::Display::acceptChanges() {
     for (auto& change : mChanges->getTypeChanges()) {
         auto layerId = change.first;
         auto type = change.second;
-        if (mDevice.mLayers.count(layerId) == 0) {
+        auto layer = mLayersById.find(layerId);
+        if (layer == mLayersById.end()) {
             // This should never happen but somehow does.
             ALOGW("Cannot accept change for unknown layer (%" PRIu64 ")",
                   layerId);
             continue;
         }
-        auto layer = mDevice.mLayers[layerId];
-        layer->setCompositionType(type);
+        layer->second->setCompositionType(type);
     }
 
     mChanges->clearTypeChanges();
@@ -563,7 +566,7 @@ Error HWC2On1Adapter::Display::createLayer(hwc2_layer_t* outLayerId) {
     std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
     auto layer = *mLayers.emplace(std::make_shared<Layer>(*this));
-    mDevice.mLayers.emplace(std::make_pair(layer->getId(), layer));
+    mLayersById.emplace(layer->getId(), layer);
     *outLayerId = layer->getId();
     ALOGV("[%" PRIu64 "] created layer %" PRIu64, mId, *outLayerId);
     markGeometryChanged();
@@ -573,14 +576,14 @@ Error HWC2On1Adapter::Display::createLayer(hwc2_layer_t* outLayerId) {
 Error HWC2On1Adapter::Display::destroyLayer(hwc2_layer_t layerId) {
     std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
-    const auto mapLayer = mDevice.mLayers.find(layerId);
-    if (mapLayer == mDevice.mLayers.end()) {
+    const auto mapLayer = mLayersById.find(layerId);
+    if (mapLayer == mLayersById.end()) {
         ALOGV("[%" PRIu64 "] destroyLayer(%" PRIu64 ") failed: no such layer",
                 mId, layerId);
         return Error::BadLayer;
     }
     const auto layer = mapLayer->second;
-    mDevice.mLayers.erase(mapLayer);
+    mLayersById.erase(mapLayer);
     const auto zRange = mLayers.equal_range(layer);
     for (auto current = zRange.first; current != zRange.second; ++current) {
         if (**current == *layer) {
@@ -785,10 +788,17 @@ Error HWC2On1Adapter::Display::getType(int32_t* outType) {
 }
 
 Error HWC2On1Adapter::Display::present(int32_t* outRetireFence) {
+    // In joint commit mode, mHwc1Mutex must be acquired before any display
+    // lock, since setAllDisplays locks every display
+    std::unique_lock<std::mutex> hwc1Lock(mDevice.mHwc1Mutex, std::defer_lock);
+    if (!mDevice.mHwc1IndependentDisplays) {
+        hwc1Lock.lock();
+    }
     std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
     if (mChanges) {
-        Error error = mDevice.setAllDisplays();
+        Error error = mDevice.mHwc1IndependentDisplays ?
+                mDevice.setDisplay(*this) : mDevice.setAllDisplays();
         if (error != Error::None) {
             ALOGE("[%" PRIu64 "] present: setAllDisplaysFailed (%s)", mId,
                     to_string(error).c_str());
@@ -970,10 +980,16 @@ Error HWC2On1Adapter::Display::setVsyncEnabled(Vsync enable) {
 
 Error HWC2On1Adapter::Display::validate(uint32_t* outNumTypes,
         uint32_t* outNumRequests) {
+    std::unique_lock<std::mutex> hwc1Lock(mDevice.mHwc1Mutex, std::defer_lock);
+    if (!mDevice.mHwc1IndependentDisplays) {
+        hwc1Lock.lock();
+    }
     std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
     if (!mChanges) {
-        if (!mDevice.prepareAllDisplays()) {
+        bool prepared = mDevice.mHwc1IndependentDisplays ?
+                mDevice.prepareDisplay(*this) : mDevice.prepareAllDisplays();
+        if (!prepared) {
             return Error::BadDisplay;
         }
     } else {
@@ -994,8 +1010,8 @@ Error HWC2On1Adapter::Display::validate(uint32_t* outNumTypes,
 Error HWC2On1Adapter::Display::updateLayerZ(hwc2_layer_t layerId, uint32_t z) {
     std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
-    const auto mapLayer = mDevice.mLayers.find(layerId);
-    if (mapLayer == mDevice.mLayers.end()) {
+    const auto mapLayer = mLayersById.find(layerId);
+    if (mapLayer == mLayersById.end()) {
         ALOGE("[%" PRIu64 "] updateLayerZ failed to find layer", mId);
         return Error::BadLayer;
     }
@@ -1028,6 +1044,17 @@ Error HWC2On1Adapter::Display::updateLayerZ(hwc2_layer_t layerId, uint32_t z) {
     return Error::None;
 }
 
+std::shared_ptr<HWC2On1Adapter::Layer> HWC2On1Adapter::Display::getLayer(
+        hwc2_layer_t layerId) const {
+    std::unique_lock<std::recursive_mutex> lock(mStateMutex);
+
+    auto layer = mLayersById.find(layerId);
+    if (layer == mLayersById.end()) {
+        return nullptr;
+    }
+    return layer->second;
+}
+
 Error HWC2On1Adapter::Display::getClientTargetSupport(uint32_t width, uint32_t height,
                                       int32_t format, int32_t dataspace){
     if (mActiveConfig == nullptr) {
@@ -2271,91 +2298,76 @@ void HWC2On1Adapter::populateCapabilities() {
     mCapabilities.insert(Capability::PresentFenceIsNotReliable);
 }
 
-HWC2On1Adapter::Display* HWC2On1Adapter::getDisplay(hwc2_display_t id) {
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+std::shared_ptr<HWC2On1Adapter::Display> HWC2On1Adapter::getDisplay(
+        hwc2_display_t id) const {
+    auto table = getDisplayTable();
 
-    auto display = mDisplays.find(id);
-    if (display == mDisplays.end()) {
+    auto display = table->displays.find(id);
+    if (display == table->displays.end()) {
         return nullptr;
     }
 
-    return display->second.get();
+    return display->second;
 }
 
-std::tuple<HWC2On1Adapter::Layer*, Error> HWC2On1Adapter::getLayer(
-        hwc2_display_t displayId, hwc2_layer_t layerId) {
-    auto display = getDisplay(displayId);
-    if (!display) {
-        return std::make_tuple(static_cast<Layer*>(nullptr), Error::BadDisplay);
-    }
-
-    auto layerEntry = mLayers.find(layerId);
-    if (layerEntry == mLayers.end()) {
-        return std::make_tuple(static_cast<Layer*>(nullptr), Error::BadLayer);
-    }
+std::shared_ptr<const HWC2On1Adapter::DisplayTable>
+        HWC2On1Adapter::getDisplayTable() const {
+    return std::atomic_load(&mDisplayTable);
+}
 
-    auto layer = layerEntry->second;
-    if (layer->getDisplay().getId() != displayId) {
-        return std::make_tuple(static_cast<Layer*>(nullptr), Error::BadLayer);
-    }
-    return std::make_tuple(layer.get(), Error::None);
+void HWC2On1Adapter::setDisplayTable(
+        std::shared_ptr<const DisplayTable> table) {
+    std::atomic_store(&mDisplayTable, std::move(table));
 }
 
 void HWC2On1Adapter::populatePrimary() {
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+    std::unique_lock<std::timed_mutex> lock(mStateMutex);
 
     auto display = std::make_shared<Display>(*this, HWC2::DisplayType::Physical);
-    mHwc1DisplayMap[HWC_DISPLAY_PRIMARY] = display->getId();
     display->setHwc1Id(HWC_DISPLAY_PRIMARY);
     display->populateConfigs();
-    mDisplays.emplace(display->getId(), std::move(display));
+
+    auto table = std::make_shared<DisplayTable>(*getDisplayTable());
+    table->hwc1DisplayMap[HWC_DISPLAY_PRIMARY] = display->getId();
+    table->displays.emplace(display->getId(), std::move(display));
+    setDisplayTable(std::move(table));
+}
+
+size_t HWC2On1Adapter::getHwc1DisplayCount() const {
+    // HWC1 always expects at least the primary and external displays, plus
+    // the virtual display if it supports one
+    return (mHwc1MinorVersion >= 3) ? HWC_NUM_DISPLAY_TYPES : 2;
 }
 
 bool HWC2On1Adapter::prepareAllDisplays() {
     ATRACE_CALL();
 
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+    auto table = getDisplayTable();
 
-    for (const auto& displayPair : mDisplays) {
+    for (const auto& displayPair : table->displays) {
         auto& display = displayPair.second;
         if (!display->prepare()) {
             return false;
         }
     }
 
-    if (mHwc1DisplayMap.count(HWC_DISPLAY_PRIMARY) == 0) {
+    if (table->hwc1DisplayMap.count(HWC_DISPLAY_PRIMARY) == 0) {
         ALOGE("prepareAllDisplays: Unable to find primary HWC1 display");
         return false;
     }
 
-    // Build an array of hwc_display_contents_1 to call prepare() on HWC1.
-    mHwc1Contents.clear();
-
-    // Always push the primary display
-    auto primaryDisplayId = mHwc1DisplayMap[HWC_DISPLAY_PRIMARY];
-    auto& primaryDisplay = mDisplays[primaryDisplayId];
-    mHwc1Contents.push_back(primaryDisplay->getDisplayContents());
-
-    // Push the external display, if present
-    if (mHwc1DisplayMap.count(HWC_DISPLAY_EXTERNAL) != 0) {
-        auto externalDisplayId = mHwc1DisplayMap[HWC_DISPLAY_EXTERNAL];
-        auto& externalDisplay = mDisplays[externalDisplayId];
-        mHwc1Contents.push_back(externalDisplay->getDisplayContents());
-    } else {
-        // Even if an external display isn't present, we still need to send
-        // at least two displays down to HWC1
-        mHwc1Contents.push_back(nullptr);
-    }
-
-    // Push the hardware virtual display, if supported and present
-    if (mHwc1MinorVersion >= 3) {
-        if (mHwc1DisplayMap.count(HWC_DISPLAY_VIRTUAL) != 0) {
-            auto virtualDisplayId = mHwc1DisplayMap[HWC_DISPLAY_VIRTUAL];
-            auto& virtualDisplay = mDisplays[virtualDisplayId];
-            mHwc1Contents.push_back(virtualDisplay->getDisplayContents());
-        } else {
-            mHwc1Contents.push_back(nullptr);
+    // Build an array of hwc_display_contents_1 to call prepare() on HWC1. The
+    // displays are kept alongside, since the table may change before set().
+    mHwc1Contents.assign(getHwc1DisplayCount(), nullptr);
+    mHwc1PreparedDisplays.assign(getHwc1DisplayCount(), nullptr);
+    for (const auto& hwc1Display : table->hwc1DisplayMap) {
+        auto hwc1Id = static_cast<size_t>(hwc1Display.first);
+        if (hwc1Id >= mHwc1Contents.size()) {
+            continue;
         }
+        auto& display = table->displays.at(hwc1Display.second);
+        mHwc1Contents[hwc1Id] = display->getDisplayContents();
+        mHwc1PreparedDisplays[hwc1Id] = display;
     }
 
     for (auto& displayContents : mHwc1Contents) {
@@ -2389,16 +2401,39 @@ bool HWC2On1Adapter::prepareAllDisplays() {
     }
 
     // Return the received contents to their respective displays
-    for (size_t hwc1Id = 0; hwc1Id < mHwc1Contents.size(); ++hwc1Id) {
-        if (mHwc1Contents[hwc1Id] == nullptr) {
-            continue;
+    for (auto& display : mHwc1PreparedDisplays) {
+        if (display) {
+            display->generateChanges();
         }
+    }
+
+    return true;
+}
+
+bool HWC2On1Adapter::prepareDisplay(Display& display) {
+    ATRACE_CALL();
+
+    if (!display.prepare()) {
+        return false;
+    }
+
+    auto hwc1Id = static_cast<size_t>(display.getHwc1Id());
+    std::vector<struct hwc_display_contents_1*> contents(
+            getHwc1DisplayCount(), nullptr);
+    if (hwc1Id >= contents.size()) {
+        ALOGE("prepareDisplay: Invalid HWC1 id %zd", hwc1Id);
+        return false;
+    }
+    contents[hwc1Id] = display.getDisplayContents();
 
-        auto displayId = mHwc1DisplayMap[hwc1Id];
-        auto& display = mDisplays[displayId];
-        display->generateChanges();
+    ALOGV("Calling HWC1 prepare for display %zd", hwc1Id);
+    {
+        ATRACE_NAME("HWC1 prepare");
+        std::unique_lock<std::mutex> lock(mHwc1Mutex);
+        mHwc1Device->prepare(mHwc1Device, contents.size(), contents.data());
     }
 
+    display.generateChanges();
     return true;
 }
 
@@ -2482,16 +2517,13 @@ void dumpHWC1Message(hwc_composer_device_1* device, size_t numDisplays,
 Error HWC2On1Adapter::setAllDisplays() {
     ATRACE_CALL();
 
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
-
     // Make sure we're ready to validate
     for (size_t hwc1Id = 0; hwc1Id < mHwc1Contents.size(); ++hwc1Id) {
         if (mHwc1Contents[hwc1Id] == nullptr) {
             continue;
         }
 
-        auto displayId = mHwc1DisplayMap[hwc1Id];
-        auto& display = mDisplays[displayId];
+        auto& display = mHwc1PreparedDisplays[hwc1Id];
         Error error = display->set(*mHwc1Contents[hwc1Id]);
         if (error != Error::None) {
             ALOGE("setAllDisplays: Failed to set display %zd: %s", hwc1Id,
@@ -2514,8 +2546,7 @@ Error HWC2On1Adapter::setAllDisplays() {
             continue;
         }
 
-        auto displayId = mHwc1DisplayMap[hwc1Id];
-        auto& display = mDisplays[displayId];
+        auto& display = mHwc1PreparedDisplays[hwc1Id];
         auto retireFenceFd = mHwc1Contents[hwc1Id]->retireFenceFd;
         ALOGV("setAllDisplays: Adding retire fence %d to display %zd",
                 retireFenceFd, hwc1Id);
@@ -2526,58 +2557,88 @@ Error HWC2On1Adapter::setAllDisplays() {
     return Error::None;
 }
 
+Error HWC2On1Adapter::setDisplay(Display& display) {
+    ATRACE_CALL();
+
+    auto hwc1Id = static_cast<size_t>(display.getHwc1Id());
+    std::vector<struct hwc_display_contents_1*> contents(
+            getHwc1DisplayCount(), nullptr);
+    if (hwc1Id >= contents.size()) {
+        ALOGE("setDisplay: Invalid HWC1 id %zd", hwc1Id);
+        return Error::BadDisplay;
+    }
+    contents[hwc1Id] = display.getDisplayContents();
+
+    Error error = display.set(*contents[hwc1Id]);
+    if (error != Error::None) {
+        ALOGE("setDisplay: Failed to set display %zd: %s", hwc1Id,
+                to_string(error).c_str());
+        return error;
+    }
+
+    ALOGV("Calling HWC1 set for display %zd", hwc1Id);
+    {
+        ATRACE_NAME("HWC1 set");
+        std::unique_lock<std::mutex> lock(mHwc1Mutex);
+        mHwc1Device->set(mHwc1Device, contents.size(), contents.data());
+    }
+
+    ALOGV("setDisplay: Adding retire fence %d to display %zd",
+            contents[hwc1Id]->retireFenceFd, hwc1Id);
+    display.addRetireFence(contents[hwc1Id]->retireFenceFd);
+    display.addReleaseFences(*contents[hwc1Id]);
+
+    return Error::None;
+}
+
 void HWC2On1Adapter::hwc1Invalidate() {
     ALOGV("Received hwc1Invalidate");
 
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
-
     // If the HWC2-side callback hasn't been registered yet, buffer this until
     // it is registered.
-    if (mCallbacks.count(Callback::Refresh) == 0) {
+    const auto& callbackInfo = getCallbackInfo(Callback::Refresh);
+    auto pointer = callbackInfo.pointer.load(std::memory_order_acquire);
+    if (pointer == nullptr) {
         mHasPendingInvalidate = true;
-        return;
-    }
-
-    const auto& callbackInfo = mCallbacks[Callback::Refresh];
-    std::vector<hwc2_display_t> displays;
-    for (const auto& displayPair : mDisplays) {
-        displays.emplace_back(displayPair.first);
+        pointer = callbackInfo.pointer.load(std::memory_order_acquire);
+        if (pointer == nullptr || !mHasPendingInvalidate.exchange(false)) {
+            return;
+        }
     }
 
-    // Call back without the state lock held.
-    lock.unlock();
-
-    auto refresh = reinterpret_cast<HWC2_PFN_REFRESH>(callbackInfo.pointer);
-    for (auto display : displays) {
-        refresh(callbackInfo.data, display);
+    auto refresh = reinterpret_cast<HWC2_PFN_REFRESH>(pointer);
+    auto data = callbackInfo.data.load(std::memory_order_relaxed);
+    for (const auto& displayPair : getDisplayTable()->displays) {
+        refresh(data, displayPair.first);
     }
 }
 
 void HWC2On1Adapter::hwc1Vsync(int hwc1DisplayId, int64_t timestamp) {
     ALOGV("Received hwc1Vsync(%d, %" PRId64 ")", hwc1DisplayId, timestamp);
 
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
-
-    // If the HWC2-side callback hasn't been registered yet, buffer this until
-    // it is registered.
-    if (mCallbacks.count(Callback::Vsync) == 0) {
-        mPendingVsyncs.emplace_back(hwc1DisplayId, timestamp);
+    auto table = getDisplayTable();
+    auto hwc1Display = table->hwc1DisplayMap.find(hwc1DisplayId);
+    if (hwc1Display == table->hwc1DisplayMap.end()) {
+        ALOGE("hwc1Vsync: Couldn't find display for HWC1 id %d", hwc1DisplayId);
         return;
     }
+    auto displayId = hwc1Display->second;
 
-    if (mHwc1DisplayMap.count(hwc1DisplayId) == 0) {
-        ALOGE("hwc1Vsync: Couldn't find display for HWC1 id %d", hwc1DisplayId);
+    // If the HWC2-side callback hasn't been registered yet, buffer this until
+    // it is registered. Flush again in case registration raced with the push.
+    const auto& callbackInfo = getCallbackInfo(Callback::Vsync);
+    auto pointer = callbackInfo.pointer.load(std::memory_order_acquire);
+    if (pointer == nullptr) {
+        mPendingVsyncs.push(displayId, timestamp);
+        if (callbackInfo.pointer.load(std::memory_order_acquire) != nullptr) {
+            flushPendingVsyncs();
+        }
         return;
     }
 
-    const auto& callbackInfo = mCallbacks[Callback::Vsync];
-    auto displayId = mHwc1DisplayMap[hwc1DisplayId];
-
-    // Call back without the state lock held.
-    lock.unlock();
-
-    auto vsync = reinterpret_cast<HWC2_PFN_VSYNC>(callbackInfo.pointer);
-    vsync(callbackInfo.data, displayId, timestamp);
+    auto vsync = reinterpret_cast<HWC2_PFN_VSYNC>(pointer);
+    vsync(callbackInfo.data.load(std::memory_order_relaxed), displayId,
+            timestamp);
 }
 
 void HWC2On1Adapter::hwc1Hotplug(int hwc1DisplayId, int connected) {
@@ -2588,10 +2649,11 @@ void HWC2On1Adapter::hwc1Hotplug(int hwc1DisplayId, int connected) {
         return;
     }
 
-    std::unique_lock<std::recursive_timed_mutex> lock(mStateMutex);
+    std::unique_lock<std::timed_mutex> lock(mStateMutex);
 
+    auto table = std::make_shared<DisplayTable>(*getDisplayTable());
     hwc2_display_t displayId = UINT64_MAX;
-    if (mHwc1DisplayMap.count(hwc1DisplayId) == 0) {
+    if (table->hwc1DisplayMap.count(hwc1DisplayId) == 0) {
         if (connected == 0) {
             ALOGW("hwc1Hotplug: Received disconnect for unconnected display");
             return;
@@ -2603,8 +2665,8 @@ void HWC2On1Adapter::hwc1Hotplug(int hwc1DisplayId, int connected) {
         display->setHwc1Id(HWC_DISPLAY_EXTERNAL);
         display->populateConfigs();
         displayId = display->getId();
-        mHwc1DisplayMap[HWC_DISPLAY_EXTERNAL] = displayId;
-        mDisplays.emplace(displayId, std::move(display));
+        table->hwc1DisplayMap[HWC_DISPLAY_EXTERNAL] = displayId;
+        table->displays.emplace(displayId, std::move(display));
     } else {
         if (connected != 0) {
             ALOGW("hwc1Hotplug: Received connect for previously connected "
@@ -2613,26 +2675,60 @@ void HWC2On1Adapter::hwc1Hotplug(int hwc1DisplayId, int connected) {
         }
 
         // Disconnect an existing display
-        displayId = mHwc1DisplayMap[hwc1DisplayId];
-        mHwc1DisplayMap.erase(HWC_DISPLAY_EXTERNAL);
-        mDisplays.erase(displayId);
+        displayId = table->hwc1DisplayMap[hwc1DisplayId];
+        table->hwc1DisplayMap.erase(HWC_DISPLAY_EXTERNAL);
+        table->displays.erase(displayId);
     }
+    setDisplayTable(std::move(table));
+
+    // Call back without the state lock held
+    lock.unlock();
 
     // If the HWC2-side callback hasn't been registered yet, buffer this until
     // it is registered
-    if (mCallbacks.count(Callback::Hotplug) == 0) {
-        mPendingHotplugs.emplace_back(hwc1DisplayId, connected);
+    const auto& callbackInfo = getCallbackInfo(Callback::Hotplug);
+    if (callbackInfo.pointer.load(std::memory_order_acquire) == nullptr) {
+        mPendingHotplugs.push(displayId, connected);
+        if (callbackInfo.pointer.load(std::memory_order_acquire) != nullptr) {
+            flushPendingHotplugs();
+        }
         return;
     }
 
-    const auto& callbackInfo = mCallbacks[Callback::Hotplug];
+    deliverHotplug(displayId, connected);
+}
 
-    // Call back without the state lock held
-    lock.unlock();
+void HWC2On1Adapter::deliverHotplug(hwc2_display_t displayId, int connected) {
+    const auto& callbackInfo = getCallbackInfo(Callback::Hotplug);
+    auto pointer = callbackInfo.pointer.load(std::memory_order_acquire);
+    if (pointer == nullptr) {
+        return;
+    }
 
-    auto hotplug = reinterpret_cast<HWC2_PFN_HOTPLUG>(callbackInfo.pointer);
+    auto hotplug = reinterpret_cast<HWC2_PFN_HOTPLUG>(pointer);
     auto hwc2Connected = (connected == 0) ?
             HWC2::Connection::Disconnected : HWC2::Connection::Connected;
-    hotplug(callbackInfo.data, displayId, static_cast<int32_t>(hwc2Connected));
+    hotplug(callbackInfo.data.load(std::memory_order_relaxed), displayId,
+            static_cast<int32_t>(hwc2Connected));
+}
+
+void HWC2On1Adapter::flushPendingVsyncs() {
+    const auto& callbackInfo = getCallbackInfo(Callback::Vsync);
+    auto pointer = callbackInfo.pointer.load(std::memory_order_acquire);
+    if (pointer == nullptr) {
+        return;
+    }
+
+    auto vsync = reinterpret_cast<HWC2_PFN_VSYNC>(pointer);
+    auto data = callbackInfo.data.load(std::memory_order_relaxed);
+    for (const auto& pending : mPendingVsyncs.takeAll()) {
+        vsync(data, pending.first, pending.second);
+    }
+}
+
+void HWC2On1Adapter::flushPendingHotplugs() {
+    for (const auto& pending : mPendingHotplugs.takeAll()) {
+        deliverHotplug(pending.first, static_cast<int>(pending.second));
+    }
 }
 } // namespace android
@@ -25,8 +25,10 @@
 
 #include "MiniFence.h"
 
+#include <array>
 #include <atomic>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <set>
@@ -222,11 +224,12 @@ private:
                     int32_t* outLayerRequests);
             HWC2::Error getType(int32_t* outType);
 
-            // Since HWC1 "presents" (called "set" in HWC1) all Displays
-            // at once, the first call to any Display::present will trigger
-            // present() on all Displays in the Device. Subsequent calls without
-            // first calling validate() are noop (except for duping/returning
-            // the retire fence).
+            // Unless the device commits displays independently (see
+            // mHwc1IndependentDisplays), HWC1 "presents" (called "set" in
+            // HWC1) all Displays at once, and the first call to any
+            // Display::present will trigger present() on all Displays in the
+            // Device. Subsequent calls without first calling validate() are
+            // noop (except for duping/returning the retire fence).
             HWC2::Error present(int32_t* outRetireFence);
 
             HWC2::Error setActiveConfig(hwc2_config_t configId);
@@ -240,14 +243,17 @@ private:
             HWC2::Error setPowerMode(HWC2::PowerMode mode);
             HWC2::Error setVsyncEnabled(HWC2::Vsync enabled);
 
-            // Since HWC1 "validates" (called "prepare" in HWC1) all Displays
-            // at once, the first call to any Display::validate() will trigger
+            // Unless the device commits displays independently, HWC1
+            // "validates" (called "prepare" in HWC1) all Displays at once, and
+            // the first call to any Display::validate() will trigger
             // validate() on all other Displays in the Device.
             HWC2::Error validate(uint32_t* outNumTypes,
                     uint32_t* outNumRequests);
 
             HWC2::Error updateLayerZ(hwc2_layer_t layerId, uint32_t z);
 
+            std::shared_ptr<Layer> getLayer(hwc2_layer_t layerId) const;
+
             HWC2::Error getClientTargetSupport(uint32_t width, uint32_t height,
                      int32_t format, int32_t dataspace);
 
@@ -445,6 +451,10 @@ private:
             // All layers this Display is aware of.
             std::multiset<std::shared_ptr<Layer>, SortLayersByZ> mLayers;
 
+            // The same layers, indexed by ID for the per-call lookup.
+            std::unordered_map<hwc2_layer_t, std::shared_ptr<Layer>>
+                    mLayersById;
+
             // Mapping between layer index in array of hwc_display_contents_1*
             // passed to HWC1 during validate/set and Layer object.
             std::unordered_map<size_t, std::shared_ptr<Layer>> mHwc1LayerMap;
@@ -615,12 +625,16 @@ private:
     static int32_t callLayerFunction(hwc2_device_t* device,
             hwc2_display_t displayId, hwc2_layer_t layerId,
             HWC2::Error (Layer::*member)(Args...), Args... args) {
-        auto result = getAdapter(device)->getLayer(displayId, layerId);
-        auto error = std::get<HWC2::Error>(result);
-        if (error == HWC2::Error::None) {
-            auto layer = std::get<Layer*>(result);
-            error = ((*layer).*member)(std::forward<Args>(args)...);
+        // Hold on to the display too, since the layer refers to it
+        auto display = getAdapter(device)->getDisplay(displayId);
+        if (!display) {
+            return static_cast<int32_t>(HWC2::Error::BadDisplay);
         }
+        auto layer = display->getLayer(layerId);
+        if (!layer) {
+            return static_cast<int32_t>(HWC2::Error::BadLayer);
+        }
+        auto error = ((*layer).*member)(std::forward<Args>(args)...);
         return static_cast<int32_t>(error);
     }
 
@@ -670,19 +684,31 @@ private:
     // Adapter internals
 
     void populateCapabilities();
-    Display* getDisplay(hwc2_display_t id);
-    std::tuple<Layer*, HWC2::Error> getLayer(hwc2_display_t displayId,
-            hwc2_layer_t layerId);
+    std::shared_ptr<Display> getDisplay(hwc2_display_t id) const;
     void populatePrimary();
 
+    // Number of entries in the display array passed to HWC1 prepare/set
+    size_t getHwc1DisplayCount() const;
+
+    // Joint commit: prepare and set every display in one HWC1 call each.
+    // Must be called with mHwc1Mutex held.
     bool prepareAllDisplays();
     std::vector<struct hwc_display_contents_1*> mHwc1Contents;
+    std::vector<std::shared_ptr<Display>> mHwc1PreparedDisplays;
     HWC2::Error setAllDisplays();
 
+    // Independent commit: prepare and set a single display, passing NULL
+    // contents for the others. Must be called with the display lock held.
+    bool prepareDisplay(Display& display);
+    HWC2::Error setDisplay(Display& display);
+
     // Callbacks
     void hwc1Invalidate();
     void hwc1Vsync(int hwc1DisplayId, int64_t timestamp);
     void hwc1Hotplug(int hwc1DisplayId, int connected);
+    void deliverHotplug(hwc2_display_t displayId, int connected);
+    void flushPendingVsyncs();
+    void flushPendingHotplugs();
 
     // These are set in the constructor and before any asynchronous events are
     // possible
@@ -692,45 +718,88 @@ private:
     bool mHwc1SupportsVirtualDisplays;
     bool mHwc1SupportsBackgroundColor;
 
+    // Joint commit stays the default: from HWC 1.1 on, prepare() and set()
+    // take one entry per display, and hwcomposer.h defines a NULL entry as a
+    // disabled or disconnected display. No HWC1 version lets an active display
+    // be left out of a call, so committing one display at a time would tell
+    // the others they are off. Devices whose HWC1 keeps showing a display when
+    // its entry is NULL can opt into independent commits with
+    // ro.vendor.hwc2on1.independent_displays, so that one display's frame
+    // does not wait for another's. With a single display, as on most HWC1
+    // devices, both modes make the same calls.
+    bool mHwc1IndependentDisplays;
+
     class Callbacks;
     const std::unique_ptr<Callbacks> mHwc1Callbacks;
 
     std::unordered_set<HWC2::Capability> mCapabilities;
 
-    // These are only accessed from the main SurfaceFlinger thread (not from
-    // callbacks or dump
+    // A HWC1 supports only one virtual display. Protected by mStateMutex.
+    std::shared_ptr<Display> mHwc1VirtualDisplay;
 
-    std::map<hwc2_layer_t, std::shared_ptr<Layer>> mLayers;
+    // Serializes changes to the display table. It is not taken on the
+    // per-frame path, nor by HWC1 callbacks other than hotplug.
+    std::timed_mutex mStateMutex;
+
+    // Serializes calls to HWC1 prepare() and set(). In joint commit mode it is
+    // also held across preparing and setting every display, and is then
+    // always acquired before any Display::mStateMutex.
+    std::mutex mHwc1Mutex;
+
+    // The set of displays is read on every call but only changes on hotplug
+    // and virtual display creation, so readers get an immutable snapshot
+    // with std::atomic_load and writers replace it with std::atomic_store
+    // under mStateMutex.
+    struct DisplayTable {
+        // Mapping between HWC2 display IDs and Display objects.
+        std::map<hwc2_display_t, std::shared_ptr<Display>> displays;
+
+        // Map HWC1 display type (HWC_DISPLAY_PRIMARY, HWC_DISPLAY_EXTERNAL,
+        // HWC_DISPLAY_VIRTUAL) to Display IDs generated by HWC2on1Adapter
+        // objects.
+        std::unordered_map<int, hwc2_display_t> hwc1DisplayMap;
+    };
+    std::shared_ptr<const DisplayTable> getDisplayTable() const;
+    // Must be called with mStateMutex held.
+    void setDisplayTable(std::shared_ptr<const DisplayTable> table);
+    std::shared_ptr<const DisplayTable> mDisplayTable;
+
+    // Registered callbacks are published with release stores, so HWC1
+    // callback threads can read them without locking. A callback that is
+    // re-registered with different data may briefly be paired with the old
+    // data, which SurfaceFlinger never does.
+    struct CallbackInfo {
+        std::atomic<hwc2_callback_data_t> data{nullptr};
+        std::atomic<hwc2_function_pointer_t> pointer{nullptr};
+    };
+    CallbackInfo& getCallbackInfo(HWC2::Callback descriptor);
+    std::array<CallbackInfo, 3> mCallbacks;
+    std::atomic<bool> mHasPendingInvalidate;
 
-    // A HWC1 supports only one virtual display.
-    std::shared_ptr<Display> mHwc1VirtualDisplay;
+    // A lock-free multi-producer queue of events. Events are pushed from
+    // HWC1 callback threads and taken all at once in arrival order.
+    class PendingEventQueue {
+        public:
+            ~PendingEventQueue();
 
-    // These are potentially accessed from multiple threads, and are protected
-    // by this mutex. This needs to be recursive, since the HWC1 implementation
-    // can call back into the invalidate callback on the same thread that is
-    // calling prepare.
-    std::recursive_timed_mutex mStateMutex;
+            void push(hwc2_display_t displayId, int64_t value);
+            std::vector<std::pair<hwc2_display_t, int64_t>> takeAll();
 
-    struct CallbackInfo {
-        hwc2_callback_data_t data;
-        hwc2_function_pointer_t pointer;
+        private:
+            struct Event {
+                hwc2_display_t displayId;
+                int64_t value;
+                Event* next;
+            };
+            std::atomic<Event*> mHead{nullptr};
     };
-    std::unordered_map<HWC2::Callback, CallbackInfo> mCallbacks;
-    bool mHasPendingInvalidate;
 
     // There is a small gap between the time the HWC1 module is started and
     // when the callbacks for vsync and hotplugs are registered by the
-    // HWC2on1Adapter. To prevent losing events they are stored in these arrays
-    // and fed to the callback as soon as possible.
-    std::vector<std::pair<int, int64_t>> mPendingVsyncs;
-    std::vector<std::pair<int, int>> mPendingHotplugs;
-
-    // Mapping between HWC1 display id and Display objects.
-    std::map<hwc2_display_t, std::shared_ptr<Display>> mDisplays;
-
-    // Map HWC1 display type (HWC_DISPLAY_PRIMARY, HWC_DISPLAY_EXTERNAL,
-    // HWC_DISPLAY_VIRTUAL) to Display IDs generated by HWC2on1Adapter objects.
-    std::unordered_map<int, hwc2_display_t> mHwc1DisplayMap;
+    // HWC2on1Adapter. To prevent losing events they are stored in these
+    // queues and fed to the callback as soon as possible.
+    PendingEventQueue mPendingVsyncs;
+    PendingEventQueue mPendingHotplugs;
 };
 
 } // namespace android
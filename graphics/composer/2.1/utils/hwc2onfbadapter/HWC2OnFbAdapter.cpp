@@ -28,9 +28,11 @@
 #include <sys/prctl.h>
 #include <unistd.h> // for close
 
+#include <cutils/properties.h>
 #include <hardware/fb.h>
 #include <log/log.h>
 #include <sync/sync.h>
+#include <ui/GraphicBufferMapper.h>
 
 using namespace HWC2;
 
@@ -189,13 +191,14 @@ int32_t setColorModeHook(hwc2_device_t* device, hwc2_display_t display, int32_t
 }
 
 int32_t setColorTransformHook(hwc2_device_t* device, hwc2_display_t display,
-                              const float* /*matrix*/, int32_t /*hint*/) {
+                              const float* /*matrix*/, int32_t hint) {
     auto& adapter = HWC2OnFbAdapter::cast(device);
     if (adapter.getDisplayId() != display) {
         return HWC2_ERROR_BAD_DISPLAY;
     }
 
-    // we always force client composition
+    // we always force client composition for non-identity transforms
+    adapter.setColorTransform(hint == HAL_COLOR_TRANSFORM_IDENTITY);
     adapter.setState(HWC2OnFbAdapter::State::MODIFIED);
     return HWC2_ERROR_NONE;
 }
@@ -319,8 +322,12 @@ int32_t validateDisplayHook(hwc2_device_t* device, hwc2_display_t display, uint3
         return HWC2_ERROR_BAD_DISPLAY;
     }
 
+    // either composite every layer in software, or none of them
+    const bool software = adapter.canCompositeInSoftware();
+    adapter.setSoftwareComposition(software);
+
     const auto& dirtyLayers = adapter.getDirtyLayers();
-    *outNumTypes = dirtyLayers.size();
+    *outNumTypes = software ? 0 : dirtyLayers.size();
     *outNumRequests = 0;
 
     if (*outNumTypes > 0) {
@@ -343,6 +350,11 @@ int32_t getChangedCompositionTypesHook(hwc2_device_t* device, hwc2_display_t dis
         return HWC2_ERROR_NOT_VALIDATED;
     }
 
+    if (adapter.isSoftwareComposition()) {
+        *outNumElements = 0;
+        return HWC2_ERROR_NONE;
+    }
+
     // request client composition for all layers
     const auto& dirtyLayers = adapter.getDirtyLayers();
     if (outLayers && outTypes) {
@@ -384,7 +396,9 @@ int32_t acceptDisplayChangesHook(hwc2_device_t* device, hwc2_display_t display)
         return HWC2_ERROR_NOT_VALIDATED;
     }
 
-    adapter.clearDirtyLayers();
+    if (!adapter.isSoftwareComposition()) {
+        adapter.clearDirtyLayers();
+    }
     adapter.setState(HWC2OnFbAdapter::State::VALIDATED);
     return HWC2_ERROR_NONE;
 }
@@ -399,7 +413,16 @@ int32_t presentDisplayHook(hwc2_device_t* device, hwc2_display_t display,
         return HWC2_ERROR_NOT_VALIDATED;
     }
 
-    adapter.postBuffer();
+    if (adapter.isSoftwareComposition()) {
+        if (!adapter.compositeAndPost()) {
+            // nothing was posted; the next validate falls back to client composition if a
+            // layer buffer could not be read
+            adapter.setState(HWC2OnFbAdapter::State::MODIFIED);
+            return HWC2_ERROR_NO_RESOURCES;
+        }
+    } else {
+        adapter.postBuffer();
+    }
     *outPresentFence = -1;
 
     return HWC2_ERROR_NONE;
@@ -454,7 +477,7 @@ int32_t setCursorPositionHook(hwc2_device_t* device, hwc2_display_t display, hwc
 }
 
 int32_t setLayerBufferHook(hwc2_device_t* device, hwc2_display_t display, hwc2_layer_t layer,
-                           buffer_handle_t /*buffer*/, int32_t acquireFence) {
+                           buffer_handle_t buffer, int32_t acquireFence) {
     if (acquireFence >= 0) {
         sync_wait(acquireFence, -1);
         close(acquireFence);
@@ -464,7 +487,7 @@ int32_t setLayerBufferHook(hwc2_device_t* device, hwc2_display_t display, hwc2_l
     if (adapter.getDisplayId() != display) {
         return HWC2_ERROR_BAD_DISPLAY;
     }
-    if (!adapter.hasLayer(layer)) {
+    if (!adapter.setLayerBuffer(layer, buffer)) {
         return HWC2_ERROR_BAD_LAYER;
     }
 
@@ -473,15 +496,18 @@ int32_t setLayerBufferHook(hwc2_device_t* device, hwc2_display_t display, hwc2_l
 }
 
 int32_t setLayerSurfaceDamageHook(hwc2_device_t* device, hwc2_display_t display, hwc2_layer_t layer,
-                                  hwc_region_t /*damage*/) {
+                                  hwc_region_t damage) {
     auto& adapter = HWC2OnFbAdapter::cast(device);
     if (adapter.getDisplayId() != display) {
         return HWC2_ERROR_BAD_DISPLAY;
     }
-    if (!adapter.hasLayer(layer)) {
+    auto* layerState = adapter.getLayer(layer);
+    if (!layerState) {
         return HWC2_ERROR_BAD_LAYER;
     }
 
+    layerState->surfaceDamage.assign(damage.rects, damage.rects + damage.numRects);
+
     // no state change
     return HWC2_ERROR_NONE;
 }
@@ -492,7 +518,7 @@ int32_t setLayerCompositionTypeHook(hwc2_device_t* device, hwc2_display_t displa
     if (adapter.getDisplayId() != display) {
         return HWC2_ERROR_BAD_DISPLAY;
     }
-    if (!adapter.markLayerDirty(layer, type != HWC2_COMPOSITION_CLIENT)) {
+    if (!adapter.setLayerCompositionType(layer, type)) {
         return HWC2_ERROR_BAD_LAYER;
     }
 
@@ -515,6 +541,57 @@ int32_t setLayerStateHook(hwc2_device_t* device, hwc2_display_t display, hwc2_la
     return HWC2_ERROR_NONE;
 }
 
+bool isSameValue(const hwc_rect_t& a, const hwc_rect_t& b) {
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+bool isSameValue(const hwc_frect_t& a, const hwc_frect_t& b) {
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+template <typename T>
+bool isSameValue(const T& a, const T& b) {
+    return a == b;
+}
+
+// for layer state the software compositor consumes
+template <typename T, T HWC2OnFbAdapter::Layer::*member>
+int32_t setLayerMemberHook(hwc2_device_t* device, hwc2_display_t display, hwc2_layer_t layer,
+                           T value) {
+    auto& adapter = HWC2OnFbAdapter::cast(device);
+    if (adapter.getDisplayId() != display) {
+        return HWC2_ERROR_BAD_DISPLAY;
+    }
+    auto* layerState = adapter.getLayer(layer);
+    if (!layerState) {
+        return HWC2_ERROR_BAD_LAYER;
+    }
+
+    if (!isSameValue(layerState->*member, value)) {
+        layerState->*member = value;
+        layerState->geometryChanged = true;
+    }
+
+    adapter.setState(HWC2OnFbAdapter::State::MODIFIED);
+    return HWC2_ERROR_NONE;
+}
+
+int32_t setLayerSidebandStreamHook(hwc2_device_t* device, hwc2_display_t display,
+                                   hwc2_layer_t layer, const native_handle_t* stream) {
+    auto& adapter = HWC2OnFbAdapter::cast(device);
+    if (adapter.getDisplayId() != display) {
+        return HWC2_ERROR_BAD_DISPLAY;
+    }
+    auto* layerState = adapter.getLayer(layer);
+    if (!layerState) {
+        return HWC2_ERROR_BAD_LAYER;
+    }
+
+    layerState->hasSidebandStream = stream != nullptr;
+    adapter.setState(HWC2OnFbAdapter::State::MODIFIED);
+    return HWC2_ERROR_NONE;
+}
+
 template <typename PFN, typename T>
 static hwc2_function_pointer_t asFP(T function) {
     static_assert(std::is_same<PFN, T>::value, "Incompatible function pointer");
@@ -605,25 +682,32 @@ hwc2_function_pointer_t getFunctionHook(hwc2_device_t* /*device*/, int32_t descr
         case HWC2_FUNCTION_SET_LAYER_COMPOSITION_TYPE:
             return asFP<HWC2_PFN_SET_LAYER_COMPOSITION_TYPE>(setLayerCompositionTypeHook);
         case HWC2_FUNCTION_SET_LAYER_BLEND_MODE:
-            return asFP<HWC2_PFN_SET_LAYER_BLEND_MODE>(setLayerStateHook<int32_t>);
+            return asFP<HWC2_PFN_SET_LAYER_BLEND_MODE>(
+                    setLayerMemberHook<int32_t, &HWC2OnFbAdapter::Layer::blendMode>);
         case HWC2_FUNCTION_SET_LAYER_COLOR:
             return asFP<HWC2_PFN_SET_LAYER_COLOR>(setLayerStateHook<hwc_color_t>);
         case HWC2_FUNCTION_SET_LAYER_DATASPACE:
-            return asFP<HWC2_PFN_SET_LAYER_DATASPACE>(setLayerStateHook<int32_t>);
+            return asFP<HWC2_PFN_SET_LAYER_DATASPACE>(
+                    setLayerMemberHook<int32_t, &HWC2OnFbAdapter::Layer::dataspace>);
         case HWC2_FUNCTION_SET_LAYER_DISPLAY_FRAME:
-            return asFP<HWC2_PFN_SET_LAYER_DISPLAY_FRAME>(setLayerStateHook<hwc_rect_t>);
+            return asFP<HWC2_PFN_SET_LAYER_DISPLAY_FRAME>(
+                    setLayerMemberHook<hwc_rect_t, &HWC2OnFbAdapter::Layer::displayFrame>);
         case HWC2_FUNCTION_SET_LAYER_PLANE_ALPHA:
-            return asFP<HWC2_PFN_SET_LAYER_PLANE_ALPHA>(setLayerStateHook<float>);
+            return asFP<HWC2_PFN_SET_LAYER_PLANE_ALPHA>(
+                    setLayerMemberHook<float, &HWC2OnFbAdapter::Layer::planeAlpha>);
         case HWC2_FUNCTION_SET_LAYER_SIDEBAND_STREAM:
-            return asFP<HWC2_PFN_SET_LAYER_SIDEBAND_STREAM>(setLayerStateHook<buffer_handle_t>);
+            return asFP<HWC2_PFN_SET_LAYER_SIDEBAND_STREAM>(setLayerSidebandStreamHook);
         case HWC2_FUNCTION_SET_LAYER_SOURCE_CROP:
-            return asFP<HWC2_PFN_SET_LAYER_SOURCE_CROP>(setLayerStateHook<hwc_frect_t>);
+            return asFP<HWC2_PFN_SET_LAYER_SOURCE_CROP>(
+                    setLayerMemberHook<hwc_frect_t, &HWC2OnFbAdapter::Layer::sourceCrop>);
         case HWC2_FUNCTION_SET_LAYER_TRANSFORM:
-            return asFP<HWC2_PFN_SET_LAYER_TRANSFORM>(setLayerStateHook<int32_t>);
+            return asFP<HWC2_PFN_SET_LAYER_TRANSFORM>(
+                    setLayerMemberHook<int32_t, &HWC2OnFbAdapter::Layer::transform>);
         case HWC2_FUNCTION_SET_LAYER_VISIBLE_REGION:
             return asFP<HWC2_PFN_SET_LAYER_VISIBLE_REGION>(setLayerStateHook<hwc_region_t>);
         case HWC2_FUNCTION_SET_LAYER_Z_ORDER:
-            return asFP<HWC2_PFN_SET_LAYER_Z_ORDER>(setLayerStateHook<uint32_t>);
+            return asFP<HWC2_PFN_SET_LAYER_Z_ORDER>(
+                    setLayerMemberHook<uint32_t, &HWC2OnFbAdapter::Layer::z>);
 
         default:
             ALOGE("unknown function descriptor %d", descriptor);
@@ -663,6 +747,14 @@ HWC2OnFbAdapter::HWC2OnFbAdapter(framebuffer_device_t* fbDevice)
     // for FB devices
     mCapabilities.insert(Capability::PresentFenceIsNotReliable);
 
+    if (property_get_bool("ro.vendor.hwc2onfb.software_composition", false)) {
+        if (SoftwareCompositor::isFormatSupported(mFbInfo.format)) {
+            mCompositor = std::make_unique<SoftwareCompositor>();
+        } else {
+            ALOGW("software composition unsupported for framebuffer format %d", mFbInfo.format);
+        }
+    }
+
     mVsyncThread.start(0, mFbInfo.vsync_period_ns);
 }
 
@@ -684,6 +776,10 @@ hwc2_config_t HWC2OnFbAdapter::getConfigId() {
 
 void HWC2OnFbAdapter::close() {
     mVsyncThread.stop();
+    mCompositor.reset();
+    for (auto& target : mTargets) {
+        target.buffer.clear();
+    }
     framebuffer_close(mFbDevice);
 }
 
@@ -716,27 +812,41 @@ HWC2OnFbAdapter::State HWC2OnFbAdapter::getState() const {
 hwc2_layer_t HWC2OnFbAdapter::addLayer() {
     hwc2_layer_t id = ++mNextLayerId;
 
-    mLayers.insert(id);
+    mLayers.emplace(id, Layer{});
     mDirtyLayers.insert(id);
 
     return id;
 }
 
 bool HWC2OnFbAdapter::removeLayer(hwc2_layer_t layer) {
+    auto iter = mLayers.find(layer);
+    if (iter == mLayers.end()) {
+        return false;
+    }
+
+    mRemovedLayerDamage.push_back(iter->second.lastDisplayFrame);
     mDirtyLayers.erase(layer);
-    return mLayers.erase(layer);
+    mLayers.erase(iter);
+    return true;
 }
 
 bool HWC2OnFbAdapter::hasLayer(hwc2_layer_t layer) const {
     return mLayers.count(layer) > 0;
 }
 
-bool HWC2OnFbAdapter::markLayerDirty(hwc2_layer_t layer, bool dirty) {
-    if (mLayers.count(layer) == 0) {
+HWC2OnFbAdapter::Layer* HWC2OnFbAdapter::getLayer(hwc2_layer_t layer) {
+    auto iter = mLayers.find(layer);
+    return iter != mLayers.end() ? &iter->second : nullptr;
+}
+
+bool HWC2OnFbAdapter::setLayerCompositionType(hwc2_layer_t layer, int32_t type) {
+    auto* layerState = getLayer(layer);
+    if (!layerState) {
         return false;
     }
 
-    if (dirty) {
+    layerState->compositionType = type;
+    if (type != HWC2_COMPOSITION_CLIENT) {
         mDirtyLayers.insert(layer);
     } else {
         mDirtyLayers.erase(layer);
@@ -745,14 +855,79 @@ bool HWC2OnFbAdapter::markLayerDirty(hwc2_layer_t layer, bool dirty) {
     return true;
 }
 
+bool HWC2OnFbAdapter::setLayerBuffer(hwc2_layer_t layer, buffer_handle_t buffer) {
+    auto* layerState = getLayer(layer);
+    if (!layerState) {
+        return false;
+    }
+
+    layerState->buffer = buffer;
+    layerState->bufferChanged = true;
+    layerState->bufferLockFailed = false;
+    if (!mCompositor || !buffer) {
+        return true;
+    }
+
+    // a layer whose buffer cannot be described falls back to client composition
+    auto& mapper = GraphicBufferMapper::get();
+    ui::PixelFormat format;
+    uint64_t width;
+    uint64_t height;
+    if (mapper.getPixelFormatRequested(buffer, &format) == NO_ERROR &&
+        mapper.getWidth(buffer, &width) == NO_ERROR &&
+        mapper.getHeight(buffer, &height) == NO_ERROR) {
+        layerState->bufferFormat = static_cast<int32_t>(format);
+        layerState->bufferWidth = uint32_t(width);
+        layerState->bufferHeight = uint32_t(height);
+    } else {
+        layerState->bufferFormat = 0;
+    }
+
+    return true;
+}
+
 const std::unordered_set<hwc2_layer_t>& HWC2OnFbAdapter::getDirtyLayers() const {
     return mDirtyLayers;
 }
 
 void HWC2OnFbAdapter::clearDirtyLayers() {
+    for (auto& [id, layer] : mLayers) {
+        layer.compositionType = HWC2_COMPOSITION_CLIENT;
+    }
     mDirtyLayers.clear();
 }
 
+void HWC2OnFbAdapter::setColorTransform(bool identity) {
+    mColorTransformIdentity = identity;
+}
+
+bool HWC2OnFbAdapter::canCompositeInSoftware() const {
+    if (!mCompositor || !mColorTransformIdentity || mLayers.empty()) {
+        return false;
+    }
+
+    for (const auto& [id, layer] : mLayers) {
+        const bool supportedDataspace = layer.dataspace == HAL_DATASPACE_UNKNOWN ||
+                layer.dataspace == HAL_DATASPACE_SRGB || layer.dataspace == HAL_DATASPACE_V0_SRGB;
+        if (layer.compositionType != HWC2_COMPOSITION_DEVICE || !layer.buffer ||
+            layer.bufferLockFailed || layer.hasSidebandStream || !supportedDataspace ||
+            !SoftwareCompositor::isFormatSupported(layer.bufferFormat) ||
+            !SoftwareCompositor::isTransformSupported(layer.transform)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void HWC2OnFbAdapter::setSoftwareComposition(bool enable) {
+    mSoftwareComposition = enable;
+}
+
+bool HWC2OnFbAdapter::isSoftwareComposition() const {
+    return mSoftwareComposition;
+}
+
 /*
  * For each frame, SurfaceFlinger
  *
@@ -787,9 +962,192 @@ bool HWC2OnFbAdapter::postBuffer() {
         error = mFbDevice->post(mFbDevice, mBuffer);
     }
 
+    mLastPresentWasSoftware = false;
     return error == 0;
 }
 
+void HWC2OnFbAdapter::addDamage(const hwc_rect_t& rect) {
+    // bounds the per-frame work spent on tracking damage
+    constexpr size_t kMaxDamageRects = 16;
+
+    if (rect.left >= rect.right || rect.top >= rect.bottom) {
+        return;
+    }
+
+    for (auto& target : mTargets) {
+        auto& damage = target.damage;
+        if (damage.size() < kMaxDamageRects) {
+            damage.push_back(rect);
+            continue;
+        }
+
+        hwc_rect_t bounds = rect;
+        for (const auto& r : damage) {
+            bounds.left = std::min(bounds.left, r.left);
+            bounds.top = std::min(bounds.top, r.top);
+            bounds.right = std::max(bounds.right, r.right);
+            bounds.bottom = std::max(bounds.bottom, r.bottom);
+        }
+        damage.assign(1, bounds);
+    }
+}
+
+bool HWC2OnFbAdapter::lockLayer(const Layer& layer, SoftwareCompositor::Layer* outLayer) {
+    void* data = nullptr;
+    int32_t bytesPerPixel = -1;
+    int32_t bytesPerStride = -1;
+    const Rect bounds(int32_t(layer.bufferWidth), int32_t(layer.bufferHeight));
+    status_t error = GraphicBufferMapper::get().lock(layer.buffer, GRALLOC_USAGE_SW_READ_OFTEN,
+                                                     bounds, &data, &bytesPerPixel,
+                                                     &bytesPerStride);
+    if (error != NO_ERROR) {
+        ALOGE("failed to lock layer buffer: %d", error);
+        return false;
+    }
+    if (bytesPerPixel != 4 || bytesPerStride <= 0) {
+        ALOGE("unexpected layer buffer layout: bpp %d, stride %d", bytesPerPixel, bytesPerStride);
+        GraphicBufferMapper::get().unlock(layer.buffer);
+        return false;
+    }
+
+    outLayer->buffer = {data, layer.bufferWidth, layer.bufferHeight,
+                        uint32_t(bytesPerStride / bytesPerPixel), layer.bufferFormat};
+    outLayer->sourceCrop = layer.sourceCrop;
+    outLayer->displayFrame = layer.displayFrame;
+    outLayer->planeAlpha = layer.planeAlpha;
+    outLayer->transform = layer.transform;
+    outLayer->blendMode = layer.blendMode;
+    return true;
+}
+
+/*
+ * Composites all layers into one of our own framebuffer-capable buffers and
+ * posts it.  Only the damage accumulated since that buffer was last posted
+ * is redrawn; the rest of it still holds valid pixels.
+ */
+bool HWC2OnFbAdapter::compositeAndPost() {
+    const hwc_rect_t screen = {0, 0, int32_t(mFbInfo.width), int32_t(mFbInfo.height)};
+    if (!mLastPresentWasSoftware) {
+        for (auto& target : mTargets) {
+            target.damage.assign(1, screen);
+        }
+    }
+
+    for (const auto& rect : mRemovedLayerDamage) {
+        addDamage(rect);
+    }
+    mRemovedLayerDamage.clear();
+
+    std::vector<std::pair<uint32_t, Layer*>> sortedLayers;
+    sortedLayers.reserve(mLayers.size());
+    for (auto& [id, layer] : mLayers) {
+        if (layer.geometryChanged) {
+            addDamage(layer.lastDisplayFrame);
+            addDamage(layer.displayFrame);
+        } else if (layer.bufferChanged) {
+            SoftwareCompositor::Layer mapped;
+            mapped.sourceCrop = layer.sourceCrop;
+            mapped.displayFrame = layer.displayFrame;
+            mapped.transform = layer.transform;
+            if (layer.surfaceDamage.empty()) {
+                addDamage(layer.displayFrame);
+            }
+            for (const auto& rect : layer.surfaceDamage) {
+                addDamage(SoftwareCompositor::mapSourceRectToDisplay(mapped, rect));
+            }
+        }
+        layer.geometryChanged = false;
+        layer.bufferChanged = false;
+        layer.lastDisplayFrame = layer.displayFrame;
+        sortedLayers.emplace_back(layer.z, &layer);
+    }
+    std::sort(sortedLayers.begin(), sortedLayers.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    auto& target = mTargets[mNextTarget];
+    mNextTarget = (mNextTarget + 1) % kTargetCount;
+    if (!target.buffer) {
+        target.buffer = sp<GraphicBuffer>::make(mFbInfo.width, mFbInfo.height, mFbInfo.format, 1,
+                                                GRALLOC_USAGE_HW_FB | GRALLOC_USAGE_SW_WRITE_OFTEN |
+                                                        GRALLOC_USAGE_SW_READ_OFTEN,
+                                                "HWC2OnFbAdapter");
+        if (target.buffer->initCheck() != NO_ERROR) {
+            ALOGE("failed to allocate composition target");
+            target.buffer.clear();
+            return false;
+        }
+        target.damage.assign(1, screen);
+    }
+
+    mLastPresentWasSoftware = true;
+    if (!target.damage.empty()) {
+        hwc_rect_t damageBounds = target.damage[0];
+        for (const auto& rect : target.damage) {
+            damageBounds.left = std::min(damageBounds.left, rect.left);
+            damageBounds.top = std::min(damageBounds.top, rect.top);
+            damageBounds.right = std::max(damageBounds.right, rect.right);
+            damageBounds.bottom = std::max(damageBounds.bottom, rect.bottom);
+        }
+
+        // only map the layers that can contribute to the damage
+        std::vector<SoftwareCompositor::Layer> layers;
+        std::vector<buffer_handle_t> lockedBuffers;
+        bool layerLockFailed = false;
+        for (const auto& [z, layer] : sortedLayers) {
+            const auto& frame = layer->displayFrame;
+            if (frame.right <= damageBounds.left || frame.left >= damageBounds.right ||
+                frame.bottom <= damageBounds.top || frame.top >= damageBounds.bottom) {
+                continue;
+            }
+            SoftwareCompositor::Layer locked;
+            if (!lockLayer(*layer, &locked)) {
+                // posting the frame without the layer would drop it from the screen
+                ALOGE("failed to composite layer at z %u in software; falling back to client "
+                      "composition",
+                      z);
+                layer->bufferLockFailed = true;
+                layerLockFailed = true;
+                break;
+            }
+            layers.push_back(locked);
+            lockedBuffers.push_back(layer->buffer);
+        }
+
+        if (layerLockFailed) {
+            for (auto buffer : lockedBuffers) {
+                GraphicBufferMapper::get().unlock(buffer);
+            }
+            // the target keeps its damage for the next present
+            return false;
+        }
+
+        void* data = nullptr;
+        status_t error = target.buffer->lock(GRALLOC_USAGE_SW_WRITE_OFTEN |
+                                                     GRALLOC_USAGE_SW_READ_OFTEN,
+                                             &data);
+        if (error == NO_ERROR) {
+            SoftwareCompositor::Surface surface = {data, mFbInfo.width, mFbInfo.height,
+                                                   target.buffer->getStride(), mFbInfo.format};
+            mCompositor->composite(layers, surface, target.damage);
+            target.buffer->unlock();
+            target.damage.clear();
+        } else {
+            ALOGE("failed to lock composition target: %d", error);
+        }
+
+        for (auto buffer : lockedBuffers) {
+            GraphicBufferMapper::get().unlock(buffer);
+        }
+
+        // the target still holds an older frame; keep its damage for the next present
+        if (error != NO_ERROR) {
+            return false;
+        }
+    }
+
+    return mFbDevice->post(mFbDevice, target.buffer->handle) == 0;
+}
+
 void HWC2OnFbAdapter::setVsyncCallback(HWC2_PFN_VSYNC callback, hwc2_callback_data_t data) {
     mVsyncThread.setCallback(callback, data);
 }
@@ -0,0 +1,493 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "HWC2OnFbAdapter"
+
+//#define LOG_NDEBUG 0
+
+#include "hwc2onfbadapter/SoftwareCompositor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <sys/prctl.h>
+
+#include <hardware/hwcomposer2.h>
+#include <log/log.h>
+
+namespace android {
+
+namespace {
+
+// RGBA_8888 and RGBX_8888 are stored as R, G, B, A bytes; on our
+// little-endian targets that puts alpha in the top byte of a uint32_t.
+constexpr uint32_t kAlphaMask = 0xff000000u;
+
+constexpr uint32_t kMaxThreadCount = 4;
+
+typedef uint8_t U8x16 __attribute__((vector_size(16)));
+typedef uint16_t U16x16 __attribute__((vector_size(32)));
+
+constexpr U16x16 kAlphaLanes = {0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff};
+constexpr U16x16 kColorLaneMask = {0xffff, 0xffff, 0xffff, 0, 0xffff, 0xffff, 0xffff, 0,
+                                   0xffff, 0xffff, 0xffff, 0, 0xffff, 0xffff, 0xffff, 0};
+
+// x / 255, rounded, for x <= 255 * 255 + 127
+inline uint32_t div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+inline U16x16 div255(U16x16 x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+inline U16x16 splat(uint32_t value) {
+    return U16x16{} + static_cast<uint16_t>(value);
+}
+
+inline U16x16 splatAlpha(U16x16 v) {
+    return __builtin_shufflevector(v, v, 3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+}
+
+inline U16x16 load4(const uint32_t* pixels) {
+    U8x16 v;
+    memcpy(&v, pixels, sizeof(v));
+    return __builtin_convertvector(v, U16x16);
+}
+
+inline void store4(uint32_t* pixels, U16x16 v) {
+    U8x16 narrowed = __builtin_convertvector(v, U8x16);
+    memcpy(pixels, &narrowed, sizeof(narrowed));
+}
+
+enum class BlendOp {
+    // source alpha is ignored
+    OPAQUE,
+    PREMULTIPLIED,
+    COVERAGE,
+};
+
+// Blends count source pixels over dst.  Every channel is computed as
+//   out = (src * srcScale + dst * (255 - a)) / 255
+// where a is the effective source alpha.  Premultiplied sources are assumed
+// to satisfy color <= alpha, which keeps the sum within 16 bits.
+template <BlendOp op>
+void blendRow(uint32_t* dst, const uint32_t* src, size_t count, uint32_t planeAlpha) {
+    size_t i = 0;
+
+    if (op == BlendOp::OPAQUE && planeAlpha == 255) {
+        for (; i < count; i++) {
+            dst[i] = src[i] | kAlphaMask;
+        }
+        return;
+    }
+
+    const U16x16 pa = splat(planeAlpha);
+    for (; i + 4 <= count; i += 4) {
+        U16x16 s = load4(src + i);
+        U16x16 d = load4(dst + i);
+        U16x16 out;
+        if (op == BlendOp::OPAQUE) {
+            s |= kAlphaLanes;
+            out = div255(s * pa + d * (splat(255) - pa));
+        } else {
+            U16x16 a = div255(splatAlpha(s) * pa);
+            U16x16 srcScale = op == BlendOp::PREMULTIPLIED
+                    ? pa
+                    : (a & kColorLaneMask) | (pa & ~kColorLaneMask);
+            out = div255(s * srcScale + d * (splat(255) - a));
+        }
+        store4(dst + i, out);
+    }
+
+    for (; i < count; i++) {
+        uint32_t s = src[i];
+        uint32_t d = dst[i];
+        uint32_t srcAlpha = op == BlendOp::OPAQUE ? 255 : s >> 24;
+        uint32_t a = op == BlendOp::OPAQUE ? planeAlpha : div255(srcAlpha * planeAlpha);
+        uint32_t colorScale = op == BlendOp::COVERAGE ? a : planeAlpha;
+
+        uint32_t out = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            uint32_t sc = shift == 24 ? srcAlpha : (s >> shift) & 0xff;
+            uint32_t scale = shift == 24 ? planeAlpha : colorScale;
+            uint32_t dc = (d >> shift) & 0xff;
+            out |= div255(sc * scale + dc * (255 - a)) << shift;
+        }
+        dst[i] = out;
+    }
+}
+
+bool isEmpty(const hwc_rect_t& rect) {
+    return rect.left >= rect.right || rect.top >= rect.bottom;
+}
+
+hwc_rect_t intersect(const hwc_rect_t& a, const hwc_rect_t& b) {
+    return {std::max(a.left, b.left), std::max(a.top, b.top), std::min(a.right, b.right),
+            std::min(a.bottom, b.bottom)};
+}
+
+bool contains(const hwc_rect_t& outer, const hwc_rect_t& inner) {
+    return outer.left <= inner.left && outer.top <= inner.top && outer.right >= inner.right &&
+            outer.bottom >= inner.bottom;
+}
+
+void unite(hwc_rect_t* bounds, const hwc_rect_t& rect) {
+    if (isEmpty(*bounds)) {
+        *bounds = rect;
+        return;
+    }
+    bounds->left = std::min(bounds->left, rect.left);
+    bounds->top = std::min(bounds->top, rect.top);
+    bounds->right = std::max(bounds->right, rect.right);
+    bounds->bottom = std::max(bounds->bottom, rect.bottom);
+}
+
+// Maps normalized display frame coordinates to normalized source crop
+// coordinates.  HWC transforms flip first and then rotate clockwise, so the
+// inverse rotates counter-clockwise first.
+void displayToSource(int32_t transform, double nx, double ny, double* outU, double* outV) {
+    double u = nx;
+    double v = ny;
+    if (transform & HWC_TRANSFORM_ROT_90) {
+        u = ny;
+        v = 1.0 - nx;
+    }
+    if (transform & HWC_TRANSFORM_FLIP_H) {
+        u = 1.0 - u;
+    }
+    if (transform & HWC_TRANSFORM_FLIP_V) {
+        v = 1.0 - v;
+    }
+    *outU = u;
+    *outV = v;
+}
+
+void sourceToDisplay(int32_t transform, double u, double v, double* outNx, double* outNy) {
+    if (transform & HWC_TRANSFORM_FLIP_H) {
+        u = 1.0 - u;
+    }
+    if (transform & HWC_TRANSFORM_FLIP_V) {
+        v = 1.0 - v;
+    }
+    if (transform & HWC_TRANSFORM_ROT_90) {
+        *outNx = 1.0 - v;
+        *outNy = u;
+    } else {
+        *outNx = u;
+        *outNy = v;
+    }
+}
+
+bool isIntegral(float value) {
+    return std::floor(value) == value;
+}
+
+} // anonymous namespace
+
+SoftwareCompositor::SoftwareCompositor(uint32_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::clamp(std::thread::hardware_concurrency(), 1u, kMaxThreadCount);
+    }
+
+    mScratch.resize(threadCount, std::vector<uint32_t>(kTileWidth));
+    for (uint32_t i = 1; i < threadCount; i++) {
+        mThreads.emplace_back(&SoftwareCompositor::workerLoop, this, i);
+    }
+}
+
+SoftwareCompositor::~SoftwareCompositor() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWorkCondition.notify_all();
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+bool SoftwareCompositor::isFormatSupported(int32_t format) {
+    return format == HAL_PIXEL_FORMAT_RGBA_8888 || format == HAL_PIXEL_FORMAT_RGBX_8888;
+}
+
+bool SoftwareCompositor::isTransformSupported(int32_t transform) {
+    return (transform & ~(HWC_TRANSFORM_FLIP_H | HWC_TRANSFORM_FLIP_V | HWC_TRANSFORM_ROT_90)) == 0;
+}
+
+hwc_rect_t SoftwareCompositor::mapSourceRectToDisplay(const Layer& layer, const hwc_rect_t& rect) {
+    const auto& crop = layer.sourceCrop;
+    const auto& frame = layer.displayFrame;
+    double cropWidth = crop.right - crop.left;
+    double cropHeight = crop.bottom - crop.top;
+    if (cropWidth <= 0.0 || cropHeight <= 0.0) {
+        return {0, 0, 0, 0};
+    }
+
+    double minX = INFINITY;
+    double minY = INFINITY;
+    double maxX = -INFINITY;
+    double maxY = -INFINITY;
+    for (int32_t x : {rect.left, rect.right}) {
+        for (int32_t y : {rect.top, rect.bottom}) {
+            double nx, ny;
+            sourceToDisplay(layer.transform, (x - crop.left) / cropWidth,
+                            (y - crop.top) / cropHeight, &nx, &ny);
+            double px = frame.left + nx * (frame.right - frame.left);
+            double py = frame.top + ny * (frame.bottom - frame.top);
+            minX = std::min(minX, px);
+            minY = std::min(minY, py);
+            maxX = std::max(maxX, px);
+            maxY = std::max(maxY, py);
+        }
+    }
+
+    // grow by a pixel to cover nearest-neighbor rounding at the edges
+    hwc_rect_t mapped = {int32_t(std::floor(minX)) - 1, int32_t(std::floor(minY)) - 1,
+                         int32_t(std::ceil(maxX)) + 1, int32_t(std::ceil(maxY)) + 1};
+    return intersect(mapped, frame);
+}
+
+bool SoftwareCompositor::prepareLayer(const Layer& layer, LayerState* outState) {
+    const auto& buffer = layer.buffer;
+    const auto& crop = layer.sourceCrop;
+    const auto& frame = layer.displayFrame;
+    if (!buffer.data || !isFormatSupported(buffer.format) ||
+        !isTransformSupported(layer.transform) || isEmpty(frame) || crop.right <= crop.left ||
+        crop.bottom <= crop.top || layer.planeAlpha <= 0.0f) {
+        return false;
+    }
+
+    auto& state = *outState;
+    state.layer = &layer;
+    state.minX = std::max(0, int32_t(std::floor(crop.left)));
+    state.minY = std::max(0, int32_t(std::floor(crop.top)));
+    state.maxX = std::min(int32_t(buffer.width), int32_t(std::ceil(crop.right))) - 1;
+    state.maxY = std::min(int32_t(buffer.height), int32_t(std::ceil(crop.bottom))) - 1;
+    if (state.maxX < state.minX || state.maxY < state.minY) {
+        return false;
+    }
+
+    // the mapping is affine; evaluate it at three points to get coefficients
+    auto map = [&](double px, double py, double* sx, double* sy) {
+        double u, v;
+        displayToSource(layer.transform, (px - frame.left) / (frame.right - frame.left),
+                        (py - frame.top) / (frame.bottom - frame.top), &u, &v);
+        *sx = crop.left + u * (crop.right - crop.left);
+        *sy = crop.top + v * (crop.bottom - crop.top);
+    };
+    double x0, y0, x1, y1, x2, y2;
+    map(0.0, 0.0, &x0, &y0);
+    map(1.0, 0.0, &x1, &y1);
+    map(0.0, 1.0, &x2, &y2);
+    state.ax = x1 - x0;
+    state.bx = x2 - x0;
+    state.cx = x0;
+    state.ay = y1 - y0;
+    state.by = y2 - y0;
+    state.cy = y0;
+
+    // rows are read straight from the buffer, so the crop must lie within it
+    state.direct = layer.transform == 0 && isIntegral(crop.left) && isIntegral(crop.top) &&
+            crop.right - crop.left == frame.right - frame.left &&
+            crop.bottom - crop.top == frame.bottom - frame.top && crop.left >= 0.0f &&
+            crop.top >= 0.0f && crop.right <= float(buffer.width) &&
+            crop.bottom <= float(buffer.height);
+    state.opaque = layer.blendMode == HWC2_BLEND_MODE_NONE ||
+            buffer.format == HAL_PIXEL_FORMAT_RGBX_8888;
+    state.planeAlpha = uint32_t(std::lround(std::clamp(layer.planeAlpha, 0.0f, 1.0f) * 255.0f));
+
+    return state.planeAlpha > 0;
+}
+
+void SoftwareCompositor::composite(const std::vector<Layer>& layers, const Surface& target,
+                                   const std::vector<hwc_rect_t>& damage) {
+    if (!target.data || !isFormatSupported(target.format)) {
+        ALOGE("unsupported composition target");
+        return;
+    }
+
+    mLayerStates.clear();
+    for (const auto& layer : layers) {
+        LayerState state;
+        if (prepareLayer(layer, &state)) {
+            mLayerStates.push_back(state);
+        } else {
+            ALOGV("skipping layer with nothing to draw");
+        }
+    }
+    mTarget = target;
+
+    // split the damage into tiles, each shrunk to the damage it contains
+    const hwc_rect_t screen = {0, 0, int32_t(target.width), int32_t(target.height)};
+    const int32_t columns = (screen.right + kTileWidth - 1) / kTileWidth;
+    const int32_t rows = (screen.bottom + kTileHeight - 1) / kTileHeight;
+    std::vector<hwc_rect_t> cells(size_t(columns) * rows, hwc_rect_t{0, 0, 0, 0});
+    for (const auto& rect : damage) {
+        hwc_rect_t clipped = intersect(rect, screen);
+        if (isEmpty(clipped)) {
+            continue;
+        }
+        for (int32_t row = clipped.top / kTileHeight; row * kTileHeight < clipped.bottom; row++) {
+            for (int32_t column = clipped.left / kTileWidth; column * kTileWidth < clipped.right;
+                 column++) {
+                hwc_rect_t cell = {column * kTileWidth, row * kTileHeight,
+                                   (column + 1) * kTileWidth, (row + 1) * kTileHeight};
+                unite(&cells[size_t(row) * columns + column], intersect(clipped, cell));
+            }
+        }
+    }
+
+    mTiles.clear();
+    for (const auto& cell : cells) {
+        if (!isEmpty(cell)) {
+            mTiles.push_back(cell);
+        }
+    }
+    if (mTiles.empty()) {
+        return;
+    }
+
+    mNextTile = 0;
+    if (mThreads.empty() || mTiles.size() == 1) {
+        drawTiles(&mScratch[0]);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mGeneration++;
+        mBusyWorkers = mThreads.size();
+    }
+    mWorkCondition.notify_all();
+
+    drawTiles(&mScratch[0]);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDoneCondition.wait(lock, [this] { return mBusyWorkers == 0; });
+}
+
+void SoftwareCompositor::workerLoop(size_t index) {
+    prctl(PR_SET_NAME, "SwCompositor", 0, 0, 0);
+
+    // workers are created before the first composite() call
+    uint64_t generation = 0;
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mWorkCondition.wait(lock, [&] { return mStopping || mGeneration != generation; });
+        if (mStopping) {
+            break;
+        }
+        generation = mGeneration;
+
+        lock.unlock();
+        drawTiles(&mScratch[index]);
+        lock.lock();
+
+        if (--mBusyWorkers == 0) {
+            mDoneCondition.notify_one();
+        }
+    }
+}
+
+void SoftwareCompositor::drawTiles(std::vector<uint32_t>* scratch) {
+    while (true) {
+        size_t tile = mNextTile.fetch_add(1, std::memory_order_relaxed);
+        if (tile >= mTiles.size()) {
+            break;
+        }
+        drawTile(mTiles[tile], scratch);
+    }
+}
+
+void SoftwareCompositor::drawTile(const hwc_rect_t& tile, std::vector<uint32_t>* scratch) const {
+    // layers below an opaque layer covering the whole tile are invisible
+    size_t first = 0;
+    bool covered = false;
+    for (size_t i = mLayerStates.size(); i-- > 0;) {
+        const auto& state = mLayerStates[i];
+        if (state.opaque && state.planeAlpha == 255 &&
+            contains(state.layer->displayFrame, tile)) {
+            first = i;
+            covered = true;
+            break;
+        }
+    }
+
+    auto* const pixels = static_cast<uint32_t*>(mTarget.data);
+    for (int32_t y = tile.top; y < tile.bottom; y++) {
+        uint32_t* row = pixels + size_t(y) * mTarget.stride;
+        if (!covered) {
+            std::fill(row + tile.left, row + tile.right, 0u);
+        }
+
+        for (size_t i = first; i < mLayerStates.size(); i++) {
+            const auto& state = mLayerStates[i];
+            const auto& frame = state.layer->displayFrame;
+            if (y < frame.top || y >= frame.bottom) {
+                continue;
+            }
+            const int32_t left = std::max(tile.left, frame.left);
+            const int32_t right = std::min(tile.right, frame.right);
+            if (left >= right) {
+                continue;
+            }
+            const size_t count = size_t(right - left);
+
+            const auto& buffer = state.layer->buffer;
+            const auto* bufferPixels = static_cast<const uint32_t*>(buffer.data);
+            const uint32_t* src;
+            if (state.direct) {
+                int32_t sx = left - frame.left + int32_t(state.layer->sourceCrop.left);
+                int32_t sy = y - frame.top + int32_t(state.layer->sourceCrop.top);
+                src = bufferPixels + size_t(sy) * buffer.stride + sx;
+            } else {
+                // nearest-neighbor sampling in 16.16 fixed point
+                const double px = left + 0.5;
+                const double py = y + 0.5;
+                int64_t fx = std::llround((state.ax * px + state.bx * py + state.cx) * 65536.0);
+                int64_t fy = std::llround((state.ay * px + state.by * py + state.cy) * 65536.0);
+                const int64_t stepX = std::llround(state.ax * 65536.0);
+                const int64_t stepY = std::llround(state.ay * 65536.0);
+
+                uint32_t* fetched = scratch->data();
+                for (size_t j = 0; j < count; j++) {
+                    int32_t sx = std::clamp(int32_t(fx >> 16), state.minX, state.maxX);
+                    int32_t sy = std::clamp(int32_t(fy >> 16), state.minY, state.maxY);
+                    fetched[j] = bufferPixels[size_t(sy) * buffer.stride + sx];
+                    fx += stepX;
+                    fy += stepY;
+                }
+                src = fetched;
+            }
+
+            uint32_t* dst = row + left;
+            if (state.opaque) {
+                blendRow<BlendOp::OPAQUE>(dst, src, count, state.planeAlpha);
+            } else if (state.layer->blendMode == HWC2_BLEND_MODE_COVERAGE) {
+                blendRow<BlendOp::COVERAGE>(dst, src, count, state.planeAlpha);
+            } else {
+                blendRow<BlendOp::PREMULTIPLIED>(dst, src, count, state.planeAlpha);
+            }
+        }
+    }
+}
+
+} // namespace android
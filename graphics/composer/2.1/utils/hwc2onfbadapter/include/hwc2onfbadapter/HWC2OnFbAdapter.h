@@ -17,11 +17,15 @@
 #ifndef ANDROID_SF_HWC2_ON_FB_ADAPTER_H
 #define ANDROID_SF_HWC2_ON_FB_ADAPTER_H
 
+#include <array>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #define HWC2_INCLUDE_STRINGIFICATION
 #define HWC2_USE_CPP11
@@ -29,6 +33,10 @@
 #undef HWC2_INCLUDE_STRINGIFICATION
 #undef HWC2_USE_CPP11
 
+#include <ui/GraphicBuffer.h>
+
+#include "hwc2onfbadapter/SoftwareCompositor.h"
+
 struct framebuffer_device_t;
 
 namespace android {
@@ -67,15 +75,51 @@ public:
     void setState(State state);
     State getState() const;
 
+    // Layer state is only consumed by the software compositor.  Without it,
+    // every layer is composited by the client and the state is ignored.
+    struct Layer {
+        buffer_handle_t buffer{nullptr};
+        int32_t bufferFormat{0};
+        uint32_t bufferWidth{0};
+        uint32_t bufferHeight{0};
+        // the buffer could not be locked for reading; composite it by the client
+        bool bufferLockFailed{false};
+        // in buffer space; empty means the whole buffer is damaged
+        std::vector<hwc_rect_t> surfaceDamage;
+
+        int32_t compositionType{HWC2_COMPOSITION_INVALID};
+        int32_t blendMode{HWC2_BLEND_MODE_NONE};
+        int32_t dataspace{HAL_DATASPACE_UNKNOWN};
+        hwc_rect_t displayFrame{};
+        hwc_frect_t sourceCrop{};
+        float planeAlpha{1.0f};
+        int32_t transform{0};
+        uint32_t z{0};
+        bool hasSidebandStream{false};
+
+        // changes since the layer was last composited in software
+        bool geometryChanged{true};
+        bool bufferChanged{true};
+        hwc_rect_t lastDisplayFrame{};
+    };
+
     hwc2_layer_t addLayer();
     bool removeLayer(hwc2_layer_t layer);
     bool hasLayer(hwc2_layer_t layer) const;
-    bool markLayerDirty(hwc2_layer_t layer, bool dirty);
+    Layer* getLayer(hwc2_layer_t layer);
+    bool setLayerCompositionType(hwc2_layer_t layer, int32_t type);
+    bool setLayerBuffer(hwc2_layer_t layer, buffer_handle_t buffer);
     const std::unordered_set<hwc2_layer_t>& getDirtyLayers() const;
     void clearDirtyLayers();
 
+    void setColorTransform(bool identity);
+    bool canCompositeInSoftware() const;
+    void setSoftwareComposition(bool enable);
+    bool isSoftwareComposition() const;
+
     void setBuffer(buffer_handle_t buffer);
     bool postBuffer();
+    bool compositeAndPost();
 
     void setVsyncCallback(HWC2_PFN_VSYNC callback, hwc2_callback_data_t data);
     void enableVsync(bool enable);
@@ -90,11 +134,32 @@ private:
     State mState{State::MODIFIED};
 
     uint64_t mNextLayerId{0};
-    std::unordered_set<hwc2_layer_t> mLayers;
+    std::unordered_map<hwc2_layer_t, Layer> mLayers;
     std::unordered_set<hwc2_layer_t> mDirtyLayers;
 
     buffer_handle_t mBuffer{nullptr};
 
+    // software composition, enabled with ro.vendor.hwc2onfb.software_composition
+    void addDamage(const hwc_rect_t& rect);
+    bool lockLayer(const Layer& layer, SoftwareCompositor::Layer* outLayer);
+
+    std::unique_ptr<SoftwareCompositor> mCompositor;
+    bool mColorTransformIdentity{true};
+    bool mSoftwareComposition{false};
+    bool mLastPresentWasSoftware{false};
+    // display-space damage of layers destroyed since the last composition
+    std::vector<hwc_rect_t> mRemovedLayerDamage;
+
+    // Composition targets are reused round-robin.  Each remembers the damage
+    // accumulated since it was last drawn so that only that is redrawn.
+    struct Target {
+        sp<GraphicBuffer> buffer;
+        std::vector<hwc_rect_t> damage;
+    };
+    static constexpr size_t kTargetCount = 2;
+    std::array<Target, kTargetCount> mTargets;
+    size_t mNextTarget{0};
+
     std::unordered_set<HWC2::Capability> mCapabilities;
 
     class VsyncThread {
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_HWC2_ON_FB_SOFTWARE_COMPOSITOR_H
+#define ANDROID_SF_HWC2_ON_FB_SOFTWARE_COMPOSITOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <hardware/hwcomposer_defs.h>
+
+namespace android {
+
+/*
+ * SoftwareCompositor blends RGBA_8888/RGBX_8888 layers into an RGBA_8888 or
+ * RGBX_8888 target on the CPU.
+ *
+ * It knows nothing about gralloc or the framebuffer HAL.  Callers hand it
+ * mapped pixel memory, so it works the same with plain CPU buffers.
+ *
+ * Only the target pixels covered by the damage passed to composite() are
+ * written.  The damage is split into screen tiles which are drawn by a small
+ * pool of worker threads.
+ */
+class SoftwareCompositor {
+public:
+    struct Surface {
+        void* data{nullptr};
+        uint32_t width{0};
+        uint32_t height{0};
+        // in pixels
+        uint32_t stride{0};
+        int32_t format{0};
+    };
+
+    struct Layer {
+        Surface buffer;
+        hwc_frect_t sourceCrop{};
+        hwc_rect_t displayFrame{};
+        float planeAlpha{1.0f};
+        // a combination of HWC_TRANSFORM_* bits
+        int32_t transform{0};
+        // one of HWC2_BLEND_MODE_*
+        int32_t blendMode{0};
+    };
+
+    // threadCount includes the calling thread; 0 picks a default
+    explicit SoftwareCompositor(uint32_t threadCount = 0);
+    ~SoftwareCompositor();
+
+    SoftwareCompositor(const SoftwareCompositor&) = delete;
+    SoftwareCompositor& operator=(const SoftwareCompositor&) = delete;
+
+    static bool isFormatSupported(int32_t format);
+    static bool isTransformSupported(int32_t transform);
+
+    // Returns the display-space bounds that a change to the given rects of
+    // layer's buffer affects, clipped to the display frame.
+    static hwc_rect_t mapSourceRectToDisplay(const Layer& layer, const hwc_rect_t& rect);
+
+    // Composites the layers, bottom-most first, into target.  Pixels outside
+    // of damage are left untouched.
+    void composite(const std::vector<Layer>& layers, const Surface& target,
+                   const std::vector<hwc_rect_t>& damage);
+
+private:
+    static constexpr int32_t kTileWidth = 128;
+    static constexpr int32_t kTileHeight = 64;
+
+    // per-layer values derived once per composite() call
+    struct LayerState {
+        const Layer* layer;
+        // source pixel center = a * (x + 0.5) + b * (y + 0.5) + c
+        double ax, bx, cx;
+        double ay, by, cy;
+        // inclusive source pixel bounds used for sampling
+        int32_t minX, minY, maxX, maxY;
+        // true when a destination row maps to a contiguous source row
+        bool direct;
+        bool opaque;
+        uint32_t planeAlpha;
+    };
+
+    static bool prepareLayer(const Layer& layer, LayerState* outState);
+
+    void workerLoop(size_t index);
+    void drawTiles(std::vector<uint32_t>* scratch);
+    void drawTile(const hwc_rect_t& tile, std::vector<uint32_t>* scratch) const;
+
+    // state of the current composite() call, read-only while workers run
+    std::vector<LayerState> mLayerStates;
+    Surface mTarget;
+    std::vector<hwc_rect_t> mTiles;
+    std::atomic<size_t> mNextTile{0};
+
+    std::vector<std::thread> mThreads;
+    std::vector<std::vector<uint32_t>> mScratch;
+    std::mutex mMutex;
+    std::condition_variable mWorkCondition;
+    std::condition_variable mDoneCondition;
+    uint64_t mGeneration{0};
+    uint32_t mBusyWorkers{0};
+    bool mStopping{false};
+};
+
+} // namespace android
+
+#endif // ANDROID_SF_HWC2_ON_FB_SOFTWARE_COMPOSITOR_H
@@ -0,0 +1,192 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <hwc2onfbadapter/SoftwareCompositor.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <hardware/hwcomposer2.h>
+
+namespace android {
+namespace {
+
+constexpr uint32_t kGuard = 0xdeadbeefu;
+// the number of guard pixels around each buffer, to catch out of bounds reads
+constexpr uint32_t kGuardPixels = 64;
+
+// A CPU buffer surrounded by guard pixels
+class Buffer {
+public:
+    Buffer(uint32_t width, uint32_t height, int32_t format = HAL_PIXEL_FORMAT_RGBA_8888)
+          : mWidth(width),
+            mHeight(height),
+            mFormat(format),
+            mPixels(kGuardPixels * 2 + size_t(width) * height, kGuard) {}
+
+    uint32_t& at(uint32_t x, uint32_t y) { return mPixels[kGuardPixels + size_t(y) * mWidth + x]; }
+
+    void fill(uint32_t (*color)(uint32_t x, uint32_t y)) {
+        for (uint32_t y = 0; y < mHeight; y++) {
+            for (uint32_t x = 0; x < mWidth; x++) {
+                at(x, y) = color(x, y);
+            }
+        }
+    }
+
+    SoftwareCompositor::Surface surface() {
+        return {mPixels.data() + kGuardPixels, mWidth, mHeight, mWidth, mFormat};
+    }
+
+private:
+    const uint32_t mWidth;
+    const uint32_t mHeight;
+    const int32_t mFormat;
+    std::vector<uint32_t> mPixels;
+};
+
+// opaque, and unique per pixel
+uint32_t positionColor(uint32_t x, uint32_t y) {
+    return 0xff000000u | (y << 8) | x;
+}
+
+SoftwareCompositor::Layer makeLayer(Buffer* buffer, hwc_frect_t crop, hwc_rect_t frame) {
+    SoftwareCompositor::Layer layer;
+    layer.buffer = buffer->surface();
+    layer.sourceCrop = crop;
+    layer.displayFrame = frame;
+    layer.blendMode = HWC2_BLEND_MODE_NONE;
+    return layer;
+}
+
+class SoftwareCompositorTest : public ::testing::TestWithParam<uint32_t> {
+protected:
+    SoftwareCompositorTest() : mCompositor(GetParam()), mTarget(kWidth, kHeight) {
+        mTarget.fill([](uint32_t, uint32_t) { return 0x12345678u; });
+    }
+
+    void composite(const std::vector<SoftwareCompositor::Layer>& layers,
+                   const std::vector<hwc_rect_t>& damage = {{0, 0, kWidth, kHeight}}) {
+        mCompositor.composite(layers, mTarget.surface(), damage);
+    }
+
+    static constexpr int32_t kWidth = 200;
+    static constexpr int32_t kHeight = 150;
+
+    SoftwareCompositor mCompositor;
+    Buffer mTarget;
+};
+
+TEST_P(SoftwareCompositorTest, DirectCopy) {
+    Buffer source(100, 80);
+    source.fill(positionColor);
+    composite({makeLayer(&source, {10, 20, 60, 70}, {5, 7, 55, 57})});
+
+    for (uint32_t y = 0; y < kHeight; y++) {
+        for (uint32_t x = 0; x < kWidth; x++) {
+            bool inFrame = x >= 5 && x < 55 && y >= 7 && y < 57;
+            uint32_t expected = inFrame ? positionColor(x - 5 + 10, y - 7 + 20) : 0u;
+            ASSERT_EQ(expected, mTarget.at(x, y)) << "at " << x << "," << y;
+        }
+    }
+}
+
+TEST_P(SoftwareCompositorTest, ScaledAndRotated) {
+    Buffer source(4, 2);
+    source.fill(positionColor);
+    // 2x nearest-neighbor scaling, rotated by 90 degrees clockwise
+    auto layer = makeLayer(&source, {0, 0, 4, 2}, {0, 0, 4, 8});
+    layer.transform = HWC_TRANSFORM_ROT_90;
+    composite({layer});
+
+    for (uint32_t y = 0; y < 8; y++) {
+        for (uint32_t x = 0; x < 4; x++) {
+            uint32_t sx = y / 2;
+            uint32_t sy = 1 - x / 2;
+            ASSERT_EQ(positionColor(sx, sy), mTarget.at(x, y)) << "at " << x << "," << y;
+        }
+    }
+}
+
+TEST_P(SoftwareCompositorTest, EdgeTouchingCropIsDirect) {
+    Buffer source(40, 30);
+    source.fill(positionColor);
+    composite({makeLayer(&source, {0, 0, 40, 30}, {100, 100, 140, 130})});
+
+    EXPECT_EQ(positionColor(0, 0), mTarget.at(100, 100));
+    EXPECT_EQ(positionColor(39, 0), mTarget.at(139, 100));
+    EXPECT_EQ(positionColor(0, 29), mTarget.at(100, 129));
+    EXPECT_EQ(positionColor(39, 29), mTarget.at(139, 129));
+}
+
+TEST_P(SoftwareCompositorTest, CropOutsideOfBufferIsClamped) {
+    Buffer source(40, 30);
+    source.fill(positionColor);
+    // same size as the frame, but starting above and left of the buffer
+    composite({makeLayer(&source, {-5, -3, 35, 27}, {0, 0, 40, 30})});
+    EXPECT_EQ(positionColor(0, 0), mTarget.at(0, 0));
+    EXPECT_EQ(positionColor(0, 0), mTarget.at(4, 2));
+    EXPECT_EQ(positionColor(1, 1), mTarget.at(6, 4));
+
+    // past the right and bottom edges
+    composite({makeLayer(&source, {10, 10, 50, 40}, {0, 0, 40, 30})});
+    EXPECT_EQ(positionColor(39, 29), mTarget.at(39, 29));
+    EXPECT_EQ(positionColor(39, 19), mTarget.at(29, 9));
+    for (uint32_t y = 0; y < 30; y++) {
+        for (uint32_t x = 0; x < 40; x++) {
+            ASSERT_NE(kGuard, mTarget.at(x, y)) << "at " << x << "," << y;
+        }
+    }
+}
+
+TEST_P(SoftwareCompositorTest, OnlyDamageIsWritten) {
+    Buffer source(kWidth, kHeight);
+    source.fill(positionColor);
+    composite({makeLayer(&source, {0, 0, kWidth, kHeight}, {0, 0, kWidth, kHeight})},
+              {{10, 10, 20, 20}, {150, 100, 190, 140}});
+
+    for (uint32_t y = 0; y < kHeight; y++) {
+        for (uint32_t x = 0; x < kWidth; x++) {
+            bool damaged = (x >= 10 && x < 20 && y >= 10 && y < 20) ||
+                    (x >= 150 && x < 190 && y >= 100 && y < 140);
+            uint32_t expected = damaged ? positionColor(x, y) : 0x12345678u;
+            ASSERT_EQ(expected, mTarget.at(x, y)) << "at " << x << "," << y;
+        }
+    }
+}
+
+TEST_P(SoftwareCompositorTest, PremultipliedBlending) {
+    Buffer bottom(1, 1);
+    bottom.at(0, 0) = 0xff0000ffu;
+    Buffer top(1, 1);
+    // half transparent premultiplied green
+    top.at(0, 0) = 0x80008000u;
+    auto topLayer = makeLayer(&top, {0, 0, 1, 1}, {0, 0, 8, 8});
+    topLayer.blendMode = HWC2_BLEND_MODE_PREMULTIPLIED;
+    composite({makeLayer(&bottom, {0, 0, 1, 1}, {0, 0, 8, 8}), topLayer});
+
+    for (uint32_t y = 0; y < 8; y++) {
+        for (uint32_t x = 0; x < 8; x++) {
+            ASSERT_EQ(0xff00807fu, mTarget.at(x, y)) << "at " << x << "," << y;
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(ThreadCounts, SoftwareCompositorTest, ::testing::Values(1u, 4u));
+
+} // anonymous namespace
+} // namespace android
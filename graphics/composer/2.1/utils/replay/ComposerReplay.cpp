@@ -0,0 +1,302 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays a capture written by ComposerCommandCapture through
+// ComposerCommandEngine.  The commands go to a HAL that does nothing, so the
+// reported times are the overhead of the engine itself.  Each command is
+// split at the HAL call made for it:
+//
+//   parse        reading the command and looking up its resources, up to the
+//                HAL call
+//   dispatch     the HAL call
+//   encode       writing the results of the HAL call
+//
+// Commands that make no HAL call are counted as parse only.  The time spent
+// copying the results of a frame to the output queue is reported per frame.
+//
+// usage: android.hardware.graphics.composer@2.1-replay <capture> [iterations]
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <composer-hal/2.1/ComposerCommandEngine.h>
+#include <composer-hal/2.1/ComposerCommandRecorder.h>
+#include <composer-hal/2.1/ComposerHal.h>
+#include <composer-resources/2.1/ComposerResources.h>
+
+#include "StubComposerHal.h"
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace composer {
+namespace V2_1 {
+namespace hal {
+namespace {
+
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+// matches BufferQueue::NUM_BUFFER_SLOTS, which is what clients use
+constexpr uint32_t kBufferCacheSize = 64;
+
+// ReplayProfiler accumulates the times reported by the engine per command
+// type.
+class ReplayProfiler : public ComposerCommandRecorder {
+   public:
+    struct Stats {
+        uint64_t count = 0;
+        nanoseconds parse{0};
+        nanoseconds dispatch{0};
+        nanoseconds encode{0};
+    };
+
+    explicit ReplayProfiler(StubComposerHal* hal) : mHal(hal) {}
+
+    void onExecuteBegin(const uint32_t*, uint32_t, size_t) override {
+        StubComposerHal::Call call;
+        mHal->takeCall(&call);
+    }
+
+    void onCommandExecuted(IComposerClient::Command command, uint16_t,
+                           nanoseconds duration) override {
+        const auto end = steady_clock::now();
+        const auto begin = end - duration;
+
+        Stats& stats = mStats[command];
+        stats.count++;
+
+        StubComposerHal::Call call;
+        if (mHal->takeCall(&call)) {
+            stats.parse += call.entry - begin;
+            stats.dispatch += call.exit - call.entry;
+            stats.encode += end - call.exit;
+        } else {
+            stats.parse += duration;
+        }
+    }
+
+    void onExecuteEnd(Error, const uint32_t*, uint32_t length) override {
+        mResultLength += length;
+        mExecuteEnd = steady_clock::now();
+    }
+
+    const std::map<IComposerClient::Command, Stats>& getStats() const { return mStats; }
+    uint64_t getResultLength() const { return mResultLength; }
+    steady_clock::time_point getExecuteEnd() const { return mExecuteEnd; }
+
+   private:
+    StubComposerHal* const mHal;
+    std::map<IComposerClient::Command, Stats> mStats;
+    uint64_t mResultLength = 0;
+    steady_clock::time_point mExecuteEnd;
+};
+
+// Registers every display and layer referenced by the captured commands so
+// that the engine finds them in the resources.
+bool addResources(const std::vector<ComposerCommandCaptureReader::Frame>& frames,
+                  ComposerResources* resources) {
+    std::set<Display> displays;
+    std::set<std::pair<Display, Layer>> layers;
+
+    for (const auto& frame : frames) {
+        const auto& commands = frame.commands;
+        Display display = 0;
+        size_t offset = 0;
+        while (offset < commands.size()) {
+            const uint32_t header = commands[offset++];
+            const auto command = static_cast<IComposerClient::Command>(
+                    header & static_cast<uint32_t>(IComposerClient::Command::OPCODE_MASK));
+            const uint16_t length =
+                    header & static_cast<uint32_t>(IComposerClient::Command::LENGTH_MASK);
+            if (offset + length > commands.size()) {
+                fprintf(stderr, "truncated command 0x%x\n", static_cast<uint32_t>(command));
+                return false;
+            }
+
+            if (length == 2 && (command == IComposerClient::Command::SELECT_DISPLAY ||
+                                command == IComposerClient::Command::SELECT_LAYER)) {
+                const uint64_t id = commands[offset] |
+                                    (static_cast<uint64_t>(commands[offset + 1]) << 32);
+                if (command == IComposerClient::Command::SELECT_DISPLAY) {
+                    display = id;
+                    displays.insert(display);
+                } else {
+                    layers.emplace(display, id);
+                }
+            }
+
+            offset += length;
+        }
+    }
+
+    for (Display display : displays) {
+        if (resources->addPhysicalDisplay(display) != Error::NONE ||
+            resources->setDisplayClientTargetCacheSize(display, kBufferCacheSize) !=
+                    Error::NONE) {
+            fprintf(stderr, "failed to add display %" PRIu64 "\n", display);
+            return false;
+        }
+    }
+    for (const auto& [display, layer] : layers) {
+        if (resources->addLayer(display, layer, kBufferCacheSize) != Error::NONE) {
+            fprintf(stderr, "failed to add layer %" PRIu64 " of display %" PRIu64 "\n", layer,
+                    display);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+double toMicros(nanoseconds duration, uint64_t count) {
+    return count ? duration.count() / 1000.0 / count : 0.0;
+}
+
+int replay(const char* path, uint32_t iterations) {
+    auto reader = ComposerCommandCaptureReader::open(path);
+    if (!reader) {
+        fprintf(stderr, "failed to open capture %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<ComposerCommandCaptureReader::Frame> frames;
+    ComposerCommandCaptureReader::Frame frame;
+    size_t maxCommandLength = 0;
+    nanoseconds capturedTime{0};
+    while (reader->readFrame(&frame)) {
+        maxCommandLength = std::max(maxCommandLength, frame.commands.size());
+        capturedTime += nanoseconds(frame.header.durationNs);
+        frames.push_back(std::move(frame));
+    }
+    if (frames.empty()) {
+        fprintf(stderr, "no frames in %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    // The resources are not initialized with a mapper.  Captured handles are
+    // replaced by empty ones, which are never imported.
+    auto resources = std::make_unique<ComposerResources>();
+    if (!addResources(frames, resources.get())) {
+        return EXIT_FAILURE;
+    }
+
+    StubComposerHal hal;
+    auto profiler = std::make_shared<ReplayProfiler>(&hal);
+    ComposerCommandEngine engine(&hal, resources.get());
+    engine.setCommandRecorder(profiler);
+
+    CommandQueueType inputQueue(maxCommandLength);
+    if (!inputQueue.isValid() || !engine.setInputMQDescriptor(*inputQueue.getDesc())) {
+        fprintf(stderr, "failed to create the command queue\n");
+        return EXIT_FAILURE;
+    }
+
+    // read back the results like a client, so that they are not discarded
+    // as stale data by the next frame
+    std::unique_ptr<CommandQueueType> outputQueue;
+    std::vector<uint32_t> results;
+
+    nanoseconds queueWriteTime{0};
+    nanoseconds executeTime{0};
+    uint64_t failedFrames = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        for (const auto& replayed : frames) {
+            if (!inputQueue.write(replayed.commands.data(), replayed.commands.size())) {
+                fprintf(stderr, "failed to write commands to the queue\n");
+                return EXIT_FAILURE;
+            }
+
+            hidl_vec<hidl_handle> handles(replayed.header.handleCount);
+            bool queueChanged;
+            uint32_t resultLength;
+            hidl_vec<hidl_handle> resultHandles;
+
+            const auto start = steady_clock::now();
+            Error error = engine.execute(replayed.commands.size(), handles, &queueChanged,
+                                         &resultLength, &resultHandles);
+            const auto end = steady_clock::now();
+            engine.reset();
+
+            executeTime += end - start;
+            if (error != Error::NONE) {
+                failedFrames++;
+                continue;
+            }
+            queueWriteTime += end - profiler->getExecuteEnd();
+
+            if (queueChanged) {
+                outputQueue = std::make_unique<CommandQueueType>(*engine.getOutputMQDescriptor(),
+                                                                 false);
+            }
+            results.resize(resultLength);
+            if (resultLength > 0 &&
+                (!outputQueue || !outputQueue->read(results.data(), resultLength))) {
+                fprintf(stderr, "failed to read results from the queue\n");
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    const uint64_t frameCount = static_cast<uint64_t>(frames.size()) * iterations;
+    printf("%zu frames, %" PRIu32 " iterations, %" PRIu64 " failed\n", frames.size(), iterations,
+           failedFrames);
+    printf("captured execute:  %10.3f us/frame\n", toMicros(capturedTime, frames.size()));
+    printf("replayed execute:  %10.3f us/frame\n", toMicros(executeTime, frameCount));
+    printf("queue write:       %10.3f us/frame, %.1f result words/frame\n",
+           toMicros(queueWriteTime, frameCount),
+           static_cast<double>(profiler->getResultLength()) / frameCount);
+    printf("\n%-36s %10s %12s %12s %12s\n", "command", "count", "parse", "dispatch",
+           "encode");
+    for (const auto& [command, stats] : profiler->getStats()) {
+        printf("%-36s %10" PRIu64 " %9.3f us %9.3f us %9.3f us\n", toString(command).c_str(),
+               stats.count, toMicros(stats.parse, stats.count),
+               toMicros(stats.dispatch, stats.count), toMicros(stats.encode, stats.count));
+    }
+
+    return EXIT_SUCCESS;
+}
+
+}  // namespace
+}  // namespace hal
+}  // namespace V2_1
+}  // namespace composer
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s <capture> [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const uint32_t iterations = argc == 3 ? static_cast<uint32_t>(atoi(argv[2])) : 1;
+    if (iterations == 0) {
+        fprintf(stderr, "invalid iteration count %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    return android::hardware::graphics::composer::V2_1::hal::replay(argv[1], iterations);
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+#include <android-base/file.h>
+#include <composer-hal/2.1/ComposerCommandEngine.h>
+#include <composer-hal/2.1/ComposerCommandRecorder.h>
+#include <composer-resources/2.1/ComposerResources.h>
+#include <gtest/gtest.h>
+
+#include "StubComposerHal.h"
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace composer {
+namespace V2_1 {
+namespace hal {
+namespace {
+
+constexpr Display kDisplay = 1;
+constexpr Layer kLayer = 2;
+constexpr uint32_t kCacheSize = 4;
+constexpr size_t kQueueSize = 1024;
+
+// Executes commands through engine, like a client would, and returns the
+// results read back from the output queue.
+Error execute(ComposerCommandEngine* engine, CommandQueueType* inputQueue,
+              const std::vector<uint32_t>& commands,
+              std::unique_ptr<CommandQueueType>* outputQueue, std::vector<uint32_t>* outResults) {
+    if (!inputQueue->write(commands.data(), commands.size())) {
+        return Error::NO_RESOURCES;
+    }
+
+    hidl_vec<hidl_handle> handles;
+    bool queueChanged = false;
+    uint32_t resultLength = 0;
+    hidl_vec<hidl_handle> resultHandles;
+    Error error =
+            engine->execute(commands.size(), handles, &queueChanged, &resultLength, &resultHandles);
+    engine->reset();
+    if (error != Error::NONE) {
+        return error;
+    }
+
+    if (queueChanged) {
+        *outputQueue = std::make_unique<CommandQueueType>(*engine->getOutputMQDescriptor(), false);
+    }
+    outResults->resize(resultLength);
+    if (resultLength > 0 &&
+        (!*outputQueue || !(*outputQueue)->read(outResults->data(), resultLength))) {
+        return Error::NO_RESOURCES;
+    }
+    return Error::NONE;
+}
+
+bool hasCommand(const std::vector<uint32_t>& commands, IComposerClient::Command command) {
+    size_t offset = 0;
+    while (offset < commands.size()) {
+        const uint32_t header = commands[offset];
+        if ((header & static_cast<uint32_t>(IComposerClient::Command::OPCODE_MASK)) ==
+            static_cast<uint32_t>(command)) {
+            return true;
+        }
+        offset += 1 + (header & static_cast<uint32_t>(IComposerClient::Command::LENGTH_MASK));
+    }
+    return false;
+}
+
+class ComposerCaptureTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        ASSERT_TRUE(mInputQueue.isValid());
+        ASSERT_EQ(Error::NONE, mResources.addPhysicalDisplay(kDisplay));
+        ASSERT_EQ(Error::NONE, mResources.setDisplayClientTargetCacheSize(kDisplay, kCacheSize));
+        ASSERT_EQ(Error::NONE, mResources.addLayer(kDisplay, kLayer, kCacheSize));
+
+        // a frame updating a layer, with a client target in a slot past the
+        // end of the cache, which makes the engine report an error
+        CommandWriterBase writer(kQueueSize);
+        writer.selectDisplay(kDisplay);
+        writer.selectLayer(kLayer);
+        writer.setLayerZOrder(3);
+        writer.setLayerPlaneAlpha(0.5f);
+        writer.setClientTarget(kCacheSize, nullptr, -1, Dataspace::UNKNOWN, {});
+        writer.validateDisplay();
+        writer.acceptDisplayChanges();
+        writer.presentDisplay();
+        mFrames.emplace_back(writer.getData(), writer.getData() + writer.getDataLength());
+
+        // a frame presenting without changes
+        writer.reset();
+        writer.selectDisplay(kDisplay);
+        writer.presentDisplay();
+        mFrames.emplace_back(writer.getData(), writer.getData() + writer.getDataLength());
+    }
+
+    // Executes mFrames through a new engine, returning the results of each.
+    std::vector<std::vector<uint32_t>> executeFrames(
+            StubComposerHal* hal, std::shared_ptr<ComposerCommandRecorder> recorder) {
+        ComposerCommandEngine engine(hal, &mResources);
+        engine.setCommandRecorder(std::move(recorder));
+        EXPECT_TRUE(engine.setInputMQDescriptor(*mInputQueue.getDesc()));
+
+        std::unique_ptr<CommandQueueType> outputQueue;
+        std::vector<std::vector<uint32_t>> results(mFrames.size());
+        for (size_t i = 0; i < mFrames.size(); i++) {
+            EXPECT_EQ(Error::NONE,
+                      execute(&engine, &mInputQueue, mFrames[i], &outputQueue, &results[i]));
+        }
+        return results;
+    }
+
+    CommandQueueType mInputQueue{kQueueSize};
+    ComposerResources mResources;
+    std::vector<std::vector<uint32_t>> mFrames;
+};
+
+TEST_F(ComposerCaptureTest, CaptureAndReplay) {
+    TemporaryFile file;
+    StubComposerHal capturedHal;
+    std::shared_ptr<ComposerCommandCapture> capture = ComposerCommandCapture::create(file.path);
+    ASSERT_NE(nullptr, capture);
+    const auto capturedResults = executeFrames(&capturedHal, capture);
+    // closes the file
+    capture.reset();
+
+    // the first frame reports the bad client target slot
+    EXPECT_TRUE(hasCommand(capturedResults[0], IComposerClient::Command::SET_ERROR));
+    EXPECT_FALSE(hasCommand(capturedResults[1], IComposerClient::Command::SET_ERROR));
+
+    auto reader = ComposerCommandCaptureReader::open(file.path);
+    ASSERT_NE(nullptr, reader);
+    std::vector<ComposerCommandCaptureReader::Frame> frames;
+    ComposerCommandCaptureReader::Frame frame;
+    while (reader->readFrame(&frame)) {
+        frames.push_back(frame);
+    }
+    ASSERT_EQ(mFrames.size(), frames.size());
+    for (size_t i = 0; i < frames.size(); i++) {
+        SCOPED_TRACE(i);
+        EXPECT_EQ(mFrames[i], frames[i].commands);
+        EXPECT_EQ(capturedResults[i], frames[i].results);
+        EXPECT_EQ(0u, frames[i].header.handleCount);
+        EXPECT_EQ(static_cast<int32_t>(Error::NONE), frames[i].header.error);
+        EXPECT_GE(frames[i].header.durationNs, 0);
+    }
+
+    // replaying the captured commands gives the same results and HAL calls
+    mFrames.clear();
+    for (const auto& captured : frames) {
+        mFrames.push_back(captured.commands);
+    }
+    StubComposerHal replayedHal;
+    EXPECT_EQ(capturedResults, executeFrames(&replayedHal, nullptr));
+    EXPECT_EQ(capturedHal.getCallCount(), replayedHal.getCallCount());
+}
+
+TEST_F(ComposerCaptureTest, TruncatedCaptureStopsReading) {
+    TemporaryFile file;
+    StubComposerHal hal;
+    std::shared_ptr<ComposerCommandCapture> capture = ComposerCommandCapture::create(file.path);
+    ASSERT_NE(nullptr, capture);
+    executeFrames(&hal, capture);
+    capture.reset();
+
+    // cut the last word of the last frame
+    off_t size = lseek(file.fd, 0, SEEK_END);
+    ASSERT_GT(size, 0);
+    ASSERT_EQ(0, ftruncate(file.fd, size - sizeof(uint32_t)));
+
+    auto reader = ComposerCommandCaptureReader::open(file.path);
+    ASSERT_NE(nullptr, reader);
+    ComposerCommandCaptureReader::Frame frame;
+    EXPECT_TRUE(reader->readFrame(&frame));
+    EXPECT_EQ(mFrames[0], frame.commands);
+    EXPECT_FALSE(reader->readFrame(&frame));
+}
+
+TEST_F(ComposerCaptureTest, RejectsOtherFiles) {
+    TemporaryFile file;
+    ASSERT_TRUE(base::WriteStringToFd("not a capture", file.fd));
+    EXPECT_EQ(nullptr, ComposerCommandCaptureReader::open(file.path));
+}
+
+}  // namespace
+}  // namespace hal
+}  // namespace V2_1
+}  // namespace composer
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,152 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <composer-hal/2.1/ComposerHal.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace composer {
+namespace V2_1 {
+namespace hal {
+
+// StubComposerHal accepts every command and remembers when it was called.
+class StubComposerHal : public ComposerHal {
+   public:
+    struct Call {
+        std::chrono::steady_clock::time_point entry;
+        std::chrono::steady_clock::time_point exit;
+    };
+
+    // Returns the number of HAL calls that execute commands.
+    uint64_t getCallCount() const { return mCallCount; }
+
+    // Returns the span of the HAL calls made since the last call, if any.
+    bool takeCall(Call* outCall) {
+        *outCall = mCall;
+        return std::exchange(mCalled, false);
+    }
+
+    bool hasCapability(hwc2_capability_t) override { return false; }
+    std::string dumpDebugInfo() override { return std::string(); }
+    void registerEventCallback(EventCallback*) override {}
+    void unregisterEventCallback() override {}
+
+    uint32_t getMaxVirtualDisplayCount() override { return 0; }
+    Error createVirtualDisplay(uint32_t, uint32_t, PixelFormat*, Display*) override {
+        return Error::NO_RESOURCES;
+    }
+    Error destroyVirtualDisplay(Display) override { return Error::BAD_DISPLAY; }
+    Error createLayer(Display, Layer*) override { return Error::NO_RESOURCES; }
+    Error destroyLayer(Display, Layer) override { return Error::BAD_LAYER; }
+
+    Error getActiveConfig(Display, Config*) override { return Error::UNSUPPORTED; }
+    Error getClientTargetSupport(Display, uint32_t, uint32_t, PixelFormat, Dataspace) override {
+        return Error::UNSUPPORTED;
+    }
+    Error getColorModes(Display, hidl_vec<ColorMode>*) override { return Error::UNSUPPORTED; }
+    Error getDisplayAttribute(Display, Config, IComposerClient::Attribute, int32_t*) override {
+        return Error::UNSUPPORTED;
+    }
+    Error getDisplayConfigs(Display, hidl_vec<Config>*) override { return Error::UNSUPPORTED; }
+    Error getDisplayName(Display, hidl_string*) override { return Error::UNSUPPORTED; }
+    Error getDisplayType(Display, IComposerClient::DisplayType*) override {
+        return Error::UNSUPPORTED;
+    }
+    Error getDozeSupport(Display, bool*) override { return Error::UNSUPPORTED; }
+    Error getHdrCapabilities(Display, hidl_vec<Hdr>*, float*, float*, float*) override {
+        return Error::UNSUPPORTED;
+    }
+
+    Error setActiveConfig(Display, Config) override { return Error::UNSUPPORTED; }
+    Error setColorMode(Display, ColorMode) override { return Error::UNSUPPORTED; }
+    Error setPowerMode(Display, IComposerClient::PowerMode) override { return Error::UNSUPPORTED; }
+    Error setVsyncEnabled(Display, IComposerClient::Vsync) override { return Error::UNSUPPORTED; }
+
+    Error setColorTransform(Display, const float*, int32_t) override { return dispatch(); }
+    Error setClientTarget(Display, buffer_handle_t, int32_t, int32_t,
+                          const std::vector<hwc_rect_t>&) override {
+        return dispatch();
+    }
+    Error setOutputBuffer(Display, buffer_handle_t, int32_t) override {
+        return dispatch();
+    }
+    Error validateDisplay(Display, std::vector<Layer>*, std::vector<IComposerClient::Composition>*,
+                          uint32_t* outDisplayRequestMask, std::vector<Layer>*,
+                          std::vector<uint32_t>*) override {
+        *outDisplayRequestMask = 0;
+        return dispatch();
+    }
+    Error acceptDisplayChanges(Display) override { return dispatch(); }
+    Error presentDisplay(Display, int32_t* outPresentFence, std::vector<Layer>*,
+                         std::vector<int32_t>*) override {
+        *outPresentFence = -1;
+        return dispatch();
+    }
+
+    Error setLayerCursorPosition(Display, Layer, int32_t, int32_t) override { return dispatch(); }
+    Error setLayerBuffer(Display, Layer, buffer_handle_t, int32_t) override {
+        return dispatch();
+    }
+    Error setLayerSurfaceDamage(Display, Layer, const std::vector<hwc_rect_t>&) override {
+        return dispatch();
+    }
+    Error setLayerBlendMode(Display, Layer, int32_t) override { return dispatch(); }
+    Error setLayerColor(Display, Layer, IComposerClient::Color) override { return dispatch(); }
+    Error setLayerCompositionType(Display, Layer, int32_t) override { return dispatch(); }
+    Error setLayerDataspace(Display, Layer, int32_t) override { return dispatch(); }
+    Error setLayerDisplayFrame(Display, Layer, const hwc_rect_t&) override { return dispatch(); }
+    Error setLayerPlaneAlpha(Display, Layer, float) override { return dispatch(); }
+    Error setLayerSidebandStream(Display, Layer, buffer_handle_t) override { return dispatch(); }
+    Error setLayerSourceCrop(Display, Layer, const hwc_frect_t&) override { return dispatch(); }
+    Error setLayerTransform(Display, Layer, int32_t) override { return dispatch(); }
+    Error setLayerVisibleRegion(Display, Layer, const std::vector<hwc_rect_t>&) override {
+        return dispatch();
+    }
+    Error setLayerZOrder(Display, Layer, uint32_t) override { return dispatch(); }
+
+   private:
+    // A command may make more than one HAL call, e.g., when presentDisplay
+    // falls back to validateDisplay.  The span covers all of them.
+    Error dispatch() {
+        mCallCount++;
+        const auto entry = std::chrono::steady_clock::now();
+        if (!mCalled) {
+            mCall.entry = entry;
+            mCalled = true;
+        }
+        mCall.exit = std::chrono::steady_clock::now();
+        return Error::NONE;
+    }
+
+    Call mCall;
+    bool mCalled = false;
+    uint64_t mCallCount = 0;
+};
+
+}  // namespace hal
+}  // namespace V2_1
+}  // namespace composer
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
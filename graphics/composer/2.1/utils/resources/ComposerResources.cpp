@@ -18,6 +18,8 @@
 
 #include "composer-resources/2.1/ComposerResources.h"
 
+#include <algorithm>
+
 namespace android {
 namespace hardware {
 namespace graphics {
@@ -25,6 +27,14 @@ namespace composer {
 namespace V2_1 {
 namespace hal {
 
+namespace {
+
+// the generation of the next cache slot update, shared by all caches so that
+// a generation is never repeated; 0 is left for slots never updated
+std::atomic<uint64_t> sNextSlotGeneration{1};
+
+}  // namespace
+
 bool ComposerHandleImporter::init() {
     mMapper4 = mapper::V4_0::IMapper::getService();
     if (mMapper4) {
@@ -122,12 +132,22 @@ void ComposerHandleImporter::freeStream(const native_handle_t* streamHandle) {
 
 ComposerHandleCache::ComposerHandleCache(ComposerHandleImporter& importer, HandleType type,
                                          uint32_t cacheSize)
-    : mImporter(importer), mHandleType(type), mHandles(cacheSize, nullptr) {}
+    : mImporter(importer),
+      mHandleType(type),
+      mHandles(cacheSize, nullptr),
+      mGenerations(std::make_shared<ComposerSlotGenerations>(cacheSize)) {}
 
 // must be initialized later with initCache
 ComposerHandleCache::ComposerHandleCache(ComposerHandleImporter& importer) : mImporter(importer) {}
 
 ComposerHandleCache::~ComposerHandleCache() {
+    // invalidate the handles found in this cache before they are freed
+    if (mGenerations) {
+        for (auto& generation : *mGenerations) {
+            generation.store(0, std::memory_order_release);
+        }
+    }
+
     switch (mHandleType) {
         case HandleType::BUFFER:
             for (auto handle : mHandles) {
@@ -156,13 +176,16 @@ bool ComposerHandleCache::initCache(HandleType type, uint32_t cacheSize) {
 
     mHandleType = type;
     mHandles.resize(cacheSize, nullptr);
+    mGenerations = std::make_shared<ComposerSlotGenerations>(cacheSize);
 
     return true;
 }
 
-Error ComposerHandleCache::lookupCache(uint32_t slot, const native_handle_t** outHandle) {
+Error ComposerHandleCache::lookupCache(uint32_t slot, const native_handle_t** outHandle,
+                                       ComposerCachedHandle* outCachedHandle) {
     if (slot >= 0 && slot < mHandles.size()) {
         *outHandle = mHandles[slot];
+        getCachedHandle(slot, outCachedHandle);
         return Error::NONE;
     } else {
         return Error::BAD_PARAMETER;
@@ -170,11 +193,15 @@ Error ComposerHandleCache::lookupCache(uint32_t slot, const native_handle_t** ou
 }
 
 Error ComposerHandleCache::updateCache(uint32_t slot, const native_handle_t* handle,
-                                       const native_handle** outReplacedHandle) {
+                                       const native_handle** outReplacedHandle,
+                                       ComposerCachedHandle* outCachedHandle) {
     if (slot >= 0 && slot < mHandles.size()) {
         auto& cachedHandle = mHandles[slot];
         *outReplacedHandle = cachedHandle;
         cachedHandle = handle;
+        (*mGenerations)[slot].store(sNextSlotGeneration.fetch_add(1, std::memory_order_relaxed),
+                                    std::memory_order_release);
+        getCachedHandle(slot, outCachedHandle);
         return Error::NONE;
     } else {
         return Error::BAD_PARAMETER;
@@ -184,13 +211,33 @@ Error ComposerHandleCache::updateCache(uint32_t slot, const native_handle_t* han
 // when fromCache is true, look up in the cache; otherwise, update the cache
 Error ComposerHandleCache::getHandle(uint32_t slot, bool fromCache, const native_handle_t* inHandle,
                                      const native_handle_t** outHandle,
-                                     const native_handle** outReplacedHandle) {
+                                     const native_handle** outReplacedHandle,
+                                     ComposerCachedHandle* outCachedHandle) {
     if (fromCache) {
         *outReplacedHandle = nullptr;
-        return lookupCache(slot, outHandle);
+        return lookupCache(slot, outHandle, outCachedHandle);
     } else {
         *outHandle = inHandle;
-        return updateCache(slot, inHandle, outReplacedHandle);
+        return updateCache(slot, inHandle, outReplacedHandle, outCachedHandle);
+    }
+}
+
+void ComposerHandleCache::getCachedHandle(uint32_t slot,
+                                          ComposerCachedHandle* outCachedHandle) const {
+    if (!outCachedHandle) {
+        return;
+    }
+
+    // A slot that was never updated has no generation to tell it from a
+    // destroyed cache, and is not worth remembering anyway.
+    const uint64_t generation = (*mGenerations)[slot].load(std::memory_order_relaxed);
+    if (generation) {
+        outCachedHandle->mGenerations = mGenerations;
+        outCachedHandle->mSlot = slot;
+        outCachedHandle->mGeneration = generation;
+        outCachedHandle->mHandle = mHandles[slot];
+    } else {
+        *outCachedHandle = ComposerCachedHandle();
     }
 }
 
@@ -202,8 +249,10 @@ ComposerLayerResource::ComposerLayerResource(ComposerHandleImporter& importer,
 Error ComposerLayerResource::getBuffer(uint32_t slot, bool fromCache,
                                        const native_handle_t* inHandle,
                                        const native_handle_t** outHandle,
-                                       const native_handle** outReplacedHandle) {
-    return mBufferCache.getHandle(slot, fromCache, inHandle, outHandle, outReplacedHandle);
+                                       const native_handle** outReplacedHandle,
+                                       ComposerCachedHandle* outCachedHandle) {
+    return mBufferCache.getHandle(slot, fromCache, inHandle, outHandle, outReplacedHandle,
+                                  outCachedHandle);
 }
 
 Error ComposerLayerResource::getSidebandStream(uint32_t slot, bool fromCache,
@@ -239,8 +288,10 @@ bool ComposerDisplayResource::isVirtual() const {
 Error ComposerDisplayResource::getClientTarget(uint32_t slot, bool fromCache,
                                                const native_handle_t* inHandle,
                                                const native_handle_t** outHandle,
-                                               const native_handle** outReplacedHandle) {
-    return mClientTargetCache.getHandle(slot, fromCache, inHandle, outHandle, outReplacedHandle);
+                                               const native_handle** outReplacedHandle,
+                                               ComposerCachedHandle* outCachedHandle) {
+    return mClientTargetCache.getHandle(slot, fromCache, inHandle, outHandle, outReplacedHandle,
+                                        outCachedHandle);
 }
 
 Error ComposerDisplayResource::getOutputBuffer(uint32_t slot, bool fromCache,
@@ -250,30 +301,52 @@ Error ComposerDisplayResource::getOutputBuffer(uint32_t slot, bool fromCache,
     return mOutputBufferCache.getHandle(slot, fromCache, inHandle, outHandle, outReplacedHandle);
 }
 
+std::vector<ComposerDisplayResource::LayerEntry>::iterator ComposerDisplayResource::lowerBoundLayer(
+        Layer layer) {
+    return std::lower_bound(
+            mLayerResources.begin(), mLayerResources.end(), layer,
+            [](const LayerEntry& entry, Layer value) { return entry.first < value; });
+}
+
 bool ComposerDisplayResource::addLayer(Layer layer,
                                        std::unique_ptr<ComposerLayerResource> layerResource) {
-    auto result = mLayerResources.emplace(layer, std::move(layerResource));
-    return result.second;
+    auto layerIter = lowerBoundLayer(layer);
+    if (layerIter != mLayerResources.end() && layerIter->first == layer) {
+        return false;
+    }
+    mLayerResources.emplace(layerIter, layer, std::move(layerResource));
+    return true;
 }
 
 bool ComposerDisplayResource::removeLayer(Layer layer) {
-    return mLayerResources.erase(layer) > 0;
+    auto layerIter = lowerBoundLayer(layer);
+    if (layerIter == mLayerResources.end() || layerIter->first != layer) {
+        return false;
+    }
+    mLayerResources.erase(layerIter);
+    return true;
 }
 
 ComposerLayerResource* ComposerDisplayResource::findLayerResource(Layer layer) {
-    auto layerIter = mLayerResources.find(layer);
-    if (layerIter == mLayerResources.end()) {
+    if (mLastLayerIndex < mLayerResources.size() &&
+        mLayerResources[mLastLayerIndex].first == layer) {
+        return mLayerResources[mLastLayerIndex].second.get();
+    }
+
+    auto layerIter = lowerBoundLayer(layer);
+    if (layerIter == mLayerResources.end() || layerIter->first != layer) {
         return nullptr;
     }
 
+    mLastLayerIndex = layerIter - mLayerResources.begin();
     return layerIter->second.get();
 }
 
 std::vector<Layer> ComposerDisplayResource::getLayers() const {
     std::vector<Layer> layers;
     layers.reserve(mLayerResources.size());
-    for (const auto& layerKey : mLayerResources) {
-        layers.push_back(layerKey.first);
+    for (const auto& layerEntry : mLayerResources) {
+        layers.push_back(layerEntry.first);
     }
     return layers;
 }
@@ -303,6 +376,7 @@ void ComposerResources::clear(RemoveDisplay removeDisplay) {
         removeDisplay(display, displayResource.isVirtual(), displayResource.getLayers());
     }
     mDisplayResources.clear();
+    mLastDisplayResource = nullptr;
 }
 
 bool ComposerResources::hasDisplay(Display display) {
@@ -328,6 +402,9 @@ Error ComposerResources::addVirtualDisplay(Display display, uint32_t outputBuffe
 
 Error ComposerResources::removeDisplay(Display display) {
     std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+    if (mLastDisplayResource && mLastDisplay == display) {
+        mLastDisplayResource = nullptr;
+    }
     return mDisplayResources.erase(display) > 0 ? Error::NONE : Error::BAD_DISPLAY;
 }
 
@@ -386,12 +463,51 @@ Error ComposerResources::removeLayer(Display display, Layer layer) {
     return displayResource->removeLayer(layer) ? Error::NONE : Error::BAD_LAYER;
 }
 
+void ComposerResources::ImportedBuffers::clear() {
+    for (const auto& buffer : mBuffers) {
+        mImporter->freeBuffer(buffer.bufferHandle);
+    }
+    mBuffers.clear();
+    mNextBuffer = 0;
+}
+
+bool ComposerResources::ImportedBuffers::take(const native_handle_t* rawHandle,
+                                              const native_handle_t** outBufferHandle,
+                                              Error* outError) {
+    for (size_t i = mNextBuffer; i < mBuffers.size(); i++) {
+        auto& buffer = mBuffers[i];
+        if (buffer.rawHandle == rawHandle) {
+            *outBufferHandle = buffer.bufferHandle;
+            *outError = buffer.error;
+            buffer.bufferHandle = nullptr;
+            mNextBuffer = i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ComposerResources::importBuffers(const std::vector<const native_handle_t*>& rawHandles,
+                                      ImportedBuffers* outBuffers) {
+    outBuffers->clear();
+    outBuffers->mImporter = &mImporter;
+    outBuffers->mBuffers.reserve(rawHandles.size());
+    for (auto rawHandle : rawHandles) {
+        const native_handle_t* bufferHandle = nullptr;
+        Error error = mImporter.importBuffer(rawHandle, &bufferHandle);
+        outBuffers->mBuffers.push_back(
+                {rawHandle, error == Error::NONE ? bufferHandle : nullptr, error});
+    }
+}
+
 Error ComposerResources::getDisplayClientTarget(Display display, uint32_t slot, bool fromCache,
                                                 const native_handle_t* rawHandle,
                                                 const native_handle_t** outBufferHandle,
-                                                ReplacedHandle* outReplacedBuffer) {
+                                                ReplacedHandle* outReplacedBuffer,
+                                                ImportedBuffers* importedBuffers,
+                                                ComposerCachedHandle* outCachedHandle) {
     return getHandle(display, 0, slot, Cache::CLIENT_TARGET, fromCache, rawHandle, outBufferHandle,
-                     outReplacedBuffer);
+                     outReplacedBuffer, importedBuffers, outCachedHandle);
 }
 
 Error ComposerResources::getDisplayOutputBuffer(Display display, uint32_t slot, bool fromCache,
@@ -405,9 +521,11 @@ Error ComposerResources::getDisplayOutputBuffer(Display display, uint32_t slot,
 Error ComposerResources::getLayerBuffer(Display display, Layer layer, uint32_t slot, bool fromCache,
                                         const native_handle_t* rawHandle,
                                         const native_handle_t** outBufferHandle,
-                                        ReplacedHandle* outReplacedBuffer) {
+                                        ReplacedHandle* outReplacedBuffer,
+                                        ImportedBuffers* importedBuffers,
+                                        ComposerCachedHandle* outCachedHandle) {
     return getHandle(display, layer, slot, Cache::LAYER_BUFFER, fromCache, rawHandle,
-                     outBufferHandle, outReplacedBuffer);
+                     outBufferHandle, outReplacedBuffer, importedBuffers, outCachedHandle);
 }
 
 Error ComposerResources::getLayerSidebandStream(Display display, Layer layer,
@@ -446,25 +564,37 @@ std::unique_ptr<ComposerLayerResource> ComposerResources::createLayerResource(
 }
 
 ComposerDisplayResource* ComposerResources::findDisplayResourceLocked(Display display) {
+    if (mLastDisplayResource && mLastDisplay == display) {
+        return mLastDisplayResource;
+    }
+
     auto iter = mDisplayResources.find(display);
     if (iter == mDisplayResources.end()) {
         return nullptr;
     }
-    return iter->second.get();
+
+    mLastDisplay = display;
+    mLastDisplayResource = iter->second.get();
+    return mLastDisplayResource;
 }
 
 Error ComposerResources::getHandle(Display display, Layer layer, uint32_t slot, Cache cache,
                                    bool fromCache, const native_handle_t* rawHandle,
                                    const native_handle_t** outHandle,
-                                   ReplacedHandle* outReplacedHandle) {
+                                   ReplacedHandle* outReplacedHandle,
+                                   ImportedBuffers* importedBuffers,
+                                   ComposerCachedHandle* outCachedHandle) {
     Error error;
 
-    // import the raw handle (or ignore raw handle when fromCache is true)
+    // import the raw handle, unless it was imported ahead (or ignore raw
+    // handle when fromCache is true)
     const native_handle_t* importedHandle = nullptr;
     if (!fromCache) {
-        error = (outReplacedHandle->isBuffer())
-                        ? mImporter.importBuffer(rawHandle, &importedHandle)
-                        : mImporter.importStream(rawHandle, &importedHandle);
+        if (!importedBuffers || !importedBuffers->take(rawHandle, &importedHandle, &error)) {
+            error = (outReplacedHandle->isBuffer())
+                            ? mImporter.importBuffer(rawHandle, &importedHandle)
+                            : mImporter.importStream(rawHandle, &importedHandle);
+        }
         if (error != Error::NONE) {
             return error;
         }
@@ -486,7 +616,7 @@ Error ComposerResources::getHandle(Display display, Layer layer, uint32_t slot,
         switch (cache) {
             case ComposerResources::Cache::CLIENT_TARGET:
                 error = displayResource->getClientTarget(slot, fromCache, importedHandle, outHandle,
-                                                         &replacedHandle);
+                                                         &replacedHandle, outCachedHandle);
                 break;
             case ComposerResources::Cache::OUTPUT_BUFFER:
                 error = displayResource->getOutputBuffer(slot, fromCache, importedHandle, outHandle,
@@ -494,7 +624,7 @@ Error ComposerResources::getHandle(Display display, Layer layer, uint32_t slot,
                 break;
             case ComposerResources::Cache::LAYER_BUFFER:
                 error = layerResource->getBuffer(slot, fromCache, importedHandle, outHandle,
-                                                 &replacedHandle);
+                                                 &replacedHandle, outCachedHandle);
                 break;
             case ComposerResources::Cache::LAYER_SIDEBAND_STREAM:
                 error = layerResource->getSidebandStream(slot, fromCache, importedHandle, outHandle,
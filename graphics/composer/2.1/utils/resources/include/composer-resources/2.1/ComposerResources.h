@@ -20,9 +20,11 @@
 #warning "ComposerResources.h included without LOG_TAG"
 #endif
 
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <android/hardware/graphics/composer/2.1/types.h>
@@ -55,6 +57,35 @@ class ComposerHandleImporter {
     sp<mapper::V4_0::IMapper> mMapper4;
 };
 
+// The generation of each slot of a ComposerHandleCache.
+using ComposerSlotGenerations = std::vector<std::atomic<uint64_t>>;
+
+// A handle found in a ComposerHandleCache slot, tagged with the generation of
+// the slot at the time.  Every update of a slot gets a new generation, unique
+// across all caches.  Unlike the handle pointer, which the allocator may reuse
+// once the replaced handle is freed, a generation is never repeated.  The slot
+// generations are atomic and are shared with this object, and they are reset
+// to 0 when the cache is destroyed, so isCurrent tells whether the slot still
+// holds the handle without locking or looking the slot up again.
+class ComposerCachedHandle {
+  public:
+    bool isCurrent() const {
+        return mGenerations &&
+               (*mGenerations)[mSlot].load(std::memory_order_acquire) == mGeneration;
+    }
+
+    const native_handle_t* get() const { return mHandle; }
+    uint64_t getGeneration() const { return mGeneration; }
+
+  private:
+    friend class ComposerHandleCache;
+
+    std::shared_ptr<const ComposerSlotGenerations> mGenerations;
+    uint32_t mSlot = 0;
+    uint64_t mGeneration = 0;
+    const native_handle_t* mHandle = nullptr;
+};
+
 class ComposerHandleCache {
   public:
     enum class HandleType {
@@ -75,18 +106,25 @@ class ComposerHandleCache {
 
     bool initCache(HandleType type, uint32_t cacheSize);
     size_t getCacheSize() const;
-    Error lookupCache(uint32_t slot, const native_handle_t** outHandle);
+    Error lookupCache(uint32_t slot, const native_handle_t** outHandle,
+                      ComposerCachedHandle* outCachedHandle = nullptr);
     Error updateCache(uint32_t slot, const native_handle_t* handle,
-                      const native_handle** outReplacedHandle);
+                      const native_handle** outReplacedHandle,
+                      ComposerCachedHandle* outCachedHandle = nullptr);
 
     // when fromCache is true, look up in the cache; otherwise, update the cache
     Error getHandle(uint32_t slot, bool fromCache, const native_handle_t* inHandle,
-                    const native_handle_t** outHandle, const native_handle** outReplacedHandle);
+                    const native_handle_t** outHandle, const native_handle** outReplacedHandle,
+                    ComposerCachedHandle* outCachedHandle = nullptr);
 
   private:
+    void getCachedHandle(uint32_t slot, ComposerCachedHandle* outCachedHandle) const;
+
     ComposerHandleImporter& mImporter;
     HandleType mHandleType = HandleType::INVALID;
     std::vector<const native_handle_t*> mHandles;
+    // generation of each slot, 0 while the slot has never been updated
+    std::shared_ptr<ComposerSlotGenerations> mGenerations;
 };
 
 // layer resource
@@ -97,7 +135,8 @@ class ComposerLayerResource {
     virtual ~ComposerLayerResource() = default;
 
     Error getBuffer(uint32_t slot, bool fromCache, const native_handle_t* inHandle,
-                    const native_handle_t** outHandle, const native_handle** outReplacedHandle);
+                    const native_handle_t** outHandle, const native_handle** outReplacedHandle,
+                    ComposerCachedHandle* outCachedHandle = nullptr);
     Error getSidebandStream(uint32_t slot, bool fromCache, const native_handle_t* inHandle,
                             const native_handle_t** outHandle,
                             const native_handle** outReplacedHandle);
@@ -127,7 +166,8 @@ class ComposerDisplayResource {
 
     Error getClientTarget(uint32_t slot, bool fromCache, const native_handle_t* inHandle,
                           const native_handle_t** outHandle,
-                          const native_handle** outReplacedHandle);
+                          const native_handle** outReplacedHandle,
+                          ComposerCachedHandle* outCachedHandle = nullptr);
 
     Error getOutputBuffer(uint32_t slot, bool fromCache, const native_handle_t* inHandle,
                           const native_handle_t** outHandle,
@@ -143,12 +183,22 @@ class ComposerDisplayResource {
     bool mustValidate() const;
 
   protected:
+    using LayerEntry = std::pair<Layer, std::unique_ptr<ComposerLayerResource>>;
+
+    std::vector<LayerEntry>::iterator lowerBoundLayer(Layer layer);
+
     const DisplayType mType;
     ComposerHandleCache mClientTargetCache;
     ComposerHandleCache mOutputBufferCache;
     bool mMustValidate;
 
-    std::unordered_map<Layer, std::unique_ptr<ComposerLayerResource>> mLayerResources;
+    // Layers sorted by ID. A display has at most a few dozen layers and they
+    // are looked up on every layer command, which a flat table serves better
+    // than a hash map.
+    std::vector<LayerEntry> mLayerResources;
+    // index of the most recently found layer, as commands for the same layer
+    // tend to arrive back to back
+    size_t mLastLayerIndex = 0;
 };
 
 class ComposerResources {
@@ -214,10 +264,53 @@ class ComposerResources {
         const native_handle_t* mHandle = nullptr;
     };
 
+    // The new buffers of a frame, imported together by importBuffers before
+    // the commands that set them are executed.  getDisplayClientTarget and
+    // getLayerBuffer take the buffers out in command order; the buffers that
+    // are never taken are freed by clear or on destruction.
+    class ImportedBuffers {
+      public:
+        ImportedBuffers() = default;
+        ImportedBuffers(const ImportedBuffers&) = delete;
+        ImportedBuffers& operator=(const ImportedBuffers&) = delete;
+
+        ~ImportedBuffers() { clear(); }
+
+        void clear();
+
+        // Hands over the next buffer imported from rawHandle, or returns
+        // false when rawHandle was not imported in this batch.
+        bool take(const native_handle_t* rawHandle, const native_handle_t** outBufferHandle,
+                  Error* outError);
+
+      private:
+        friend class ComposerResources;
+
+        struct Buffer {
+            const native_handle_t* rawHandle;
+            const native_handle_t* bufferHandle;
+            Error error;
+        };
+
+        ComposerHandleImporter* mImporter = nullptr;
+        std::vector<Buffer> mBuffers;
+        size_t mNextBuffer = 0;
+    };
+
+    // Imports rawHandles, in order, without taking mDisplayResourcesMutex.
+    void importBuffers(const std::vector<const native_handle_t*>& rawHandles,
+                       ImportedBuffers* outBuffers);
+
+    // When importedBuffers is set, a new buffer imported there is used
+    // instead of importing rawHandle again.  outCachedHandle, when set,
+    // receives the slot handle so that later lookups of the same slot can be
+    // served without calling into ComposerResources while it is current.
     Error getDisplayClientTarget(Display display, uint32_t slot, bool fromCache,
                                  const native_handle_t* rawHandle,
                                  const native_handle_t** outBufferHandle,
-                                 ReplacedHandle* outReplacedBuffer);
+                                 ReplacedHandle* outReplacedBuffer,
+                                 ImportedBuffers* importedBuffers = nullptr,
+                                 ComposerCachedHandle* outCachedHandle = nullptr);
 
     Error getDisplayOutputBuffer(Display display, uint32_t slot, bool fromCache,
                                  const native_handle_t* rawHandle,
@@ -226,7 +319,9 @@ class ComposerResources {
 
     Error getLayerBuffer(Display display, Layer layer, uint32_t slot, bool fromCache,
                          const native_handle_t* rawHandle, const native_handle_t** outBufferHandle,
-                         ReplacedHandle* outReplacedBuffer);
+                         ReplacedHandle* outReplacedBuffer,
+                         ImportedBuffers* importedBuffers = nullptr,
+                         ComposerCachedHandle* outCachedHandle = nullptr);
 
     Error getLayerSidebandStream(Display display, Layer layer, const native_handle_t* rawHandle,
                                  const native_handle_t** outStreamHandle,
@@ -245,6 +340,11 @@ class ComposerResources {
     std::mutex mDisplayResourcesMutex;
     std::unordered_map<Display, std::unique_ptr<ComposerDisplayResource>> mDisplayResources;
 
+    // The display of the last lookup, since commands are grouped by display.
+    // Protected by mDisplayResourcesMutex.
+    Display mLastDisplay = 0;
+    ComposerDisplayResource* mLastDisplayResource = nullptr;
+
   private:
     enum class Cache {
         CLIENT_TARGET,
@@ -255,7 +355,8 @@ class ComposerResources {
 
     Error getHandle(Display display, Layer layer, uint32_t slot, Cache cache, bool fromCache,
                     const native_handle_t* rawHandle, const native_handle_t** outHandle,
-                    ReplacedHandle* outReplacedHandle);
+                    ReplacedHandle* outReplacedHandle, ImportedBuffers* importedBuffers = nullptr,
+                    ComposerCachedHandle* outCachedHandle = nullptr);
 };
 
 }  // namespace hal
@@ -294,6 +294,96 @@ TEST(Metadata, setGetSmpte2094_10) {
     EXPECT_EQ(simpleBuffer, read->value());
 }
 
+TEST(Metadata, decodeViews) {
+    std::vector<uint8_t> buffer(10000, 0);
+
+    using NameValue = StandardMetadata<StandardMetadataType::NAME>::value;
+    int size = NameValue::encode("Hello", buffer.data(), buffer.size());
+    auto name = NameValue::decodeView(buffer.data(), size);
+    ASSERT_TRUE(name.has_value());
+    EXPECT_EQ("Hello", *name);
+    EXPECT_FALSE(NameValue::decodeView(buffer.data(), size - 1).has_value());
+
+    using CompressionValue = StandardMetadata<StandardMetadataType::COMPRESSION>::value;
+    size = CompressionValue::encode(ExtendableType{"bestest", 9}, buffer.data(), buffer.size());
+    auto compression = CompressionValue::decodeView(buffer.data(), size);
+    ASSERT_TRUE(compression.has_value());
+    EXPECT_EQ("bestest", compression->name);
+    EXPECT_EQ(9, compression->value);
+
+    using RectsValue = StandardMetadata<StandardMetadataType::CROP>::value;
+    const std::vector<Rect> cropRects{Rect{10, 11, 12, 13}, Rect{20, 21, 22, 23}};
+    size = RectsValue::encode(cropRects, buffer.data(), buffer.size());
+    auto rects = RectsValue::decodeView(buffer.data(), size);
+    ASSERT_TRUE(rects.has_value());
+    ASSERT_EQ(2, rects->size());
+    EXPECT_EQ(cropRects[0], (*rects)[0]);
+    EXPECT_EQ(cropRects[1], (*rects)[1]);
+    // The rect count is checked against the size before anything is read
+    EXPECT_FALSE(RectsValue::decodeView(buffer.data(), size - 1).has_value());
+    reinterpret_cast<int64_t*>(SkipHeader(buffer).data())[0] = INT64_MAX;
+    EXPECT_FALSE(RectsValue::decodeView(buffer.data(), size).has_value());
+
+    using SMPTE2094_10Value = StandardMetadata<StandardMetadataType::SMPTE2094_10>::value;
+    auto bytes = SMPTE2094_10Value::decodeView(buffer.data(), 0);
+    ASSERT_TRUE(bytes.has_value());
+    EXPECT_FALSE(bytes->has_value());
+    const std::vector<uint8_t> simpleBuffer{0, 1, 2, 3, 4, 5};
+    size = SMPTE2094_10Value::encode(simpleBuffer, buffer.data(), buffer.size());
+    bytes = SMPTE2094_10Value::decodeView(buffer.data(), size);
+    ASSERT_TRUE(bytes.has_value());
+    ASSERT_TRUE(bytes->has_value());
+    EXPECT_EQ(simpleBuffer,
+              std::vector<uint8_t>((*bytes)->data, (*bytes)->data + (*bytes)->size));
+}
+
+static int32_t fakeGetStandardMetadata(buffer_handle_t, int64_t type, void* destBuffer,
+                                       size_t destBufferSize) {
+    return provideStandardMetadata(
+            static_cast<StandardMetadataType>(type), destBuffer, destBufferSize,
+            []<StandardMetadataType T>(auto&& provide) -> int32_t {
+                if constexpr (T == StandardMetadataType::DATASPACE) {
+                    return provide(Dataspace::BT2020);
+                } else if constexpr (T == StandardMetadataType::CROP) {
+                    return provide(std::vector<Rect>{Rect{1, 2, 3, 4}});
+                } else if constexpr (T == StandardMetadataType::SMPTE2086) {
+                    return provide(std::nullopt);
+                }
+                return -AIMAPPER_ERROR_UNSUPPORTED;
+            });
+}
+
+TEST(MetadataBatch, fetch) {
+    AIMapper mapper{};
+    mapper.v5.getStandardMetadata = fakeGetStandardMetadata;
+    auto handle = reinterpret_cast<buffer_handle_t>(&mapper);
+
+    StandardMetadataBatch<StandardMetadataType::DATASPACE, StandardMetadataType::CROP,
+                          StandardMetadataType::SMPTE2086, StandardMetadataType::BLEND_MODE>
+            batch;
+    const int32_t expectedSize = (4 + HeaderSize) + (8 + 16 + HeaderSize);
+
+    // Only the dataspace fits
+    std::vector<uint8_t> buffer(4 + HeaderSize, 0);
+    EXPECT_EQ(expectedSize, batch.fetch(&mapper, handle, buffer.data(), buffer.size()));
+    EXPECT_EQ(Dataspace::BT2020, batch.get<StandardMetadataType::DATASPACE>());
+    EXPECT_FALSE(batch.get<StandardMetadataType::CROP>().has_value());
+
+    buffer.resize(expectedSize);
+    EXPECT_EQ(expectedSize, batch.fetch(&mapper, handle, buffer.data(), buffer.size()));
+    EXPECT_EQ(Dataspace::BT2020, batch.get<StandardMetadataType::DATASPACE>());
+    auto crop = batch.get<StandardMetadataType::CROP>();
+    ASSERT_TRUE(crop.has_value());
+    ASSERT_EQ(1, crop->size());
+    EXPECT_EQ((Rect{1, 2, 3, 4}), (*crop)[0]);
+    // A valid encoding of a nullopt
+    auto smpte2086 = batch.get<StandardMetadataType::SMPTE2086>();
+    ASSERT_TRUE(smpte2086.has_value());
+    EXPECT_FALSE(smpte2086->has_value());
+    // Unsupported
+    EXPECT_FALSE(batch.get<StandardMetadataType::BLEND_MODE>().has_value());
+}
+
 TEST(MetadataProvider, bufferId) {
     using BufferId = StandardMetadata<StandardMetadataType::BUFFER_ID>::value;
     std::vector<uint8_t> buffer(10000, 0);
@@ -31,6 +31,8 @@
 #include <android/hardware/graphics/mapper/IMapper.h>
 
 #include <cinttypes>
+#include <cstring>
+#include <optional>
 #include <string_view>
 #include <type_traits>
 #include <vector>
@@ -50,6 +52,44 @@ using ::aidl::android::hardware::graphics::common::Smpte2086;
 using ::aidl::android::hardware::graphics::common::StandardMetadataType;
 using ::aidl::android::hardware::graphics::common::XyColor;
 
+// Allocation-free views of the variable length metadata fields. They point into the encoded
+// metadata, which must outlive them.
+
+struct ExtendableTypeView {
+    std::string_view name;
+    int64_t value = 0;
+
+    bool operator==(const ExtendableType& other) const {
+        return name == other.name && value == other.value;
+    }
+};
+
+class RectListView {
+  public:
+    RectListView() = default;
+    RectListView(const uint8_t* _Nullable data, size_t count) : mData(data), mCount(count) {}
+
+    [[nodiscard]] size_t size() const { return mCount; }
+    [[nodiscard]] bool empty() const { return mCount == 0; }
+
+    [[nodiscard]] Rect operator[](size_t index) const {
+        int32_t values[4];
+        memcpy(values, mData + index * sizeof(values), sizeof(values));
+        return Rect{values[0], values[1], values[2], values[3]};
+    }
+
+    static constexpr size_t kEncodedRectSize = 4 * sizeof(int32_t);
+
+  private:
+    const uint8_t* _Nullable mData = nullptr;
+    size_t mCount = 0;
+};
+
+struct ByteView {
+    const uint8_t* _Nullable data = nullptr;
+    size_t size = 0;
+};
+
 class MetadataWriter {
   private:
     uint8_t* _Nonnull mDest;
@@ -234,6 +274,35 @@ class MetadataReader {
         }
     }
 
+    [[nodiscard]] const uint8_t* _Nullable readBytes(size_t length) {
+        return reinterpret_cast<const uint8_t*>(advance(length));
+    }
+
+    [[nodiscard]] std::optional<ExtendableTypeView> readExtendableView() {
+        ExtendableTypeView ret;
+        ret.name = readString();
+        auto value = readInt<int64_t>();
+        if (value) {
+            ret.value = value.value();
+            return ret;
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    // Reads a list of count elements of elementSize bytes each, after checking that all of it is
+    // present.
+    [[nodiscard]] const uint8_t* _Nullable readArray(size_t elementSize, size_t* _Nonnull count) {
+        auto countOpt = readInt<int64_t>();
+        if (!countOpt || *countOpt < 0 || static_cast<uint64_t>(*countOpt) > remaining() / elementSize) {
+            mOk = false;
+            *count = 0;
+            return nullptr;
+        }
+        *count = static_cast<size_t>(*countOpt);
+        return readBytes(*count * elementSize);
+    }
+
     [[nodiscard]] std::vector<uint8_t> readBuffer() {
         std::vector<uint8_t> ret;
         size_t length = readInt<int64_t>().value_or(0);
@@ -264,6 +333,12 @@ struct MetadataValue<HEADER, T, std::enable_if_t<std::is_integral_v<T>>> {
                 .template checkHeader<HEADER>()
                 .template readInt<T>();
     }
+
+    using view_type = T;
+    [[nodiscard]] static std::optional<T> decodeView(const void* _Nonnull metadata,
+                                                     size_t metadataSize) {
+        return decode(metadata, metadataSize);
+    }
 };
 
 template <typename HEADER, typename T>
@@ -283,6 +358,12 @@ struct MetadataValue<HEADER, T, std::enable_if_t<std::is_enum_v<T>>> {
                        ? std::optional<T>(static_cast<T>(temp))
                        : std::nullopt;
     }
+
+    using view_type = T;
+    [[nodiscard]] static std::optional<T> decodeView(const void* _Nonnull metadata,
+                                                     size_t metadataSize) {
+        return decode(metadata, metadataSize);
+    }
 };
 
 template <typename HEADER>
@@ -301,6 +382,14 @@ struct MetadataValue<HEADER, std::string> {
         auto result = reader.readString();
         return reader.ok() ? std::optional<std::string>{result} : std::nullopt;
     }
+
+    using view_type = std::string_view;
+    [[nodiscard]] static std::optional<std::string_view> decodeView(const void* _Nonnull metadata,
+                                                                    size_t metadataSize) {
+        auto reader = MetadataReader{metadata, metadataSize}.template checkHeader<HEADER>();
+        auto result = reader.readString();
+        return reader.ok() ? std::optional<std::string_view>{result} : std::nullopt;
+    }
 };
 
 template <typename HEADER>
@@ -321,6 +410,14 @@ struct MetadataValue<HEADER, ExtendableType> {
                 .template checkHeader<HEADER>()
                 .readExtendable();
     }
+
+    using view_type = ExtendableTypeView;
+    [[nodiscard]] static std::optional<ExtendableTypeView> decodeView(
+            const void* _Nonnull metadata, size_t metadataSize) {
+        auto reader = MetadataReader{metadata, metadataSize}.template checkHeader<HEADER>();
+        auto result = reader.readExtendableView();
+        return reader.ok() ? result : std::nullopt;
+    }
 };
 
 template <typename HEADER>
@@ -411,6 +508,17 @@ struct MetadataValue<HEADER, std::vector<Rect>> {
         }
         return reader.ok() ? DecodeResult{std::move(value)} : std::nullopt;
     }
+
+    using view_type = RectListView;
+    [[nodiscard]] static std::optional<RectListView> decodeView(const void* _Nonnull metadata,
+                                                                size_t metadataSize) {
+        MetadataReader reader{metadata, metadataSize};
+        reader.template checkHeader<HEADER>();
+        size_t count = 0;
+        const uint8_t* rects = reader.readArray(RectListView::kEncodedRectSize, &count);
+        return reader.ok() ? std::optional<RectListView>{RectListView{rects, count}}
+                           : std::nullopt;
+    }
 };
 
 template <typename HEADER>
@@ -455,6 +563,13 @@ struct MetadataValue<HEADER, std::optional<Smpte2086>> {
         }
         return DecodeResult{std::move(optValue)};
     }
+
+    // no allocation is needed to decode the value itself
+    using view_type = std::optional<Smpte2086>;
+    [[nodiscard]] static DecodeResult decodeView(const void* _Nullable metadata,
+                                                 size_t metadataSize) {
+        return decode(metadata, metadataSize);
+    }
 };
 
 template <typename HEADER>
@@ -490,6 +605,13 @@ struct MetadataValue<HEADER, std::optional<Cta861_3>> {
         }
         return DecodeResult{std::move(optValue)};
     }
+
+    // no allocation is needed to decode the value itself
+    using view_type = std::optional<Cta861_3>;
+    [[nodiscard]] static DecodeResult decodeView(const void* _Nullable metadata,
+                                                 size_t metadataSize) {
+        return decode(metadata, metadataSize);
+    }
 };
 
 template <typename HEADER>
@@ -520,6 +642,23 @@ struct MetadataValue<HEADER, std::optional<std::vector<uint8_t>>> {
         }
         return DecodeResult{std::move(optValue)};
     }
+
+    using view_type = std::optional<ByteView>;
+    [[nodiscard]] static std::optional<view_type> decodeView(const void* _Nonnull metadata,
+                                                             size_t metadataSize) {
+        view_type optValue;
+        if (metadataSize > 0) {
+            MetadataReader reader{metadata, metadataSize};
+            reader.template checkHeader<HEADER>();
+            size_t length = 0;
+            const uint8_t* data = reader.readArray(1, &length);
+            if (!reader.ok()) {
+                return std::nullopt;
+            }
+            optValue = ByteView{data, length};
+        }
+        return std::optional<view_type>{std::in_place, optValue};
+    }
 };
 
 template <StandardMetadataType>
@@ -567,6 +706,99 @@ DEFINE_TYPE(STRIDE, uint32_t);
 
 #undef DEFINE_TYPE
 
+/**
+ * Fetches a fixed set of standard metadata types of a buffer into one caller-provided buffer, and
+ * decodes them without allocating. PLANE_LAYOUTS has no allocation-free form and cannot be part of
+ * a batch. For example:
+ *
+ *   StandardMetadataBatch<StandardMetadataType::DATASPACE, StandardMetadataType::CROP> batch;
+ *   uint8_t storage[512];
+ *   if (batch.fetch(mapper, buffer, storage, sizeof(storage)) <= sizeof(storage)) {
+ *       auto dataspace = batch.get<StandardMetadataType::DATASPACE>();
+ *   }
+ */
+template <StandardMetadataType... TYPES>
+class StandardMetadataBatch {
+  private:
+    static constexpr size_t kCount = sizeof...(TYPES);
+    static constexpr StandardMetadataType kTypes[] = {TYPES...};
+
+    template <typename T, typename = void>
+    struct HasView : std::false_type {};
+    template <typename T>
+    struct HasView<T, std::void_t<typename T::view_type>> : std::true_type {};
+
+    static_assert(kCount > 0, "Batch must contain at least one type");
+    static_assert((HasView<typename StandardMetadata<TYPES>::value>::value && ...),
+                  "Every type in a batch must have an allocation-free decoder");
+
+    template <StandardMetadataType T>
+    static constexpr size_t indexOf() {
+        size_t index = 0;
+        while (index < kCount && kTypes[index] != T) {
+            index++;
+        }
+        return index;
+    }
+
+    const uint8_t* _Nullable mData = nullptr;
+    size_t mDataSize = 0;
+    size_t mOffsets[kCount] = {};
+    // -1 if the mapper doesn't support the type
+    int32_t mSizes[kCount] = {};
+
+  public:
+    /**
+     * Calls getStandardMetadata for every type, storing the results back to back in destBuffer.
+     * Returns the total size needed, which is larger than destBufferSize if some of the values
+     * did not fit, or a negative AIMapper_Error. Types the mapper doesn't support are skipped.
+     */
+    [[nodiscard]] int32_t fetch(const AIMapper* _Nonnull mapper, buffer_handle_t _Nonnull buffer,
+                                void* _Nullable destBuffer, size_t destBufferSize) {
+        mData = reinterpret_cast<const uint8_t*>(destBuffer);
+        mDataSize = destBuffer ? destBufferSize : 0;
+
+        size_t offset = 0;
+        for (size_t i = 0; i < kCount; i++) {
+            const bool hasRoom = offset < mDataSize;
+            int32_t size = mapper->v5.getStandardMetadata(
+                    buffer, static_cast<int64_t>(kTypes[i]),
+                    hasRoom ? static_cast<uint8_t*>(destBuffer) + offset : nullptr,
+                    hasRoom ? mDataSize - offset : 0);
+            mOffsets[i] = offset;
+            if (size == -AIMAPPER_ERROR_UNSUPPORTED) {
+                mSizes[i] = -1;
+                continue;
+            }
+            if (size < 0) {
+                mData = nullptr;
+                return size;
+            }
+            mSizes[i] = size;
+            offset += size;
+            if (offset > static_cast<size_t>(INT32_MAX)) {
+                mData = nullptr;
+                return -AIMAPPER_ERROR_BAD_VALUE;
+            }
+        }
+        return static_cast<int32_t>(offset);
+    }
+
+    /**
+     * Decodes one of the fetched types. Returns nullopt if it wasn't fetched, didn't fit or
+     * is malformed.
+     */
+    template <StandardMetadataType T>
+    [[nodiscard]] std::optional<typename StandardMetadata<T>::value::view_type> get() const {
+        constexpr size_t index = indexOf<T>();
+        static_assert(index < kCount, "Type is not part of this batch");
+        if (!mData || mSizes[index] < 0 || mOffsets[index] + mSizes[index] > mDataSize) {
+            return std::nullopt;
+        }
+        return StandardMetadata<T>::value::decodeView(mData + mOffsets[index], mSizes[index]);
+    }
+};
+
 #if defined(__cplusplus) && __cplusplus >= 202002L
 
 template <typename F, std::size_t... I>
@@ -189,6 +189,13 @@ class Burst final : public nn::IBurst, public std::enable_shared_from_this<Burst
             const hal::utils::RequestRelocation& relocation, FallbackFunction fallback) const;
 
   private:
+    // Same as executeInternal, but the request is sent by calling sendRequest, which returns
+    // nn::Result<void>.
+    template <typename SendFunction>
+    nn::ExecutionResult<std::pair<std::vector<nn::OutputShape>, nn::Timing>> executeWithSender(
+            const SendFunction& sendRequest, const hal::utils::RequestRelocation& relocation,
+            FallbackFunction fallback) const;
+
     mutable std::atomic_flag mExecutionInFlight = ATOMIC_FLAG_INIT;
     const nn::SharedPreparedModel kPreparedModel;
     const std::unique_ptr<RequestChannelSender> mRequestChannelSender;
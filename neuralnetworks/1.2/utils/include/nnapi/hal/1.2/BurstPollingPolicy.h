@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_1_2_UTILS_BURST_POLLING_POLICY_H
+#define ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_1_2_UTILS_BURST_POLLING_POLICY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace android::hardware::neuralnetworks::V1_2::utils {
+
+/**
+ * Decides how long a burst channel receiver polls the FMQ before it blocks on the futex.
+ *
+ * Polling picks up a packet sooner than a futex wake-up, but burns a core while it waits. The
+ * policy keeps a moving average of how long the receiver has recently waited for a packet (the
+ * execution time for the controller, the time between requests for the server) and only polls when
+ * the next packet is expected to arrive within the maximum polling time window. Polling stops for a
+ * while once the receiver is found to compete with other threads for the CPU.
+ *
+ * The polling time window and recordPacket must only be used by the thread receiving packets.
+ * getCounters may be called from any thread.
+ */
+class BurstPollingPolicy final {
+  public:
+    enum class Outcome {
+        // The packet arrived while the receiver was polling.
+        RECEIVED_WHILE_POLLING,
+        // The receiver polled for the whole polling time window, then waited on the futex.
+        POLLING_TIMED_OUT,
+        // The polling time window was zero, so the receiver waited on the futex.
+        NOT_POLLED,
+        // The receiver stopped polling because it was descheduled in favor of another thread.
+        CONTENDED,
+    };
+
+    struct Counters {
+        uint64_t receivedWhilePolling = 0;
+        uint64_t pollingTimedOut = 0;
+        uint64_t notPolled = 0;
+        uint64_t contended = 0;
+    };
+
+    /**
+     * A single poll of the FMQ that takes longer than this means the receiver was descheduled.
+     */
+    static constexpr std::chrono::microseconds kContentionThreshold{50};
+
+    /**
+     * Number of packets for which the receiver does not poll after contention was detected.
+     */
+    static constexpr uint32_t kContentionBackoffPackets = 16;
+
+    /**
+     * @param maxPollingTimeWindow Upper bound of the polling time window. Zero disables polling.
+     */
+    explicit BurstPollingPolicy(std::chrono::microseconds maxPollingTimeWindow);
+
+    /**
+     * Returns how long to poll for the next packet before blocking on the futex.
+     */
+    std::chrono::nanoseconds getPollingTimeWindow() const;
+
+    /**
+     * Returns true if a single poll of the FMQ that took pollDuration indicates that the receiver
+     * competes with other threads for the CPU.
+     */
+    static bool isContended(std::chrono::nanoseconds pollDuration);
+
+    /**
+     * Records that a packet was received.
+     *
+     * @param waitTime Time from when the receiver began waiting until the packet was received.
+     * @param outcome How the receiver waited for the packet.
+     */
+    void recordPacket(std::chrono::nanoseconds waitTime, Outcome outcome);
+
+    Counters getCounters() const;
+
+  private:
+    const std::chrono::nanoseconds kMaxPollingTimeWindow;
+    std::chrono::nanoseconds mAverageWaitTime{0};
+    uint32_t mBackoffPackets = 0;
+
+    std::atomic<uint64_t> mReceivedWhilePolling{0};
+    std::atomic<uint64_t> mPollingTimedOut{0};
+    std::atomic<uint64_t> mNotPolled{0};
+    std::atomic<uint64_t> mContended{0};
+};
+
+}  // namespace android::hardware::neuralnetworks::V1_2::utils
+
+#endif  // ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_1_2_UTILS_BURST_POLLING_POLICY_H
@@ -17,6 +17,8 @@
 #ifndef ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_1_2_UTILS_BURST_UTILS_H
 #define ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_1_2_UTILS_BURST_UTILS_H
 
+#include "nnapi/hal/1.2/BurstPollingPolicy.h"
+
 #include <android/hardware/neuralnetworks/1.0/types.h>
 #include <android/hardware/neuralnetworks/1.2/types.h>
 #include <fmq/MessageQueue.h>
@@ -40,18 +42,22 @@ namespace android::hardware::neuralnetworks::V1_2::utils {
 constexpr const size_t kExecutionBurstChannelLength = 1024;
 
 /**
- * Get how long the burst controller should poll while waiting for results to be returned.
+ * Get the longest time the burst controller may poll while waiting for results to be returned.
+ * The time actually spent polling is adapted to recent wait times by BurstPollingPolicy.
  *
- * This time can be affected by the property "debug.nn.burst-controller-polling-window".
+ * It is 100 microseconds by default, and can be affected by the property
+ * "debug.nn.burst-controller-polling-window".
  *
  * @return Polling time in microseconds.
  */
 std::chrono::microseconds getBurstControllerPollingTimeWindow();
 
 /**
- * Get how long the burst server should poll while waiting for a request to be received.
+ * Get the longest time the burst server may poll while waiting for a request to be received. The
+ * time actually spent polling is adapted to recent wait times by BurstPollingPolicy.
  *
- * This time can be affected by the property "debug.nn.burst-server-polling-window".
+ * It is 100 microseconds by default, and can be affected by the property
+ * "debug.nn.burst-server-polling-window".
  *
  * @return Polling time in microseconds.
  */
@@ -124,7 +130,7 @@ class RequestChannelSender final : public neuralnetworks::utils::IProtectedCallb
     create(size_t channelLength);
 
     /**
-     * Send the request to the channel.
+     * Send the request to the channel. The request is serialized directly into the FMQ.
      *
      * @param request Request object without the pool information.
      * @param measure Whether to collect timing information for the execution.
@@ -165,7 +171,7 @@ class RequestChannelReceiver final {
      * Create the receiving end of a request channel.
      *
      * @param requestChannel Descriptor for the request channel.
-     * @param pollingTimeWindow How much time (in microseconds) the RequestChannelReceiver is
+     * @param pollingTimeWindow Maximum time (in microseconds) the RequestChannelReceiver is
      *     allowed to poll the FMQ before waiting on the blocking futex. Polling may result in lower
      *     latencies at the potential cost of more power usage.
      * @return RequestChannelReceiver on successful creation, nullptr otherwise.
@@ -175,7 +181,7 @@ class RequestChannelReceiver final {
             std::chrono::microseconds pollingTimeWindow);
 
     /**
-     * Get the request from the channel.
+     * Get the request from the channel. The request is deserialized directly from the FMQ.
      *
      * This method will block until either:
      * 1) The packet has been retrieved, or
@@ -192,16 +198,23 @@ class RequestChannelReceiver final {
      */
     void invalidate();
 
+    /**
+     * Returns how the receiver has waited for the packets received so far. The counters are also
+     * published as systrace counters after each packet.
+     */
+    BurstPollingPolicy::Counters getPollingCounters() const;
+
     RequestChannelReceiver(PrivateConstructorTag tag,
                            const MQDescriptorSync<FmqRequestDatum>& requestChannel,
                            std::chrono::microseconds pollingTimeWindow);
 
   private:
+    nn::Result<BurstPollingPolicy::Outcome> pollForPacket();
     nn::Result<std::vector<FmqRequestDatum>> getPacketBlocking();
 
     MessageQueue<FmqRequestDatum, kSynchronizedReadWrite> mFmqRequestChannel;
     std::atomic<bool> mTeardown{false};
-    const std::chrono::microseconds kPollingTimeWindow;
+    BurstPollingPolicy mPollingPolicy;
 };
 
 /**
@@ -222,7 +235,7 @@ class ResultChannelSender final {
             const MQDescriptorSync<FmqResultDatum>& resultChannel);
 
     /**
-     * Send the result to the channel.
+     * Send the result to the channel. The result is serialized directly into the FMQ.
      *
      * @param errorStatus Status of the execution.
      * @param outputShapes Dynamic shapes of the output tensors.
@@ -256,7 +269,7 @@ class ResultChannelReceiver final : public neuralnetworks::utils::IProtectedCall
      * Create the receiving end of a result channel.
      *
      * @param channelLength Number of elements in the FMQ.
-     * @param pollingTimeWindow How much time (in microseconds) the ResultChannelReceiver is allowed
+     * @param pollingTimeWindow Maximum time (in microseconds) the ResultChannelReceiver is allowed
      *     to poll the FMQ before waiting on the blocking futex. Polling may result in lower
      *     latencies at the potential cost of more power usage.
      * @return A pair of ResultChannelReceiver and the FMQ descriptor on successful creation, or
@@ -267,7 +280,7 @@ class ResultChannelReceiver final : public neuralnetworks::utils::IProtectedCall
     create(size_t channelLength, std::chrono::microseconds pollingTimeWindow);
 
     /**
-     * Get the result from the channel.
+     * Get the result from the channel. The result is deserialized directly from the FMQ.
      *
      * This method will block until either:
      * 1) The packet has been retrieved, or
@@ -284,6 +297,12 @@ class ResultChannelReceiver final : public neuralnetworks::utils::IProtectedCall
      */
     void notifyAsDeadObject() override;
 
+    /**
+     * Returns how the receiver has waited for the packets received so far. The counters are also
+     * published as systrace counters after each packet.
+     */
+    BurstPollingPolicy::Counters getPollingCounters() const;
+
     // prefer calling ResultChannelReceiver::getBlocking
     nn::Result<std::vector<FmqResultDatum>> getPacketBlocking();
 
@@ -291,9 +310,11 @@ class ResultChannelReceiver final : public neuralnetworks::utils::IProtectedCall
                           std::chrono::microseconds pollingTimeWindow);
 
   private:
+    nn::Result<BurstPollingPolicy::Outcome> pollForPacket();
+
     MessageQueue<FmqResultDatum, kSynchronizedReadWrite> mFmqResultChannel;
     std::atomic<bool> mValid{true};
-    const std::chrono::microseconds kPollingTimeWindow;
+    BurstPollingPolicy mPollingPolicy;
 };
 
 }  // namespace android::hardware::neuralnetworks::V1_2::utils
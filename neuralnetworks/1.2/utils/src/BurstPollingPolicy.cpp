@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BurstPollingPolicy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace android::hardware::neuralnetworks::V1_2::utils {
+namespace {
+
+// Weight of a new sample in the moving average of the wait time is 1/kAverageWeightDivisor.
+constexpr int64_t kAverageWeightDivisor = 8;
+
+}  // namespace
+
+BurstPollingPolicy::BurstPollingPolicy(std::chrono::microseconds maxPollingTimeWindow)
+    : kMaxPollingTimeWindow(std::max(maxPollingTimeWindow, std::chrono::microseconds{0})) {}
+
+std::chrono::nanoseconds BurstPollingPolicy::getPollingTimeWindow() const {
+    if (mBackoffPackets > 0 || mAverageWaitTime > kMaxPollingTimeWindow) {
+        return std::chrono::nanoseconds{0};
+    }
+    // Leave headroom for packets that arrive somewhat later than average.
+    return std::min(mAverageWaitTime + mAverageWaitTime / 2, kMaxPollingTimeWindow);
+}
+
+bool BurstPollingPolicy::isContended(std::chrono::nanoseconds pollDuration) {
+    return pollDuration > kContentionThreshold;
+}
+
+void BurstPollingPolicy::recordPacket(std::chrono::nanoseconds waitTime, Outcome outcome) {
+    switch (outcome) {
+        case Outcome::RECEIVED_WHILE_POLLING:
+            mReceivedWhilePolling.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case Outcome::POLLING_TIMED_OUT:
+            mPollingTimedOut.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case Outcome::NOT_POLLED:
+            mNotPolled.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case Outcome::CONTENDED:
+            mContended.fetch_add(1, std::memory_order_relaxed);
+            break;
+    }
+
+    if (outcome == Outcome::CONTENDED) {
+        mBackoffPackets = kContentionBackoffPackets;
+    } else if (mBackoffPackets > 0) {
+        mBackoffPackets--;
+    }
+
+    waitTime = std::max(waitTime, std::chrono::nanoseconds{0});
+    mAverageWaitTime += (waitTime - mAverageWaitTime) / kAverageWeightDivisor;
+}
+
+BurstPollingPolicy::Counters BurstPollingPolicy::getCounters() const {
+    return {
+            .receivedWhilePolling = mReceivedWhilePolling.load(std::memory_order_relaxed),
+            .pollingTimedOut = mPollingTimedOut.load(std::memory_order_relaxed),
+            .notPolled = mNotPolled.load(std::memory_order_relaxed),
+            .contended = mContended.load(std::memory_order_relaxed),
+    };
+}
+
+}  // namespace android::hardware::neuralnetworks::V1_2::utils
@@ -15,6 +15,7 @@
  */
 
 #include "BurstUtils.h"
+#include "BurstPollingPolicy.h"
 
 #include <android-base/logging.h>
 #include <android-base/properties.h>
@@ -27,14 +28,21 @@
 #include <nnapi/Types.h>
 #include <nnapi/hal/1.0/ProtectCallback.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cstring>
+#include <limits>
 #include <memory>
+#include <new>
+#include <optional>
 #include <thread>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+#include "Tracing.h"
+
 namespace android::hardware::neuralnetworks::V1_2::utils {
 namespace {
 
@@ -42,7 +50,8 @@ constexpr V1_2::Timing kNoTiming = {std::numeric_limits<uint64_t>::max(),
                                     std::numeric_limits<uint64_t>::max()};
 
 std::chrono::microseconds getPollingTimeWindow(const std::string& property) {
-    constexpr int32_t kDefaultPollingTimeWindow = 0;
+    // BurstPollingPolicy only polls for packets expected within this window.
+    constexpr int32_t kDefaultPollingTimeWindow = 100;
 #ifdef NN_DEBUGGABLE
     constexpr int32_t kMinPollingTimeWindow = 0;
     const int32_t selectedPollingTimeWindow =
@@ -54,20 +63,8 @@ std::chrono::microseconds getPollingTimeWindow(const std::string& property) {
 #endif  // NN_DEBUGGABLE
 }
 
-}  // namespace
-
-std::chrono::microseconds getBurstControllerPollingTimeWindow() {
-    return getPollingTimeWindow("debug.nn.burst-controller-polling-window");
-}
-
-std::chrono::microseconds getBurstServerPollingTimeWindow() {
-    return getPollingTimeWindow("debug.nn.burst-server-polling-window");
-}
-
-// serialize a request into a packet
-std::vector<FmqRequestDatum> serialize(const V1_0::Request& request, V1_2::MeasureTiming measure,
-                                       const std::vector<int32_t>& slots) {
-    // count how many elements need to be sent for a request
+// count how many elements need to be sent for a request
+size_t getSerializedSize(const V1_0::Request& request, const std::vector<int32_t>& slots) {
     size_t count = 2 + request.inputs.size() + request.outputs.size() + slots.size();
     for (const auto& input : request.inputs) {
         count += input.dimensions.size();
@@ -76,14 +73,30 @@ std::vector<FmqRequestDatum> serialize(const V1_0::Request& request, V1_2::Measu
         count += output.dimensions.size();
     }
     CHECK_LE(count, std::numeric_limits<uint32_t>::max());
+    return count;
+}
 
-    // create buffer to temporarily store elements
-    std::vector<FmqRequestDatum> data;
-    data.reserve(count);
+// count how many elements need to be sent for a result
+size_t getSerializedSize(const std::vector<V1_2::OutputShape>& outputShapes) {
+    size_t count = 2 + outputShapes.size();
+    for (const auto& outputShape : outputShapes) {
+        count += outputShape.dimensions.size();
+    }
+    CHECK_LE(count, std::numeric_limits<uint32_t>::max());
+    return count;
+}
+
+// Serialize a request into the elements returned by getElement(index), which must hold
+// getSerializedSize(request, slots) elements.
+template <typename GetElement>
+void serializeInto(const V1_0::Request& request, V1_2::MeasureTiming measure,
+                   const std::vector<int32_t>& slots, const GetElement& getElement) {
+    const size_t count = getSerializedSize(request, slots);
+    size_t index = 0;
+    const auto next = [&getElement, &index]() -> FmqRequestDatum& { return getElement(index++); };
 
     // package packetInfo
-    data.emplace_back();
-    data.back().packetInformation(
+    next().packetInformation(
             {.packetSize = static_cast<uint32_t>(count),
              .numberOfInputOperands = static_cast<uint32_t>(request.inputs.size()),
              .numberOfOutputOperands = static_cast<uint32_t>(request.outputs.size()),
@@ -92,315 +105,288 @@ std::vector<FmqRequestDatum> serialize(const V1_0::Request& request, V1_2::Measu
     // package input data
     for (const auto& input : request.inputs) {
         // package operand information
-        data.emplace_back();
-        data.back().inputOperandInformation(
+        next().inputOperandInformation(
                 {.hasNoValue = input.hasNoValue,
                  .location = input.location,
                  .numberOfDimensions = static_cast<uint32_t>(input.dimensions.size())});
 
         // package operand dimensions
         for (uint32_t dimension : input.dimensions) {
-            data.emplace_back();
-            data.back().inputOperandDimensionValue(dimension);
+            next().inputOperandDimensionValue(dimension);
         }
     }
 
     // package output data
     for (const auto& output : request.outputs) {
         // package operand information
-        data.emplace_back();
-        data.back().outputOperandInformation(
+        next().outputOperandInformation(
                 {.hasNoValue = output.hasNoValue,
                  .location = output.location,
                  .numberOfDimensions = static_cast<uint32_t>(output.dimensions.size())});
 
         // package operand dimensions
         for (uint32_t dimension : output.dimensions) {
-            data.emplace_back();
-            data.back().outputOperandDimensionValue(dimension);
+            next().outputOperandDimensionValue(dimension);
         }
     }
 
     // package pool identifier
     for (int32_t slot : slots) {
-        data.emplace_back();
-        data.back().poolIdentifier(slot);
+        next().poolIdentifier(slot);
     }
 
     // package measureTiming
-    data.emplace_back();
-    data.back().measureTiming(measure);
-
-    CHECK_EQ(data.size(), count);
+    next().measureTiming(measure);
 
-    // return packet
-    return data;
+    CHECK_EQ(index, count);
 }
 
-// serialize result
-std::vector<FmqResultDatum> serialize(V1_0::ErrorStatus errorStatus,
-                                      const std::vector<V1_2::OutputShape>& outputShapes,
-                                      V1_2::Timing timing) {
-    // count how many elements need to be sent for a request
-    size_t count = 2 + outputShapes.size();
-    for (const auto& outputShape : outputShapes) {
-        count += outputShape.dimensions.size();
-    }
-
-    // create buffer to temporarily store elements
-    std::vector<FmqResultDatum> data;
-    data.reserve(count);
+// Serialize a result into the elements returned by getElement(index), which must hold
+// getSerializedSize(outputShapes) elements.
+template <typename GetElement>
+void serializeInto(V1_0::ErrorStatus errorStatus,
+                   const std::vector<V1_2::OutputShape>& outputShapes, V1_2::Timing timing,
+                   const GetElement& getElement) {
+    const size_t count = getSerializedSize(outputShapes);
+    size_t index = 0;
+    const auto next = [&getElement, &index]() -> FmqResultDatum& { return getElement(index++); };
 
     // package packetInfo
-    data.emplace_back();
-    data.back().packetInformation({.packetSize = static_cast<uint32_t>(count),
-                                   .errorStatus = errorStatus,
-                                   .numberOfOperands = static_cast<uint32_t>(outputShapes.size())});
+    next().packetInformation({.packetSize = static_cast<uint32_t>(count),
+                              .errorStatus = errorStatus,
+                              .numberOfOperands = static_cast<uint32_t>(outputShapes.size())});
 
     // package output shape data
     for (const auto& operand : outputShapes) {
         // package operand information
-        data.emplace_back();
-        data.back().operandInformation(
+        next().operandInformation(
                 {.isSufficient = operand.isSufficient,
                  .numberOfDimensions = static_cast<uint32_t>(operand.dimensions.size())});
 
         // package operand dimensions
         for (uint32_t dimension : operand.dimensions) {
-            data.emplace_back();
-            data.back().operandDimensionValue(dimension);
+            next().operandDimensionValue(dimension);
         }
     }
 
     // package executionTiming
-    data.emplace_back();
-    data.back().executionTiming(timing);
-
-    CHECK_EQ(data.size(), count);
+    next().executionTiming(timing);
 
-    // return result
-    return data;
+    CHECK_EQ(index, count);
 }
 
-// deserialize request
-nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>> deserialize(
-        const std::vector<FmqRequestDatum>& data) {
-    using discriminator = FmqRequestDatum::hidl_discriminator;
+// Reads the elements of a packet one at a time. Each element is copied byte-wise before it is
+// inspected: the packet may live in FMQ memory that the other process can still modify, and an
+// element with an unknown discriminator must be rejected rather than copy-constructed.
+template <typename Datum, typename GetElement>
+class PacketReader {
+  public:
+    PacketReader(size_t size, const GetElement& getElement)
+        : kSize(size), kGetElement(getElement) {}
+
+    // Reads the next element if it has the expected discriminator.
+    const Datum* next(typename Datum::hidl_discriminator expected) {
+        if (mIndex >= kSize) {
+            return nullptr;
+        }
+        std::memcpy(static_cast<void*>(&mDatum), kGetElement(mIndex), sizeof(mDatum));
+        mIndex++;
+        return mDatum.getDiscriminator() == expected ? &mDatum : nullptr;
+    }
 
-    size_t index = 0;
+    size_t index() const { return mIndex; }
+    size_t remaining() const { return kSize - mIndex; }
+
+  private:
+    const size_t kSize;
+    const GetElement& kGetElement;
+    size_t mIndex = 0;
+    Datum mDatum;
+};
+
+// Deserialize the request packet made of the size elements returned by getElement(index).
+template <typename GetElement>
+nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>>
+deserializeRequest(size_t size, const GetElement& getElement) {
+    using discriminator = FmqRequestDatum::hidl_discriminator;
+    PacketReader<FmqRequestDatum, GetElement> reader(size, getElement);
 
     // validate packet information
-    if (index >= data.size() ||
-        data.at(index).getDiscriminator() != discriminator::packetInformation) {
+    const FmqRequestDatum* datum = reader.next(discriminator::packetInformation);
+    if (datum == nullptr) {
         return NN_ERROR() << "FMQ Request packet ill-formed";
     }
 
     // unpackage packet information
-    const FmqRequestDatum::PacketInformation& packetInfo = data.at(index).packetInformation();
-    index++;
+    const FmqRequestDatum::PacketInformation packetInfo = datum->packetInformation();
     const uint32_t packetSize = packetInfo.packetSize;
     const uint32_t numberOfInputOperands = packetInfo.numberOfInputOperands;
     const uint32_t numberOfOutputOperands = packetInfo.numberOfOutputOperands;
     const uint32_t numberOfPools = packetInfo.numberOfPools;
 
     // verify packet size
-    if (data.size() != packetSize) {
+    if (size != packetSize) {
         return NN_ERROR() << "FMQ Request packet ill-formed";
     }
 
-    // unpackage input operands
-    std::vector<V1_0::RequestArgument> inputs;
-    inputs.reserve(numberOfInputOperands);
-    for (size_t operand = 0; operand < numberOfInputOperands; ++operand) {
-        // validate input operand information
-        if (index >= data.size() ||
-            data.at(index).getDiscriminator() != discriminator::inputOperandInformation) {
-            return NN_ERROR() << "FMQ Request packet ill-formed";
-        }
-
-        // unpackage operand information
-        const FmqRequestDatum::OperandInformation& operandInfo =
-                data.at(index).inputOperandInformation();
-        index++;
-        const bool hasNoValue = operandInfo.hasNoValue;
-        const V1_0::DataLocation location = operandInfo.location;
-        const uint32_t numberOfDimensions = operandInfo.numberOfDimensions;
-
-        // unpackage operand dimensions
-        std::vector<uint32_t> dimensions;
-        dimensions.reserve(numberOfDimensions);
-        for (size_t i = 0; i < numberOfDimensions; ++i) {
-            // validate dimension
-            if (index >= data.size() ||
-                data.at(index).getDiscriminator() != discriminator::inputOperandDimensionValue) {
+    // The number of operands is bounded by the packet size, which has been checked to be the
+    // number of elements available.
+    const auto deserializeArguments =
+            [&reader](uint32_t numberOfOperands, discriminator operandInformation,
+                      discriminator operandDimensionValue)
+            -> nn::Result<hidl_vec<V1_0::RequestArgument>> {
+        hidl_vec<V1_0::RequestArgument> arguments;
+        arguments.resize(std::min<size_t>(numberOfOperands, reader.remaining()));
+        for (size_t operand = 0; operand < numberOfOperands; ++operand) {
+            // validate operand information
+            const FmqRequestDatum* information = reader.next(operandInformation);
+            if (information == nullptr) {
                 return NN_ERROR() << "FMQ Request packet ill-formed";
             }
 
-            // unpackage dimension
-            const uint32_t dimension = data.at(index).inputOperandDimensionValue();
-            index++;
+            // unpackage operand information
+            const FmqRequestDatum::OperandInformation operandInfo =
+                    operandInformation == discriminator::inputOperandInformation
+                            ? information->inputOperandInformation()
+                            : information->outputOperandInformation();
+            const uint32_t numberOfDimensions = operandInfo.numberOfDimensions;
+
+            // unpackage operand dimensions
+            hidl_vec<uint32_t> dimensions;
+            dimensions.resize(std::min<size_t>(numberOfDimensions, reader.remaining()));
+            for (size_t i = 0; i < numberOfDimensions; ++i) {
+                // validate dimension
+                const FmqRequestDatum* dimension = reader.next(operandDimensionValue);
+                if (dimension == nullptr) {
+                    return NN_ERROR() << "FMQ Request packet ill-formed";
+                }
+
+                // unpackage dimension
+                dimensions[i] = operandDimensionValue == discriminator::inputOperandDimensionValue
+                                        ? dimension->inputOperandDimensionValue()
+                                        : dimension->outputOperandDimensionValue();
+            }
 
             // store result
-            dimensions.push_back(dimension);
+            arguments[operand] = {.hasNoValue = operandInfo.hasNoValue,
+                                  .location = operandInfo.location,
+                                  .dimensions = std::move(dimensions)};
         }
+        return arguments;
+    };
 
-        // store result
-        inputs.push_back(
-                {.hasNoValue = hasNoValue, .location = location, .dimensions = dimensions});
-    }
+    // unpackage input operands
+    auto inputs = NN_TRY(deserializeArguments(numberOfInputOperands,
+                                              discriminator::inputOperandInformation,
+                                              discriminator::inputOperandDimensionValue));
 
     // unpackage output operands
-    std::vector<V1_0::RequestArgument> outputs;
-    outputs.reserve(numberOfOutputOperands);
-    for (size_t operand = 0; operand < numberOfOutputOperands; ++operand) {
-        // validate output operand information
-        if (index >= data.size() ||
-            data.at(index).getDiscriminator() != discriminator::outputOperandInformation) {
-            return NN_ERROR() << "FMQ Request packet ill-formed";
-        }
-
-        // unpackage operand information
-        const FmqRequestDatum::OperandInformation& operandInfo =
-                data.at(index).outputOperandInformation();
-        index++;
-        const bool hasNoValue = operandInfo.hasNoValue;
-        const V1_0::DataLocation location = operandInfo.location;
-        const uint32_t numberOfDimensions = operandInfo.numberOfDimensions;
-
-        // unpackage operand dimensions
-        std::vector<uint32_t> dimensions;
-        dimensions.reserve(numberOfDimensions);
-        for (size_t i = 0; i < numberOfDimensions; ++i) {
-            // validate dimension
-            if (index >= data.size() ||
-                data.at(index).getDiscriminator() != discriminator::outputOperandDimensionValue) {
-                return NN_ERROR() << "FMQ Request packet ill-formed";
-            }
-
-            // unpackage dimension
-            const uint32_t dimension = data.at(index).outputOperandDimensionValue();
-            index++;
-
-            // store result
-            dimensions.push_back(dimension);
-        }
-
-        // store result
-        outputs.push_back(
-                {.hasNoValue = hasNoValue, .location = location, .dimensions = dimensions});
-    }
+    auto outputs = NN_TRY(deserializeArguments(numberOfOutputOperands,
+                                               discriminator::outputOperandInformation,
+                                               discriminator::outputOperandDimensionValue));
 
     // unpackage pools
     std::vector<int32_t> slots;
-    slots.reserve(numberOfPools);
+    slots.reserve(std::min<size_t>(numberOfPools, reader.remaining()));
     for (size_t pool = 0; pool < numberOfPools; ++pool) {
         // validate input operand information
-        if (index >= data.size() ||
-            data.at(index).getDiscriminator() != discriminator::poolIdentifier) {
+        datum = reader.next(discriminator::poolIdentifier);
+        if (datum == nullptr) {
             return NN_ERROR() << "FMQ Request packet ill-formed";
         }
 
         // unpackage operand information
-        const int32_t poolId = data.at(index).poolIdentifier();
-        index++;
-
-        // store result
-        slots.push_back(poolId);
+        slots.push_back(datum->poolIdentifier());
     }
 
     // validate measureTiming
-    if (index >= data.size() || data.at(index).getDiscriminator() != discriminator::measureTiming) {
+    datum = reader.next(discriminator::measureTiming);
+    if (datum == nullptr) {
         return NN_ERROR() << "FMQ Request packet ill-formed";
     }
 
     // unpackage measureTiming
-    const V1_2::MeasureTiming measure = data.at(index).measureTiming();
-    index++;
+    const V1_2::MeasureTiming measure = datum->measureTiming();
 
     // validate packet information
-    if (index != packetSize) {
+    if (reader.index() != packetSize) {
         return NN_ERROR() << "FMQ Request packet ill-formed";
     }
 
     // return request
-    V1_0::Request request = {.inputs = inputs, .outputs = outputs, .pools = {}};
+    V1_0::Request request = {
+            .inputs = std::move(inputs), .outputs = std::move(outputs), .pools = {}};
     return std::make_tuple(std::move(request), std::move(slots), measure);
 }
 
-// deserialize a packet into the result
-nn::Result<std::tuple<V1_0::ErrorStatus, std::vector<V1_2::OutputShape>, V1_2::Timing>> deserialize(
-        const std::vector<FmqResultDatum>& data) {
+// Deserialize the result packet made of the size elements returned by getElement(index).
+template <typename GetElement>
+nn::Result<std::tuple<V1_0::ErrorStatus, std::vector<V1_2::OutputShape>, V1_2::Timing>>
+deserializeResult(size_t size, const GetElement& getElement) {
     using discriminator = FmqResultDatum::hidl_discriminator;
-    size_t index = 0;
+    PacketReader<FmqResultDatum, GetElement> reader(size, getElement);
 
     // validate packet information
-    if (index >= data.size() ||
-        data.at(index).getDiscriminator() != discriminator::packetInformation) {
+    const FmqResultDatum* datum = reader.next(discriminator::packetInformation);
+    if (datum == nullptr) {
         return NN_ERROR() << "FMQ Result packet ill-formed";
     }
 
     // unpackage packet information
-    const FmqResultDatum::PacketInformation& packetInfo = data.at(index).packetInformation();
-    index++;
+    const FmqResultDatum::PacketInformation packetInfo = datum->packetInformation();
     const uint32_t packetSize = packetInfo.packetSize;
     const V1_0::ErrorStatus errorStatus = packetInfo.errorStatus;
     const uint32_t numberOfOperands = packetInfo.numberOfOperands;
 
     // verify packet size
-    if (data.size() != packetSize) {
+    if (size != packetSize) {
         return NN_ERROR() << "FMQ Result packet ill-formed";
     }
 
     // unpackage operands
-    std::vector<V1_2::OutputShape> outputShapes;
-    outputShapes.reserve(numberOfOperands);
+    std::vector<V1_2::OutputShape> outputShapes(
+            std::min<size_t>(numberOfOperands, reader.remaining()));
     for (size_t operand = 0; operand < numberOfOperands; ++operand) {
         // validate operand information
-        if (index >= data.size() ||
-            data.at(index).getDiscriminator() != discriminator::operandInformation) {
+        datum = reader.next(discriminator::operandInformation);
+        if (datum == nullptr) {
             return NN_ERROR() << "FMQ Result packet ill-formed";
         }
 
         // unpackage operand information
-        const FmqResultDatum::OperandInformation& operandInfo = data.at(index).operandInformation();
-        index++;
-        const bool isSufficient = operandInfo.isSufficient;
+        const FmqResultDatum::OperandInformation operandInfo = datum->operandInformation();
         const uint32_t numberOfDimensions = operandInfo.numberOfDimensions;
 
         // unpackage operand dimensions
-        std::vector<uint32_t> dimensions;
-        dimensions.reserve(numberOfDimensions);
+        hidl_vec<uint32_t> dimensions;
+        dimensions.resize(std::min<size_t>(numberOfDimensions, reader.remaining()));
         for (size_t i = 0; i < numberOfDimensions; ++i) {
             // validate dimension
-            if (index >= data.size() ||
-                data.at(index).getDiscriminator() != discriminator::operandDimensionValue) {
+            datum = reader.next(discriminator::operandDimensionValue);
+            if (datum == nullptr) {
                 return NN_ERROR() << "FMQ Result packet ill-formed";
             }
 
             // unpackage dimension
-            const uint32_t dimension = data.at(index).operandDimensionValue();
-            index++;
-
-            // store result
-            dimensions.push_back(dimension);
+            dimensions[i] = datum->operandDimensionValue();
         }
 
         // store result
-        outputShapes.push_back({.dimensions = dimensions, .isSufficient = isSufficient});
+        outputShapes[operand] = {.dimensions = std::move(dimensions),
+                                 .isSufficient = operandInfo.isSufficient};
     }
 
     // validate execution timing
-    if (index >= data.size() ||
-        data.at(index).getDiscriminator() != discriminator::executionTiming) {
+    datum = reader.next(discriminator::executionTiming);
+    if (datum == nullptr) {
         return NN_ERROR() << "FMQ Result packet ill-formed";
     }
 
     // unpackage execution timing
-    const V1_2::Timing timing = data.at(index).executionTiming();
-    index++;
+    const V1_2::Timing timing = datum->executionTiming();
 
     // validate packet information
-    if (index != packetSize) {
+    if (reader.index() != packetSize) {
         return NN_ERROR() << "FMQ Result packet ill-formed";
     }
 
@@ -408,6 +394,193 @@ nn::Result<std::tuple<V1_0::ErrorStatus, std::vector<V1_2::OutputShape>, V1_2::T
     return std::make_tuple(errorStatus, std::move(outputShapes), timing);
 }
 
+// Serializes a packet of count elements directly into the FMQ and wakes up the reader. Returns
+// false if the FMQ does not have room for the packet.
+template <typename Datum, typename Serialize>
+bool writePacket(MessageQueue<Datum, kSynchronizedReadWrite>* queue, size_t count,
+                 const Serialize& serialize) {
+    typename MessageQueue<Datum, kSynchronizedReadWrite>::MemTransaction transaction;
+    if (!queue->beginWrite(count, &transaction)) {
+        return false;
+    }
+
+    // The elements are constructed in place because the FMQ memory does not hold valid objects.
+    serialize([&transaction](size_t index) -> Datum& {
+        return *new (transaction.getSlot(index)) Datum();
+    });
+
+    if (!queue->commitWrite(count)) {
+        return false;
+    }
+
+    // The event flag bit that readBlocking waits on is private to libfmq. An empty writeBlocking
+    // writes nothing and sets that bit, waking up the reader.
+    return queue->writeBlocking(transaction.getSlot(0), 0);
+}
+
+// Waits for a packet and deserializes it directly from the FMQ.
+//
+// NOTE: all of the packet is available once its first element is. This is known because in FMQ,
+// all writes are published (made available) atomically, and the producer always publishes the
+// entire packet in one function call.
+template <typename Type, typename Datum, typename Deserialize>
+nn::Result<Type> readPacket(MessageQueue<Datum, kSynchronizedReadWrite>* queue,
+                            const Deserialize& deserialize) {
+    // Wait for the first element with a blocking read, which waits on the futex if the packet is
+    // not yet available and signals the writer once the element is consumed.
+    Datum first;
+    if (!queue->readBlocking(&first, 1)) {
+        return NN_ERROR() << "Error receiving packet";
+    }
+
+    // Deserialize the remaining elements in place.
+    const size_t count = queue->availableToRead();
+    typename MessageQueue<Datum, kSynchronizedReadWrite>::MemTransaction transaction;
+    if (count > 0 && !queue->beginRead(count, &transaction)) {
+        return NN_ERROR() << "Error receiving packet";
+    }
+    const auto getElement = [&first, &transaction](size_t index) -> const Datum* {
+        return index == 0 ? &first : transaction.getSlot(index - 1);
+    };
+    auto result = deserialize(count + 1, getElement);
+    if (count > 0 && !queue->commitRead(count)) {
+        return NN_ERROR() << "Error receiving packet";
+    }
+    return result;
+}
+
+// Polls queue for a packet for at most the polling time window chosen by policy. Returns
+// std::nullopt if isInvalid() becomes true while polling.
+//
+// Polling is more responsive (yielding lower latencies) than waiting on the futex, but can take up
+// more power, so only poll for a limited period of time.
+template <typename Datum, typename IsInvalid>
+std::optional<BurstPollingPolicy::Outcome> pollQueue(
+        const MessageQueue<Datum, kSynchronizedReadWrite>& queue, const BurstPollingPolicy& policy,
+        const IsInvalid& isInvalid) {
+    const auto pollingTimeWindow = policy.getPollingTimeWindow();
+    if (pollingTimeWindow.count() == 0) {
+        return BurstPollingPolicy::Outcome::NOT_POLLED;
+    }
+
+    auto& getCurrentTime = std::chrono::steady_clock::now;
+    auto lastPoll = getCurrentTime();
+    const auto timeToStopPolling = lastPoll + pollingTimeWindow;
+
+    while (true) {
+        // if class is being torn down, immediately return
+        if (isInvalid()) {
+            return std::nullopt;
+        }
+
+        // Check if data is available. If it is, the packet can be read without waiting.
+        if (queue.availableToRead() > 0) {
+            return BurstPollingPolicy::Outcome::RECEIVED_WHILE_POLLING;
+        }
+
+        std::this_thread::yield();
+
+        // A long yield means another thread needed this CPU, so stop competing with it.
+        const auto now = getCurrentTime();
+        if (BurstPollingPolicy::isContended(now - lastPoll)) {
+            return BurstPollingPolicy::Outcome::CONTENDED;
+        }
+        if (now >= timeToStopPolling) {
+            return BurstPollingPolicy::Outcome::POLLING_TIMED_OUT;
+        }
+        lastPoll = now;
+    }
+}
+
+// Names of the systrace counters that show how a receiver waited for its packets.
+struct PollingTraceCounters {
+    const char* receivedWhilePolling;
+    const char* pollingTimedOut;
+    const char* notPolled;
+    const char* contended;
+    const char* pollingTimeWindowUs;
+};
+
+constexpr PollingTraceCounters kRequestChannelTraceCounters = {
+        .receivedWhilePolling = "NN burst server: received while polling",
+        .pollingTimedOut = "NN burst server: polling timed out",
+        .notPolled = "NN burst server: not polled",
+        .contended = "NN burst server: polling contended",
+        .pollingTimeWindowUs = "NN burst server: polling window (us)",
+};
+
+constexpr PollingTraceCounters kResultChannelTraceCounters = {
+        .receivedWhilePolling = "NN burst controller: received while polling",
+        .pollingTimedOut = "NN burst controller: polling timed out",
+        .notPolled = "NN burst controller: not polled",
+        .contended = "NN burst controller: polling contended",
+        .pollingTimeWindowUs = "NN burst controller: polling window (us)",
+};
+
+// Records how the receiver waited for a packet, and publishes the polling counters and the next
+// polling time window as systrace counters.
+void recordPacket(BurstPollingPolicy* policy, const PollingTraceCounters& traceCounters,
+                  std::chrono::steady_clock::time_point waitStart,
+                  BurstPollingPolicy::Outcome outcome) {
+    policy->recordPacket(std::chrono::steady_clock::now() - waitStart, outcome);
+    if (!ATRACE_ENABLED()) {
+        return;
+    }
+
+    const auto counters = policy->getCounters();
+    ATRACE_INT64(traceCounters.receivedWhilePolling, counters.receivedWhilePolling);
+    ATRACE_INT64(traceCounters.pollingTimedOut, counters.pollingTimedOut);
+    ATRACE_INT64(traceCounters.notPolled, counters.notPolled);
+    ATRACE_INT64(traceCounters.contended, counters.contended);
+    ATRACE_INT64(traceCounters.pollingTimeWindowUs,
+                 std::chrono::duration_cast<std::chrono::microseconds>(
+                         policy->getPollingTimeWindow())
+                         .count());
+}
+
+}  // namespace
+
+std::chrono::microseconds getBurstControllerPollingTimeWindow() {
+    return getPollingTimeWindow("debug.nn.burst-controller-polling-window");
+}
+
+std::chrono::microseconds getBurstServerPollingTimeWindow() {
+    return getPollingTimeWindow("debug.nn.burst-server-polling-window");
+}
+
+// serialize a request into a packet
+std::vector<FmqRequestDatum> serialize(const V1_0::Request& request, V1_2::MeasureTiming measure,
+                                       const std::vector<int32_t>& slots) {
+    const size_t count = getSerializedSize(request, slots);
+    std::vector<FmqRequestDatum> data(count);
+    serializeInto(request, measure, slots,
+                  [&data](size_t index) -> FmqRequestDatum& { return data[index]; });
+    return data;
+}
+
+// serialize result
+std::vector<FmqResultDatum> serialize(V1_0::ErrorStatus errorStatus,
+                                      const std::vector<V1_2::OutputShape>& outputShapes,
+                                      V1_2::Timing timing) {
+    const size_t count = getSerializedSize(outputShapes);
+    std::vector<FmqResultDatum> data(count);
+    serializeInto(errorStatus, outputShapes, timing,
+                  [&data](size_t index) -> FmqResultDatum& { return data[index]; });
+    return data;
+}
+
+// deserialize request
+nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>> deserialize(
+        const std::vector<FmqRequestDatum>& data) {
+    return deserializeRequest(data.size(), [&data](size_t index) { return &data[index]; });
+}
+
+// deserialize a packet into the result
+nn::Result<std::tuple<V1_0::ErrorStatus, std::vector<V1_2::OutputShape>, V1_2::Timing>> deserialize(
+        const std::vector<FmqResultDatum>& data) {
+    return deserializeResult(data.size(), [&data](size_t index) { return &data[index]; });
+}
+
 // RequestChannelSender methods
 
 nn::GeneralResult<
@@ -430,8 +603,24 @@ RequestChannelSender::RequestChannelSender(PrivateConstructorTag /*tag*/, size_t
 nn::Result<void> RequestChannelSender::send(const V1_0::Request& request,
                                             V1_2::MeasureTiming measure,
                                             const std::vector<int32_t>& slots) {
-    const std::vector<FmqRequestDatum> serialized = serialize(request, measure, slots);
-    return sendPacket(serialized);
+    if (!mValid) {
+        return NN_ERROR() << "FMQ object is invalid";
+    }
+
+    const size_t count = getSerializedSize(request, slots);
+    if (count > mFmqRequestChannel.availableToWrite()) {
+        return NN_ERROR()
+               << "RequestChannelSender::send -- packet size exceeds size available in FMQ";
+    }
+
+    const auto serializePacket = [&request, measure, &slots](const auto& getElement) {
+        serializeInto(request, measure, slots, getElement);
+    };
+    if (!writePacket(&mFmqRequestChannel, count, serializePacket)) {
+        return NN_ERROR() << "RequestChannelSender::send -- failed to write to the FMQ";
+    }
+
+    return {};
 }
 
 nn::Result<void> RequestChannelSender::sendPacket(const std::vector<FmqRequestDatum>& packet) {
@@ -481,12 +670,27 @@ nn::GeneralResult<std::unique_ptr<RequestChannelReceiver>> RequestChannelReceive
 RequestChannelReceiver::RequestChannelReceiver(
         PrivateConstructorTag /*tag*/, const MQDescriptorSync<FmqRequestDatum>& requestChannel,
         std::chrono::microseconds pollingTimeWindow)
-    : mFmqRequestChannel(requestChannel), kPollingTimeWindow(pollingTimeWindow) {}
+    : mFmqRequestChannel(requestChannel), mPollingPolicy(pollingTimeWindow) {}
 
 nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>>
 RequestChannelReceiver::getBlocking() {
-    const auto packet = NN_TRY(getPacketBlocking());
-    return deserialize(packet);
+    using Type = std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>;
+
+    const auto waitStart = std::chrono::steady_clock::now();
+    const auto outcome = NN_TRY(pollForPacket());
+
+    const auto deserializePacket = [](size_t size, const auto& getElement) {
+        return deserializeRequest(size, getElement);
+    };
+    auto result = readPacket<Type>(&mFmqRequestChannel, deserializePacket);
+    recordPacket(&mPollingPolicy, kRequestChannelTraceCounters, waitStart, outcome);
+
+    // terminate loop
+    if (mTeardown) {
+        return NN_ERROR() << "FMQ object is being torn down";
+    }
+
+    return result;
 }
 
 void RequestChannelReceiver::invalidate() {
@@ -500,44 +704,35 @@ void RequestChannelReceiver::invalidate() {
     mFmqRequestChannel.writeBlocking(data.data(), data.size());
 }
 
-nn::Result<std::vector<FmqRequestDatum>> RequestChannelReceiver::getPacketBlocking() {
+nn::Result<BurstPollingPolicy::Outcome> RequestChannelReceiver::pollForPacket() {
     if (mTeardown) {
         return NN_ERROR() << "FMQ object is being torn down";
     }
 
-    // First spend time polling if results are available in FMQ instead of waiting on the futex.
-    // Polling is more responsive (yielding lower latencies), but can take up more power, so only
-    // poll for a limited period of time.
-
-    auto& getCurrentTime = std::chrono::high_resolution_clock::now;
-    const auto timeToStopPolling = getCurrentTime() + kPollingTimeWindow;
-
-    while (getCurrentTime() < timeToStopPolling) {
-        // if class is being torn down, immediately return
-        if (mTeardown.load(std::memory_order_relaxed)) {
-            return NN_ERROR() << "FMQ object is being torn down";
-        }
+    // First spend time polling if packets are available in FMQ instead of waiting on the futex.
+    const auto isInvalid = [this] { return mTeardown.load(std::memory_order_relaxed); };
+    const auto outcome = pollQueue(mFmqRequestChannel, mPollingPolicy, isInvalid);
+    if (!outcome.has_value()) {
+        return NN_ERROR() << "FMQ object is being torn down";
+    }
 
-        // Check if data is available. If it is, immediately retrieve it and return.
-        const size_t available = mFmqRequestChannel.availableToRead();
-        if (available > 0) {
-            std::vector<FmqRequestDatum> packet(available);
-            const bool success = mFmqRequestChannel.readBlocking(packet.data(), available);
-            if (!success) {
-                return NN_ERROR() << "Error receiving packet";
-            }
-            return packet;
-        }
+    // If polling did not find a packet, the caller performs a blocking read which uses a futex to
+    // save power.
+    return *outcome;
+}
 
-        std::this_thread::yield();
-    }
+BurstPollingPolicy::Counters RequestChannelReceiver::getPollingCounters() const {
+    return mPollingPolicy.getCounters();
+}
 
-    // If we get to this point, we either stopped polling because it was taking too long or polling
-    // was not allowed. Instead, perform a blocking call which uses a futex to save power.
+nn::Result<std::vector<FmqRequestDatum>> RequestChannelReceiver::getPacketBlocking() {
+    const auto waitStart = std::chrono::steady_clock::now();
+    const auto outcome = NN_TRY(pollForPacket());
 
     // wait for request packet and read first element of request packet
     FmqRequestDatum datum;
     bool success = mFmqRequestChannel.readBlocking(&datum, 1);
+    recordPacket(&mPollingPolicy, kRequestChannelTraceCounters, waitStart, outcome);
 
     // retrieve remaining elements
     // NOTE: all of the data is already available at this point, so there's no need to do a blocking
@@ -588,8 +783,19 @@ ResultChannelSender::ResultChannelSender(PrivateConstructorTag /*tag*/,
 void ResultChannelSender::send(V1_0::ErrorStatus errorStatus,
                                const std::vector<V1_2::OutputShape>& outputShapes,
                                V1_2::Timing timing) {
-    const std::vector<FmqResultDatum> serialized = serialize(errorStatus, outputShapes, timing);
-    sendPacket(serialized);
+    const size_t count = getSerializedSize(outputShapes);
+    if (count > mFmqResultChannel.availableToWrite()) {
+        // sendPacket replaces the packet with an error packet
+        sendPacket(serialize(errorStatus, outputShapes, timing));
+        return;
+    }
+
+    const auto serializePacket = [errorStatus, &outputShapes, timing](const auto& getElement) {
+        serializeInto(errorStatus, outputShapes, timing, getElement);
+    };
+    if (!writePacket(&mFmqResultChannel, count, serializePacket)) {
+        LOG(ERROR) << "ResultChannelSender::send -- failed to write to the FMQ";
+    }
 }
 
 void ResultChannelSender::sendPacket(const std::vector<FmqResultDatum>& packet) {
@@ -628,12 +834,26 @@ ResultChannelReceiver::create(size_t channelLength, std::chrono::microseconds po
 ResultChannelReceiver::ResultChannelReceiver(PrivateConstructorTag /*tag*/, size_t channelLength,
                                              std::chrono::microseconds pollingTimeWindow)
     : mFmqResultChannel(channelLength, /*configureEventFlagWord=*/true),
-      kPollingTimeWindow(pollingTimeWindow) {}
+      mPollingPolicy(pollingTimeWindow) {}
 
 nn::Result<std::tuple<V1_0::ErrorStatus, std::vector<V1_2::OutputShape>, V1_2::Timing>>
 ResultChannelReceiver::getBlocking() {
-    const auto packet = NN_TRY(getPacketBlocking());
-    return deserialize(packet);
+    using Type = std::tuple<V1_0::ErrorStatus, std::vector<V1_2::OutputShape>, V1_2::Timing>;
+
+    const auto waitStart = std::chrono::steady_clock::now();
+    const auto outcome = NN_TRY(pollForPacket());
+
+    const auto deserializePacket = [](size_t size, const auto& getElement) {
+        return deserializeResult(size, getElement);
+    };
+    auto result = readPacket<Type>(&mFmqResultChannel, deserializePacket);
+    recordPacket(&mPollingPolicy, kResultChannelTraceCounters, waitStart, outcome);
+
+    if (!mValid) {
+        return NN_ERROR() << "FMQ object is invalid";
+    }
+
+    return result;
 }
 
 void ResultChannelReceiver::notifyAsDeadObject() {
@@ -647,44 +867,35 @@ void ResultChannelReceiver::notifyAsDeadObject() {
     mFmqResultChannel.writeBlocking(data.data(), data.size());
 }
 
-nn::Result<std::vector<FmqResultDatum>> ResultChannelReceiver::getPacketBlocking() {
+nn::Result<BurstPollingPolicy::Outcome> ResultChannelReceiver::pollForPacket() {
     if (!mValid) {
         return NN_ERROR() << "FMQ object is invalid";
     }
 
-    // First spend time polling if results are available in FMQ instead of waiting on the futex.
-    // Polling is more responsive (yielding lower latencies), but can take up more power, so only
-    // poll for a limited period of time.
-
-    auto& getCurrentTime = std::chrono::high_resolution_clock::now;
-    const auto timeToStopPolling = getCurrentTime() + kPollingTimeWindow;
-
-    while (getCurrentTime() < timeToStopPolling) {
-        // if class is being torn down, immediately return
-        if (!mValid.load(std::memory_order_relaxed)) {
-            return NN_ERROR() << "FMQ object is invalid";
-        }
+    // First spend time polling if packets are available in FMQ instead of waiting on the futex.
+    const auto isInvalid = [this] { return !mValid.load(std::memory_order_relaxed); };
+    const auto outcome = pollQueue(mFmqResultChannel, mPollingPolicy, isInvalid);
+    if (!outcome.has_value()) {
+        return NN_ERROR() << "FMQ object is invalid";
+    }
 
-        // Check if data is available. If it is, immediately retrieve it and return.
-        const size_t available = mFmqResultChannel.availableToRead();
-        if (available > 0) {
-            std::vector<FmqResultDatum> packet(available);
-            const bool success = mFmqResultChannel.readBlocking(packet.data(), available);
-            if (!success) {
-                return NN_ERROR() << "Error receiving packet";
-            }
-            return packet;
-        }
+    // If polling did not find a packet, the caller performs a blocking read which uses a futex to
+    // save power.
+    return *outcome;
+}
 
-        std::this_thread::yield();
-    }
+BurstPollingPolicy::Counters ResultChannelReceiver::getPollingCounters() const {
+    return mPollingPolicy.getCounters();
+}
 
-    // If we get to this point, we either stopped polling because it was taking too long or polling
-    // was not allowed. Instead, perform a blocking call which uses a futex to save power.
+nn::Result<std::vector<FmqResultDatum>> ResultChannelReceiver::getPacketBlocking() {
+    const auto waitStart = std::chrono::steady_clock::now();
+    const auto outcome = NN_TRY(pollForPacket());
 
     // wait for result packet and read first element of result packet
     FmqResultDatum datum;
     bool success = mFmqResultChannel.readBlocking(&datum, 1);
+    recordPacket(&mPollingPolicy, kResultChannelTraceCounters, waitStart, outcome);
 
     // retrieve remaining elements
     // NOTE: all of the data is already available at this point, so there's no need to do a blocking
@@ -221,7 +221,7 @@ nn::GeneralResult<std::vector<bool>> Device::getSupportedOperations(const nn::Mo
     // Ensure that model is ready for IPC.
     std::optional<nn::Model> maybeModelInShared;
     const nn::Model& modelInShared =
-            NN_TRY(hal::utils::flushDataFromPointerToShared(&model, &maybeModelInShared));
+            NN_TRY(hal::utils::flushModelDataToShared(&model, &maybeModelInShared));
 
     const auto hidlModel = NN_TRY(convert(modelInShared));
 
@@ -242,7 +242,7 @@ nn::GeneralResult<nn::SharedPreparedModel> Device::prepareModel(
     // Ensure that model is ready for IPC.
     std::optional<nn::Model> maybeModelInShared;
     const nn::Model& modelInShared =
-            NN_TRY(hal::utils::flushDataFromPointerToShared(&model, &maybeModelInShared));
+            NN_TRY(hal::utils::flushModelDataToShared(&model, &maybeModelInShared));
 
     const auto hidlModel = NN_TRY(convert(modelInShared));
     const auto hidlPreference = NN_TRY(convert(preference));
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <nnapi/hal/1.2/BurstPollingPolicy.h>
+
+#include <chrono>
+
+namespace android::hardware::neuralnetworks::V1_2::utils {
+namespace {
+
+using namespace std::chrono_literals;
+using Outcome = BurstPollingPolicy::Outcome;
+
+constexpr auto kMaxPollingTimeWindow = 100us;
+
+void recordPackets(BurstPollingPolicy* policy, std::chrono::nanoseconds waitTime, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        policy->recordPacket(waitTime, Outcome::RECEIVED_WHILE_POLLING);
+    }
+}
+
+}  // namespace
+
+TEST(BurstPollingPolicyTest, doesNotPollBeforeFirstPacket) {
+    const BurstPollingPolicy policy(kMaxPollingTimeWindow);
+    EXPECT_EQ(policy.getPollingTimeWindow(), 0ns);
+}
+
+TEST(BurstPollingPolicyTest, pollingTimeWindowFollowsWaitTime) {
+    BurstPollingPolicy policy(kMaxPollingTimeWindow);
+    recordPackets(&policy, 40us, 100);
+
+    const auto pollingTimeWindow = policy.getPollingTimeWindow();
+    EXPECT_GT(pollingTimeWindow, 40us);
+    EXPECT_LE(pollingTimeWindow, kMaxPollingTimeWindow);
+}
+
+TEST(BurstPollingPolicyTest, pollingTimeWindowIsBounded) {
+    BurstPollingPolicy policy(kMaxPollingTimeWindow);
+    recordPackets(&policy, 90us, 100);
+    EXPECT_EQ(policy.getPollingTimeWindow(), kMaxPollingTimeWindow);
+}
+
+TEST(BurstPollingPolicyTest, doesNotPollForLongWaits) {
+    BurstPollingPolicy policy(kMaxPollingTimeWindow);
+    recordPackets(&policy, 40us, 100);
+    recordPackets(&policy, 5ms, 100);
+    EXPECT_EQ(policy.getPollingTimeWindow(), 0ns);
+
+    recordPackets(&policy, 40us, 100);
+    EXPECT_GT(policy.getPollingTimeWindow(), 0ns);
+}
+
+TEST(BurstPollingPolicyTest, zeroMaxDisablesPolling) {
+    BurstPollingPolicy policy(0us);
+    recordPackets(&policy, 0ns, 100);
+    EXPECT_EQ(policy.getPollingTimeWindow(), 0ns);
+}
+
+TEST(BurstPollingPolicyTest, backsOffAfterContention) {
+    BurstPollingPolicy policy(kMaxPollingTimeWindow);
+    recordPackets(&policy, 40us, 100);
+    policy.recordPacket(40us, Outcome::CONTENDED);
+
+    for (uint32_t i = 0; i < BurstPollingPolicy::kContentionBackoffPackets; ++i) {
+        EXPECT_EQ(policy.getPollingTimeWindow(), 0ns);
+        policy.recordPacket(40us, Outcome::NOT_POLLED);
+    }
+    EXPECT_GT(policy.getPollingTimeWindow(), 0ns);
+}
+
+TEST(BurstPollingPolicyTest, isContended) {
+    EXPECT_FALSE(BurstPollingPolicy::isContended(1us));
+    EXPECT_TRUE(BurstPollingPolicy::isContended(BurstPollingPolicy::kContentionThreshold + 1us));
+}
+
+TEST(BurstPollingPolicyTest, countsOutcomes) {
+    BurstPollingPolicy policy(kMaxPollingTimeWindow);
+    policy.recordPacket(10us, Outcome::RECEIVED_WHILE_POLLING);
+    policy.recordPacket(10us, Outcome::RECEIVED_WHILE_POLLING);
+    policy.recordPacket(200us, Outcome::POLLING_TIMED_OUT);
+    policy.recordPacket(10us, Outcome::NOT_POLLED);
+    policy.recordPacket(10us, Outcome::CONTENDED);
+
+    const auto counters = policy.getCounters();
+    EXPECT_EQ(counters.receivedWhilePolling, 2u);
+    EXPECT_EQ(counters.pollingTimedOut, 1u);
+    EXPECT_EQ(counters.notPolled, 1u);
+    EXPECT_EQ(counters.contended, 1u);
+}
+
+}  // namespace android::hardware::neuralnetworks::V1_2::utils
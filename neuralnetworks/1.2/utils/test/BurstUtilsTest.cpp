@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <nnapi/hal/1.2/BurstUtils.h>
+
+#include <chrono>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::V1_2::utils {
+namespace {
+
+using namespace std::chrono_literals;
+
+// Short enough for a few packets to wrap around the end of the ring.
+constexpr size_t kShortChannelLength = 16;
+
+// Serialized into 6 elements: packet information, one operand with two dimensions, one pool and
+// the timing measurement.
+const V1_0::Request kRequest = {
+        .inputs = {{.hasNoValue = false,
+                    .location = {.poolIndex = 0, .offset = 4, .length = 24},
+                    .dimensions = {2, 3}}},
+        .outputs = {},
+        .pools = {}};
+const std::vector<int32_t> kSlots = {7};
+
+// Serialized into 5 elements: packet information, one operand with two dimensions and the timing.
+const std::vector<V1_2::OutputShape> kOutputShapes = {{.dimensions = {4, 5}, .isSufficient = true}};
+constexpr V1_2::Timing kTiming = {.timeOnDevice = 10, .timeInDriver = 20};
+
+struct RequestChannel {
+    std::unique_ptr<RequestChannelSender> sender;
+    std::unique_ptr<RequestChannelReceiver> receiver;
+};
+
+struct ResultChannel {
+    std::unique_ptr<ResultChannelSender> sender;
+    std::unique_ptr<ResultChannelReceiver> receiver;
+};
+
+RequestChannel createRequestChannel(size_t channelLength) {
+    auto created = RequestChannelSender::create(channelLength);
+    EXPECT_TRUE(created.has_value());
+    if (!created.has_value()) {
+        return {};
+    }
+    auto [sender, descriptor] = std::move(created.value());
+    auto receiver = RequestChannelReceiver::create(*descriptor, 0us);
+    EXPECT_TRUE(receiver.has_value());
+    if (!receiver.has_value()) {
+        return {};
+    }
+    return {.sender = std::move(sender), .receiver = std::move(receiver.value())};
+}
+
+ResultChannel createResultChannel(size_t channelLength) {
+    auto created = ResultChannelReceiver::create(channelLength, 0us);
+    EXPECT_TRUE(created.has_value());
+    if (!created.has_value()) {
+        return {};
+    }
+    auto [receiver, descriptor] = std::move(created.value());
+    auto sender = ResultChannelSender::create(*descriptor);
+    EXPECT_TRUE(sender.has_value());
+    if (!sender.has_value()) {
+        return {};
+    }
+    return {.sender = std::move(sender.value()), .receiver = std::move(receiver)};
+}
+
+void expectRequest(const RequestChannel& channel) {
+    const auto result = channel.receiver->getBlocking();
+    ASSERT_TRUE(result.has_value());
+    const auto& [request, slots, measure] = result.value();
+    ASSERT_EQ(request.inputs.size(), 1u);
+    EXPECT_FALSE(request.inputs[0].hasNoValue);
+    EXPECT_EQ(request.inputs[0].location.offset, 4u);
+    EXPECT_EQ(request.inputs[0].location.length, 24u);
+    EXPECT_EQ(request.inputs[0].dimensions, hidl_vec<uint32_t>({2, 3}));
+    EXPECT_EQ(request.outputs.size(), 0u);
+    EXPECT_EQ(slots, kSlots);
+    EXPECT_EQ(measure, V1_2::MeasureTiming::YES);
+}
+
+void expectResult(const ResultChannel& channel) {
+    const auto result = channel.receiver->getBlocking();
+    ASSERT_TRUE(result.has_value());
+    const auto& [status, outputShapes, timing] = result.value();
+    EXPECT_EQ(status, V1_0::ErrorStatus::NONE);
+    ASSERT_EQ(outputShapes.size(), 1u);
+    EXPECT_EQ(outputShapes[0].dimensions, hidl_vec<uint32_t>({4, 5}));
+    EXPECT_TRUE(outputShapes[0].isSufficient);
+    EXPECT_EQ(timing.timeOnDevice, kTiming.timeOnDevice);
+    EXPECT_EQ(timing.timeInDriver, kTiming.timeInDriver);
+}
+
+}  // namespace
+
+TEST(BurstUtilsTest, requestRoundTrip) {
+    const auto channel = createRequestChannel(kExecutionBurstChannelLength);
+    ASSERT_NE(channel.receiver, nullptr);
+
+    ASSERT_TRUE(channel.sender->send(kRequest, V1_2::MeasureTiming::YES, kSlots).has_value());
+    expectRequest(channel);
+}
+
+TEST(BurstUtilsTest, requestPacketsWrapAroundChannel) {
+    const auto channel = createRequestChannel(kShortChannelLength);
+    ASSERT_NE(channel.receiver, nullptr);
+
+    // The third packet starts at element 12 and ends past the end of the ring, later packets
+    // start at other offsets.
+    for (int i = 0; i < 8; ++i) {
+        SCOPED_TRACE(i);
+        ASSERT_TRUE(channel.sender->send(kRequest, V1_2::MeasureTiming::YES, kSlots).has_value());
+        expectRequest(channel);
+    }
+}
+
+TEST(BurstUtilsTest, requestLargerThanChannelIsNotSent) {
+    const auto channel = createRequestChannel(kShortChannelLength);
+    ASSERT_NE(channel.receiver, nullptr);
+
+    V1_0::Request request = kRequest;
+    request.inputs[0].dimensions.resize(kShortChannelLength);
+    EXPECT_FALSE(channel.sender->send(request, V1_2::MeasureTiming::YES, kSlots).has_value());
+
+    // the channel is still usable
+    ASSERT_TRUE(channel.sender->send(kRequest, V1_2::MeasureTiming::YES, kSlots).has_value());
+    expectRequest(channel);
+}
+
+TEST(BurstUtilsTest, truncatedRequestPacketIsRejected) {
+    const auto channel = createRequestChannel(kShortChannelLength);
+    ASSERT_NE(channel.receiver, nullptr);
+
+    // Go around the ring a few times first so the truncated packet also wraps.
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(channel.sender->send(kRequest, V1_2::MeasureTiming::YES, kSlots).has_value());
+        expectRequest(channel);
+    }
+
+    auto packet = serialize(kRequest, V1_2::MeasureTiming::YES, kSlots);
+    packet.pop_back();
+    ASSERT_TRUE(channel.sender->sendPacket(packet).has_value());
+    EXPECT_FALSE(channel.receiver->getBlocking().has_value());
+
+    // the rejected packet is consumed and the next one is read from the right offset
+    ASSERT_TRUE(channel.sender->send(kRequest, V1_2::MeasureTiming::YES, kSlots).has_value());
+    expectRequest(channel);
+}
+
+TEST(BurstUtilsTest, malformedRequestPacketsAreRejected) {
+    const auto channel = createRequestChannel(kShortChannelLength);
+    ASSERT_NE(channel.receiver, nullptr);
+    const auto packet = serialize(kRequest, V1_2::MeasureTiming::YES, kSlots);
+
+    // packet size that does not match the number of elements
+    auto wrongSize = packet;
+    auto packetInformation = wrongSize.front().packetInformation();
+    packetInformation.packetSize += 1;
+    wrongSize.front().packetInformation(packetInformation);
+
+    // number of dimensions larger than the packet
+    auto tooManyDimensions = packet;
+    auto operandInformation = tooManyDimensions[1].inputOperandInformation();
+    operandInformation.numberOfDimensions = 0xffffffff;
+    tooManyDimensions[1].inputOperandInformation(operandInformation);
+
+    // element of the wrong type in place of the timing measurement
+    auto wrongElement = packet;
+    wrongElement.back().poolIdentifier(0);
+
+    for (const auto& malformed : {wrongSize, tooManyDimensions, wrongElement}) {
+        ASSERT_TRUE(channel.sender->sendPacket(malformed).has_value());
+        EXPECT_FALSE(channel.receiver->getBlocking().has_value());
+        ASSERT_TRUE(channel.sender->sendPacket(packet).has_value());
+        expectRequest(channel);
+    }
+}
+
+TEST(BurstUtilsTest, resultRoundTrip) {
+    const auto channel = createResultChannel(kExecutionBurstChannelLength);
+    ASSERT_NE(channel.sender, nullptr);
+
+    channel.sender->send(V1_0::ErrorStatus::NONE, kOutputShapes, kTiming);
+    expectResult(channel);
+}
+
+TEST(BurstUtilsTest, resultPacketsWrapAroundChannel) {
+    const auto channel = createResultChannel(kShortChannelLength);
+    ASSERT_NE(channel.sender, nullptr);
+
+    // The fourth packet starts at element 15 and ends past the end of the ring, later packets
+    // start at other offsets.
+    for (int i = 0; i < 8; ++i) {
+        SCOPED_TRACE(i);
+        channel.sender->send(V1_0::ErrorStatus::NONE, kOutputShapes, kTiming);
+        expectResult(channel);
+    }
+}
+
+TEST(BurstUtilsTest, resultLargerThanChannelIsSentAsFailure) {
+    const auto channel = createResultChannel(kShortChannelLength);
+    ASSERT_NE(channel.sender, nullptr);
+
+    std::vector<V1_2::OutputShape> outputShapes = kOutputShapes;
+    outputShapes[0].dimensions.resize(kShortChannelLength);
+    channel.sender->send(V1_0::ErrorStatus::NONE, outputShapes, kTiming);
+
+    const auto result = channel.receiver->getBlocking();
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(std::get<0>(result.value()), V1_0::ErrorStatus::GENERAL_FAILURE);
+    EXPECT_TRUE(std::get<1>(result.value()).empty());
+}
+
+TEST(BurstUtilsTest, malformedResultPacketsAreRejected) {
+    const auto channel = createResultChannel(kShortChannelLength);
+    ASSERT_NE(channel.sender, nullptr);
+    const auto packet = serialize(V1_0::ErrorStatus::NONE, kOutputShapes, kTiming);
+
+    // truncated packet
+    auto truncated = packet;
+    truncated.pop_back();
+
+    // number of operands larger than the packet
+    auto tooManyOperands = packet;
+    auto packetInformation = tooManyOperands.front().packetInformation();
+    packetInformation.numberOfOperands = 0xffffffff;
+    tooManyOperands.front().packetInformation(packetInformation);
+
+    // element of the wrong type in place of a dimension
+    auto wrongElement = packet;
+    wrongElement[2].executionTiming(kTiming);
+
+    for (const auto& malformed : {truncated, tooManyOperands, wrongElement}) {
+        channel.sender->sendPacket(malformed);
+        EXPECT_FALSE(channel.receiver->getBlocking().has_value());
+        channel.sender->sendPacket(packet);
+        expectResult(channel);
+    }
+}
+
+TEST(BurstUtilsTest, pollingTimeWindowIsBoundedByDefault) {
+    EXPECT_EQ(getBurstControllerPollingTimeWindow(), 100us);
+    EXPECT_EQ(getBurstServerPollingTimeWindow(), 100us);
+}
+
+TEST(BurstUtilsTest, receiversCountHowPacketsWereReceived) {
+    const auto requestChannel = createRequestChannel(kExecutionBurstChannelLength);
+    ASSERT_NE(requestChannel.receiver, nullptr);
+    const auto resultChannel = createResultChannel(kExecutionBurstChannelLength);
+    ASSERT_NE(resultChannel.sender, nullptr);
+
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_TRUE(requestChannel.sender->send(kRequest, V1_2::MeasureTiming::YES, kSlots)
+                            .has_value());
+        expectRequest(requestChannel);
+        resultChannel.sender->send(V1_0::ErrorStatus::NONE, kOutputShapes, kTiming);
+        expectResult(resultChannel);
+    }
+
+    // The channels were created with a zero polling time window.
+    for (const auto& counters : {requestChannel.receiver->getPollingCounters(),
+                                 resultChannel.receiver->getPollingCounters()}) {
+        EXPECT_EQ(counters.notPolled, 2u);
+        EXPECT_EQ(counters.receivedWhilePolling, 0u);
+        EXPECT_EQ(counters.pollingTimedOut, 0u);
+        EXPECT_EQ(counters.contended, 0u);
+    }
+}
+
+}  // namespace android::hardware::neuralnetworks::V1_2::utils
@@ -20,10 +20,12 @@
 #include <android-base/macros.h>
 #include <android-base/thread_annotations.h>
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <set>
+#include <shared_mutex>
 #include <stack>
 #include <utility>
 #include <vector>
@@ -34,17 +36,27 @@
 namespace android::nn {
 
 // This class manages a CPU buffer allocated on heap and provides validation methods.
+//
+// Buffers made by AidlManagedBuffer::create come from a process-wide pool of power-of-two size
+// classes and go back to it when the AidlManagedBuffer is destroyed, so a driver that allocates and
+// frees device memory for every execution does not hit the heap each time. As with a fresh heap
+// allocation, the contents of a new buffer are unspecified until it is initialized.
 class AidlManagedBuffer {
+    DISALLOW_COPY_AND_ASSIGN(AidlManagedBuffer);
+
   public:
     static std::shared_ptr<AidlManagedBuffer> create(uint32_t size,
                                                      std::set<AidlHalPreparedModelRole> roles,
                                                      const Operand& operand);
 
-    // Prefer AidlManagedBuffer::create.
+    // Prefer AidlManagedBuffer::create. "capacity" is the size class of buffer if it was taken from
+    // the buffer pool, or 0 if buffer is not to be returned to the pool.
     AidlManagedBuffer(std::unique_ptr<uint8_t[]> buffer, uint32_t size,
-                      std::set<AidlHalPreparedModelRole> roles, const Operand& operand);
+                      std::set<AidlHalPreparedModelRole> roles, const Operand& operand,
+                      uint32_t capacity = 0);
+    ~AidlManagedBuffer();
 
-    uint8_t* getPointer() const { return kBuffer.get(); }
+    uint8_t* getPointer() const { return mBuffer.get(); }
     uint32_t getSize() const { return kSize; }
 
     // "poolIndex" is the index of this buffer in the request.pools.
@@ -59,14 +71,25 @@ class AidlManagedBuffer {
     void setInitialized(bool initialized);
 
   private:
-    mutable std::mutex mMutex;
-    const std::unique_ptr<uint8_t[]> kBuffer;
+    using Dimensions = std::shared_ptr<const std::vector<uint32_t>>;
+
+    bool hasRole(const aidl_hal::IPreparedModel* preparedModel, IOType type, uint32_t index) const;
+    Dimensions getUpdatedDimensions() const;
+
+    // Only moved from in the destructor, to return the buffer to the pool.
+    std::unique_ptr<uint8_t[]> mBuffer;
     const uint32_t kSize;
-    const std::set<AidlHalPreparedModelRole> kRoles;
+    const uint32_t kCapacity;
+    // Sorted, so that a role is found by binary search.
+    const std::vector<AidlHalPreparedModelRole> kRoles;
     const OperandType kOperandType;
     const std::vector<uint32_t> kInitialDimensions;
-    std::vector<uint32_t> mUpdatedDimensions GUARDED_BY(mMutex);
-    bool mInitialized GUARDED_BY(mMutex) = false;
+
+    // The updated dimensions are published as an immutable snapshot. mMutex is only held to swap or
+    // copy the pointer, never while the dimensions are inspected.
+    mutable std::mutex mMutex;
+    Dimensions mUpdatedDimensions GUARDED_BY(mMutex);
+    std::atomic<bool> mInitialized = false;
 };
 
 // Keep track of all AidlManagedBuffers and assign each with a unique token.
@@ -105,7 +128,9 @@ class AidlBufferTracker : public std::enable_shared_from_this<AidlBufferTracker>
   private:
     void free(uint32_t token);
 
-    mutable std::mutex mMutex;
+    // get() is called for every device memory pool of every request, while add() and free() are
+    // only called on allocation, so lookups only take a shared lock.
+    mutable std::shared_mutex mMutex;
     std::stack<uint32_t, std::vector<uint32_t>> mFreeTokens GUARDED_BY(mMutex);
 
     // Since the tokens are allocated in a non-sparse way, we use a vector to represent the mapping.
@@ -21,38 +21,150 @@
 #include <android-base/macros.h>
 #include <nnapi/TypeUtils.h>
 
+#include <algorithm>
+#include <array>
 #include <memory>
 #include <mutex>
 #include <set>
+#include <shared_mutex>
 #include <stack>
 #include <utility>
 #include <vector>
 
 namespace android::nn {
+namespace {
+
+// Keeps the heap allocations of destroyed AidlManagedBuffers for reuse. Allocations are rounded up
+// to a power of two between kMinSizeClass and kMaxSizeClass, so that a freed buffer can back any
+// later buffer of the same size class. Larger buffers are not pooled, and the pool holds at most
+// kMaxPooledBytes, evicting its largest buffers first.
+class AidlManagedBufferPool {
+  public:
+    static AidlManagedBufferPool& get() {
+        static auto* const pool = new AidlManagedBufferPool();
+        return *pool;
+    }
+
+    // Returns a buffer of at least size bytes and its size class, which is 0 if the buffer is not
+    // pooled. Returns nullptr if the allocation fails.
+    std::pair<std::unique_ptr<uint8_t[]>, uint32_t> allocate(uint32_t size) {
+        if (size > kMaxSizeClass) {
+            return {std::unique_ptr<uint8_t[]>(new (std::nothrow) uint8_t[size]), 0};
+        }
+        const size_t index = getSizeClassIndex(size);
+        const uint32_t capacity = kMinSizeClass << index;
+        {
+            std::lock_guard<std::mutex> guard(mMutex);
+            auto& freeBuffers = mFreeBuffers[index];
+            if (!freeBuffers.empty()) {
+                auto buffer = std::move(freeBuffers.back());
+                freeBuffers.pop_back();
+                mPooledBytes -= capacity;
+                return {std::move(buffer), capacity};
+            }
+        }
+        return {std::unique_ptr<uint8_t[]>(new (std::nothrow) uint8_t[capacity]), capacity};
+    }
+
+    // Takes back a buffer returned by allocate. If the pool already holds enough buffers of its
+    // size class, the buffer is freed. If the pool then holds more than kMaxPooledBytes, its
+    // largest buffers are freed.
+    void recycle(std::unique_ptr<uint8_t[]> buffer, uint32_t capacity) {
+        CHECK_GE(capacity, kMinSizeClass);
+        CHECK_LE(capacity, kMaxSizeClass);
+        const size_t index = getSizeClassIndex(capacity);
+        CHECK_EQ(capacity, kMinSizeClass << index);
+
+        // evicted buffers are freed after the lock is released
+        std::vector<std::unique_ptr<uint8_t[]>> evicted;
+        std::lock_guard<std::mutex> guard(mMutex);
+        auto& freeBuffers = mFreeBuffers[index];
+        if (freeBuffers.size() >= kMaxFreeBuffersPerSizeClass) {
+            evicted.push_back(std::move(buffer));
+            return;
+        }
+        freeBuffers.push_back(std::move(buffer));
+        mPooledBytes += capacity;
+        for (size_t i = kNumSizeClasses; mPooledBytes > kMaxPooledBytes && i > 0;) {
+            auto& largest = mFreeBuffers[i - 1];
+            if (largest.empty()) {
+                --i;
+                continue;
+            }
+            evicted.push_back(std::move(largest.back()));
+            largest.pop_back();
+            mPooledBytes -= kMinSizeClass << (i - 1);
+        }
+    }
+
+  private:
+    static constexpr uint32_t kMinSizeClass = 4 * 1024;
+    static constexpr uint32_t kMaxSizeClass = 1024 * 1024;
+    static constexpr size_t kNumSizeClasses = 9;
+    static constexpr size_t kMaxFreeBuffersPerSizeClass = 4;
+    static constexpr size_t kMaxPooledBytes = 4 * 1024 * 1024;
+    static_assert(kMinSizeClass << (kNumSizeClasses - 1) == kMaxSizeClass);
+    static_assert(kMaxSizeClass <= kMaxPooledBytes);
+
+    static size_t getSizeClassIndex(uint32_t size) {
+        size_t index = 0;
+        while ((kMinSizeClass << index) < size) {
+            ++index;
+        }
+        return index;
+    }
+
+    std::mutex mMutex;
+    std::array<std::vector<std::unique_ptr<uint8_t[]>>, kNumSizeClasses> mFreeBuffers
+            GUARDED_BY(mMutex);
+    size_t mPooledBytes GUARDED_BY(mMutex) = 0;
+};
+
+}  // namespace
 
 std::shared_ptr<AidlManagedBuffer> AidlManagedBuffer::create(
         uint32_t size, std::set<AidlHalPreparedModelRole> roles, const Operand& operand) {
-    std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[size]);
-    if (buffer == nullptr) {
-        return nullptr;
-    }
     if (isExtension(operand.type)) {
         LOG(ERROR) << "AidlManagedBuffer cannot handle extension operands.";
         return nullptr;
     }
-    return std::make_shared<AidlManagedBuffer>(std::move(buffer), size, std::move(roles), operand);
+    auto [buffer, capacity] = AidlManagedBufferPool::get().allocate(size);
+    if (buffer == nullptr) {
+        return nullptr;
+    }
+    return std::make_shared<AidlManagedBuffer>(std::move(buffer), size, std::move(roles), operand,
+                                               capacity);
 }
 
 AidlManagedBuffer::AidlManagedBuffer(std::unique_ptr<uint8_t[]> buffer, uint32_t size,
                                      std::set<AidlHalPreparedModelRole> roles,
-                                     const Operand& operand)
-    : kBuffer(std::move(buffer)),
+                                     const Operand& operand, uint32_t capacity)
+    : mBuffer(std::move(buffer)),
       kSize(size),
-      kRoles(std::move(roles)),
+      kCapacity(capacity),
+      kRoles(roles.begin(), roles.end()),
       kOperandType(operand.type),
       kInitialDimensions(operand.dimensions),
-      mUpdatedDimensions(operand.dimensions) {
+      mUpdatedDimensions(std::make_shared<const std::vector<uint32_t>>(operand.dimensions)) {
     CHECK(!isExtension(kOperandType));
+    CHECK(kCapacity == 0 || kCapacity >= kSize);
+}
+
+AidlManagedBuffer::~AidlManagedBuffer() {
+    if (kCapacity > 0 && mBuffer != nullptr) {
+        AidlManagedBufferPool::get().recycle(std::move(mBuffer), kCapacity);
+    }
+}
+
+bool AidlManagedBuffer::hasRole(const aidl_hal::IPreparedModel* preparedModel, IOType type,
+                                uint32_t index) const {
+    return std::binary_search(kRoles.begin(), kRoles.end(),
+                              AidlHalPreparedModelRole(preparedModel, type, index));
+}
+
+AidlManagedBuffer::Dimensions AidlManagedBuffer::getUpdatedDimensions() const {
+    std::lock_guard<std::mutex> guard(mMutex);
+    return mUpdatedDimensions;
 }
 
 ErrorStatus AidlManagedBuffer::validateRequest(
@@ -60,14 +172,13 @@ ErrorStatus AidlManagedBuffer::validateRequest(
         const aidl_hal::IPreparedModel* preparedModel) const {
     CHECK_LT(poolIndex, request.pools.size());
     CHECK(std::holds_alternative<Request::MemoryDomainToken>(request.pools[poolIndex]));
-    std::lock_guard<std::mutex> guard(mMutex);
 
     bool usedAsInput = false, usedAsOutput = false;
     for (uint32_t i = 0; i < request.inputs.size(); i++) {
         if (request.inputs[i].lifetime != Request::Argument::LifeTime::POOL) continue;
         if (request.inputs[i].location.poolIndex != poolIndex) continue;
         // Validate if the input role is specified during allocation.
-        if (kRoles.count({preparedModel, IOType::INPUT, i}) == 0) {
+        if (!hasRole(preparedModel, IOType::INPUT, i)) {
             LOG(ERROR) << "AidlManagedBuffer::validateRequest -- invalid buffer role.";
             return ErrorStatus::INVALID_ARGUMENT;
         }
@@ -77,10 +188,11 @@ ErrorStatus AidlManagedBuffer::validateRequest(
                        "request.";
             return ErrorStatus::GENERAL_FAILURE;
         }
-        auto combined = combineDimensions(mUpdatedDimensions, request.inputs[i].dimensions);
+        const auto updatedDimensions = getUpdatedDimensions();
+        auto combined = combineDimensions(*updatedDimensions, request.inputs[i].dimensions);
         if (!combined.has_value()) {
             LOG(ERROR) << "AidlManagedBuffer::validateRequest -- incompatible dimensions ("
-                       << toString(mUpdatedDimensions) << " vs "
+                       << toString(*updatedDimensions) << " vs "
                        << toString(request.inputs[i].dimensions) << ")";
             return ErrorStatus::INVALID_ARGUMENT;
         }
@@ -95,7 +207,7 @@ ErrorStatus AidlManagedBuffer::validateRequest(
             return ErrorStatus::INVALID_ARGUMENT;
         }
         // Validate if the output role is specified during allocation.
-        if (kRoles.count({preparedModel, IOType::OUTPUT, i}) == 0) {
+        if (!hasRole(preparedModel, IOType::OUTPUT, i)) {
             LOG(ERROR) << "AidlManagedBuffer::validateRequest -- invalid buffer role.";
             return ErrorStatus::INVALID_ARGUMENT;
         }
@@ -162,7 +274,6 @@ ErrorStatus AidlManagedBuffer::validateCopyTo(uint32_t size) const {
                    << " vs " << size;
         return ErrorStatus::INVALID_ARGUMENT;
     }
-    std::lock_guard<std::mutex> guard(mMutex);
     if (!mInitialized) {
         LOG(ERROR) << "AidlManagedBuffer::validateCopyTo -- using uninitialized buffer as source.";
         return ErrorStatus::GENERAL_FAILURE;
@@ -177,13 +288,14 @@ bool AidlManagedBuffer::updateDimensions(const std::vector<uint32_t>& dimensions
                    << toString(kInitialDimensions) << " vs " << toString(dimensions) << ")";
         return false;
     }
+    auto updatedDimensions = std::make_shared<const std::vector<uint32_t>>(
+            std::move(combined).value());
     std::lock_guard<std::mutex> guard(mMutex);
-    mUpdatedDimensions = std::move(combined).value();
+    mUpdatedDimensions = std::move(updatedDimensions);
     return true;
 }
 
 void AidlManagedBuffer::setInitialized(bool initialized) {
-    std::lock_guard<std::mutex> guard(mMutex);
     mInitialized = initialized;
 }
 
@@ -192,7 +304,7 @@ std::unique_ptr<AidlBufferTracker::Token> AidlBufferTracker::add(
     if (buffer == nullptr) {
         return nullptr;
     }
-    std::lock_guard<std::mutex> guard(mMutex);
+    std::lock_guard<std::shared_mutex> guard(mMutex);
     uint32_t token = 0;
     if (mFreeTokens.empty()) {
         token = mTokenToBuffers.size();
@@ -207,16 +319,19 @@ std::unique_ptr<AidlBufferTracker::Token> AidlBufferTracker::add(
 }
 
 std::shared_ptr<AidlManagedBuffer> AidlBufferTracker::get(uint32_t token) const {
-    std::lock_guard<std::mutex> guard(mMutex);
-    if (mTokenToBuffers.size() <= token || mTokenToBuffers[token] == nullptr) {
+    // std::shared_lock is not visible to the thread safety analysis, so the shared lock is taken
+    // explicitly.
+    mMutex.lock_shared();
+    auto buffer = token < mTokenToBuffers.size() ? mTokenToBuffers[token] : nullptr;
+    mMutex.unlock_shared();
+    if (buffer == nullptr) {
         LOG(ERROR) << "AidlBufferTracker::get -- unknown token " << token;
-        return nullptr;
     }
-    return mTokenToBuffers[token];
+    return buffer;
 }
 
 void AidlBufferTracker::free(uint32_t token) {
-    std::lock_guard<std::mutex> guard(mMutex);
+    std::lock_guard<std::shared_mutex> guard(mMutex);
     CHECK_LT(token, mTokenToBuffers.size());
     CHECK(mTokenToBuffers[token] != nullptr);
     VLOG(MEMORY) << "AidlBufferTracker::free -- release token = " << token;
@@ -89,6 +89,14 @@ GeneralResult<std::vector<UnvalidatedConvertOutput<Type>>> unvalidatedConvert(
     return unvalidatedConvertVec(arguments);
 }
 
+// The operands and operations of a large model are split across threads.
+template <typename Type>
+GeneralResult<std::vector<UnvalidatedConvertOutput<Type>>> unvalidatedConvertInParallel(
+        const std::vector<Type>& arguments) {
+    return hal::utils::convertInParallel(
+            arguments, [](const Type& argument) { return nn::unvalidatedConvert(argument); });
+}
+
 template <typename Type>
 GeneralResult<UnvalidatedConvertOutput<Type>> validatedConvert(const Type& halObject) {
     auto canonical = NN_TRY(nn::unvalidatedConvert(halObject));
@@ -310,8 +318,8 @@ GeneralResult<Model> unvalidatedConvert(const aidl_hal::Model& model) {
 }
 
 GeneralResult<Model::Subgraph> unvalidatedConvert(const aidl_hal::Subgraph& subgraph) {
-    auto operands = NN_TRY(unvalidatedConvert(subgraph.operands));
-    auto operations = NN_TRY(unvalidatedConvert(subgraph.operations));
+    auto operands = NN_TRY(unvalidatedConvertInParallel(subgraph.operands));
+    auto operations = NN_TRY(unvalidatedConvertInParallel(subgraph.operations));
     auto inputIndexes = NN_TRY(toUnsigned(subgraph.inputIndexes));
     auto outputIndexes = NN_TRY(toUnsigned(subgraph.outputIndexes));
     return Model::Subgraph{
@@ -798,6 +806,14 @@ nn::GeneralResult<std::vector<UnvalidatedConvertOutput<Type>>> unvalidatedConver
     return halObject;
 }
 
+// The operands and operations of a large model are split across threads.
+template <typename Type>
+nn::GeneralResult<std::vector<UnvalidatedConvertOutput<Type>>> unvalidatedConvertInParallel(
+        const std::vector<Type>& arguments) {
+    return hal::utils::convertInParallel(
+            arguments, [](const Type& argument) { return unvalidatedConvert(argument); });
+}
+
 template <typename Type>
 nn::GeneralResult<UnvalidatedConvertOutput<Type>> validatedConvert(const Type& canonical) {
     NN_TRY(compliantVersion(canonical));
@@ -985,8 +1001,8 @@ nn::GeneralResult<Operation> unvalidatedConvert(const nn::Operation& operation)
 }
 
 nn::GeneralResult<Subgraph> unvalidatedConvert(const nn::Model::Subgraph& subgraph) {
-    auto operands = NN_TRY(unvalidatedConvert(subgraph.operands));
-    auto operations = NN_TRY(unvalidatedConvert(subgraph.operations));
+    auto operands = NN_TRY(unvalidatedConvertInParallel(subgraph.operands));
+    auto operations = NN_TRY(unvalidatedConvertInParallel(subgraph.operations));
     auto inputIndexes = NN_TRY(toSigned(subgraph.inputIndexes));
     auto outputIndexes = NN_TRY(toSigned(subgraph.outputIndexes));
     return Subgraph{
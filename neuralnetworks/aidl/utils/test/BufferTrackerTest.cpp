@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MockPreparedModel.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <nnapi/TypeUtils.h>
+#include <nnapi/Types.h>
+#include <nnapi/hal/aidl/BufferTracker.h>
+
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace android::nn {
+namespace {
+
+using ::aidl::android::hardware::neuralnetworks::utils::MockPreparedModel;
+
+constexpr uint32_t kSize = 16;
+
+const Operand kOperand = {
+        .type = OperandType::TENSOR_FLOAT32,
+        .dimensions = {0, 4},
+        .lifetime = Operand::LifeTime::TEMPORARY_VARIABLE,
+};
+
+Request createRequest(IOType type, std::vector<uint32_t> dimensions) {
+    const Request::Argument argument = {
+            .lifetime = Request::Argument::LifeTime::POOL,
+            .location = {.poolIndex = 0},
+            .dimensions = std::move(dimensions),
+    };
+    Request request;
+    (type == IOType::INPUT ? request.inputs : request.outputs).push_back(argument);
+    request.pools.push_back(Request::MemoryDomainToken{1});
+    return request;
+}
+
+}  // namespace
+
+TEST(BufferTrackerTest, validateRequestChecksRoles) {
+    // setup call
+    const auto preparedModel = MockPreparedModel::create();
+    const auto otherPreparedModel = MockPreparedModel::create();
+    const std::set<AidlHalPreparedModelRole> roles = {
+            {preparedModel.get(), IOType::INPUT, 0},
+            {otherPreparedModel.get(), IOType::OUTPUT, 0},
+    };
+    const auto buffer = AidlManagedBuffer::create(kSize, roles, kOperand);
+    ASSERT_NE(buffer, nullptr);
+    buffer->setInitialized(true);
+
+    // run test
+    const auto input = createRequest(IOType::INPUT, {});
+    const auto output = createRequest(IOType::OUTPUT, {});
+
+    // verify result
+    EXPECT_EQ(buffer->validateRequest(0, input, preparedModel.get()), ErrorStatus::NONE);
+    EXPECT_EQ(buffer->validateRequest(0, output, otherPreparedModel.get()), ErrorStatus::NONE);
+    EXPECT_EQ(buffer->validateRequest(0, output, preparedModel.get()),
+              ErrorStatus::INVALID_ARGUMENT);
+    EXPECT_EQ(buffer->validateRequest(0, input, otherPreparedModel.get()),
+              ErrorStatus::INVALID_ARGUMENT);
+}
+
+TEST(BufferTrackerTest, validateRequestUsesUpdatedDimensions) {
+    // setup call
+    const auto preparedModel = MockPreparedModel::create();
+    const auto buffer =
+            AidlManagedBuffer::create(kSize, {{preparedModel.get(), IOType::INPUT, 0}}, kOperand);
+    ASSERT_NE(buffer, nullptr);
+    const auto request = createRequest(IOType::INPUT, {2, 4});
+
+    // run test
+    EXPECT_EQ(buffer->validateRequest(0, request, preparedModel.get()),
+              ErrorStatus::GENERAL_FAILURE);
+    buffer->setInitialized(true);
+    ASSERT_TRUE(buffer->updateDimensions({3, 4}));
+
+    // verify result
+    EXPECT_EQ(buffer->validateRequest(0, request, preparedModel.get()),
+              ErrorStatus::INVALID_ARGUMENT);
+    ASSERT_TRUE(buffer->updateDimensions({2, 4}));
+    EXPECT_EQ(buffer->validateRequest(0, request, preparedModel.get()), ErrorStatus::NONE);
+}
+
+TEST(BufferTrackerTest, createReusesFreedBuffer) {
+    // setup call
+    auto buffer = AidlManagedBuffer::create(kSize, {}, kOperand);
+    ASSERT_NE(buffer, nullptr);
+    const uint8_t* pointer = buffer->getPointer();
+
+    // run test
+    buffer.reset();
+    const auto reused = AidlManagedBuffer::create(kSize * 2, {}, kOperand);
+
+    // verify result
+    ASSERT_NE(reused, nullptr);
+    EXPECT_EQ(reused->getPointer(), pointer);
+    EXPECT_EQ(reused->getSize(), kSize * 2);
+}
+
+TEST(BufferTrackerTest, trackerReusesFreedTokens) {
+    // setup call
+    const auto tracker = AidlBufferTracker::create();
+    const auto buffer = AidlManagedBuffer::create(kSize, {}, kOperand);
+    ASSERT_NE(buffer, nullptr);
+
+    // run test
+    auto token = tracker->add(buffer);
+    ASSERT_NE(token, nullptr);
+    const uint32_t value = token->get();
+    EXPECT_EQ(tracker->get(value), buffer);
+    token.reset();
+    EXPECT_EQ(tracker->get(value), nullptr);
+    const auto reusedToken = tracker->add(buffer);
+
+    // verify result
+    ASSERT_NE(reusedToken, nullptr);
+    EXPECT_EQ(reusedToken->get(), value);
+    EXPECT_NE(value, 0u);
+}
+
+}  // namespace android::nn
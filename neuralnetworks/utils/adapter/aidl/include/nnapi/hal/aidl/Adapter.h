@@ -46,6 +46,9 @@ using Executor = std::function<void(Task, ::android::nn::OptionalTimePoint)>;
 /**
  * Adapt an NNAPI canonical interface object to a AIDL NN HAL interface object.
  *
+ * A device that does not implement compilation caching can be wrapped in a utils::CachingDevice
+ * before it is adapted, so that models prepared again are not compiled again.
+ *
  * @param device NNAPI canonical IDevice interface object to be adapted.
  * @param executor Type-erased executor to handle executing tasks asynchronously.
  * @return AIDL NN HAL IDevice interface object.
@@ -24,6 +24,7 @@
 #include <android/binder_auto_utils.h>
 #include <nnapi/IBurst.h>
 #include <nnapi/Types.h>
+#include <nnapi/hal/MemoryCache.h>
 
 #include <memory>
 #include <mutex>
@@ -39,7 +40,10 @@ namespace aidl::android::hardware::neuralnetworks::adapter {
 class Burst : public BnBurst {
   public:
     // Precondition: burst != nullptr
-    explicit Burst(::android::nn::SharedBurst burst);
+    // Precondition: memoryCache != nullptr
+    Burst(::android::nn::SharedBurst burst,
+          std::shared_ptr<const ::android::hardware::neuralnetworks::utils::MemoryCache>
+                  memoryCache);
 
     ndk::ScopedAStatus executeSynchronously(const Request& request,
                                             const std::vector<int64_t>& memoryIdentifierTokens,
@@ -70,6 +74,9 @@ class Burst : public BnBurst {
   private:
     const ::android::nn::SharedBurst kBurst;
     const ThreadSafeMemoryCache kMemoryCache;
+    // memory converted for pools that have no memory identifier token
+    const std::shared_ptr<const ::android::hardware::neuralnetworks::utils::MemoryCache>
+            kPoolMemoryCache;
 };
 
 }  // namespace aidl::android::hardware::neuralnetworks::adapter
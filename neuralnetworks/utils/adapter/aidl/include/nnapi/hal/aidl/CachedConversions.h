@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_ADAPTER_AIDL_CACHED_CONVERSIONS_H
+#define ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_ADAPTER_AIDL_CACHED_CONVERSIONS_H
+
+#include <aidl/android/hardware/neuralnetworks/Memory.h>
+#include <aidl/android/hardware/neuralnetworks/Request.h>
+#include <nnapi/Result.h>
+#include <nnapi/Types.h>
+#include <nnapi/hal/MemoryCache.h>
+
+namespace aidl::android::hardware::neuralnetworks::adapter {
+
+/**
+ * Converts memory to canonical form, reusing the memory cached for it if there is one.
+ */
+::android::nn::GeneralResult<::android::nn::SharedMemory> convertMemory(
+        const Memory& memory, const ::android::hardware::neuralnetworks::utils::MemoryCache& cache);
+
+/**
+ * Converts request to canonical form and validates it. The memory pools of the request are
+ * converted with convertMemory.
+ *
+ * Errors are reported as nn::ErrorStatus::INVALID_ARGUMENT.
+ */
+::android::nn::GeneralResult<::android::nn::Request> convertRequest(
+        const Request& request, const ::android::hardware::neuralnetworks::utils::MemoryCache& cache);
+
+}  // namespace aidl::android::hardware::neuralnetworks::adapter
+
+#endif  // ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_ADAPTER_AIDL_CACHED_CONVERSIONS_H
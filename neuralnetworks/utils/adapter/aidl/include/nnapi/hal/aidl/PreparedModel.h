@@ -28,6 +28,7 @@
 #include <android/binder_auto_utils.h>
 #include <nnapi/IPreparedModel.h>
 #include <nnapi/Types.h>
+#include <nnapi/hal/MemoryCache.h>
 
 #include <memory>
 #include <vector>
@@ -67,6 +68,9 @@ class PreparedModel : public BnPreparedModel {
 
   protected:
     const ::android::nn::SharedPreparedModel kPreparedModel;
+    // memory converted for the pools of earlier requests, shared with the bursts of this model
+    const std::shared_ptr<const ::android::hardware::neuralnetworks::utils::MemoryCache>
+            kMemoryCache;
 };
 
 }  // namespace aidl::android::hardware::neuralnetworks::adapter
@@ -16,6 +16,8 @@
 
 #include "Burst.h"
 
+#include "CachedConversions.h"
+
 #include <android-base/logging.h>
 #include <android-base/thread_annotations.h>
 #include <android/binder_auto_utils.h>
@@ -23,6 +25,7 @@
 #include <nnapi/Result.h>
 #include <nnapi/Types.h>
 #include <nnapi/Validation.h>
+#include <nnapi/hal/MemoryCache.h>
 #include <nnapi/hal/aidl/Conversions.h>
 #include <nnapi/hal/aidl/Utils.h>
 
@@ -38,6 +41,7 @@ namespace aidl::android::hardware::neuralnetworks::adapter {
 namespace {
 
 using Value = Burst::ThreadSafeMemoryCache::Value;
+using ::android::hardware::neuralnetworks::utils::MemoryCache;
 
 template <typename Type>
 auto convertInput(const Type& object) -> decltype(nn::convert(std::declval<Type>())) {
@@ -91,7 +95,8 @@ std::vector<nn::IBurst::OptionalCacheHold> ensureAllMemoriesAreCached(
 }
 
 nn::ExecutionResult<ExecutionResult> executeSynchronously(
-        const nn::IBurst& burst, const Burst::ThreadSafeMemoryCache& cache, const Request& request,
+        const nn::IBurst& burst, const Burst::ThreadSafeMemoryCache& cache,
+        const MemoryCache& poolCache, const Request& request,
         const std::vector<int64_t>& memoryIdentifierTokens, bool measureTiming, int64_t deadlineNs,
         int64_t loopTimeoutDurationNs, const std::vector<TokenValuePair>& hints,
         const std::vector<ExtensionNameAndPrefix>& extensionNameToPrefix) {
@@ -104,7 +109,7 @@ nn::ExecutionResult<ExecutionResult> executeSynchronously(
         return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT) << "Invalid memoryIdentifierTokens";
     }
 
-    auto nnRequest = NN_TRY(convertInput(request));
+    auto nnRequest = NN_TRY(convertRequest(request, poolCache));
     const auto nnMeasureTiming = measureTiming ? nn::MeasureTiming::YES : nn::MeasureTiming::NO;
     const auto nnDeadline = NN_TRY(makeOptionalTimePoint(deadlineNs));
     const auto nnLoopTimeoutDuration = NN_TRY(makeOptionalDuration(loopTimeoutDurationNs));
@@ -147,8 +152,10 @@ void Burst::ThreadSafeMemoryCache::remove(int64_t token) const {
     mCache.erase(token);
 }
 
-Burst::Burst(nn::SharedBurst burst) : kBurst(std::move(burst)) {
+Burst::Burst(nn::SharedBurst burst, std::shared_ptr<const MemoryCache> memoryCache)
+    : kBurst(std::move(burst)), kPoolMemoryCache(std::move(memoryCache)) {
     CHECK(kBurst != nullptr);
+    CHECK(kPoolMemoryCache != nullptr);
 }
 
 ndk::ScopedAStatus Burst::executeSynchronously(const Request& request,
@@ -157,8 +164,9 @@ ndk::ScopedAStatus Burst::executeSynchronously(const Request& request,
                                                int64_t loopTimeoutDurationNs,
                                                ExecutionResult* executionResult) {
     auto result =
-            adapter::executeSynchronously(*kBurst, kMemoryCache, request, memoryIdentifierTokens,
-                                          measureTiming, deadlineNs, loopTimeoutDurationNs, {}, {});
+            adapter::executeSynchronously(*kBurst, kMemoryCache, *kPoolMemoryCache, request,
+                                          memoryIdentifierTokens, measureTiming, deadlineNs,
+                                          loopTimeoutDurationNs, {}, {});
     if (!result.has_value()) {
         auto [message, code, _] = std::move(result).error();
         const auto aidlCode = utils::convert(code).value_or(ErrorStatus::GENERAL_FAILURE);
@@ -173,7 +181,8 @@ ndk::ScopedAStatus Burst::executeSynchronouslyWithConfig(
         const Request& request, const std::vector<int64_t>& memoryIdentifierTokens,
         const ExecutionConfig& config, int64_t deadlineNs, ExecutionResult* executionResult) {
     auto result = adapter::executeSynchronously(
-            *kBurst, kMemoryCache, request, memoryIdentifierTokens, config.measureTiming,
+            *kBurst, kMemoryCache, *kPoolMemoryCache, request, memoryIdentifierTokens,
+            config.measureTiming,
             deadlineNs, config.loopTimeoutDurationNs, config.executionHints,
             config.extensionNameToPrefix);
     if (!result.has_value()) {
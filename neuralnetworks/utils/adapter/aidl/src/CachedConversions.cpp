@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CachedConversions.h"
+
+#include <aidl/android/hardware/neuralnetworks/Memory.h>
+#include <aidl/android/hardware/neuralnetworks/Request.h>
+#include <aidl/android/hardware/neuralnetworks/RequestMemoryPool.h>
+#include <nnapi/Result.h>
+#include <nnapi/Types.h>
+#include <nnapi/hal/MemoryCache.h>
+#include <nnapi/hal/aidl/Conversions.h>
+#include <nnapi/hal/aidl/Utils.h>
+
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace aidl::android::hardware::neuralnetworks::adapter {
+namespace {
+
+using ::android::hardware::neuralnetworks::utils::MemoryCache;
+
+std::optional<MemoryCache::Key> makeKey(const Memory& memory) {
+    switch (memory.getTag()) {
+        case Memory::Tag::ashmem: {
+            const auto& ashmem = memory.get<Memory::Tag::ashmem>();
+            return MemoryCache::makeKey({ashmem.fd.get()}, "ashmem", {ashmem.size});
+        }
+        case Memory::Tag::mappableFile: {
+            const auto& mappableFile = memory.get<Memory::Tag::mappableFile>();
+            return MemoryCache::makeKey(
+                    {mappableFile.fd.get()}, "mappableFile",
+                    {mappableFile.length, mappableFile.prot, mappableFile.offset});
+        }
+        case Memory::Tag::hardwareBuffer: {
+            const auto& hardwareBuffer = memory.get<Memory::Tag::hardwareBuffer>();
+            const auto& description = hardwareBuffer.description;
+            std::vector<int> fds;
+            fds.reserve(hardwareBuffer.handle.fds.size());
+            for (const auto& fd : hardwareBuffer.handle.fds) {
+                fds.push_back(fd.get());
+            }
+            std::vector<int64_t> attributes = {
+                    description.width,
+                    description.height,
+                    description.layers,
+                    static_cast<int64_t>(description.format),
+                    static_cast<int64_t>(description.usage),
+                    description.stride,
+            };
+            attributes.insert(attributes.end(), hardwareBuffer.handle.ints.begin(),
+                              hardwareBuffer.handle.ints.end());
+            return MemoryCache::makeKey(fds, "hardwareBuffer", std::move(attributes));
+        }
+    }
+    return std::nullopt;
+}
+
+nn::GeneralResult<nn::Request::MemoryPool> convertMemoryPool(const RequestMemoryPool& memoryPool,
+                                                             const MemoryCache& cache) {
+    if (memoryPool.getTag() == RequestMemoryPool::Tag::pool) {
+        return convertMemory(memoryPool.get<RequestMemoryPool::Tag::pool>(), cache);
+    }
+    return nn::unvalidatedConvert(memoryPool);
+}
+
+nn::GeneralResult<nn::Request> convertRequestImpl(const Request& request,
+                                                  const MemoryCache& cache) {
+    nn::Request canonical;
+    canonical.inputs.reserve(request.inputs.size());
+    for (const auto& input : request.inputs) {
+        canonical.inputs.push_back(NN_TRY(nn::unvalidatedConvert(input)));
+    }
+    canonical.outputs.reserve(request.outputs.size());
+    for (const auto& output : request.outputs) {
+        canonical.outputs.push_back(NN_TRY(nn::unvalidatedConvert(output)));
+    }
+    canonical.pools.reserve(request.pools.size());
+    for (const auto& pool : request.pools) {
+        canonical.pools.push_back(NN_TRY(convertMemoryPool(pool, cache)));
+    }
+    NN_TRY(utils::compliantVersion(canonical));
+    return canonical;
+}
+
+}  // namespace
+
+nn::GeneralResult<nn::SharedMemory> convertMemory(const Memory& memory, const MemoryCache& cache) {
+    return cache.getOrCreate(makeKey(memory), [&memory] { return nn::convert(memory); });
+}
+
+nn::GeneralResult<nn::Request> convertRequest(const Request& request, const MemoryCache& cache) {
+    auto result = convertRequestImpl(request, cache);
+    if (!result.has_value()) {
+        result.error().code = nn::ErrorStatus::INVALID_ARGUMENT;
+    }
+    return result;
+}
+
+}  // namespace aidl::android::hardware::neuralnetworks::adapter
@@ -17,6 +17,7 @@
 #include "PreparedModel.h"
 
 #include "Burst.h"
+#include "CachedConversions.h"
 #include "Execution.h"
 
 #include <aidl/android/hardware/neuralnetworks/BnFencedExecutionCallback.h>
@@ -33,6 +34,7 @@
 #include <nnapi/SharedMemory.h>
 #include <nnapi/Types.h>
 #include <nnapi/Validation.h>
+#include <nnapi/hal/MemoryCache.h>
 #include <nnapi/hal/aidl/Conversions.h>
 #include <nnapi/hal/aidl/Utils.h>
 
@@ -43,6 +45,8 @@
 namespace aidl::android::hardware::neuralnetworks::adapter {
 namespace {
 
+using ::android::hardware::neuralnetworks::utils::MemoryCache;
+
 class FencedExecutionCallback : public BnFencedExecutionCallback {
   public:
     FencedExecutionCallback(nn::ExecuteFencedInfoCallback callback)
@@ -119,10 +123,11 @@ nn::GeneralResult<nn::OptionalTimePoint> makeOptionalTimePoint(int64_t durationN
 }
 
 nn::ExecutionResult<ExecutionResult> executeSynchronously(
-        const nn::IPreparedModel& preparedModel, const Request& request, bool measureTiming,
-        int64_t deadlineNs, int64_t loopTimeoutDurationNs, const std::vector<TokenValuePair>& hints,
+        const nn::IPreparedModel& preparedModel, const MemoryCache& cache, const Request& request,
+        bool measureTiming, int64_t deadlineNs, int64_t loopTimeoutDurationNs,
+        const std::vector<TokenValuePair>& hints,
         const std::vector<ExtensionNameAndPrefix>& extensionNameToPrefix) {
-    const auto nnRequest = NN_TRY(convertInput(request));
+    const auto nnRequest = NN_TRY(convertRequest(request, cache));
     const auto nnMeasureTiming = measureTiming ? nn::MeasureTiming::YES : nn::MeasureTiming::NO;
     const auto nnDeadline = NN_TRY(makeOptionalTimePoint(deadlineNs));
     const auto nnLoopTimeoutDuration = NN_TRY(makeOptionalDuration(loopTimeoutDurationNs));
@@ -148,12 +153,12 @@ nn::ExecutionResult<ExecutionResult> executeSynchronously(
 }
 
 nn::GeneralResult<FencedExecutionResult> executeFenced(
-        const nn::IPreparedModel& preparedModel, const Request& request,
+        const nn::IPreparedModel& preparedModel, const MemoryCache& cache, const Request& request,
         const std::vector<ndk::ScopedFileDescriptor>& waitFor, bool measureTiming,
         int64_t deadlineNs, int64_t loopTimeoutDurationNs, int64_t durationNs,
         const std::vector<TokenValuePair>& hints,
         const std::vector<ExtensionNameAndPrefix>& extensionNameToPrefix) {
-    const auto nnRequest = NN_TRY(convertInput(request));
+    const auto nnRequest = NN_TRY(convertRequest(request, cache));
     const auto nnWaitFor = NN_TRY(convertSyncFences(waitFor));
     const auto nnMeasureTiming = measureTiming ? nn::MeasureTiming::YES : nn::MeasureTiming::NO;
     const auto nnDeadline = NN_TRY(makeOptionalTimePoint(deadlineNs));
@@ -178,10 +183,10 @@ nn::GeneralResult<FencedExecutionResult> executeFenced(
 }
 
 nn::GeneralResult<nn::SharedExecution> createReusableExecution(
-        const nn::IPreparedModel& preparedModel, const Request& request, bool measureTiming,
-        int64_t loopTimeoutDurationNs, const std::vector<TokenValuePair>& hints,
+        const nn::IPreparedModel& preparedModel, const MemoryCache& cache, const Request& request,
+        bool measureTiming, int64_t loopTimeoutDurationNs, const std::vector<TokenValuePair>& hints,
         const std::vector<ExtensionNameAndPrefix>& extensionNameToPrefix) {
-    const auto nnRequest = NN_TRY(convertInput(request));
+    const auto nnRequest = NN_TRY(convertRequest(request, cache));
     const auto nnMeasureTiming = measureTiming ? nn::MeasureTiming::YES : nn::MeasureTiming::NO;
     const auto nnLoopTimeoutDuration = NN_TRY(makeOptionalDuration(loopTimeoutDurationNs));
     auto nnHints = NN_TRY(convertInput(hints));
@@ -235,7 +240,7 @@ nn::GeneralResult<FencedExecutionResult> executeFenced(
 }  // namespace
 
 PreparedModel::PreparedModel(nn::SharedPreparedModel preparedModel)
-    : kPreparedModel(std::move(preparedModel)) {
+    : kPreparedModel(std::move(preparedModel)), kMemoryCache(std::make_shared<MemoryCache>()) {
     CHECK(kPreparedModel != nullptr);
 }
 
@@ -243,8 +248,9 @@ ndk::ScopedAStatus PreparedModel::executeSynchronously(const Request& request, b
                                                        int64_t deadlineNs,
                                                        int64_t loopTimeoutDurationNs,
                                                        ExecutionResult* executionResult) {
-    auto result = adapter::executeSynchronously(*kPreparedModel, request, measureTiming, deadlineNs,
-                                                loopTimeoutDurationNs, {}, {});
+    auto result = adapter::executeSynchronously(*kPreparedModel, *kMemoryCache, request,
+                                                measureTiming, deadlineNs, loopTimeoutDurationNs,
+                                                {}, {});
     if (!result.has_value()) {
         const auto& [message, code, _] = result.error();
         const auto aidlCode = utils::convert(code).value_or(ErrorStatus::GENERAL_FAILURE);
@@ -259,8 +265,9 @@ ndk::ScopedAStatus PreparedModel::executeFenced(
         const Request& request, const std::vector<ndk::ScopedFileDescriptor>& waitFor,
         bool measureTiming, int64_t deadlineNs, int64_t loopTimeoutDurationNs, int64_t durationNs,
         FencedExecutionResult* executionResult) {
-    auto result = adapter::executeFenced(*kPreparedModel, request, waitFor, measureTiming,
-                                         deadlineNs, loopTimeoutDurationNs, durationNs, {}, {});
+    auto result = adapter::executeFenced(*kPreparedModel, *kMemoryCache, request, waitFor,
+                                         measureTiming, deadlineNs, loopTimeoutDurationNs,
+                                         durationNs, {}, {});
     if (!result.has_value()) {
         const auto& [message, code] = result.error();
         const auto aidlCode = utils::convert(code).value_or(ErrorStatus::GENERAL_FAILURE);
@@ -276,7 +283,7 @@ ndk::ScopedAStatus PreparedModel::executeSynchronouslyWithConfig(const Request&
                                                                  int64_t deadlineNs,
                                                                  ExecutionResult* executionResult) {
     auto result = adapter::executeSynchronously(
-            *kPreparedModel, request, config.measureTiming, deadlineNs,
+            *kPreparedModel, *kMemoryCache, request, config.measureTiming, deadlineNs,
             config.loopTimeoutDurationNs, config.executionHints, config.extensionNameToPrefix);
     if (!result.has_value()) {
         const auto& [message, code, _] = result.error();
@@ -292,8 +299,9 @@ ndk::ScopedAStatus PreparedModel::executeFencedWithConfig(
         const Request& request, const std::vector<ndk::ScopedFileDescriptor>& waitFor,
         const ExecutionConfig& config, int64_t deadlineNs, int64_t durationNs,
         FencedExecutionResult* executionResult) {
-    auto result = adapter::executeFenced(*kPreparedModel, request, waitFor, config.measureTiming,
-                                         deadlineNs, config.loopTimeoutDurationNs, durationNs,
+    auto result = adapter::executeFenced(*kPreparedModel, *kMemoryCache, request, waitFor,
+                                         config.measureTiming, deadlineNs,
+                                         config.loopTimeoutDurationNs, durationNs,
                                          config.executionHints, config.extensionNameToPrefix);
     if (!result.has_value()) {
         const auto& [message, code] = result.error();
@@ -313,7 +321,7 @@ ndk::ScopedAStatus PreparedModel::configureExecutionBurst(std::shared_ptr<IBurst
         return ndk::ScopedAStatus::fromServiceSpecificErrorWithMessage(
                 static_cast<int32_t>(aidlCode), message.c_str());
     }
-    *burst = ndk::SharedRefBase::make<Burst>(std::move(result).value());
+    *burst = ndk::SharedRefBase::make<Burst>(std::move(result).value(), kMemoryCache);
     return ndk::ScopedAStatus::ok();
 }
 
@@ -325,8 +333,8 @@ ndk::ScopedAStatus PreparedModel::createReusableExecution(const Request& request
                                                           const ExecutionConfig& config,
                                                           std::shared_ptr<IExecution>* execution) {
     auto result = adapter::createReusableExecution(
-            *kPreparedModel, request, config.measureTiming, config.loopTimeoutDurationNs,
-            config.executionHints, config.extensionNameToPrefix);
+            *kPreparedModel, *kMemoryCache, request, config.measureTiming,
+            config.loopTimeoutDurationNs, config.executionHints, config.extensionNameToPrefix);
     if (!result.has_value()) {
         const auto& [message, code] = result.error();
         const auto aidlCode = utils::convert(code).value_or(ErrorStatus::GENERAL_FAILURE);
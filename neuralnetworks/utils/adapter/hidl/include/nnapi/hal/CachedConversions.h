@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_ADAPTER_CACHED_CONVERSIONS_H
+#define ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_ADAPTER_CACHED_CONVERSIONS_H
+
+#include <android/hardware/neuralnetworks/1.0/types.h>
+#include <android/hardware/neuralnetworks/1.3/types.h>
+#include <hidl/HidlSupport.h>
+#include <nnapi/Result.h>
+#include <nnapi/Types.h>
+#include <nnapi/hal/MemoryCache.h>
+
+namespace android::hardware::neuralnetworks::adapter {
+
+/**
+ * Converts memory to canonical form, reusing the memory cached for it if there is one.
+ */
+nn::GeneralResult<nn::SharedMemory> convertMemory(const hidl_memory& memory,
+                                                  const utils::MemoryCache& cache);
+
+/**
+ * Converts request to canonical form and validates it. The memory pools of the request are
+ * converted with convertMemory.
+ *
+ * Errors are reported as nn::ErrorStatus::INVALID_ARGUMENT.
+ */
+nn::GeneralResult<nn::Request> convertRequest(const V1_0::Request& request,
+                                              const utils::MemoryCache& cache);
+nn::GeneralResult<nn::Request> convertRequest(const V1_3::Request& request,
+                                              const utils::MemoryCache& cache);
+
+}  // namespace android::hardware::neuralnetworks::adapter
+
+#endif  // ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_ADAPTER_CACHED_CONVERSIONS_H
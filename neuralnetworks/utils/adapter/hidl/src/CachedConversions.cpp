@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CachedConversions.h"
+
+#include <android/hardware/neuralnetworks/1.0/types.h>
+#include <android/hardware/neuralnetworks/1.3/types.h>
+#include <hidl/HidlSupport.h>
+#include <nnapi/Result.h>
+#include <nnapi/Types.h>
+#include <nnapi/hal/1.0/Conversions.h>
+#include <nnapi/hal/1.0/Utils.h>
+#include <nnapi/hal/1.3/Conversions.h>
+#include <nnapi/hal/1.3/Utils.h>
+#include <nnapi/hal/MemoryCache.h>
+
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::adapter {
+namespace {
+
+using utils::MemoryCache;
+
+std::optional<MemoryCache::Key> makeKey(const hidl_memory& memory) {
+    const native_handle_t* handle = memory.handle();
+    if (handle == nullptr) {
+        return std::nullopt;
+    }
+    const int* fdsBegin = handle->data;
+    const int* intsBegin = handle->data + handle->numFds;
+    const int* intsEnd = intsBegin + handle->numInts;
+
+    std::vector<int64_t> attributes = {static_cast<int64_t>(memory.size())};
+    attributes.insert(attributes.end(), intsBegin, intsEnd);
+    return MemoryCache::makeKey(std::vector<int>(fdsBegin, intsBegin), memory.name(),
+                                std::move(attributes));
+}
+
+nn::GeneralResult<nn::Request::MemoryPool> convertMemoryPool(const hidl_memory& memoryPool,
+                                                             const MemoryCache& cache) {
+    return convertMemory(memoryPool, cache);
+}
+
+nn::GeneralResult<nn::Request::MemoryPool> convertMemoryPool(
+        const V1_3::Request::MemoryPool& memoryPool, const MemoryCache& cache) {
+    using Discriminator = V1_3::Request::MemoryPool::hidl_discriminator;
+    if (memoryPool.getDiscriminator() == Discriminator::hidlMemory) {
+        return convertMemory(memoryPool.hidlMemory(), cache);
+    }
+    return nn::unvalidatedConvert(memoryPool);
+}
+
+template <typename Type>
+nn::GeneralResult<nn::Request> unvalidatedConvertRequest(const Type& request,
+                                                         const MemoryCache& cache) {
+    nn::Request canonical;
+    canonical.inputs.reserve(request.inputs.size());
+    for (const auto& input : request.inputs) {
+        canonical.inputs.push_back(NN_TRY(nn::unvalidatedConvert(input)));
+    }
+    canonical.outputs.reserve(request.outputs.size());
+    for (const auto& output : request.outputs) {
+        canonical.outputs.push_back(NN_TRY(nn::unvalidatedConvert(output)));
+    }
+    canonical.pools.reserve(request.pools.size());
+    for (const auto& pool : request.pools) {
+        canonical.pools.push_back(NN_TRY(convertMemoryPool(pool, cache)));
+    }
+    return canonical;
+}
+
+nn::GeneralResult<nn::Request> convertRequestImpl(const V1_0::Request& request,
+                                                  const MemoryCache& cache) {
+    auto canonical = NN_TRY(unvalidatedConvertRequest(request, cache));
+    NN_TRY(V1_0::utils::compliantVersion(canonical));
+    return canonical;
+}
+
+nn::GeneralResult<nn::Request> convertRequestImpl(const V1_3::Request& request,
+                                                  const MemoryCache& cache) {
+    auto canonical = NN_TRY(unvalidatedConvertRequest(request, cache));
+    NN_TRY(V1_3::utils::compliantVersion(canonical));
+    return canonical;
+}
+
+template <typename Type>
+nn::GeneralResult<nn::Request> convertRequestOrInvalidArgument(const Type& request,
+                                                               const MemoryCache& cache) {
+    auto result = convertRequestImpl(request, cache);
+    if (!result.has_value()) {
+        result.error().code = nn::ErrorStatus::INVALID_ARGUMENT;
+    }
+    return result;
+}
+
+}  // namespace
+
+nn::GeneralResult<nn::SharedMemory> convertMemory(const hidl_memory& memory,
+                                                  const MemoryCache& cache) {
+    return cache.getOrCreate(makeKey(memory), [&memory] { return nn::unvalidatedConvert(memory); });
+}
+
+nn::GeneralResult<nn::Request> convertRequest(const V1_0::Request& request,
+                                              const MemoryCache& cache) {
+    return convertRequestOrInvalidArgument(request, cache);
+}
+
+nn::GeneralResult<nn::Request> convertRequest(const V1_3::Request& request,
+                                              const MemoryCache& cache) {
+    return convertRequestOrInvalidArgument(request, cache);
+}
+
+}  // namespace android::hardware::neuralnetworks::adapter
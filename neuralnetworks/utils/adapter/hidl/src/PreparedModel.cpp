@@ -17,6 +17,7 @@
 #include "PreparedModel.h"
 
 #include "Burst.h"
+#include "CachedConversions.h"
 
 #include <android-base/logging.h>
 #include <android/hardware/neuralnetworks/1.0/IExecutionCallback.h>
@@ -36,6 +37,7 @@
 #include <nnapi/hal/1.2/Utils.h>
 #include <nnapi/hal/1.3/Conversions.h>
 #include <nnapi/hal/1.3/Utils.h>
+#include <nnapi/hal/MemoryCache.h>
 
 #include <memory>
 #include <thread>
@@ -46,6 +48,8 @@
 namespace android::hardware::neuralnetworks::adapter {
 namespace {
 
+using utils::MemoryCache;
+
 template <typename Type>
 auto convertInput(const Type& object) -> decltype(nn::convert(std::declval<Type>())) {
     auto result = nn::convert(object);
@@ -135,13 +139,13 @@ void notify(CallbackType* callback, ExecutionResult result) {
 }
 
 nn::GeneralResult<void> execute(const nn::SharedPreparedModel& preparedModel,
-                                const V1_0::Request& request,
+                                const MemoryCache& cache, const V1_0::Request& request,
                                 const sp<V1_0::IExecutionCallback>& callback) {
     if (callback.get() == nullptr) {
         return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT) << "Invalid callback";
     }
 
-    const auto nnRequest = NN_TRY(convertInput(request));
+    const auto nnRequest = NN_TRY(convertRequest(request, cache));
 
     auto result = preparedModel->execute(nnRequest, nn::MeasureTiming::NO, {}, {}, {}, {});
 
@@ -155,13 +159,14 @@ nn::GeneralResult<void> execute(const nn::SharedPreparedModel& preparedModel,
 }
 
 nn::GeneralResult<void> execute_1_2(const nn::SharedPreparedModel& preparedModel,
-                                    const V1_0::Request& request, V1_2::MeasureTiming measure,
+                                    const MemoryCache& cache, const V1_0::Request& request,
+                                    V1_2::MeasureTiming measure,
                                     const sp<V1_2::IExecutionCallback>& callback) {
     if (callback.get() == nullptr) {
         return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT) << "Invalid callback";
     }
 
-    const auto nnRequest = NN_TRY(convertInput(request));
+    const auto nnRequest = NN_TRY(convertRequest(request, cache));
     const auto nnMeasure = NN_TRY(convertInput(measure));
 
     auto result = preparedModel->execute(nnRequest, nnMeasure, {}, {}, {}, {});
@@ -176,7 +181,8 @@ nn::GeneralResult<void> execute_1_2(const nn::SharedPreparedModel& preparedModel
 }
 
 nn::GeneralResult<void> execute_1_3(const nn::SharedPreparedModel& preparedModel,
-                                    const V1_3::Request& request, V1_2::MeasureTiming measure,
+                                    const MemoryCache& cache, const V1_3::Request& request,
+                                    V1_2::MeasureTiming measure,
                                     const V1_3::OptionalTimePoint& deadline,
                                     const V1_3::OptionalTimeoutDuration& loopTimeoutDuration,
                                     const sp<V1_3::IExecutionCallback>& callback) {
@@ -184,7 +190,7 @@ nn::GeneralResult<void> execute_1_3(const nn::SharedPreparedModel& preparedModel
         return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT) << "Invalid callback";
     }
 
-    const auto nnRequest = NN_TRY(convertInput(request));
+    const auto nnRequest = NN_TRY(convertRequest(request, cache));
     const auto nnMeasure = NN_TRY(convertInput(measure));
     const auto nnDeadline = NN_TRY(convertInput(deadline));
     const auto nnLoopTimeoutDuration = NN_TRY(convertInput(loopTimeoutDuration));
@@ -202,9 +208,9 @@ nn::GeneralResult<void> execute_1_3(const nn::SharedPreparedModel& preparedModel
 }
 
 nn::ExecutionResult<std::pair<hidl_vec<V1_2::OutputShape>, V1_2::Timing>> executeSynchronously(
-        const nn::SharedPreparedModel& preparedModel, const V1_0::Request& request,
-        V1_2::MeasureTiming measure) {
-    const auto nnRequest = NN_TRY(convertInput(request));
+        const nn::SharedPreparedModel& preparedModel, const MemoryCache& cache,
+        const V1_0::Request& request, V1_2::MeasureTiming measure) {
+    const auto nnRequest = NN_TRY(convertRequest(request, cache));
     const auto nnMeasure = NN_TRY(convertInput(measure));
 
     const auto [outputShapes, timing] =
@@ -216,10 +222,11 @@ nn::ExecutionResult<std::pair<hidl_vec<V1_2::OutputShape>, V1_2::Timing>> execut
 }
 
 nn::ExecutionResult<std::pair<hidl_vec<V1_2::OutputShape>, V1_2::Timing>> executeSynchronously_1_3(
-        const nn::SharedPreparedModel& preparedModel, const V1_3::Request& request,
-        V1_2::MeasureTiming measure, const V1_3::OptionalTimePoint& deadline,
+        const nn::SharedPreparedModel& preparedModel, const MemoryCache& cache,
+        const V1_3::Request& request, V1_2::MeasureTiming measure,
+        const V1_3::OptionalTimePoint& deadline,
         const V1_3::OptionalTimeoutDuration& loopTimeoutDuration) {
-    const auto nnRequest = NN_TRY(convertInput(request));
+    const auto nnRequest = NN_TRY(convertRequest(request, cache));
     const auto nnMeasure = NN_TRY(convertInput(measure));
     const auto nnDeadline = NN_TRY(convertInput(deadline));
     const auto nnLoopTimeoutDuration = NN_TRY(convertInput(loopTimeoutDuration));
@@ -257,12 +264,13 @@ nn::GeneralResult<sp<V1_2::IBurstContext>> configureExecutionBurst(
 }
 
 nn::GeneralResult<std::pair<hidl_handle, sp<V1_3::IFencedExecutionCallback>>> executeFenced(
-        const nn::SharedPreparedModel& preparedModel, const V1_3::Request& request,
-        const hidl_vec<hidl_handle>& waitFor, V1_2::MeasureTiming measure,
+        const nn::SharedPreparedModel& preparedModel, const MemoryCache& cache,
+        const V1_3::Request& request, const hidl_vec<hidl_handle>& waitFor,
+        V1_2::MeasureTiming measure,
         const V1_3::OptionalTimePoint& deadline,
         const V1_3::OptionalTimeoutDuration& loopTimeoutDuration,
         const V1_3::OptionalTimeoutDuration& duration) {
-    const auto nnRequest = NN_TRY(convertInput(request));
+    const auto nnRequest = NN_TRY(convertRequest(request, cache));
     const auto nnWaitFor = NN_TRY(convertSyncFences(waitFor));
     const auto nnMeasure = NN_TRY(convertInput(measure));
     const auto nnDeadline = NN_TRY(convertInput(deadline));
@@ -291,7 +299,7 @@ nn::SharedPreparedModel PreparedModel::getUnderlyingPreparedModel() const {
 
 Return<V1_0::ErrorStatus> PreparedModel::execute(const V1_0::Request& request,
                                                  const sp<V1_0::IExecutionCallback>& callback) {
-    auto result = adapter::execute(kPreparedModel, request, callback);
+    auto result = adapter::execute(kPreparedModel, kMemoryCache, request, callback);
     if (!result.has_value()) {
         auto [message, code] = std::move(result).error();
         LOG(ERROR) << "adapter::PreparedModel::execute failed with " << code << ": " << message;
@@ -304,7 +312,7 @@ Return<V1_0::ErrorStatus> PreparedModel::execute(const V1_0::Request& request,
 Return<V1_0::ErrorStatus> PreparedModel::execute_1_2(const V1_0::Request& request,
                                                      V1_2::MeasureTiming measure,
                                                      const sp<V1_2::IExecutionCallback>& callback) {
-    auto result = adapter::execute_1_2(kPreparedModel, request, measure, callback);
+    auto result = adapter::execute_1_2(kPreparedModel, kMemoryCache, request, measure, callback);
     if (!result.has_value()) {
         auto [message, code] = std::move(result).error();
         LOG(ERROR) << "adapter::PreparedModel::execute_1_2 failed with " << code << ": " << message;
@@ -319,7 +327,7 @@ Return<V1_3::ErrorStatus> PreparedModel::execute_1_3(
         const V1_3::OptionalTimePoint& deadline,
         const V1_3::OptionalTimeoutDuration& loopTimeoutDuration,
         const sp<V1_3::IExecutionCallback>& callback) {
-    auto result = adapter::execute_1_3(kPreparedModel, request, measure, deadline,
+    auto result = adapter::execute_1_3(kPreparedModel, kMemoryCache, request, measure, deadline,
                                        loopTimeoutDuration, callback);
     if (!result.has_value()) {
         auto [message, code] = std::move(result).error();
@@ -333,7 +341,7 @@ Return<V1_3::ErrorStatus> PreparedModel::execute_1_3(
 Return<void> PreparedModel::executeSynchronously(const V1_0::Request& request,
                                                  V1_2::MeasureTiming measure,
                                                  executeSynchronously_cb cb) {
-    auto result = adapter::executeSynchronously(kPreparedModel, request, measure);
+    auto result = adapter::executeSynchronously(kPreparedModel, kMemoryCache, request, measure);
     if (!result.has_value()) {
         auto [message, code, outputShapes] = std::move(result).error();
         LOG(ERROR) << "adapter::PreparedModel::executeSynchronously failed with " << code << ": "
@@ -351,8 +359,8 @@ Return<void> PreparedModel::executeSynchronously_1_3(
         const V1_3::Request& request, V1_2::MeasureTiming measure,
         const V1_3::OptionalTimePoint& deadline,
         const V1_3::OptionalTimeoutDuration& loopTimeoutDuration, executeSynchronously_1_3_cb cb) {
-    auto result = adapter::executeSynchronously_1_3(kPreparedModel, request, measure, deadline,
-                                                    loopTimeoutDuration);
+    auto result = adapter::executeSynchronously_1_3(kPreparedModel, kMemoryCache, request, measure,
+                                                    deadline, loopTimeoutDuration);
     if (!result.has_value()) {
         auto [message, code, outputShapes] = std::move(result).error();
         LOG(ERROR) << "adapter::PreparedModel::executeSynchronously_1_3 failed with " << code
@@ -392,8 +400,8 @@ Return<void> PreparedModel::executeFenced(const V1_3::Request& request,
                                           const V1_3::OptionalTimeoutDuration& loopTimeoutDuration,
                                           const V1_3::OptionalTimeoutDuration& duration,
                                           executeFenced_cb callback) {
-    auto result = adapter::executeFenced(kPreparedModel, request, waitFor, measure, deadline,
-                                         loopTimeoutDuration, duration);
+    auto result = adapter::executeFenced(kPreparedModel, kMemoryCache, request, waitFor, measure,
+                                         deadline, loopTimeoutDuration, duration);
     if (!result.has_value()) {
         auto [message, code] = std::move(result).error();
         LOG(ERROR) << "adapter::PreparedModel::executeFenced failed with " << code << ": "
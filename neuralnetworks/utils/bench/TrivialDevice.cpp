@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TrivialDevice.h"
+
+#include <android-base/logging.h>
+#include <nnapi/IBuffer.h>
+#include <nnapi/IBurst.h>
+#include <nnapi/IDevice.h>
+#include <nnapi/IExecution.h>
+#include <nnapi/IPreparedModel.h>
+#include <nnapi/Result.h>
+#include <nnapi/SharedMemory.h>
+#include <nnapi/Types.h>
+
+#include <any>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::bench {
+namespace {
+
+constexpr auto kNoInfo = std::numeric_limits<float>::max();
+constexpr auto kNoPerformanceInfo =
+        nn::Capabilities::PerformanceInfo{.execTime = kNoInfo, .powerUsage = kNoInfo};
+constexpr auto kFastPerformanceInfo =
+        nn::Capabilities::PerformanceInfo{.execTime = 0.1f, .powerUsage = 0.1f};
+
+nn::Capabilities createCapabilities() {
+    auto operandPerformance = nn::Capabilities::OperandPerformanceTable::create(
+            {{.type = nn::OperandType::TENSOR_FLOAT32, .info = kFastPerformanceInfo}});
+    CHECK(operandPerformance.has_value());
+    return {.relaxedFloat32toFloat16PerformanceScalar = kNoPerformanceInfo,
+            .relaxedFloat32toFloat16PerformanceTensor = kNoPerformanceInfo,
+            .operandPerformance = std::move(operandPerformance).value(),
+            .ifPerformance = kNoPerformanceInfo,
+            .whilePerformance = kNoPerformanceInfo};
+}
+
+using ExecutionResult = nn::ExecutionResult<std::pair<std::vector<nn::OutputShape>, nn::Timing>>;
+using FencedExecutionResult =
+        nn::GeneralResult<std::pair<nn::SyncFence, nn::ExecuteFencedInfoCallback>>;
+
+nn::GeneralResult<float*> getData(const nn::Request::Argument& argument,
+                                  const std::vector<nn::Mapping>& mappings) {
+    if (argument.lifetime != nn::Request::Argument::LifeTime::POOL) {
+        return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT) << "TrivialDevice only supports pools";
+    }
+    const auto& location = argument.location;
+    if (location.poolIndex >= mappings.size()) {
+        return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT) << "Invalid pool index";
+    }
+    const auto& mapping = mappings[location.poolIndex];
+    if (static_cast<size_t>(location.offset) + location.length > mapping.size) {
+        return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT) << "Argument out of bounds";
+    }
+    auto* const* data = std::get_if<void*>(&mapping.pointer);
+    if (data == nullptr) {
+        return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT) << "Pool is not writable";
+    }
+    return reinterpret_cast<float*>(static_cast<uint8_t*>(*data) + location.offset);
+}
+
+// Runs a model created by createModel. Output i is the sum of input i with itself.
+nn::GeneralResult<std::vector<nn::OutputShape>> computeOutputs(const nn::Model& model,
+                                                               const nn::Request& request) {
+    if (request.inputs.size() != model.main.inputIndexes.size() ||
+        request.outputs.size() != model.main.outputIndexes.size()) {
+        return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT) << "Request does not match model";
+    }
+
+    std::vector<nn::Mapping> mappings;
+    mappings.reserve(request.pools.size());
+    for (const auto& pool : request.pools) {
+        const auto* memory = std::get_if<nn::SharedMemory>(&pool);
+        if (memory == nullptr) {
+            return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT)
+                   << "TrivialDevice does not support driver-managed memory";
+        }
+        mappings.push_back(NN_TRY(nn::map(*memory)));
+    }
+
+    std::vector<nn::OutputShape> outputShapes;
+    outputShapes.reserve(request.outputs.size());
+    for (size_t i = 0; i < request.outputs.size(); ++i) {
+        const auto& input = request.inputs[i];
+        const auto& output = request.outputs[i];
+        if (input.location.length != output.location.length) {
+            return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT) << "Mismatched argument lengths";
+        }
+        const float* in = NN_TRY(getData(input, mappings));
+        float* out = NN_TRY(getData(output, mappings));
+        for (size_t j = 0; j < output.location.length / sizeof(float); ++j) {
+            out[j] = in[j] + in[j];
+        }
+        const auto& operand = model.main.operands[model.main.outputIndexes[i]];
+        outputShapes.push_back({.dimensions = operand.dimensions, .isSufficient = true});
+    }
+    return outputShapes;
+}
+
+ExecutionResult run(const nn::Model& model, const nn::Request& request) {
+    auto outputShapes = NN_TRY(computeOutputs(model, request));
+    return std::make_pair(std::move(outputShapes), nn::Timing{});
+}
+
+FencedExecutionResult runFenced(const nn::Model& model, const nn::Request& request,
+                                const std::vector<nn::SyncFence>& waitFor) {
+    for (const auto& fence : waitFor) {
+        if (fence.syncWait({}) != nn::SyncFence::FenceState::SIGNALED) {
+            return NN_ERROR() << "Failed to wait on fence";
+        }
+    }
+    NN_TRY(computeOutputs(model, request));
+    nn::ExecuteFencedInfoCallback callback = [] {
+        return nn::GeneralResult<std::pair<nn::Timing, nn::Timing>>(
+                std::make_pair(nn::Timing{}, nn::Timing{}));
+    };
+    return std::make_pair(nn::SyncFence::createAsSignaled(), std::move(callback));
+}
+
+class TrivialExecution final : public nn::IExecution {
+  public:
+    TrivialExecution(std::shared_ptr<const nn::Model> model, nn::Request request)
+        : kModel(std::move(model)), kRequest(std::move(request)) {}
+
+    ExecutionResult compute(const nn::OptionalTimePoint& /*deadline*/) const override {
+        return run(*kModel, kRequest);
+    }
+
+    FencedExecutionResult computeFenced(
+            const std::vector<nn::SyncFence>& waitFor, const nn::OptionalTimePoint& /*deadline*/,
+            const nn::OptionalDuration& /*timeoutDurationAfterFence*/) const override {
+        return runFenced(*kModel, kRequest, waitFor);
+    }
+
+  private:
+    const std::shared_ptr<const nn::Model> kModel;
+    const nn::Request kRequest;
+};
+
+class TrivialBurst final : public nn::IBurst {
+  public:
+    explicit TrivialBurst(std::shared_ptr<const nn::Model> model) : kModel(std::move(model)) {}
+
+    OptionalCacheHold cacheMemory(const nn::SharedMemory& /*memory*/) const override {
+        return nullptr;
+    }
+
+    ExecutionResult execute(
+            const nn::Request& request, nn::MeasureTiming /*measure*/,
+            const nn::OptionalTimePoint& /*deadline*/,
+            const nn::OptionalDuration& /*loopTimeoutDuration*/,
+            const std::vector<nn::TokenValuePair>& /*hints*/,
+            const std::vector<nn::ExtensionNameAndPrefix>& /*extensionNameToPrefix*/)
+            const override {
+        return run(*kModel, request);
+    }
+
+    nn::GeneralResult<nn::SharedExecution> createReusableExecution(
+            const nn::Request& request, nn::MeasureTiming /*measure*/,
+            const nn::OptionalDuration& /*loopTimeoutDuration*/,
+            const std::vector<nn::TokenValuePair>& /*hints*/,
+            const std::vector<nn::ExtensionNameAndPrefix>& /*extensionNameToPrefix*/)
+            const override {
+        return std::make_shared<const TrivialExecution>(kModel, request);
+    }
+
+  private:
+    const std::shared_ptr<const nn::Model> kModel;
+};
+
+class TrivialPreparedModel final : public nn::IPreparedModel {
+  public:
+    explicit TrivialPreparedModel(nn::Model model)
+        : kModel(std::make_shared<const nn::Model>(std::move(model))) {}
+
+    ExecutionResult execute(
+            const nn::Request& request, nn::MeasureTiming /*measure*/,
+            const nn::OptionalTimePoint& /*deadline*/,
+            const nn::OptionalDuration& /*loopTimeoutDuration*/,
+            const std::vector<nn::TokenValuePair>& /*hints*/,
+            const std::vector<nn::ExtensionNameAndPrefix>& /*extensionNameToPrefix*/)
+            const override {
+        return run(*kModel, request);
+    }
+
+    FencedExecutionResult executeFenced(
+            const nn::Request& request, const std::vector<nn::SyncFence>& waitFor,
+            nn::MeasureTiming /*measure*/, const nn::OptionalTimePoint& /*deadline*/,
+            const nn::OptionalDuration& /*loopTimeoutDuration*/,
+            const nn::OptionalDuration& /*timeoutDurationAfterFence*/,
+            const std::vector<nn::TokenValuePair>& /*hints*/,
+            const std::vector<nn::ExtensionNameAndPrefix>& /*extensionNameToPrefix*/)
+            const override {
+        return runFenced(*kModel, request, waitFor);
+    }
+
+    nn::GeneralResult<nn::SharedExecution> createReusableExecution(
+            const nn::Request& request, nn::MeasureTiming /*measure*/,
+            const nn::OptionalDuration& /*loopTimeoutDuration*/,
+            const std::vector<nn::TokenValuePair>& /*hints*/,
+            const std::vector<nn::ExtensionNameAndPrefix>& /*extensionNameToPrefix*/)
+            const override {
+        return std::make_shared<const TrivialExecution>(kModel, request);
+    }
+
+    nn::GeneralResult<nn::SharedBurst> configureExecutionBurst() const override {
+        return std::make_shared<const TrivialBurst>(kModel);
+    }
+
+    std::any getUnderlyingResource() const override { return {}; }
+
+  private:
+    const std::shared_ptr<const nn::Model> kModel;
+};
+
+}  // namespace
+
+nn::Model createModel(size_t numInputs, size_t tensorSize) {
+    const auto dimension = static_cast<uint32_t>(tensorSize);
+    const nn::Operand tensor = {
+            .type = nn::OperandType::TENSOR_FLOAT32,
+            .dimensions = {dimension},
+            .scale = 0.0f,
+            .zeroPoint = 0,
+            .lifetime = nn::Operand::LifeTime::SUBGRAPH_INPUT,
+            .location = {},
+    };
+
+    nn::Model model;
+    auto& subgraph = model.main;
+
+    constexpr int32_t kActivation = 0;
+    auto activation = nn::Operand{
+            .type = nn::OperandType::INT32,
+            .dimensions = {},
+            .scale = 0.0f,
+            .zeroPoint = 0,
+            .lifetime = nn::Operand::LifeTime::CONSTANT_COPY,
+            .location = model.operandValues.append(
+                    reinterpret_cast<const uint8_t*>(&kActivation), sizeof(kActivation)),
+    };
+    const auto activationIndex = static_cast<uint32_t>(subgraph.operands.size());
+    subgraph.operands.push_back(std::move(activation));
+
+    for (size_t i = 0; i < numInputs; ++i) {
+        const auto inputIndex = static_cast<uint32_t>(subgraph.operands.size());
+        subgraph.operands.push_back(tensor);
+        subgraph.inputIndexes.push_back(inputIndex);
+    }
+    for (size_t i = 0; i < numInputs; ++i) {
+        const auto outputIndex = static_cast<uint32_t>(subgraph.operands.size());
+        auto output = tensor;
+        output.lifetime = nn::Operand::LifeTime::SUBGRAPH_OUTPUT;
+        subgraph.operands.push_back(std::move(output));
+        subgraph.outputIndexes.push_back(outputIndex);
+
+        const uint32_t inputIndex = subgraph.inputIndexes[i];
+        subgraph.operations.push_back({.type = nn::OperationType::ADD,
+                                       .inputs = {inputIndex, inputIndex, activationIndex},
+                                       .outputs = {outputIndex}});
+    }
+
+    return model;
+}
+
+nn::Request createRequest(size_t numInputs, size_t tensorSize) {
+    const auto length = static_cast<uint32_t>(tensorSize * sizeof(float));
+    auto memory = nn::createSharedMemory(2 * numInputs * length);
+    CHECK(memory.has_value());
+
+    const auto makeArgument = [length](size_t index) {
+        return nn::Request::Argument{
+                .lifetime = nn::Request::Argument::LifeTime::POOL,
+                .location = {.poolIndex = 0, .offset = static_cast<uint32_t>(index * length),
+                             .length = length},
+                .dimensions = {},
+        };
+    };
+
+    nn::Request request;
+    for (size_t i = 0; i < numInputs; ++i) {
+        request.inputs.push_back(makeArgument(i));
+        request.outputs.push_back(makeArgument(numInputs + i));
+    }
+    request.pools.push_back(std::move(memory).value());
+    return request;
+}
+
+TrivialDevice::TrivialDevice(std::string name)
+    : kName(std::move(name)), kVersionString("1"), kCapabilities(createCapabilities()) {}
+
+const std::string& TrivialDevice::getName() const {
+    return kName;
+}
+
+const std::string& TrivialDevice::getVersionString() const {
+    return kVersionString;
+}
+
+nn::Version TrivialDevice::getFeatureLevel() const {
+    return nn::kVersionFeatureLevel5;
+}
+
+nn::DeviceType TrivialDevice::getType() const {
+    return nn::DeviceType::ACCELERATOR;
+}
+
+const std::vector<nn::Extension>& TrivialDevice::getSupportedExtensions() const {
+    return kExtensions;
+}
+
+const nn::Capabilities& TrivialDevice::getCapabilities() const {
+    return kCapabilities;
+}
+
+std::pair<uint32_t, uint32_t> TrivialDevice::getNumberOfCacheFilesNeeded() const {
+    return std::make_pair(/*numModelCache=*/0, /*numDataCache=*/0);
+}
+
+nn::GeneralResult<void> TrivialDevice::wait() const {
+    return {};
+}
+
+nn::GeneralResult<std::vector<bool>> TrivialDevice::getSupportedOperations(
+        const nn::Model& model) const {
+    return std::vector<bool>(model.main.operations.size(), true);
+}
+
+nn::GeneralResult<nn::SharedPreparedModel> TrivialDevice::prepareModel(
+        const nn::Model& model, nn::ExecutionPreference /*preference*/, nn::Priority /*priority*/,
+        nn::OptionalTimePoint /*deadline*/, const std::vector<nn::SharedHandle>& /*modelCache*/,
+        const std::vector<nn::SharedHandle>& /*dataCache*/, const nn::CacheToken& /*token*/,
+        const std::vector<nn::TokenValuePair>& /*hints*/,
+        const std::vector<nn::ExtensionNameAndPrefix>& /*extensionNameToPrefix*/) const {
+    return std::make_shared<const TrivialPreparedModel>(model);
+}
+
+nn::GeneralResult<nn::SharedPreparedModel> TrivialDevice::prepareModelFromCache(
+        nn::OptionalTimePoint /*deadline*/, const std::vector<nn::SharedHandle>& /*modelCache*/,
+        const std::vector<nn::SharedHandle>& /*dataCache*/,
+        const nn::CacheToken& /*token*/) const {
+    return NN_ERROR(nn::ErrorStatus::GENERAL_FAILURE)
+           << "TrivialDevice does not support compilation caching";
+}
+
+nn::GeneralResult<nn::SharedBuffer> TrivialDevice::allocate(
+        const nn::BufferDesc& /*desc*/,
+        const std::vector<nn::SharedPreparedModel>& /*preparedModels*/,
+        const std::vector<nn::BufferRole>& /*inputRoles*/,
+        const std::vector<nn::BufferRole>& /*outputRoles*/) const {
+    return NN_ERROR(nn::ErrorStatus::GENERAL_FAILURE)
+           << "TrivialDevice does not support driver-managed memory";
+}
+
+}  // namespace android::hardware::neuralnetworks::bench
@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of the NN HAL plumbing between a client and a device.
+//
+// Every benchmark runs models on a TrivialDevice, whose own work is a single pass over the input
+// and output tensors. The "Direct" path calls the TrivialDevice without any HAL in between. Each
+// other path wraps the TrivialDevice in the adapter for its HAL version and calls it through the
+// client-side utils of that version, all in the same process. The difference between a path and
+// "Direct" is therefore the cost of the conversions, validation, memory mapping, callbacks and,
+// for bursts, the FMQ of that HAL version.
+//
+// The Stage/* benchmarks time individual steps of that plumbing on their own.
+
+#include "TrivialDevice.h"
+
+#include <aidl/android/hardware/neuralnetworks/IDevice.h>
+#include <android/hardware/neuralnetworks/1.3/IDevice.h>
+#include <benchmark/benchmark.h>
+#include <nnapi/IBurst.h>
+#include <nnapi/IDevice.h>
+#include <nnapi/IExecution.h>
+#include <nnapi/IPreparedModel.h>
+#include <nnapi/Result.h>
+#include <nnapi/SharedMemory.h>
+#include <nnapi/Types.h>
+#include <nnapi/Validation.h>
+#include <nnapi/hal/1.0/Conversions.h>
+#include <nnapi/hal/1.0/Device.h>
+#include <nnapi/hal/1.1/Device.h>
+#include <nnapi/hal/1.2/Device.h>
+#include <nnapi/hal/1.3/Conversions.h>
+#include <nnapi/hal/1.3/Device.h>
+#include <nnapi/hal/Adapter.h>
+#include <nnapi/hal/aidl/Adapter.h>
+#include <nnapi/hal/aidl/Conversions.h>
+#include <nnapi/hal/aidl/Device.h>
+#include <nnapi/hal/aidl/Utils.h>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::bench {
+namespace {
+
+namespace aidl_hal = ::aidl::android::hardware::neuralnetworks;
+
+enum class Path { DIRECT, HIDL_V1_0, HIDL_V1_1, HIDL_V1_2, HIDL_V1_3, AIDL };
+
+constexpr Path kAllPaths[] = {Path::DIRECT,    Path::HIDL_V1_0, Path::HIDL_V1_1,
+                              Path::HIDL_V1_2, Path::HIDL_V1_3, Path::AIDL};
+// Paths that support fenced execution without emulating it.
+constexpr Path kFencedPaths[] = {Path::DIRECT, Path::HIDL_V1_3, Path::AIDL};
+
+const std::string kDeviceName = "trivial";
+
+std::string toString(Path path) {
+    switch (path) {
+        case Path::DIRECT:
+            return "Direct";
+        case Path::HIDL_V1_0:
+            return "HIDL_V1_0";
+        case Path::HIDL_V1_1:
+            return "HIDL_V1_1";
+        case Path::HIDL_V1_2:
+            return "HIDL_V1_2";
+        case Path::HIDL_V1_3:
+            return "HIDL_V1_3";
+        case Path::AIDL:
+            return "AIDL";
+    }
+    return "Unknown";
+}
+
+nn::GeneralResult<nn::SharedDevice> createDevice(Path path) {
+    nn::SharedDevice device = std::make_shared<const TrivialDevice>(kDeviceName);
+    switch (path) {
+        case Path::DIRECT:
+            return device;
+        case Path::HIDL_V1_0:
+            return V1_0::utils::Device::create(kDeviceName, adapter::adapt(std::move(device)));
+        case Path::HIDL_V1_1:
+            return V1_1::utils::Device::create(kDeviceName, adapter::adapt(std::move(device)));
+        case Path::HIDL_V1_2:
+            return V1_2::utils::Device::create(kDeviceName, adapter::adapt(std::move(device)));
+        case Path::HIDL_V1_3:
+            return V1_3::utils::Device::create(kDeviceName, adapter::adapt(std::move(device)));
+        case Path::AIDL: {
+            auto aidlDevice = aidl_hal::adapter::adapt(std::move(device));
+            const auto featureLevel =
+                    aidl_hal::utils::aidlVersionToCanonicalVersion(aidl_hal::IDevice::version);
+            if (!featureLevel.has_value()) {
+                return NN_ERROR() << "Unknown AIDL version " << aidl_hal::IDevice::version;
+            }
+            return aidl_hal::utils::Device::create(kDeviceName, std::move(aidlDevice),
+                                                   featureLevel.value());
+        }
+    }
+    return NN_ERROR() << "Unknown path";
+}
+
+size_t getNumInputs(const benchmark::State& state) {
+    return static_cast<size_t>(state.range(0));
+}
+
+size_t getTensorSize(const benchmark::State& state) {
+    return static_cast<size_t>(state.range(1));
+}
+
+void setCounters(benchmark::State* state) {
+    const auto bytesPerInference = 2 * getNumInputs(*state) * getTensorSize(*state) * sizeof(float);
+    state->SetItemsProcessed(state->iterations());
+    state->SetBytesProcessed(state->iterations() * bytesPerInference);
+}
+
+void configure(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"inputs", "elements"});
+    for (int64_t numInputs : {1, 4, 16}) {
+        for (int64_t tensorSize : {1, 1024, 256 * 1024}) {
+            b->Args({numInputs, tensorSize});
+        }
+    }
+}
+
+// Prepares the benchmark model on the device of path and creates a request for it. Reports an
+// error through state and returns std::nullopt on failure.
+std::optional<std::pair<nn::SharedPreparedModel, nn::Request>> prepare(Path path,
+                                                                       benchmark::State* state) {
+    const auto numInputs = getNumInputs(*state);
+    const auto tensorSize = getTensorSize(*state);
+
+    auto device = createDevice(path);
+    if (!device.has_value()) {
+        state->SkipWithError(device.error().message.c_str());
+        return std::nullopt;
+    }
+    auto preparedModel = device.value()->prepareModel(
+            createModel(numInputs, tensorSize), nn::ExecutionPreference::FAST_SINGLE_ANSWER,
+            nn::Priority::DEFAULT, {}, {}, {}, {}, {}, {});
+    if (!preparedModel.has_value()) {
+        state->SkipWithError(preparedModel.error().message.c_str());
+        return std::nullopt;
+    }
+    return std::make_pair(std::move(preparedModel).value(), createRequest(numInputs, tensorSize));
+}
+
+void execute(benchmark::State& state, Path path) {
+    const auto prepared = prepare(path, &state);
+    if (!prepared.has_value()) {
+        return;
+    }
+    const auto& [preparedModel, request] = prepared.value();
+
+    for (auto _ : state) {
+        const auto result =
+                preparedModel->execute(request, nn::MeasureTiming::NO, {}, {}, {}, {});
+        if (!result.has_value()) {
+            state.SkipWithError(result.error().message.c_str());
+            break;
+        }
+    }
+    setCounters(&state);
+}
+
+void executeFenced(benchmark::State& state, Path path) {
+    const auto prepared = prepare(path, &state);
+    if (!prepared.has_value()) {
+        return;
+    }
+    const auto& [preparedModel, request] = prepared.value();
+
+    for (auto _ : state) {
+        const auto result = preparedModel->executeFenced(request, {}, nn::MeasureTiming::NO, {},
+                                                         {}, {}, {}, {});
+        if (!result.has_value()) {
+            state.SkipWithError(result.error().message.c_str());
+            break;
+        }
+        if (result.value().first.syncWait({}) != nn::SyncFence::FenceState::SIGNALED) {
+            state.SkipWithError("Failed to wait on fence");
+            break;
+        }
+    }
+    setCounters(&state);
+}
+
+void computeReusable(benchmark::State& state, Path path) {
+    const auto prepared = prepare(path, &state);
+    if (!prepared.has_value()) {
+        return;
+    }
+    const auto& [preparedModel, request] = prepared.value();
+    const auto execution =
+            preparedModel->createReusableExecution(request, nn::MeasureTiming::NO, {}, {}, {});
+    if (!execution.has_value()) {
+        state.SkipWithError(execution.error().message.c_str());
+        return;
+    }
+
+    for (auto _ : state) {
+        const auto result = execution.value()->compute({});
+        if (!result.has_value()) {
+            state.SkipWithError(result.error().message.c_str());
+            break;
+        }
+    }
+    setCounters(&state);
+}
+
+void executeBurst(benchmark::State& state, Path path) {
+    const auto prepared = prepare(path, &state);
+    if (!prepared.has_value()) {
+        return;
+    }
+    const auto& [preparedModel, request] = prepared.value();
+    const auto burst = preparedModel->configureExecutionBurst();
+    if (!burst.has_value()) {
+        state.SkipWithError(burst.error().message.c_str());
+        return;
+    }
+    const auto hold =
+            burst.value()->cacheMemory(std::get<nn::SharedMemory>(request.pools.front()));
+
+    for (auto _ : state) {
+        const auto result = burst.value()->execute(request, nn::MeasureTiming::NO, {}, {}, {}, {});
+        if (!result.has_value()) {
+            state.SkipWithError(result.error().message.c_str());
+            break;
+        }
+    }
+    setCounters(&state);
+}
+
+void validateRequest(benchmark::State& state) {
+    const auto request = createRequest(getNumInputs(state), getTensorSize(state));
+    for (auto _ : state) {
+        const auto result = nn::validate(request);
+        if (!result.has_value()) {
+            state.SkipWithError(result.error().c_str());
+            break;
+        }
+    }
+    setCounters(&state);
+}
+
+template <typename ConvertFn>
+void convertRequest(benchmark::State& state, const ConvertFn& convert) {
+    const auto request = createRequest(getNumInputs(state), getTensorSize(state));
+    for (auto _ : state) {
+        const auto result = convert(request);
+        if (!result.has_value()) {
+            state.SkipWithError(result.error().message.c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(result);
+    }
+    setCounters(&state);
+}
+
+void mapPool(benchmark::State& state) {
+    const auto request = createRequest(getNumInputs(state), getTensorSize(state));
+    const auto& memory = std::get<nn::SharedMemory>(request.pools.front());
+    for (auto _ : state) {
+        const auto mapping = nn::map(memory);
+        if (!mapping.has_value()) {
+            state.SkipWithError(mapping.error().message.c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(mapping);
+    }
+    setCounters(&state);
+}
+
+void registerBenchmarks() {
+    for (const auto path : kAllPaths) {
+        const auto name = toString(path);
+        configure(benchmark::RegisterBenchmark(("Execute/" + name).c_str(), execute, path));
+        configure(benchmark::RegisterBenchmark(("Reusable/" + name).c_str(), computeReusable,
+                                               path));
+        configure(benchmark::RegisterBenchmark(("Burst/" + name).c_str(), executeBurst, path));
+    }
+    for (const auto path : kFencedPaths) {
+        configure(benchmark::RegisterBenchmark(("Fenced/" + toString(path)).c_str(),
+                                               executeFenced, path));
+    }
+
+    configure(benchmark::RegisterBenchmark("Stage/ValidateRequest", validateRequest));
+    configure(benchmark::RegisterBenchmark("Stage/MapPool", mapPool));
+    // Requests round trip through the HAL types, as they do between the client utils and the
+    // adapter. HIDL 1.1 and 1.2 use the HIDL 1.0 request.
+    configure(benchmark::RegisterBenchmark(
+            "Stage/ConvertRequest/HIDL_V1_0", [](benchmark::State& state) {
+                convertRequest(state, [](const nn::Request& request) -> nn::GeneralResult<void> {
+                    NN_TRY(nn::convert(NN_TRY(V1_0::utils::convert(request))));
+                    return {};
+                });
+            }));
+    configure(benchmark::RegisterBenchmark(
+            "Stage/ConvertRequest/HIDL_V1_3", [](benchmark::State& state) {
+                convertRequest(state, [](const nn::Request& request) -> nn::GeneralResult<void> {
+                    NN_TRY(nn::convert(NN_TRY(V1_3::utils::convert(request))));
+                    return {};
+                });
+            }));
+    configure(benchmark::RegisterBenchmark(
+            "Stage/ConvertRequest/AIDL", [](benchmark::State& state) {
+                convertRequest(state, [](const nn::Request& request) -> nn::GeneralResult<void> {
+                    NN_TRY(nn::convert(NN_TRY(aidl_hal::utils::convert(request))));
+                    return {};
+                });
+            }));
+}
+
+}  // namespace
+}  // namespace android::hardware::neuralnetworks::bench
+
+int main(int argc, char** argv) {
+    ::benchmark::Initialize(&argc, argv);
+    ::android::hardware::neuralnetworks::bench::registerBenchmarks();
+    ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_CACHING_DEVICE_H
+#define ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_CACHING_DEVICE_H
+
+#include <android-base/thread_annotations.h>
+#include <nnapi/IBuffer.h>
+#include <nnapi/IDevice.h>
+#include <nnapi/IPreparedModel.h>
+#include <nnapi/Result.h>
+#include <nnapi/Types.h>
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::utils {
+
+/**
+ * Device that keeps the models prepared by a device which does not implement compilation caching.
+ *
+ * A device that reports it needs no cache files has to compile a model from scratch each time a
+ * client prepares it, e.g., every time an app starts. CachingDevice keeps the prepared models of
+ * such a device, looked up by the cache token together with a hash of the model and of the
+ * arguments that affect compilation, and returns the kept prepared model when the same model is
+ * prepared again. The hash only narrows the lookup down: the kept model is compared with the
+ * prepared one, including the contents of its memory pools, before it is reused. The service
+ * adapting the device to the NN HAL opts in by adapting a CachingDevice instead of the device
+ * itself.
+ *
+ * Models are never cached when the cache token is all zero, when a memory pool cannot be mapped,
+ * e.g., a pool backed by device memory, or when an operand points to memory owned by the caller.
+ * Devices that implement compilation caching themselves are passed through unchanged.
+ *
+ * Entries are evicted in least recently used order once the cache is full. Each entry keeps its
+ * model, and therefore the model's memory pools, alive. An evicted prepared model stays alive for
+ * as long as a client holds a reference to it.
+ *
+ * CachingDevice is thread-safe.
+ */
+class CachingDevice final : public nn::IDevice {
+  public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    static constexpr size_t kDefaultCapacity = 16;
+
+    explicit CachingDevice(nn::SharedDevice device, size_t capacity = kDefaultCapacity);
+
+    /**
+     * Returns how many prepareModel calls were served from the cache and how many were forwarded
+     * to the underlying device while caching was possible.
+     */
+    Stats getStats() const EXCLUDES(mMutex);
+
+    const std::string& getName() const override;
+    const std::string& getVersionString() const override;
+    nn::Version getFeatureLevel() const override;
+    nn::DeviceType getType() const override;
+    const std::vector<nn::Extension>& getSupportedExtensions() const override;
+    const nn::Capabilities& getCapabilities() const override;
+    std::pair<uint32_t, uint32_t> getNumberOfCacheFilesNeeded() const override;
+
+    nn::GeneralResult<void> wait() const override;
+
+    nn::GeneralResult<std::vector<bool>> getSupportedOperations(
+            const nn::Model& model) const override;
+
+    nn::GeneralResult<nn::SharedPreparedModel> prepareModel(
+            const nn::Model& model, nn::ExecutionPreference preference, nn::Priority priority,
+            nn::OptionalTimePoint deadline, const std::vector<nn::SharedHandle>& modelCache,
+            const std::vector<nn::SharedHandle>& dataCache, const nn::CacheToken& token,
+            const std::vector<nn::TokenValuePair>& hints,
+            const std::vector<nn::ExtensionNameAndPrefix>& extensionNameToPrefix) const override;
+
+    nn::GeneralResult<nn::SharedPreparedModel> prepareModelFromCache(
+            nn::OptionalTimePoint deadline, const std::vector<nn::SharedHandle>& modelCache,
+            const std::vector<nn::SharedHandle>& dataCache,
+            const nn::CacheToken& token) const override;
+
+    nn::GeneralResult<nn::SharedBuffer> allocate(
+            const nn::BufferDesc& desc, const std::vector<nn::SharedPreparedModel>& preparedModels,
+            const std::vector<nn::BufferRole>& inputRoles,
+            const std::vector<nn::BufferRole>& outputRoles) const override;
+
+  private:
+    // cache token and hash of the model and compilation arguments
+    using Key = std::pair<nn::CacheToken, uint64_t>;
+
+    // the model and the arguments that affect how it is compiled
+    struct Compilation {
+        nn::Model model;
+        nn::ExecutionPreference preference;
+        nn::Priority priority;
+        std::vector<nn::TokenValuePair> hints;
+        std::vector<nn::ExtensionNameAndPrefix> extensionNameToPrefix;
+
+        // Compares the contents of the models, including the contents of their memory pools.
+        bool matches(const Compilation& other) const;
+    };
+
+    struct Entry {
+        Key key;
+        Compilation compilation;
+        nn::SharedPreparedModel preparedModel;
+    };
+    using Entries = std::list<Entry>;
+
+    std::optional<nn::SharedPreparedModel> find(const Key& key,
+                                                const Compilation& compilation) const
+            EXCLUDES(mMutex);
+    nn::SharedPreparedModel insert(const Key& key, Compilation compilation,
+                                   nn::SharedPreparedModel preparedModel) const EXCLUDES(mMutex);
+
+    const nn::SharedDevice kDevice;
+    const size_t kCapacity;
+    mutable std::mutex mMutex;
+    // most recently used entry first
+    mutable Entries mEntries GUARDED_BY(mMutex);
+    mutable std::map<Key, Entries::iterator> mIndex GUARDED_BY(mMutex);
+    mutable Stats mStats GUARDED_BY(mMutex);
+};
+
+}  // namespace android::hardware::neuralnetworks::utils
+
+#endif  // ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_CACHING_DEVICE_H
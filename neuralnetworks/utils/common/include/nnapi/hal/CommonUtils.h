@@ -21,7 +21,12 @@
 #include <nnapi/SharedMemory.h>
 #include <nnapi/Types.h>
 
+#include <algorithm>
 #include <functional>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 // Shorthands
@@ -48,6 +53,89 @@ nn::Capabilities::OperandPerformanceTable makeQuantized8PerformanceConsistentWit
         const nn::Capabilities::PerformanceInfo& float32Performance,
         const nn::Capabilities::PerformanceInfo& quantized8Performance);
 
+// Operands with a CONSTANT_COPY value of at least this many bytes are moved to shared memory by
+// flushModelDataToShared.
+constexpr size_t kLargeConstantThreshold = 64 * 1024;
+
+// Moves the values of CONSTANT_COPY operands that are at least threshold bytes long from the
+// operand values of model into a new shared memory pool, and turns them into CONSTANT_REFERENCE
+// operands. Large values are then passed across processes by reference instead of being copied
+// into and out of the transaction.
+//
+// If model has no such operands, model is returned. Otherwise the relocated model is stored in
+// maybeModelInSharedOut and a reference to it is returned.
+nn::GeneralResult<std::reference_wrapper<const nn::Model>> flushLargeConstantsToShared(
+        const nn::Model* model, std::optional<nn::Model>* maybeModelInSharedOut,
+        size_t threshold = kLargeConstantThreshold);
+
+// Prepares model for IPC by combining flushDataFromPointerToShared and
+// flushLargeConstantsToShared.
+nn::GeneralResult<std::reference_wrapper<const nn::Model>> flushModelDataToShared(
+        const nn::Model* model, std::optional<nn::Model>* maybeModelInSharedOut);
+
+// Minimum number of elements convertInParallel gives to each thread. For fewer elements, starting
+// a thread costs more than the conversion it takes over.
+constexpr size_t kMinParallelConversionSize = 4096;
+
+// Returns the number of threads convertInParallel uses for a vector of size elements. Each thread
+// gets at least minParallelSize elements.
+size_t getConversionThreadCount(size_t size, size_t minParallelSize);
+
+// The type of the value returned by convert for an element of type Type.
+template <typename Type, typename Convert>
+using ConvertOutput = std::decay_t<
+        decltype(std::declval<const Convert&>()(std::declval<const Type&>()).value())>;
+
+// Applies convert to every element of arguments and returns the results in order. Large vectors,
+// such as the operands and operations of a big model, are split into contiguous chunks that are
+// converted concurrently; convert must therefore be safe to call from several threads.
+//
+// If any element fails to convert, returns the error of the first failing element, exactly as a
+// sequential loop would.
+template <typename Type, typename Convert>
+nn::GeneralResult<std::vector<ConvertOutput<Type, Convert>>> convertInParallel(
+        const std::vector<Type>& arguments, const Convert& convert,
+        size_t minParallelSize = kMinParallelConversionSize) {
+    using Output = ConvertOutput<Type, Convert>;
+
+    const size_t size = arguments.size();
+    const size_t numChunks = getConversionThreadCount(size, minParallelSize);
+    const size_t chunkSize = (size + numChunks - 1) / numChunks;
+
+    std::vector<Output> outputs(size);
+    std::vector<std::optional<nn::GeneralError>> errors(numChunks);
+    const auto convertChunk = [&arguments, &convert, &outputs, &errors, size, chunkSize](
+                                      size_t chunk) {
+        const size_t end = std::min(size, (chunk + 1) * chunkSize);
+        for (size_t i = chunk * chunkSize; i < end; ++i) {
+            auto result = convert(arguments[i]);
+            if (!result.has_value()) {
+                errors[chunk] = std::move(result).error();
+                return;
+            }
+            outputs[i] = std::move(result).value();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numChunks - 1);
+    for (size_t chunk = 1; chunk < numChunks; ++chunk) {
+        threads.emplace_back(convertChunk, chunk);
+    }
+    convertChunk(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // Chunks are in element order, so the first chunk with an error holds the first failure.
+    for (const auto& error : errors) {
+        if (error.has_value()) {
+            return NN_ERROR(error->code) << error->message;
+        }
+    }
+    return outputs;
+}
+
 using nn::convertRequestFromPointerToShared;
 using nn::flushDataFromPointerToShared;
 using nn::hasNoPointerData;
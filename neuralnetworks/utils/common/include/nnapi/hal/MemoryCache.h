@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_MEMORY_CACHE_H
+#define ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_MEMORY_CACHE_H
+
+#include <android-base/thread_annotations.h>
+#include <nnapi/Result.h>
+#include <nnapi/Types.h>
+#include <sys/types.h>
+
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::utils {
+
+/**
+ * Cache of the canonical memory created for the memory pools of incoming requests.
+ *
+ * Clients commonly pass the same memory pools to thousands of executions. Converting a pool
+ * duplicates its file descriptors and, for hardware buffers, imports the buffer. MemoryCache keeps
+ * the memory created for a pool, keyed by the identity of the files backing the pool, so that each
+ * pool is converted only once.
+ *
+ * A cached memory holds its files open, so the identity of a file cannot be reused by another file
+ * while it is in the cache. Files whose identity is not unique to them, such as regions of the
+ * legacy ashmem device, are never cached.
+ *
+ * Entries are evicted in least recently used order once the cache is full. The memory of an evicted
+ * entry stays alive for as long as an execution holds a reference to it.
+ *
+ * MemoryCache is thread-safe.
+ */
+class MemoryCache final {
+  public:
+    struct Key {
+        // (st_dev, st_ino) of each file backing the memory
+        std::vector<std::pair<dev_t, ino_t>> files;
+        // kind of memory, e.g., "ashmem"
+        std::string name;
+        // everything else that distinguishes memories backed by the same files, e.g., offset, size
+        // and protection
+        std::vector<int64_t> attributes;
+
+        bool operator<(const Key& other) const;
+    };
+
+    using Factory = std::function<nn::GeneralResult<nn::SharedMemory>()>;
+
+    static constexpr size_t kDefaultCapacity = 32;
+
+    /**
+     * Creates the key of a memory backed by the files referenced by fds.
+     *
+     * @return The key, or std::nullopt if any of the files cannot be identified uniquely.
+     */
+    static std::optional<Key> makeKey(const std::vector<int>& fds, std::string name,
+                                      std::vector<int64_t> attributes);
+
+    explicit MemoryCache(size_t capacity = kDefaultCapacity);
+
+    /**
+     * Returns the memory cached for key, or creates and caches it.
+     *
+     * If key is std::nullopt, the memory is created and not cached. Errors from create are returned
+     * unchanged and are not cached.
+     */
+    nn::GeneralResult<nn::SharedMemory> getOrCreate(const std::optional<Key>& key,
+                                                    const Factory& create) const;
+
+    size_t size() const;
+
+  private:
+    using Entry = std::pair<Key, nn::SharedMemory>;
+    using Entries = std::list<Entry>;
+
+    const size_t kCapacity;
+    mutable std::mutex mMutex;
+    // most recently used first
+    mutable Entries mEntries GUARDED_BY(mMutex);
+    mutable std::map<Key, Entries::iterator> mIndex GUARDED_BY(mMutex);
+};
+
+}  // namespace android::hardware::neuralnetworks::utils
+
+#endif  // ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_MEMORY_CACHE_H
@@ -0,0 +1,432 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CachingDevice.h"
+
+#include <android-base/logging.h>
+#include <nnapi/IBuffer.h>
+#include <nnapi/IDevice.h>
+#include <nnapi/IPreparedModel.h>
+#include <nnapi/Result.h>
+#include <nnapi/SharedMemory.h>
+#include <nnapi/Types.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::utils {
+namespace {
+
+// 64-bit FNV-1a, extended to consume eight bytes per step so that large constant pools hash
+// quickly. Collisions are easy to construct, so the hash is only used to find the entry to compare
+// a compilation with.
+class Hasher {
+  public:
+    void add(const void* data, size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        for (; size >= sizeof(uint64_t); bytes += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, bytes, sizeof(word));
+            mHash = (mHash ^ word) * kPrime;
+        }
+        for (; size > 0; ++bytes, --size) {
+            mHash = (mHash ^ *bytes) * kPrime;
+        }
+    }
+
+    template <typename Type>
+    std::enable_if_t<std::is_arithmetic_v<Type> || std::is_enum_v<Type>> add(Type value) {
+        add(&value, sizeof(value));
+    }
+
+    void add(const std::string& string) {
+        add(string.size());
+        add(string.data(), string.size());
+    }
+
+    template <typename Type>
+    void add(const std::vector<Type>& values) {
+        add(values.size());
+        if constexpr (std::is_arithmetic_v<Type>) {
+            add(values.data(), values.size() * sizeof(Type));
+        } else {
+            for (const auto& value : values) {
+                add(value);
+            }
+        }
+    }
+
+    uint64_t get() const { return mHash; }
+
+  private:
+    static constexpr uint64_t kOffsetBasis = 0xcbf29ce484222325;
+    static constexpr uint64_t kPrime = 0x100000001b3;
+
+    uint64_t mHash = kOffsetBasis;
+};
+
+void hashOperand(Hasher* hasher, const nn::Operand& operand) {
+    hasher->add(operand.type);
+    hasher->add(operand.dimensions);
+    hasher->add(operand.scale);
+    hasher->add(operand.zeroPoint);
+    hasher->add(operand.lifetime);
+
+    const auto& location = operand.location;
+    hasher->add(location.poolIndex);
+    hasher->add(location.offset);
+    hasher->add(location.length);
+    hasher->add(location.padding);
+
+    hasher->add(operand.extraParams.index());
+    if (const auto* quantParams = std::get_if<nn::Operand::SymmPerChannelQuantParams>(
+                &operand.extraParams)) {
+        hasher->add(quantParams->scales);
+        hasher->add(quantParams->channelDim);
+    } else if (const auto* extensionParams =
+                       std::get_if<nn::Operand::ExtensionParams>(&operand.extraParams)) {
+        hasher->add(*extensionParams);
+    }
+}
+
+void hashSubgraph(Hasher* hasher, const nn::Model::Subgraph& subgraph) {
+    hasher->add(subgraph.operands.size());
+    for (const auto& operand : subgraph.operands) {
+        hashOperand(hasher, operand);
+    }
+    hasher->add(subgraph.operations.size());
+    for (const auto& operation : subgraph.operations) {
+        hasher->add(operation.type);
+        hasher->add(operation.inputs);
+        hasher->add(operation.outputs);
+    }
+    hasher->add(subgraph.inputIndexes);
+    hasher->add(subgraph.outputIndexes);
+}
+
+void hashExtensionNameToPrefix(
+        Hasher* hasher, const std::vector<nn::ExtensionNameAndPrefix>& extensionNameToPrefix) {
+    hasher->add(extensionNameToPrefix.size());
+    for (const auto& [name, prefix] : extensionNameToPrefix) {
+        hasher->add(name);
+        hasher->add(prefix);
+    }
+}
+
+// Returns the contents of a memory pool, or std::nullopt if they cannot be read. The data stays
+// valid for as long as the mapping is alive.
+std::optional<std::pair<nn::Mapping, const void*>> mapPool(const nn::SharedMemory& pool) {
+    auto mapping = nn::map(pool);
+    if (!mapping.has_value()) {
+        return std::nullopt;
+    }
+    const void* data =
+            std::visit([](auto* ptr) -> const void* { return ptr; }, mapping.value().pointer);
+    return std::make_pair(std::move(mapping).value(), data);
+}
+
+// Operands with POINTER lifetime refer to memory owned by the caller, which is only valid for the
+// duration of the call and so cannot be compared with later.
+bool hasPointerOperands(const nn::Model& model) {
+    const auto hasPointerOperand = [](const nn::Model::Subgraph& subgraph) {
+        return std::any_of(subgraph.operands.begin(), subgraph.operands.end(),
+                           [](const nn::Operand& operand) {
+                               return operand.lifetime == nn::Operand::LifeTime::POINTER;
+                           });
+    };
+    return hasPointerOperand(model.main) ||
+           std::any_of(model.referenced.begin(), model.referenced.end(), hasPointerOperand);
+}
+
+// Returns a hash of everything that affects how model is compiled, or std::nullopt if the contents
+// of a memory pool cannot be read.
+std::optional<uint64_t> hashCompilation(
+        const nn::Model& model, nn::ExecutionPreference preference, nn::Priority priority,
+        const std::vector<nn::TokenValuePair>& hints,
+        const std::vector<nn::ExtensionNameAndPrefix>& extensionNameToPrefix) {
+    Hasher hasher;
+
+    hashSubgraph(&hasher, model.main);
+    hasher.add(model.referenced.size());
+    for (const auto& subgraph : model.referenced) {
+        hashSubgraph(&hasher, subgraph);
+    }
+    hasher.add(model.operandValues.size());
+    hasher.add(model.operandValues.data(), model.operandValues.size());
+    hasher.add(model.pools.size());
+    for (const auto& pool : model.pools) {
+        const auto mapped = mapPool(pool);
+        if (!mapped.has_value()) {
+            return std::nullopt;
+        }
+        const auto& [mapping, data] = *mapped;
+        hasher.add(mapping.size);
+        hasher.add(data, mapping.size);
+    }
+    hasher.add(model.relaxComputationFloat32toFloat16);
+    hashExtensionNameToPrefix(&hasher, model.extensionNameToPrefix);
+    hashExtensionNameToPrefix(&hasher, extensionNameToPrefix);
+
+    hasher.add(preference);
+    hasher.add(priority);
+    hasher.add(hints.size());
+    for (const auto& [token, value] : hints) {
+        hasher.add(token);
+        hasher.add(value);
+    }
+
+    return hasher.get();
+}
+
+bool isSameOperand(const nn::Operand& a, const nn::Operand& b) {
+    if (a.type != b.type || a.dimensions != b.dimensions || a.scale != b.scale ||
+        a.zeroPoint != b.zeroPoint || a.lifetime != b.lifetime ||
+        a.location.poolIndex != b.location.poolIndex || a.location.offset != b.location.offset ||
+        a.location.length != b.location.length || a.location.padding != b.location.padding ||
+        a.extraParams.index() != b.extraParams.index()) {
+        return false;
+    }
+    if (const auto* quantParams =
+                std::get_if<nn::Operand::SymmPerChannelQuantParams>(&a.extraParams)) {
+        const auto& other = std::get<nn::Operand::SymmPerChannelQuantParams>(b.extraParams);
+        return quantParams->scales == other.scales && quantParams->channelDim == other.channelDim;
+    }
+    if (const auto* extensionParams = std::get_if<nn::Operand::ExtensionParams>(&a.extraParams)) {
+        return *extensionParams == std::get<nn::Operand::ExtensionParams>(b.extraParams);
+    }
+    return true;
+}
+
+bool isSameOperation(const nn::Operation& a, const nn::Operation& b) {
+    return a.type == b.type && a.inputs == b.inputs && a.outputs == b.outputs;
+}
+
+bool isSameSubgraph(const nn::Model::Subgraph& a, const nn::Model::Subgraph& b) {
+    return std::equal(a.operands.begin(), a.operands.end(), b.operands.begin(), b.operands.end(),
+                      isSameOperand) &&
+           std::equal(a.operations.begin(), a.operations.end(), b.operations.begin(),
+                      b.operations.end(), isSameOperation) &&
+           a.inputIndexes == b.inputIndexes && a.outputIndexes == b.outputIndexes;
+}
+
+bool isSamePool(const nn::SharedMemory& a, const nn::SharedMemory& b) {
+    if (a == b) {
+        return true;
+    }
+    const auto mappedA = mapPool(a);
+    const auto mappedB = mapPool(b);
+    if (!mappedA.has_value() || !mappedB.has_value()) {
+        return false;
+    }
+    const auto& [mappingA, dataA] = *mappedA;
+    const auto& [mappingB, dataB] = *mappedB;
+    return mappingA.size == mappingB.size &&
+           (mappingA.size == 0 || std::memcmp(dataA, dataB, mappingA.size) == 0);
+}
+
+bool isSameExtensionNameAndPrefix(const nn::ExtensionNameAndPrefix& a,
+                                  const nn::ExtensionNameAndPrefix& b) {
+    return a.name == b.name && a.prefix == b.prefix;
+}
+
+bool isSameExtensionNameToPrefix(const std::vector<nn::ExtensionNameAndPrefix>& a,
+                                 const std::vector<nn::ExtensionNameAndPrefix>& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), isSameExtensionNameAndPrefix);
+}
+
+bool isSameHint(const nn::TokenValuePair& a, const nn::TokenValuePair& b) {
+    return a.token == b.token && a.value == b.value;
+}
+
+bool isSameModel(const nn::Model& a, const nn::Model& b) {
+    const auto& valuesA = a.operandValues;
+    const auto& valuesB = b.operandValues;
+    return isSameSubgraph(a.main, b.main) &&
+           std::equal(a.referenced.begin(), a.referenced.end(), b.referenced.begin(),
+                      b.referenced.end(), isSameSubgraph) &&
+           valuesA.size() == valuesB.size() &&
+           (valuesA.size() == 0 ||
+            std::memcmp(valuesA.data(), valuesB.data(), valuesA.size()) == 0) &&
+           std::equal(a.pools.begin(), a.pools.end(), b.pools.begin(), b.pools.end(),
+                      isSamePool) &&
+           a.relaxComputationFloat32toFloat16 == b.relaxComputationFloat32toFloat16 &&
+           isSameExtensionNameToPrefix(a.extensionNameToPrefix, b.extensionNameToPrefix);
+}
+
+}  // namespace
+
+bool CachingDevice::Compilation::matches(const Compilation& other) const {
+    return preference == other.preference && priority == other.priority &&
+           std::equal(hints.begin(), hints.end(), other.hints.begin(), other.hints.end(),
+                      isSameHint) &&
+           isSameExtensionNameToPrefix(extensionNameToPrefix, other.extensionNameToPrefix) &&
+           isSameModel(model, other.model);
+}
+
+CachingDevice::CachingDevice(nn::SharedDevice device, size_t capacity)
+    : kDevice(std::move(device)), kCapacity(capacity) {
+    CHECK(kDevice != nullptr);
+    CHECK_GT(kCapacity, 0u);
+}
+
+CachingDevice::Stats CachingDevice::getStats() const {
+    std::lock_guard guard(mMutex);
+    return mStats;
+}
+
+const std::string& CachingDevice::getName() const {
+    return kDevice->getName();
+}
+
+const std::string& CachingDevice::getVersionString() const {
+    return kDevice->getVersionString();
+}
+
+nn::Version CachingDevice::getFeatureLevel() const {
+    return kDevice->getFeatureLevel();
+}
+
+nn::DeviceType CachingDevice::getType() const {
+    return kDevice->getType();
+}
+
+const std::vector<nn::Extension>& CachingDevice::getSupportedExtensions() const {
+    return kDevice->getSupportedExtensions();
+}
+
+const nn::Capabilities& CachingDevice::getCapabilities() const {
+    return kDevice->getCapabilities();
+}
+
+std::pair<uint32_t, uint32_t> CachingDevice::getNumberOfCacheFilesNeeded() const {
+    return kDevice->getNumberOfCacheFilesNeeded();
+}
+
+nn::GeneralResult<void> CachingDevice::wait() const {
+    return kDevice->wait();
+}
+
+nn::GeneralResult<std::vector<bool>> CachingDevice::getSupportedOperations(
+        const nn::Model& model) const {
+    return kDevice->getSupportedOperations(model);
+}
+
+nn::GeneralResult<nn::SharedPreparedModel> CachingDevice::prepareModel(
+        const nn::Model& model, nn::ExecutionPreference preference, nn::Priority priority,
+        nn::OptionalTimePoint deadline, const std::vector<nn::SharedHandle>& modelCache,
+        const std::vector<nn::SharedHandle>& dataCache, const nn::CacheToken& token,
+        const std::vector<nn::TokenValuePair>& hints,
+        const std::vector<nn::ExtensionNameAndPrefix>& extensionNameToPrefix) const {
+    const auto prepare = [&] {
+        return kDevice->prepareModel(model, preference, priority, deadline, modelCache, dataCache,
+                                     token, hints, extensionNameToPrefix);
+    };
+
+    // A device that implements compilation caching expects to populate modelCache and dataCache.
+    if (kDevice->getNumberOfCacheFilesNeeded() != std::make_pair(0u, 0u)) {
+        return prepare();
+    }
+
+    // An all zero token means the client did not identify the model.
+    if (std::all_of(token.begin(), token.end(), [](uint8_t byte) { return byte == 0; })) {
+        return prepare();
+    }
+    if (hasPointerOperands(model)) {
+        return prepare();
+    }
+    const auto hash = hashCompilation(model, preference, priority, hints, extensionNameToPrefix);
+    if (!hash.has_value()) {
+        return prepare();
+    }
+    const Key key(token, *hash);
+    Compilation compilation = {.model = model,
+                               .preference = preference,
+                               .priority = priority,
+                               .hints = hints,
+                               .extensionNameToPrefix = extensionNameToPrefix};
+
+    if (auto preparedModel = find(key, compilation)) {
+        return std::move(preparedModel).value();
+    }
+    auto preparedModel = NN_TRY(prepare());
+    CHECK(preparedModel != nullptr);
+    return insert(key, std::move(compilation), std::move(preparedModel));
+}
+
+nn::GeneralResult<nn::SharedPreparedModel> CachingDevice::prepareModelFromCache(
+        nn::OptionalTimePoint deadline, const std::vector<nn::SharedHandle>& modelCache,
+        const std::vector<nn::SharedHandle>& dataCache, const nn::CacheToken& token) const {
+    // The cache is keyed by the contents of the model, which is not known here.
+    return kDevice->prepareModelFromCache(deadline, modelCache, dataCache, token);
+}
+
+nn::GeneralResult<nn::SharedBuffer> CachingDevice::allocate(
+        const nn::BufferDesc& desc, const std::vector<nn::SharedPreparedModel>& preparedModels,
+        const std::vector<nn::BufferRole>& inputRoles,
+        const std::vector<nn::BufferRole>& outputRoles) const {
+    return kDevice->allocate(desc, preparedModels, inputRoles, outputRoles);
+}
+
+std::optional<nn::SharedPreparedModel> CachingDevice::find(const Key& key,
+                                                           const Compilation& compilation) const {
+    std::lock_guard guard(mMutex);
+    const auto it = mIndex.find(key);
+    if (it == mIndex.end() || !it->second->compilation.matches(compilation)) {
+        mStats.misses++;
+        return std::nullopt;
+    }
+    mStats.hits++;
+    mEntries.splice(mEntries.begin(), mEntries, it->second);
+    return it->second->preparedModel;
+}
+
+nn::SharedPreparedModel CachingDevice::insert(const Key& key, Compilation compilation,
+                                              nn::SharedPreparedModel preparedModel) const {
+    std::lock_guard guard(mMutex);
+
+    if (const auto it = mIndex.find(key); it != mIndex.end()) {
+        Entry& entry = *it->second;
+        mEntries.splice(mEntries.begin(), mEntries, it->second);
+        // If another thread prepared the same model in the meantime, that prepared model is kept.
+        // Otherwise the hash collided with another model, which is replaced.
+        if (entry.compilation.matches(compilation)) {
+            return entry.preparedModel;
+        }
+        entry.compilation = std::move(compilation);
+        entry.preparedModel = preparedModel;
+        return preparedModel;
+    }
+
+    mEntries.push_front(
+            {.key = key, .compilation = std::move(compilation), .preparedModel = preparedModel});
+    mIndex.emplace(key, mEntries.begin());
+    if (mEntries.size() > kCapacity) {
+        mIndex.erase(mEntries.back().key);
+        mEntries.pop_back();
+    }
+    return preparedModel;
+}
+
+}  // namespace android::hardware::neuralnetworks::utils
@@ -25,12 +25,79 @@
 
 #include <algorithm>
 #include <any>
+#include <cstring>
 #include <functional>
+#include <limits>
 #include <optional>
+#include <thread>
 #include <variant>
 #include <vector>
 
 namespace android::hardware::neuralnetworks::utils {
+namespace {
+
+constexpr size_t kSharedConstantAlignment = 64;
+
+// Upper bound on the threads used by convertInParallel, so that preparing a model does not take
+// over every core of a large device.
+constexpr size_t kMaxConversionThreads = 8;
+
+size_t roundUp(size_t size, size_t multiple) {
+    return (size + multiple - 1) / multiple * multiple;
+}
+
+bool isLargeConstant(const nn::Operand& operand, size_t threshold) {
+    return operand.lifetime == nn::Operand::LifeTime::CONSTANT_COPY &&
+           operand.location.length >= threshold;
+}
+
+size_t getSharedConstantsSize(const nn::Model::Subgraph& subgraph, size_t threshold,
+                              size_t sharedSize) {
+    for (const auto& operand : subgraph.operands) {
+        if (isLargeConstant(operand, threshold)) {
+            sharedSize = roundUp(sharedSize, kSharedConstantAlignment) + operand.location.length;
+        }
+    }
+    return sharedSize;
+}
+
+// Rewrites the CONSTANT_COPY operands of subgraph, copying large values from sourceValues to
+// sharedData and all other values to operandValues.
+nn::GeneralResult<void> relocateConstants(nn::Model::Subgraph* subgraph, size_t threshold,
+                                          const nn::Model::OperandValues& sourceValues,
+                                          uint32_t poolIndex, uint8_t* sharedData,
+                                          size_t* sharedOffset,
+                                          nn::Model::OperandValues* operandValues) {
+    for (auto& operand : subgraph->operands) {
+        if (operand.lifetime != nn::Operand::LifeTime::CONSTANT_COPY) {
+            continue;
+        }
+        const size_t offset = operand.location.offset;
+        const size_t length = operand.location.length;
+        if (offset > sourceValues.size() || length > sourceValues.size() - offset) {
+            return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT)
+                   << "CONSTANT_COPY operand is out of bounds of the operand values";
+        }
+        const uint8_t* data = sourceValues.data() + offset;
+
+        if (!isLargeConstant(operand, threshold)) {
+            operand.location = operandValues->append(data, length);
+            continue;
+        }
+
+        *sharedOffset = roundUp(*sharedOffset, kSharedConstantAlignment);
+        std::memcpy(sharedData + *sharedOffset, data, length);
+        operand.lifetime = nn::Operand::LifeTime::CONSTANT_REFERENCE;
+        operand.location = {};
+        operand.location.poolIndex = poolIndex;
+        operand.location.offset = static_cast<uint32_t>(*sharedOffset);
+        operand.location.length = static_cast<uint32_t>(length);
+        *sharedOffset += length;
+    }
+    return {};
+}
+
+}  // namespace
 
 nn::Capabilities::OperandPerformanceTable makeQuantized8PerformanceConsistentWithP(
         const nn::Capabilities::PerformanceInfo& float32Performance,
@@ -51,4 +118,83 @@ nn::Capabilities::OperandPerformanceTable makeQuantized8PerformanceConsistentWit
             .value();
 }
 
+nn::GeneralResult<std::reference_wrapper<const nn::Model>> flushLargeConstantsToShared(
+        const nn::Model* model, std::optional<nn::Model>* maybeModelInSharedOut,
+        size_t threshold) {
+    CHECK(model != nullptr);
+    CHECK(maybeModelInSharedOut != nullptr);
+    CHECK_GT(threshold, 0u);
+
+    size_t sharedSize = getSharedConstantsSize(model->main, threshold, 0);
+    for (const auto& subgraph : model->referenced) {
+        sharedSize = getSharedConstantsSize(subgraph, threshold, sharedSize);
+    }
+    if (sharedSize == 0) {
+        return *model;
+    }
+    if (sharedSize > std::numeric_limits<uint32_t>::max()) {
+        return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT)
+               << "CONSTANT_COPY operands are too large to be moved to shared memory";
+    }
+
+    auto memory = NN_TRY(nn::createSharedMemory(sharedSize));
+    const auto mapping = NN_TRY(nn::map(memory));
+    void* const* sharedData = std::get_if<void*>(&mapping.pointer);
+    if (sharedData == nullptr) {
+        return NN_ERROR() << "Shared memory for CONSTANT_COPY operands is not writable";
+    }
+
+    nn::Model modelInShared = {
+            .main = model->main,
+            .referenced = model->referenced,
+            .operandValues = {},
+            .pools = model->pools,
+            .relaxComputationFloat32toFloat16 = model->relaxComputationFloat32toFloat16,
+            .extensionNameToPrefix = model->extensionNameToPrefix,
+    };
+    const auto poolIndex = static_cast<uint32_t>(modelInShared.pools.size());
+    modelInShared.pools.push_back(std::move(memory));
+
+    size_t sharedOffset = 0;
+    const auto relocate = [&](nn::Model::Subgraph* subgraph) {
+        return relocateConstants(subgraph, threshold, model->operandValues, poolIndex,
+                                 static_cast<uint8_t*>(*sharedData), &sharedOffset,
+                                 &modelInShared.operandValues);
+    };
+    NN_TRY(relocate(&modelInShared.main));
+    for (auto& subgraph : modelInShared.referenced) {
+        NN_TRY(relocate(&subgraph));
+    }
+    CHECK_EQ(sharedOffset, sharedSize);
+
+    *maybeModelInSharedOut = std::move(modelInShared);
+    return **maybeModelInSharedOut;
+}
+
+nn::GeneralResult<std::reference_wrapper<const nn::Model>> flushModelDataToShared(
+        const nn::Model* model, std::optional<nn::Model>* maybeModelInSharedOut) {
+    CHECK(maybeModelInSharedOut != nullptr);
+
+    std::optional<nn::Model> maybeModelWithoutPointers;
+    const nn::Model& modelWithoutPointers =
+            NN_TRY(flushDataFromPointerToShared(model, &maybeModelWithoutPointers));
+    const nn::Model& modelInShared =
+            NN_TRY(flushLargeConstantsToShared(&modelWithoutPointers, maybeModelInSharedOut));
+
+    // Keep the model without pointers alive if no constants had to be moved.
+    if (&modelInShared == &modelWithoutPointers && maybeModelWithoutPointers.has_value()) {
+        *maybeModelInSharedOut = std::move(maybeModelWithoutPointers);
+        return **maybeModelInSharedOut;
+    }
+    return modelInShared;
+}
+
+size_t getConversionThreadCount(size_t size, size_t minParallelSize) {
+    if (minParallelSize == 0 || size < 2 * minParallelSize) {
+        return 1;
+    }
+    const size_t hardwareThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    return std::min({size / minParallelSize, hardwareThreads, kMaxConversionThreads});
+}
+
 }  // namespace android::hardware::neuralnetworks::utils
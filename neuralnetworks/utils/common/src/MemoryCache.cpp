@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MemoryCache.h"
+
+#include <android-base/logging.h>
+#include <android-base/thread_annotations.h>
+#include <nnapi/Result.h>
+#include <nnapi/Types.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::utils {
+namespace {
+
+// DMA_BUF_MAGIC from linux/magic.h, which older kernel headers do not define.
+constexpr int kDmaBufMagic = 0x444d4142;
+
+// Returns the identity of the file referenced by fd if no other file can share it. Regular files,
+// including memfd files, have an inode of their own. So do dma-bufs, which live in their own
+// filesystem. Regions of the legacy ashmem device and files backed by the shared anonymous inode
+// all report the same inode.
+std::optional<std::pair<dev_t, ino_t>> getUniqueFileIdentity(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return std::nullopt;
+    }
+    if (S_ISREG(st.st_mode)) {
+        return std::make_pair(st.st_dev, st.st_ino);
+    }
+
+    struct statfs stfs;
+    if (fstatfs(fd, &stfs) == 0 && stfs.f_type == kDmaBufMagic) {
+        return std::make_pair(st.st_dev, st.st_ino);
+    }
+    return std::nullopt;
+}
+
+}  // namespace
+
+bool MemoryCache::Key::operator<(const Key& other) const {
+    return std::tie(files, name, attributes) < std::tie(other.files, other.name, other.attributes);
+}
+
+std::optional<MemoryCache::Key> MemoryCache::makeKey(const std::vector<int>& fds, std::string name,
+                                                     std::vector<int64_t> attributes) {
+    if (fds.empty()) {
+        return std::nullopt;
+    }
+
+    Key key{.files = {}, .name = std::move(name), .attributes = std::move(attributes)};
+    key.files.reserve(fds.size());
+    for (int fd : fds) {
+        auto identity = getUniqueFileIdentity(fd);
+        if (!identity.has_value()) {
+            return std::nullopt;
+        }
+        key.files.push_back(*identity);
+    }
+    return key;
+}
+
+MemoryCache::MemoryCache(size_t capacity) : kCapacity(capacity) {
+    CHECK_GT(kCapacity, 0u);
+}
+
+nn::GeneralResult<nn::SharedMemory> MemoryCache::getOrCreate(const std::optional<Key>& key,
+                                                             const Factory& create) const {
+    if (!key.has_value()) {
+        return create();
+    }
+
+    {
+        std::lock_guard guard(mMutex);
+        if (const auto it = mIndex.find(*key); it != mIndex.end()) {
+            mEntries.splice(mEntries.begin(), mEntries, it->second);
+            return it->second->second;
+        }
+    }
+
+    // Create the memory without holding the lock, as importing it may be slow. If another thread
+    // cached the same memory in the meantime, that memory is kept.
+    auto memory = NN_TRY(create());
+
+    std::lock_guard guard(mMutex);
+    if (const auto it = mIndex.find(*key); it != mIndex.end()) {
+        mEntries.splice(mEntries.begin(), mEntries, it->second);
+        return it->second->second;
+    }
+
+    mEntries.emplace_front(*key, memory);
+    mIndex.emplace(*key, mEntries.begin());
+    if (mEntries.size() > kCapacity) {
+        mIndex.erase(mEntries.back().first);
+        mEntries.pop_back();
+    }
+    return memory;
+}
+
+size_t MemoryCache::size() const {
+    std::lock_guard guard(mMutex);
+    return mEntries.size();
+}
+
+}  // namespace android::hardware::neuralnetworks::utils
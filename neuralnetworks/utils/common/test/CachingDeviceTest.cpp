@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gmock/gmock.h>
+#include <nnapi/Types.h>
+#include <nnapi/hal/CachingDevice.h>
+
+#include <array>
+#include <memory>
+#include <utility>
+
+#include "MockDevice.h"
+#include "MockPreparedModel.h"
+
+namespace android::hardware::neuralnetworks::utils {
+namespace {
+
+using ::testing::_;
+using ::testing::Return;
+
+using SharedMockDevice = std::shared_ptr<const nn::MockDevice>;
+
+constexpr auto kNoCacheFilesNeeded = std::pair<uint32_t, uint32_t>(0, 0);
+constexpr auto kCacheFilesNeeded = std::pair<uint32_t, uint32_t>(1, 1);
+constexpr nn::CacheToken kToken = {1};
+
+SharedMockDevice createMockDevice(std::pair<uint32_t, uint32_t> numberOfCacheFilesNeeded) {
+    auto mockDevice = std::make_shared<const nn::MockDevice>();
+    ON_CALL(*mockDevice, getNumberOfCacheFilesNeeded())
+            .WillByDefault(Return(numberOfCacheFilesNeeded));
+    EXPECT_CALL(*mockDevice, getNumberOfCacheFilesNeeded()).Times(testing::AnyNumber());
+    return mockDevice;
+}
+
+nn::GeneralResult<nn::SharedPreparedModel> prepare(const CachingDevice& device,
+                                                   const nn::Model& model,
+                                                   const nn::CacheToken& token = kToken) {
+    return device.prepareModel(model, nn::ExecutionPreference::DEFAULT, nn::Priority::DEFAULT, {},
+                               {}, {}, token, {}, {});
+}
+
+nn::Model createModel(bool relaxComputationFloat32toFloat16) {
+    nn::Model model;
+    model.relaxComputationFloat32toFloat16 = relaxComputationFloat32toFloat16;
+    return model;
+}
+
+// FNV-1a consuming eight bytes per step maps both of these to the same hash: flipping the top bit
+// of a word flips the top bit of the product, which the flipped top bit of the next word undoes.
+nn::Model createModelWithOperandValues(uint8_t topByte) {
+    std::array<uint8_t, 16> values{};
+    values[7] = topByte;
+    values[15] = topByte;
+    nn::Model model;
+    model.operandValues = nn::Model::OperandValues(values.data(), values.size());
+    return model;
+}
+
+const auto kReturnGeneralFailure = [](const auto&... /*args*/) {
+    return nn::error(nn::ErrorStatus::GENERAL_FAILURE);
+};
+
+}  // namespace
+
+TEST(CachingDeviceTest, prepareModelReusesPreparedModel) {
+    // setup call
+    const auto mockDevice = createMockDevice(kNoCacheFilesNeeded);
+    const auto mockPreparedModel = std::make_shared<const nn::MockPreparedModel>();
+    EXPECT_CALL(*mockDevice, prepareModel(_, _, _, _, _, _, _, _, _))
+            .Times(1)
+            .WillOnce(Return(mockPreparedModel));
+    const CachingDevice device(mockDevice);
+
+    // run test
+    const auto first = prepare(device, createModel(false));
+    const auto second = prepare(device, createModel(false));
+
+    // verify result
+    ASSERT_TRUE(first.has_value());
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(first.value(), mockPreparedModel);
+    EXPECT_EQ(second.value(), mockPreparedModel);
+    const auto stats = device.getStats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 1u);
+}
+
+TEST(CachingDeviceTest, prepareModelDistinguishesModels) {
+    // setup call
+    const auto mockDevice = createMockDevice(kNoCacheFilesNeeded);
+    EXPECT_CALL(*mockDevice, prepareModel(_, _, _, _, _, _, _, _, _))
+            .Times(2)
+            .WillRepeatedly(Return(std::make_shared<const nn::MockPreparedModel>()));
+    const CachingDevice device(mockDevice);
+
+    // run test
+    EXPECT_TRUE(prepare(device, createModel(false)).has_value());
+    EXPECT_TRUE(prepare(device, createModel(true)).has_value());
+
+    // verify result
+    EXPECT_EQ(device.getStats().hits, 0u);
+}
+
+TEST(CachingDeviceTest, prepareModelDistinguishesTokens) {
+    // setup call
+    const auto mockDevice = createMockDevice(kNoCacheFilesNeeded);
+    EXPECT_CALL(*mockDevice, prepareModel(_, _, _, _, _, _, _, _, _))
+            .Times(2)
+            .WillRepeatedly(Return(std::make_shared<const nn::MockPreparedModel>()));
+    const CachingDevice device(mockDevice);
+    nn::CacheToken otherToken{};
+    otherToken.front() = 2;
+
+    // run test
+    EXPECT_TRUE(prepare(device, createModel(false)).has_value());
+    EXPECT_TRUE(prepare(device, createModel(false), otherToken).has_value());
+
+    // verify result
+    EXPECT_EQ(device.getStats().hits, 0u);
+}
+
+TEST(CachingDeviceTest, prepareModelComparesModelsWithSameHash) {
+    // setup call
+    const auto mockDevice = createMockDevice(kNoCacheFilesNeeded);
+    const auto firstPreparedModel = std::make_shared<const nn::MockPreparedModel>();
+    const auto secondPreparedModel = std::make_shared<const nn::MockPreparedModel>();
+    EXPECT_CALL(*mockDevice, prepareModel(_, _, _, _, _, _, _, _, _))
+            .Times(2)
+            .WillOnce(Return(firstPreparedModel))
+            .WillOnce(Return(secondPreparedModel));
+    const CachingDevice device(mockDevice);
+
+    // run test
+    const auto first = prepare(device, createModelWithOperandValues(0x00));
+    const auto second = prepare(device, createModelWithOperandValues(0x80));
+    const auto third = prepare(device, createModelWithOperandValues(0x80));
+
+    // verify result
+    ASSERT_TRUE(first.has_value());
+    ASSERT_TRUE(second.has_value());
+    ASSERT_TRUE(third.has_value());
+    EXPECT_EQ(first.value(), firstPreparedModel);
+    EXPECT_EQ(second.value(), secondPreparedModel);
+    EXPECT_EQ(third.value(), secondPreparedModel);
+    const auto stats = device.getStats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 2u);
+}
+
+TEST(CachingDeviceTest, prepareModelPassesThroughWithoutToken) {
+    // setup call
+    const auto mockDevice = createMockDevice(kNoCacheFilesNeeded);
+    EXPECT_CALL(*mockDevice, prepareModel(_, _, _, _, _, _, _, _, _))
+            .Times(2)
+            .WillRepeatedly(Return(std::make_shared<const nn::MockPreparedModel>()));
+    const CachingDevice device(mockDevice);
+
+    // run test
+    EXPECT_TRUE(prepare(device, createModel(false), nn::CacheToken{}).has_value());
+    EXPECT_TRUE(prepare(device, createModel(false), nn::CacheToken{}).has_value());
+
+    // verify result
+    const auto stats = device.getStats();
+    EXPECT_EQ(stats.hits, 0u);
+    EXPECT_EQ(stats.misses, 0u);
+}
+
+TEST(CachingDeviceTest, prepareModelPassesThroughWhenDeviceCaches) {
+    // setup call
+    const auto mockDevice = createMockDevice(kCacheFilesNeeded);
+    EXPECT_CALL(*mockDevice, prepareModel(_, _, _, _, _, _, _, _, _))
+            .Times(2)
+            .WillRepeatedly(Return(std::make_shared<const nn::MockPreparedModel>()));
+    const CachingDevice device(mockDevice);
+
+    // run test
+    EXPECT_TRUE(prepare(device, createModel(false)).has_value());
+    EXPECT_TRUE(prepare(device, createModel(false)).has_value());
+
+    // verify result
+    const auto stats = device.getStats();
+    EXPECT_EQ(stats.hits, 0u);
+    EXPECT_EQ(stats.misses, 0u);
+}
+
+TEST(CachingDeviceTest, prepareModelDoesNotCacheErrors) {
+    // setup call
+    const auto mockDevice = createMockDevice(kNoCacheFilesNeeded);
+    EXPECT_CALL(*mockDevice, prepareModel(_, _, _, _, _, _, _, _, _))
+            .Times(2)
+            .WillOnce(kReturnGeneralFailure)
+            .WillOnce(Return(std::make_shared<const nn::MockPreparedModel>()));
+    const CachingDevice device(mockDevice);
+
+    // run test
+    const auto first = prepare(device, createModel(false));
+    const auto second = prepare(device, createModel(false));
+
+    // verify result
+    ASSERT_FALSE(first.has_value());
+    EXPECT_EQ(first.error().code, nn::ErrorStatus::GENERAL_FAILURE);
+    EXPECT_TRUE(second.has_value());
+}
+
+TEST(CachingDeviceTest, evictsLeastRecentlyUsed) {
+    // setup call
+    const auto mockDevice = createMockDevice(kNoCacheFilesNeeded);
+    EXPECT_CALL(*mockDevice, prepareModel(_, _, _, _, _, _, _, _, _))
+            .Times(3)
+            .WillRepeatedly(Return(std::make_shared<const nn::MockPreparedModel>()));
+    const CachingDevice device(mockDevice, /*capacity=*/1);
+
+    // run test
+    EXPECT_TRUE(prepare(device, createModel(false)).has_value());
+    EXPECT_TRUE(prepare(device, createModel(true)).has_value());
+    EXPECT_TRUE(prepare(device, createModel(false)).has_value());
+
+    // verify result
+    const auto stats = device.getStats();
+    EXPECT_EQ(stats.hits, 0u);
+    EXPECT_EQ(stats.misses, 3u);
+}
+
+}  // namespace android::hardware::neuralnetworks::utils
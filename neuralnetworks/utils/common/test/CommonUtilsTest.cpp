@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gmock/gmock.h>
+#include <nnapi/SharedMemory.h>
+#include <nnapi/Types.h>
+#include <nnapi/hal/CommonUtils.h>
+
+#include <cstring>
+#include <numeric>
+#include <optional>
+#include <variant>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::utils {
+namespace {
+
+constexpr size_t kThreshold = 16;
+constexpr size_t kMinParallelSize = 4;
+
+nn::GeneralResult<int> doubleOrFail(int value) {
+    if (value < 0) {
+        return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT) << value;
+    }
+    return 2 * value;
+}
+
+std::vector<int> makeSequence(size_t size) {
+    std::vector<int> values(size);
+    std::iota(values.begin(), values.end(), 0);
+    return values;
+}
+
+nn::Operand makeConstant(nn::Model::OperandValues* operandValues,
+                         const std::vector<uint8_t>& value) {
+    nn::Operand operand;
+    operand.lifetime = nn::Operand::LifeTime::CONSTANT_COPY;
+    operand.location = operandValues->append(value.data(), value.size());
+    return operand;
+}
+
+std::vector<uint8_t> getValue(const nn::Model& model, const nn::Operand& operand) {
+    const auto& location = operand.location;
+    if (operand.lifetime == nn::Operand::LifeTime::CONSTANT_COPY) {
+        const uint8_t* data = model.operandValues.data() + location.offset;
+        return std::vector<uint8_t>(data, data + location.length);
+    }
+    const auto mapping = nn::map(model.pools.at(location.poolIndex)).value();
+    const auto* data = static_cast<const uint8_t*>(std::get<void*>(mapping.pointer));
+    return std::vector<uint8_t>(data + location.offset, data + location.offset + location.length);
+}
+
+}  // namespace
+
+TEST(CommonUtilsTest, flushLargeConstantsToSharedKeepsSmallConstants) {
+    nn::Model model;
+    model.main.operands.push_back(makeConstant(&model.operandValues, {1, 2, 3, 4}));
+
+    std::optional<nn::Model> maybeModelInShared;
+    const auto result = flushLargeConstantsToShared(&model, &maybeModelInShared, kThreshold);
+
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(&result.value().get(), &model);
+    EXPECT_FALSE(maybeModelInShared.has_value());
+}
+
+TEST(CommonUtilsTest, flushLargeConstantsToSharedMovesLargeConstants) {
+    const std::vector<uint8_t> small = {1, 2, 3, 4};
+    const std::vector<uint8_t> large(kThreshold, 5);
+    const std::vector<uint8_t> larger(kThreshold + 3, 6);
+    nn::Model model;
+    model.main.operands.push_back(makeConstant(&model.operandValues, large));
+    model.main.operands.push_back(makeConstant(&model.operandValues, small));
+    model.referenced.push_back({});
+    model.referenced[0].operands.push_back(makeConstant(&model.operandValues, larger));
+
+    std::optional<nn::Model> maybeModelInShared;
+    const auto result = flushLargeConstantsToShared(&model, &maybeModelInShared, kThreshold);
+
+    ASSERT_TRUE(result.has_value());
+    ASSERT_TRUE(maybeModelInShared.has_value());
+    const nn::Model& modelInShared = result.value();
+    EXPECT_EQ(&modelInShared, &maybeModelInShared.value());
+    ASSERT_EQ(modelInShared.pools.size(), 1u);
+    EXPECT_LT(modelInShared.operandValues.size(), model.operandValues.size());
+
+    const auto& operands = modelInShared.main.operands;
+    const auto& referencedOperands = modelInShared.referenced[0].operands;
+    EXPECT_EQ(operands[0].lifetime, nn::Operand::LifeTime::CONSTANT_REFERENCE);
+    EXPECT_EQ(operands[1].lifetime, nn::Operand::LifeTime::CONSTANT_COPY);
+    EXPECT_EQ(referencedOperands[0].lifetime, nn::Operand::LifeTime::CONSTANT_REFERENCE);
+    EXPECT_EQ(operands[0].location.poolIndex, 0u);
+    EXPECT_EQ(referencedOperands[0].location.poolIndex, 0u);
+    EXPECT_EQ(getValue(modelInShared, operands[0]), large);
+    EXPECT_EQ(getValue(modelInShared, operands[1]), small);
+    EXPECT_EQ(getValue(modelInShared, referencedOperands[0]), larger);
+}
+
+TEST(CommonUtilsTest, flushLargeConstantsToSharedRejectsOutOfBoundsConstant) {
+    nn::Model model;
+    auto operand = makeConstant(&model.operandValues, std::vector<uint8_t>(kThreshold, 1));
+    operand.location.offset += 1;
+    model.main.operands.push_back(operand);
+
+    std::optional<nn::Model> maybeModelInShared;
+    const auto result = flushLargeConstantsToShared(&model, &maybeModelInShared, kThreshold);
+
+    ASSERT_FALSE(result.has_value());
+    EXPECT_EQ(result.error().code, nn::ErrorStatus::INVALID_ARGUMENT);
+}
+
+TEST(CommonUtilsTest, getConversionThreadCountKeepsSmallVectorsOnOneThread) {
+    EXPECT_EQ(getConversionThreadCount(0, kMinParallelSize), 1u);
+    EXPECT_EQ(getConversionThreadCount(2 * kMinParallelSize - 1, kMinParallelSize), 1u);
+    EXPECT_EQ(getConversionThreadCount(1000, 0), 1u);
+}
+
+TEST(CommonUtilsTest, getConversionThreadCountGivesEachThreadEnoughElements) {
+    for (size_t size = 0; size < 64 * kMinParallelSize; ++size) {
+        const size_t numThreads = getConversionThreadCount(size, kMinParallelSize);
+        EXPECT_GE(numThreads, 1u);
+        if (numThreads > 1) {
+            EXPECT_GE(size / numThreads, kMinParallelSize);
+        }
+    }
+}
+
+TEST(CommonUtilsTest, convertInParallelPreservesOrder) {
+    const auto values = makeSequence(100 * kMinParallelSize + 3);
+
+    const auto result = convertInParallel(values, doubleOrFail, kMinParallelSize);
+
+    ASSERT_TRUE(result.has_value()) << result.error().message;
+    ASSERT_EQ(result.value().size(), values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        EXPECT_EQ(result.value()[i], 2 * values[i]);
+    }
+}
+
+TEST(CommonUtilsTest, convertInParallelHandlesEmptyVector) {
+    const auto result = convertInParallel(std::vector<int>{}, doubleOrFail, kMinParallelSize);
+
+    ASSERT_TRUE(result.has_value()) << result.error().message;
+    EXPECT_TRUE(result.value().empty());
+}
+
+TEST(CommonUtilsTest, convertInParallelReturnsFirstError) {
+    auto values = makeSequence(100 * kMinParallelSize);
+    values[values.size() / 2] = -1;
+    values[values.size() - 1] = -2;
+
+    const auto result = convertInParallel(values, doubleOrFail, kMinParallelSize);
+
+    ASSERT_FALSE(result.has_value());
+    EXPECT_EQ(result.error().code, nn::ErrorStatus::INVALID_ARGUMENT);
+    EXPECT_EQ(result.error().message, "-1");
+}
+
+}  // namespace android::hardware::neuralnetworks::utils
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+#include <gmock/gmock.h>
+#include <nnapi/SharedMemory.h>
+#include <nnapi/Types.h>
+#include <nnapi/hal/MemoryCache.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace android::hardware::neuralnetworks::utils {
+namespace {
+
+using ::testing::Return;
+
+using MockMemoryFactory = ::testing::MockFunction<nn::GeneralResult<nn::SharedMemory>()>;
+
+base::unique_fd createFile() {
+    FILE* file = tmpfile();
+    CHECK(file != nullptr);
+    base::unique_fd fd(dup(fileno(file)));
+    fclose(file);
+    return fd;
+}
+
+nn::SharedMemory createMemory() {
+    return nn::createSharedMemory(4).value();
+}
+
+MemoryCache::Key makeKey(int fd, int64_t size = 4) {
+    auto key = MemoryCache::makeKey({fd}, "ashmem", {size});
+    CHECK(key.has_value());
+    return std::move(key).value();
+}
+
+}  // namespace
+
+TEST(MemoryCacheTest, makeKeyIdentifiesFile) {
+    const auto file = createFile();
+    const base::unique_fd duplicate(dup(file.get()));
+    const auto otherFile = createFile();
+
+    const auto key = makeKey(file.get());
+    const auto duplicateKey = makeKey(duplicate.get());
+    const auto otherKey = makeKey(otherFile.get());
+
+    EXPECT_FALSE(key < duplicateKey || duplicateKey < key);
+    EXPECT_TRUE(key < otherKey || otherKey < key);
+    EXPECT_TRUE(key < makeKey(file.get(), 8) || makeKey(file.get(), 8) < key);
+}
+
+TEST(MemoryCacheTest, makeKeyRejectsSharedIdentity) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    const base::unique_fd readEnd(fds[0]);
+    const base::unique_fd writeEnd(fds[1]);
+
+    EXPECT_FALSE(MemoryCache::makeKey({readEnd.get()}, "ashmem", {}).has_value());
+    EXPECT_FALSE(MemoryCache::makeKey({}, "ashmem", {}).has_value());
+}
+
+TEST(MemoryCacheTest, getOrCreateReusesMemory) {
+    const auto file = createFile();
+    const auto memory = createMemory();
+    MockMemoryFactory factory;
+    EXPECT_CALL(factory, Call()).Times(1).WillOnce(Return(memory));
+
+    const MemoryCache cache;
+    const auto first = cache.getOrCreate(makeKey(file.get()), factory.AsStdFunction());
+    const auto second = cache.getOrCreate(makeKey(file.get()), factory.AsStdFunction());
+
+    ASSERT_TRUE(first.has_value());
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(first.value(), memory);
+    EXPECT_EQ(second.value(), memory);
+    EXPECT_EQ(cache.size(), 1u);
+}
+
+TEST(MemoryCacheTest, getOrCreateWithoutKey) {
+    MockMemoryFactory factory;
+    EXPECT_CALL(factory, Call()).Times(2).WillRepeatedly(Return(createMemory()));
+
+    const MemoryCache cache;
+    EXPECT_TRUE(cache.getOrCreate(std::nullopt, factory.AsStdFunction()).has_value());
+    EXPECT_TRUE(cache.getOrCreate(std::nullopt, factory.AsStdFunction()).has_value());
+    EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(MemoryCacheTest, getOrCreateDoesNotCacheErrors) {
+    const auto file = createFile();
+    MockMemoryFactory factory;
+    EXPECT_CALL(factory, Call())
+            .Times(2)
+            .WillOnce([]() -> nn::GeneralResult<nn::SharedMemory> {
+                return NN_ERROR() << "failed to create memory";
+            })
+            .WillOnce(Return(createMemory()));
+
+    const MemoryCache cache;
+    EXPECT_FALSE(cache.getOrCreate(makeKey(file.get()), factory.AsStdFunction()).has_value());
+    EXPECT_TRUE(cache.getOrCreate(makeKey(file.get()), factory.AsStdFunction()).has_value());
+    EXPECT_EQ(cache.size(), 1u);
+}
+
+TEST(MemoryCacheTest, evictsLeastRecentlyUsed) {
+    const auto file1 = createFile();
+    const auto file2 = createFile();
+    const auto file3 = createFile();
+    const auto memory1 = createMemory();
+    const auto memory2 = createMemory();
+    const auto factory = [](nn::SharedMemory memory) {
+        return [memory] { return nn::GeneralResult<nn::SharedMemory>(memory); };
+    };
+    const auto fail = []() -> nn::GeneralResult<nn::SharedMemory> {
+        return NN_ERROR() << "unexpected cache miss";
+    };
+
+    const MemoryCache cache(2);
+    ASSERT_TRUE(cache.getOrCreate(makeKey(file1.get()), factory(memory1)).has_value());
+    ASSERT_TRUE(cache.getOrCreate(makeKey(file2.get()), factory(memory2)).has_value());
+    // file1 becomes the most recently used, so file2 is evicted by file3
+    ASSERT_TRUE(cache.getOrCreate(makeKey(file1.get()), fail).has_value());
+    ASSERT_TRUE(cache.getOrCreate(makeKey(file3.get()), factory(createMemory())).has_value());
+
+    EXPECT_EQ(cache.size(), 2u);
+    const auto cached = cache.getOrCreate(makeKey(file1.get()), fail);
+    ASSERT_TRUE(cached.has_value());
+    EXPECT_EQ(cached.value(), memory1);
+    EXPECT_FALSE(cache.getOrCreate(makeKey(file2.get()), fail).has_value());
+}
+
+}  // namespace android::hardware::neuralnetworks::utils
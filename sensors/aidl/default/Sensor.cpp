@@ -16,8 +16,10 @@
 
 #include "sensors-impl/Sensor.h"
 
+#include "sensors-impl/SensorScheduler.h"
 #include "utils/SystemClock.h"
 
+#include <algorithm>
 #include <cmath>
 
 using ::ndk::ScopedAStatus;
@@ -32,44 +34,67 @@ static constexpr int32_t kDefaultMaxDelayUs = 10 * 1000 * 1000;
 Sensor::Sensor(ISensorsEventCallback* callback)
     : mIsEnabled(false),
       mSamplingPeriodNs(0),
-      mLastSampleTimeNs(0),
+      mMaxReportLatencyNs(0),
+      mScheduler(nullptr),
       mCallback(callback),
-      mMode(OperationMode::NORMAL) {
-    mRunThread = std::thread(startThread, this);
-}
+      mMode(OperationMode::NORMAL) {}
 
 Sensor::~Sensor() {
-    std::unique_lock<std::mutex> lock(mRunMutex);
-    mStopThread = true;
-    mIsEnabled = false;
-    mWaitCV.notify_all();
-    lock.release();
-    mRunThread.join();
+    if (mScheduler != nullptr) {
+        mScheduler->unschedule(this);
+    }
 }
 
 const SensorInfo& Sensor::getSensorInfo() const {
     return mSensorInfo;
 }
 
-void Sensor::batch(int64_t samplingPeriodNs) {
+void Sensor::batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs) {
     if (samplingPeriodNs < mSensorInfo.minDelayUs * 1000LL) {
         samplingPeriodNs = mSensorInfo.minDelayUs * 1000LL;
     } else if (samplingPeriodNs > mSensorInfo.maxDelayUs * 1000LL) {
         samplingPeriodNs = mSensorInfo.maxDelayUs * 1000LL;
     }
 
-    if (mSamplingPeriodNs != samplingPeriodNs) {
+    maxReportLatencyNs = std::max<int64_t>(maxReportLatencyNs, 0);
+
+    std::lock_guard<std::mutex> lock(mScheduleMutex);
+    if (mSamplingPeriodNs != samplingPeriodNs || mMaxReportLatencyNs != maxReportLatencyNs) {
         mSamplingPeriodNs = samplingPeriodNs;
-        // Wake up the 'run' thread to check if a new event should be generated now
-        mWaitCV.notify_all();
+        mMaxReportLatencyNs = maxReportLatencyNs;
+        // Let the scheduler check if a new event should be generated now
+        updateSchedule();
     }
 }
 
 void Sensor::activate(bool enable) {
+    std::lock_guard<std::mutex> lock(mScheduleMutex);
     if (mIsEnabled != enable) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
         mIsEnabled = enable;
-        mWaitCV.notify_all();
+        updateSchedule();
+    }
+}
+
+void Sensor::setScheduler(SensorScheduler* scheduler) {
+    std::lock_guard<std::mutex> lock(mScheduleMutex);
+    if (mScheduler != nullptr) {
+        mScheduler->unschedule(this);
+    }
+    mScheduler = scheduler;
+    updateSchedule();
+}
+
+void Sensor::updateSchedule() {
+    if (mScheduler == nullptr) {
+        return;
+    }
+    if (mIsEnabled && mMode == OperationMode::NORMAL) {
+        // A sensor that is enabled before batch() is called samples at its fastest rate.
+        const int64_t samplingPeriodNs =
+                mSamplingPeriodNs > 0 ? mSamplingPeriodNs : mSensorInfo.minDelayUs * 1000LL;
+        mScheduler->schedule(this, samplingPeriodNs, mMaxReportLatencyNs);
+    } else {
+        mScheduler->unschedule(this);
     }
 }
 
@@ -91,42 +116,16 @@ ScopedAStatus Sensor::flush() {
             .what = MetaDataEventType::META_DATA_FLUSH_COMPLETE,
     };
     ev.payload.set<EventPayload::Tag::meta>(meta);
-    std::vector<Event> evs{ev};
+    std::vector<Event> evs;
+    if (mScheduler != nullptr) {
+        evs = mScheduler->takePendingEvents(this);
+    }
+    evs.push_back(ev);
     mCallback->postEvents(evs, isWakeUpSensor());
 
     return ScopedAStatus::ok();
 }
 
-void Sensor::startThread(Sensor* sensor) {
-    sensor->run();
-}
-
-void Sensor::run() {
-    std::unique_lock<std::mutex> runLock(mRunMutex);
-    constexpr int64_t kNanosecondsInSeconds = 1000 * 1000 * 1000;
-
-    while (!mStopThread) {
-        if (!mIsEnabled || mMode == OperationMode::DATA_INJECTION) {
-            mWaitCV.wait(runLock, [&] {
-                return ((mIsEnabled && mMode == OperationMode::NORMAL) || mStopThread);
-            });
-        } else {
-            timespec curTime;
-            clock_gettime(CLOCK_BOOTTIME, &curTime);
-            int64_t now = (curTime.tv_sec * kNanosecondsInSeconds) + curTime.tv_nsec;
-            int64_t nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-
-            if (now >= nextSampleTime) {
-                mLastSampleTimeNs = now;
-                nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-                mCallback->postEvents(readEvents(), isWakeUpSensor());
-            }
-
-            mWaitCV.wait_for(runLock, std::chrono::nanoseconds(nextSampleTime - now));
-        }
-    }
-}
-
 bool Sensor::isWakeUpSensor() {
     return mSensorInfo.flags & static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_WAKE_UP);
 }
@@ -144,10 +143,10 @@ std::vector<Event> Sensor::readEvents() {
 }
 
 void Sensor::setOperationMode(OperationMode mode) {
+    std::lock_guard<std::mutex> lock(mScheduleMutex);
     if (mMode != mode) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
         mMode = mode;
-        mWaitCV.notify_all();
+        updateSchedule();
     }
 }
 
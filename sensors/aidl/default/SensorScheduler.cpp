@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sensors-impl/SensorScheduler.h"
+
+#include "sensors-impl/Sensor.h"
+
+#include "utils/SystemClock.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace sensors {
+
+// A sensor may be sampled up to this long before its deadline to share a wake-up with another
+// sensor, but never earlier than a sixteenth of its sampling period.
+static constexpr int64_t kMaxCoalesceWindowNs = 1000 * 1000;
+
+SensorScheduler::SensorScheduler(ISensorsEventCallback* callback)
+    : mCallback(callback), mClock(::android::elapsedRealtimeNano), mStopThread(false) {
+    mRunThread = std::thread(&SensorScheduler::run, this);
+}
+
+SensorScheduler::SensorScheduler(ISensorsEventCallback* callback, std::function<int64_t()> clock)
+    : mCallback(callback), mClock(std::move(clock)), mStopThread(false) {}
+
+SensorScheduler::~SensorScheduler() {
+    stop();
+}
+
+void SensorScheduler::schedule(Sensor* sensor, int64_t samplingPeriodNs,
+                               int64_t maxReportLatencyNs) {
+    // A zero period would make the sensor due again as soon as it is sampled.
+    samplingPeriodNs = std::max<int64_t>(samplingPeriodNs, 1);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    SensorState& state = mStates[sensor];
+    if (state.scheduled && state.samplingPeriodNs == samplingPeriodNs &&
+        state.maxReportLatencyNs == maxReportLatencyNs) {
+        return;
+    }
+    state.generation++;
+    state.scheduled = true;
+    state.samplingPeriodNs = samplingPeriodNs;
+    state.maxReportLatencyNs = maxReportLatencyNs;
+
+    const int64_t now = mClock();
+    pushDeadlineLocked(sensor, state, std::max(now, state.lastSampleTimeNs + samplingPeriodNs));
+    mWaitCV.notify_all();
+}
+
+void SensorScheduler::unschedule(const Sensor* sensor) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mStates.find(sensor);
+    if (it == mStates.end()) {
+        return;
+    }
+    it->second.generation++;
+    it->second.scheduled = false;
+    it->second.pendingEvents.clear();
+}
+
+std::vector<SensorScheduler::Event> SensorScheduler::takePendingEvents(const Sensor* sensor) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mStates.find(sensor);
+    if (it == mStates.end()) {
+        return {};
+    }
+    return std::exchange(it->second.pendingEvents, {});
+}
+
+void SensorScheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopThread = true;
+        mWaitCV.notify_all();
+    }
+    if (mRunThread.joinable()) {
+        mRunThread.join();
+    }
+}
+
+void SensorScheduler::pushDeadlineLocked(Sensor* sensor, const SensorState& state,
+                                         int64_t timeNs) {
+    const int64_t window = std::min(kMaxCoalesceWindowNs, state.samplingPeriodNs / 16);
+    mDeadlines.push({
+            .earliestNs = timeNs - window,
+            .timeNs = timeNs,
+            .sensor = sensor,
+            .generation = state.generation,
+    });
+}
+
+void SensorScheduler::sampleLocked(const Deadline& deadline, int64_t now,
+                                   std::vector<Event>* events, std::vector<Event>* wakeUpEvents) {
+    auto it = mStates.find(deadline.sensor);
+    if (it == mStates.end() || it->second.generation != deadline.generation) {
+        // The sensor was rescheduled or unscheduled since this deadline was pushed.
+        return;
+    }
+    SensorState& state = it->second;
+    Sensor* sensor = deadline.sensor;
+
+    std::vector<Event> sampled = sensor->readEvents();
+    state.lastSampleTimeNs = now;
+
+    // Keep to the original deadlines unless the thread fell behind, in which case the missed
+    // samples are skipped instead of being generated in a burst.
+    int64_t nextTimeNs = deadline.timeNs + state.samplingPeriodNs;
+    if (nextTimeNs <= now) {
+        nextTimeNs = now + state.samplingPeriodNs;
+    }
+    pushDeadlineLocked(sensor, state, nextTimeNs);
+
+    std::vector<Event>* output = sensor->isWakeUpSensor() ? wakeUpEvents : events;
+    const size_t fifoMaxEventCount = sensor->getSensorInfo().fifoMaxEventCount;
+    if (state.maxReportLatencyNs <= 0 || fifoMaxEventCount == 0) {
+        output->insert(output->end(), sampled.begin(), sampled.end());
+        return;
+    }
+
+    if (state.pendingEvents.empty()) {
+        state.deliverByNs = now + state.maxReportLatencyNs;
+    }
+    state.pendingEvents.insert(state.pendingEvents.end(), sampled.begin(), sampled.end());
+    // Deliver now if waiting for the next sample would miss the report latency or overflow the
+    // FIFO.
+    if (nextTimeNs > state.deliverByNs || state.pendingEvents.size() >= fifoMaxEventCount) {
+        output->insert(output->end(), state.pendingEvents.begin(), state.pendingEvents.end());
+        state.pendingEvents.clear();
+    }
+}
+
+std::optional<int64_t> SensorScheduler::sampleDue(int64_t nowNs) {
+    std::vector<Event> events;
+    std::vector<Event> wakeUpEvents;
+    std::optional<int64_t> nextNs;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        while (!mDeadlines.empty() && mDeadlines.top().earliestNs <= nowNs) {
+            const Deadline deadline = mDeadlines.top();
+            mDeadlines.pop();
+            sampleLocked(deadline, nowNs, &events, &wakeUpEvents);
+        }
+        if (!mDeadlines.empty()) {
+            nextNs = mDeadlines.top().earliestNs;
+        }
+    }
+
+    // Post outside of the lock so that binder threads reconfiguring sensors are not blocked on the
+    // event FMQ.
+    if (!events.empty()) {
+        mCallback->postEvents(events, false /* wakeup */);
+    }
+    if (!wakeUpEvents.empty()) {
+        mCallback->postEvents(wakeUpEvents, true /* wakeup */);
+    }
+    return nextNs;
+}
+
+void SensorScheduler::run() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mStopThread) {
+        if (mDeadlines.empty()) {
+            mWaitCV.wait(lock, [&] { return mStopThread || !mDeadlines.empty(); });
+            continue;
+        }
+
+        const int64_t now = mClock();
+        const int64_t earliestNs = mDeadlines.top().earliestNs;
+        if (earliestNs > now) {
+            mWaitCV.wait_for(lock, std::chrono::nanoseconds(earliestNs - now));
+            continue;
+        }
+
+        lock.unlock();
+        sampleDue(now);
+        lock.lock();
+    }
+}
+
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -14,7 +14,8 @@
  * limitations under the License.
  */
 
-#include <thread>
+#include <atomic>
+#include <vector>
 
 #include <aidl/android/hardware/sensors/BnSensors.h>
 
@@ -23,6 +24,8 @@ namespace android {
 namespace hardware {
 namespace sensors {
 
+class SensorScheduler;
+
 class ISensorsEventCallback {
   public:
     using Event = ::aidl::android::hardware::sensors::Event;
@@ -45,35 +48,38 @@ class Sensor {
     virtual ~Sensor();
 
     const SensorInfo& getSensorInfo() const;
-    void batch(int64_t samplingPeriodNs);
+    void batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs = 0);
     virtual void activate(bool enable);
     ndk::ScopedAStatus flush();
 
+    // Sets the scheduler that samples this sensor while it is enabled. Without a scheduler, the
+    // sensor only delivers injected events.
+    void setScheduler(SensorScheduler* scheduler);
+
     void setOperationMode(OperationMode mode);
     bool supportsDataInjection() const;
     ndk::ScopedAStatus injectEvent(const Event& event);
 
   protected:
-    void run();
+    friend class SensorScheduler;
+
     virtual std::vector<Event> readEvents();
     virtual void readEventPayload(EventPayload&) = 0;
-    static void startThread(Sensor* sensor);
+    void updateSchedule();
 
     bool isWakeUpSensor();
 
-    bool mIsEnabled;
+    std::atomic_bool mIsEnabled;
     int64_t mSamplingPeriodNs;
-    int64_t mLastSampleTimeNs;
+    int64_t mMaxReportLatencyNs;
     SensorInfo mSensorInfo;
 
-    std::atomic_bool mStopThread;
-    std::condition_variable mWaitCV;
-    std::mutex mRunMutex;
-    std::thread mRunThread;
+    SensorScheduler* mScheduler;
+    std::mutex mScheduleMutex;
 
     ISensorsEventCallback* mCallback;
 
-    OperationMode mMode;
+    std::atomic<OperationMode> mMode;
 };
 
 class OnChangeSensor : public Sensor {
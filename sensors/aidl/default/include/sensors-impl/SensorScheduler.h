@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include <aidl/android/hardware/sensors/Event.h>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace sensors {
+
+class ISensorsEventCallback;
+class Sensor;
+
+// Samples all active sensors from a single thread.
+//
+// Each active sensor has a deadline in a heap ordered by time. When the thread wakes up, it samples
+// every sensor that is due, and posts the events of all of them with one postEvents call per
+// wake-up mode. A sensor may be sampled slightly before its deadline so that it shares a wake-up
+// with another sensor; its following deadlines are not moved, so its average rate is unchanged.
+//
+// Events of a sensor with a hardware FIFO (fifoMaxEventCount > 0) are held back for up to the
+// maxReportLatency it was batched with, or until its FIFO would be full.
+class SensorScheduler {
+  public:
+    using Event = ::aidl::android::hardware::sensors::Event;
+
+    explicit SensorScheduler(ISensorsEventCallback* callback);
+    // Creates a scheduler that reads the time from clock, in nanoseconds, and only samples sensors
+    // when sampleDue is called. Used to test the schedule without depending on real time.
+    SensorScheduler(ISensorsEventCallback* callback, std::function<int64_t()> clock);
+    ~SensorScheduler();
+
+    // Starts sampling sensor every samplingPeriodNs, or updates its rate and report latency.
+    void schedule(Sensor* sensor, int64_t samplingPeriodNs, int64_t maxReportLatencyNs);
+
+    // Stops sampling sensor and drops the events held back for it.
+    void unschedule(const Sensor* sensor);
+
+    // Returns the events held back for sensor, which are then no longer delivered by the
+    // scheduler.
+    std::vector<Event> takePendingEvents(const Sensor* sensor);
+
+    // Stops the sampling thread. No sensor is sampled after stop returns.
+    void stop();
+
+    // Samples every sensor that may be sampled at nowNs and posts their events. Returns the time
+    // from which the next sensor may be sampled, or std::nullopt if no sensor is scheduled.
+    std::optional<int64_t> sampleDue(int64_t nowNs);
+
+  private:
+    struct Deadline {
+        // The time from which the sensor may be sampled.
+        int64_t earliestNs;
+        // The time at which the sensor is due.
+        int64_t timeNs;
+        Sensor* sensor;
+        uint64_t generation;
+
+        bool operator>(const Deadline& other) const { return earliestNs > other.earliestNs; }
+    };
+
+    struct SensorState {
+        // Bumped whenever the schedule of the sensor changes, which invalidates the deadlines
+        // already in the heap.
+        uint64_t generation = 0;
+        bool scheduled = false;
+        int64_t samplingPeriodNs = 0;
+        int64_t maxReportLatencyNs = 0;
+        int64_t lastSampleTimeNs = 0;
+        // The time by which pendingEvents must be delivered.
+        int64_t deliverByNs = 0;
+        std::vector<Event> pendingEvents;
+    };
+
+    void run();
+    void pushDeadlineLocked(Sensor* sensor, const SensorState& state, int64_t timeNs);
+    void sampleLocked(const Deadline& deadline, int64_t now, std::vector<Event>* events,
+                      std::vector<Event>* wakeUpEvents);
+
+    ISensorsEventCallback* const mCallback;
+    const std::function<int64_t()> mClock;
+
+    std::mutex mMutex;
+    std::condition_variable mWaitCV;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> mDeadlines;
+    std::map<const Sensor*, SensorState> mStates;
+    bool mStopThread;
+    std::thread mRunThread;
+};
+
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
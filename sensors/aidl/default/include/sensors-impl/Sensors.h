@@ -22,6 +22,7 @@
 #include <hardware_legacy/power.h>
 #include <map>
 #include "Sensor.h"
+#include "SensorScheduler.h"
 
 namespace aidl {
 namespace android {
@@ -40,6 +41,7 @@ class Sensors : public BnSensors, public ISensorsEventCallback {
   public:
     Sensors()
         : mEventQueueFlag(nullptr),
+          mScheduler(this /* callback */),
           mNextHandle(1),
           mOutstandingWakeUpEvents(0),
           mReadWakeLockQueueRun(false),
@@ -57,6 +59,8 @@ class Sensors : public BnSensors, public ISensorsEventCallback {
     }
 
     virtual ~Sensors() {
+        // Stop sampling before the sensors and the event FMQ go away.
+        mScheduler.stop();
         deleteEventFlag();
         mReadWakeLockQueueRun = false;
         mWakeLockThread.join();
@@ -114,6 +118,7 @@ class Sensors : public BnSensors, public ISensorsEventCallback {
     void AddSensor() {
         std::shared_ptr<SensorType> sensor =
                 std::make_shared<SensorType>(mNextHandle++ /* sensorHandle */, this /* callback */);
+        sensor->setScheduler(&mScheduler);
         mSensors[sensor->getSensorInfo().sensorHandle] = sensor;
     }
 
@@ -190,6 +195,8 @@ class Sensors : public BnSensors, public ISensorsEventCallback {
     EventFlag* mEventQueueFlag;
     // Callback for asynchronous events, such as dynamic sensor connections.
     std::shared_ptr<::aidl::android::hardware::sensors::ISensorsCallback> mCallback;
+    // Samples all enabled sensors on one thread. Declared before mSensors so that it outlives them.
+    SensorScheduler mScheduler;
     // A map of the available sensors.
     std::map<int32_t, std::shared_ptr<Sensor>> mSensors;
     // The next available sensor handle.
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "sensors-impl/Sensor.h"
+#include "sensors-impl/SensorScheduler.h"
+
+#include <map>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace sensors {
+
+namespace {
+
+constexpr int64_t kUs = 1000;
+constexpr int64_t kMs = 1000 * kUs;
+// The scheduler never samples a sensor before its previous sample plus its period, so the clock
+// starts late enough for the first sample to be due when a sensor is scheduled.
+constexpr int64_t kStartNs = 1000 * kMs;
+
+// The events of one postEvents call, as (sensor handle, time since kStartNs) pairs.
+struct Post {
+    bool wakeup;
+    std::vector<std::pair<int32_t, int64_t>> events;
+};
+
+class RecordingCallback : public ISensorsEventCallback {
+  public:
+    void postEvents(const std::vector<Event>& events, bool wakeup) override {
+        Post post = {.wakeup = wakeup, .events = {}};
+        for (const auto& event : events) {
+            post.events.emplace_back(event.sensorHandle, event.timestamp - kStartNs);
+        }
+        posts.push_back(std::move(post));
+    }
+
+    std::vector<Post> posts;
+};
+
+// Reports one event stamped with the time of the scheduler clock each time it is sampled.
+class TestSensor : public Sensor {
+  public:
+    TestSensor(int32_t sensorHandle, ISensorsEventCallback* callback, const int64_t* nowNs,
+               bool wakeUp = false)
+        : Sensor(callback), mNowNs(nowNs) {
+        mSensorInfo.sensorHandle = sensorHandle;
+        mSensorInfo.type = SensorType::ACCELEROMETER;
+        mSensorInfo.fifoMaxEventCount = 0;
+        mSensorInfo.flags =
+                wakeUp ? static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_WAKE_UP) : 0;
+    }
+
+  protected:
+    std::vector<Event> readEvents() override {
+        Event event;
+        event.sensorHandle = mSensorInfo.sensorHandle;
+        event.sensorType = mSensorInfo.type;
+        event.timestamp = *mNowNs;
+        return {event};
+    }
+
+    void readEventPayload(EventPayload&) override {}
+
+  private:
+    const int64_t* const mNowNs;
+};
+
+class SensorSchedulerTest : public ::testing::Test {
+  protected:
+    // Samples the sensors due at kStartNs + timeNs, and returns the next time one is due.
+    std::optional<int64_t> sampleAt(int64_t timeNs) {
+        mNowNs = kStartNs + timeNs;
+        const auto nextNs = mScheduler.sampleDue(mNowNs);
+        return nextNs.has_value() ? std::make_optional(*nextNs - kStartNs) : std::nullopt;
+    }
+
+    // Samples the sensors each time one becomes due, up to endNs.
+    void runUntil(int64_t endNs) {
+        for (auto nextNs = sampleAt(mNowNs - kStartNs); nextNs.has_value() && *nextNs <= endNs;
+             nextNs = sampleAt(*nextNs)) {
+        }
+    }
+
+    // Returns the times at which each sensor was sampled.
+    std::map<int32_t, std::vector<int64_t>> getSampleTimes() const {
+        std::map<int32_t, std::vector<int64_t>> sampleTimes;
+        for (const auto& post : mCallback.posts) {
+            for (const auto& [sensorHandle, timeNs] : post.events) {
+                sampleTimes[sensorHandle].push_back(timeNs);
+            }
+        }
+        return sampleTimes;
+    }
+
+    int64_t mNowNs = kStartNs;
+    RecordingCallback mCallback;
+    SensorScheduler mScheduler{&mCallback, [this] { return mNowNs; }};
+};
+
+}  // namespace
+
+TEST_F(SensorSchedulerTest, SamplesEachSensorOnItsOwnPeriod) {
+    TestSensor fast(1, &mCallback, &mNowNs);
+    TestSensor slow(2, &mCallback, &mNowNs);
+    mScheduler.schedule(&fast, 10 * kMs, 0);
+    mScheduler.schedule(&slow, 25 * kMs, 0);
+
+    runUntil(200 * kMs);
+
+    // Each sample is taken at most the coalescing window before its deadline, and the deadlines
+    // stay on the period grid.
+    auto sampleTimes = getSampleTimes();
+    ASSERT_EQ(sampleTimes[1].size(), 21u);
+    for (size_t i = 0; i < sampleTimes[1].size(); i++) {
+        EXPECT_GE(sampleTimes[1][i], int64_t(i) * 10 * kMs - 10 * kMs / 16) << i;
+        EXPECT_LE(sampleTimes[1][i], int64_t(i) * 10 * kMs) << i;
+    }
+    ASSERT_EQ(sampleTimes[2].size(), 9u);
+    for (size_t i = 0; i < sampleTimes[2].size(); i++) {
+        EXPECT_GE(sampleTimes[2][i], int64_t(i) * 25 * kMs - 1 * kMs) << i;
+        EXPECT_LE(sampleTimes[2][i], int64_t(i) * 25 * kMs) << i;
+    }
+
+    // Events are posted in time order.
+    int64_t lastTimeNs = 0;
+    for (const auto& post : mCallback.posts) {
+        for (const auto& [sensorHandle, timeNs] : post.events) {
+            EXPECT_GE(timeNs, lastTimeNs) << "sensor " << sensorHandle;
+            lastTimeNs = timeNs;
+        }
+    }
+}
+
+TEST_F(SensorSchedulerTest, CoalescingWindowIsSixteenthOfPeriodUpToOneMillisecond) {
+    TestSensor fast(1, &mCallback, &mNowNs);
+    TestSensor slow(2, &mCallback, &mNowNs);
+    mScheduler.schedule(&fast, 8 * kMs, 0);
+    mScheduler.schedule(&slow, 100 * kMs, 0);
+
+    EXPECT_EQ(sampleAt(0), 7500 * kUs);
+    EXPECT_EQ(sampleAt(7 * kMs), 7500 * kUs);
+    EXPECT_EQ(sampleAt(7500 * kUs), 15500 * kUs);
+
+    // Not 100 ms / 16: the window of the slow sensor is capped at 1 ms.
+    runUntil(98 * kMs);
+    const size_t numPosts = mCallback.posts.size();
+    sampleAt(99 * kMs - 1);
+    EXPECT_EQ(mCallback.posts.size(), numPosts);
+    sampleAt(99 * kMs);
+    ASSERT_EQ(mCallback.posts.size(), numPosts + 1);
+    EXPECT_EQ(mCallback.posts.back().events,
+              (std::vector<std::pair<int32_t, int64_t>>{{2, 99 * kMs}}));
+}
+
+TEST_F(SensorSchedulerTest, SharesWakeUpWhenBothSensorsAreWithinTheirWindows) {
+    TestSensor fast(1, &mCallback, &mNowNs);
+    TestSensor slow(2, &mCallback, &mNowNs);
+    mScheduler.schedule(&fast, 10 * kMs, 0);
+    mScheduler.schedule(&slow, 25 * kMs, 0);
+
+    // The slow sensor has the wider window, so its event comes first.
+    sampleAt(0);
+    ASSERT_EQ(mCallback.posts.size(), 1u);
+    EXPECT_EQ(mCallback.posts[0].events,
+              (std::vector<std::pair<int32_t, int64_t>>{{2, 0}, {1, 0}}));
+
+    for (int64_t timeNs : {9500 * kUs, 19500 * kUs, 24500 * kUs, 29500 * kUs, 39500 * kUs}) {
+        sampleAt(timeNs);
+    }
+    ASSERT_EQ(mCallback.posts.size(), 6u);
+    EXPECT_EQ(mCallback.posts[3].events,
+              (std::vector<std::pair<int32_t, int64_t>>{{2, 24500 * kUs}}));
+
+    // Both are due at 50 ms. The slow sensor may be sampled from 49 ms and the fast one from
+    // 49.375 ms, so one wake-up after that samples both, earliest window first.
+    sampleAt(49500 * kUs);
+    ASSERT_EQ(mCallback.posts.size(), 7u);
+    EXPECT_EQ(mCallback.posts.back().events,
+              (std::vector<std::pair<int32_t, int64_t>>{{2, 49500 * kUs}, {1, 49500 * kUs}}));
+
+    // At 74.5 ms the slow sensor is due, but the fast one is still outside of its window.
+    sampleAt(59500 * kUs);
+    sampleAt(69500 * kUs);
+    sampleAt(74500 * kUs);
+    EXPECT_EQ(mCallback.posts.back().events,
+              (std::vector<std::pair<int32_t, int64_t>>{{2, 74500 * kUs}}));
+}
+
+TEST_F(SensorSchedulerTest, SkipsSamplesMissedWhileBehind) {
+    TestSensor sensor(1, &mCallback, &mNowNs);
+    mScheduler.schedule(&sensor, 10 * kMs, 0);
+
+    sampleAt(0);
+    // The samples due at 10, 20 and 30 ms are replaced by one, and the period restarts from it.
+    EXPECT_EQ(sampleAt(35 * kMs), 45 * kMs - 10 * kMs / 16);
+    EXPECT_EQ(getSampleTimes()[1], (std::vector<int64_t>{0, 35 * kMs}));
+}
+
+TEST_F(SensorSchedulerTest, PostsWakeUpEventsSeparately) {
+    TestSensor sensor(1, &mCallback, &mNowNs);
+    TestSensor wakeUpSensor(2, &mCallback, &mNowNs, /*wakeUp=*/true);
+    mScheduler.schedule(&sensor, 10 * kMs, 0);
+    mScheduler.schedule(&wakeUpSensor, 10 * kMs, 0);
+
+    sampleAt(0);
+    ASSERT_EQ(mCallback.posts.size(), 2u);
+    EXPECT_FALSE(mCallback.posts[0].wakeup);
+    EXPECT_EQ(mCallback.posts[0].events, (std::vector<std::pair<int32_t, int64_t>>{{1, 0}}));
+    EXPECT_TRUE(mCallback.posts[1].wakeup);
+    EXPECT_EQ(mCallback.posts[1].events, (std::vector<std::pair<int32_t, int64_t>>{{2, 0}}));
+}
+
+TEST_F(SensorSchedulerTest, RescheduleAndUnscheduleDropOldDeadlines) {
+    TestSensor sensor(1, &mCallback, &mNowNs);
+    mScheduler.schedule(&sensor, 10 * kMs, 0);
+    sampleAt(0);
+
+    // The new period applies from the last sample.
+    mScheduler.schedule(&sensor, 20 * kMs, 0);
+    EXPECT_EQ(sampleAt(10 * kMs), 19 * kMs);
+    sampleAt(20 * kMs);
+
+    mScheduler.unschedule(&sensor);
+    EXPECT_FALSE(sampleAt(40 * kMs).has_value());
+    EXPECT_EQ(getSampleTimes()[1], (std::vector<int64_t>{0, 20 * kMs}));
+}
+
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
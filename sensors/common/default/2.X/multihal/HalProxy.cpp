@@ -224,8 +224,7 @@ Return<Result> HalProxy::initializeCommon(
     disableAllSensors();
 
     // Clears the queue if any events were pending write before.
-    mPendingWriteEventsQueue = std::queue<std::pair<std::vector<V2_1::Event>, size_t>>();
-    mSizePendingWriteEventsQueue = 0;
+    mPendingWriteEvents.clear();
 
     // Clears previously connected dynamic sensors
     mDynamicSensors.clear();
@@ -370,14 +369,16 @@ Return<void> HalProxy::debug(const hidl_handle& fd, const hidl_vec<hidl_string>&
            << " ms ago" << std::endl;
     // TODO(b/142969448): Add logging for history of wakelock acquisition per subhal.
     stream << "  Wakelock ref count: " << mWakelockRefCount << std::endl;
-    stream << "  # of events on pending write writes queue: " << mSizePendingWriteEventsQueue
+    stream << "  # of events on pending write writes queue: " << mPendingWriteEvents.size()
            << std::endl;
     stream << " Most events seen on pending write events queue: "
            << mMostEventsObservedPendingWriteEventsQueue << std::endl;
-    if (!mPendingWriteEventsQueue.empty()) {
-        stream << "  Size of events list on front of pending writes queue: "
-               << mPendingWriteEventsQueue.front().first.size() << std::endl;
-    }
+    stream << "  Capacity of pending write events queue: " << mPendingWriteEvents.capacity()
+           << std::endl;
+    stream << "  # of events dropped with pending write events queue full: "
+           << mNumEventsDroppedPendingQueueFull << std::endl;
+    stream << "  # of events dropped after blocking write timed out: "
+           << mNumEventsDroppedWriteTimeout << std::endl;
     stream << "  # of non-dynamic sensors across all subhals: " << mSensors.size() << std::endl;
     stream << "  # of dynamic sensors across all subhals: " << mDynamicSensors.size() << std::endl;
     stream << "SubHals (" << mSubHalList.size() << "):" << std::endl;
@@ -575,37 +576,38 @@ void HalProxy::handlePendingWrites() {
     std::unique_lock<std::mutex> lock(mEventQueueWriteMutex);
     while (mThreadsRun.load()) {
         mEventQueueWriteCV.wait(
-                lock, [&] { return !mPendingWriteEventsQueue.empty() || !mThreadsRun.load(); });
+                lock, [&] { return !mPendingWriteEvents.empty() || !mThreadsRun.load(); });
         if (mThreadsRun.load()) {
-            std::vector<Event>& pendingWriteEvents = mPendingWriteEventsQueue.front().first;
-            size_t numWakeupEvents = mPendingWriteEventsQueue.front().second;
-            size_t eventQueueSize = mEventQueue->getQuantumCount();
-            size_t numToWrite = std::min(pendingWriteEvents.size(), eventQueueSize);
+            // Take the events off the queue for the blocking write, so that subhals can keep
+            // posting, and the queue can grow, while it is in progress.
+            size_t numToWrite =
+                    std::min(mPendingWriteEvents.size(), mEventQueue->getQuantumCount());
+            mBlockingWriteEvents.clear();
+            while (mBlockingWriteEvents.size() < numToWrite) {
+                auto [events, numEvents] = mPendingWriteEvents.front();
+                numEvents = std::min(numEvents, numToWrite - mBlockingWriteEvents.size());
+                mBlockingWriteEvents.insert(mBlockingWriteEvents.end(), events,
+                                            events + numEvents);
+                mPendingWriteEvents.pop(numEvents);
+            }
+            mBlockingWriteInProgress = true;
             lock.unlock();
-            if (!mEventQueue->writeBlocking(
-                        pendingWriteEvents.data(), numToWrite,
-                        static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ),
-                        static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS),
-                        kPendingWriteTimeoutNs, mEventQueueFlag)) {
+            bool success = mEventQueue->writeBlocking(
+                    mBlockingWriteEvents.data(), numToWrite,
+                    static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ),
+                    static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS),
+                    kPendingWriteTimeoutNs, mEventQueueFlag);
+            if (!success) {
                 ALOGE("Dropping %zu events after blockingWrite failed.", numToWrite);
+                size_t numWakeupEvents = countNumWakeupEvents(mBlockingWriteEvents, numToWrite);
                 if (numWakeupEvents > 0) {
-                    if (pendingWriteEvents.size() > eventQueueSize) {
-                        decrementRefCountAndMaybeReleaseWakelock(
-                                countNumWakeupEvents(pendingWriteEvents, eventQueueSize));
-                    } else {
-                        decrementRefCountAndMaybeReleaseWakelock(numWakeupEvents);
-                    }
+                    decrementRefCountAndMaybeReleaseWakelock(numWakeupEvents);
                 }
             }
             lock.lock();
-            mSizePendingWriteEventsQueue -= numToWrite;
-            if (pendingWriteEvents.size() > eventQueueSize) {
-                // TODO(b/143302327): Check if this erase operation is too inefficient. It will copy
-                // all the events ahead of it down to fill gap off array at front after the erase.
-                pendingWriteEvents.erase(pendingWriteEvents.begin(),
-                                         pendingWriteEvents.begin() + eventQueueSize);
-            } else {
-                mPendingWriteEventsQueue.pop();
+            mBlockingWriteInProgress = false;
+            if (!success) {
+                mNumEventsDroppedWriteTimeout += numToWrite;
             }
         }
     }
@@ -658,37 +660,101 @@ void HalProxy::resetSharedWakelock() {
     mWakelockTimeoutResetTime = getTimeNow();
 }
 
-void HalProxy::postEventsToMessageQueue(const std::vector<Event>& events, size_t numWakeupEvents,
+void HalProxy::postEventsToMessageQueue(const std::vector<Event>& events, int32_t subHalIndex,
                                         V2_0::implementation::ScopedWakelock wakelock) {
-    size_t numToWrite = 0;
     std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
-    if (wakelock.isLocked()) {
-        incrementRefCountAndMaybeAcquireWakelock(numWakeupEvents);
-    }
-    if (mPendingWriteEventsQueue.empty()) {
-        numToWrite = std::min(events.size(), mEventQueue->availableToWrite());
-        if (numToWrite > 0) {
-            if (mEventQueue->write(events.data(), numToWrite)) {
-                // TODO(b/143302327): While loop if mEventQueue->avaiableToWrite > 0 to possibly fit
-                // in more writes immediately
-                mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
-            } else {
-                numToWrite = 0;
+    // Events may only be written right away if none are waiting on the background thread, so that
+    // they reach the framework in the order they were posted.
+    bool canWrite = mPendingWriteEvents.empty() && !mBlockingWriteInProgress;
+    size_t numPushed = 0;
+    size_t numWakeupEvents = 0;
+    while (numPushed < events.size()) {
+        size_t numToPush =
+                std::min(events.size() - numPushed, mPendingWriteEvents.availableToPush());
+        if (numToPush == 0) {
+            break;
+        }
+        size_t numPushedWakeupEvents =
+                pushPendingWriteEventsLocked(events.data() + numPushed, numToPush, subHalIndex);
+        numPushed += numToPush;
+        numWakeupEvents += numPushedWakeupEvents;
+        // The ref count must be taken before the framework can see, and ack, the events.
+        if (wakelock.isLocked() && numPushedWakeupEvents > 0) {
+            incrementRefCountAndMaybeAcquireWakelock(numPushedWakeupEvents);
+        }
+        if (canWrite) {
+            canWrite = writePendingEventsLocked();
+        }
+    }
+
+    size_t numDropped = events.size() - numPushed;
+    if (numDropped > 0) {
+        ALOGW("Dropping %zu events, pending write events queue is full.", numDropped);
+        mNumEventsDroppedPendingQueueFull += numDropped;
+        for (size_t i = numPushed; i < events.size(); i++) {
+            int32_t sensorHandle = V2_0::implementation::setSubHalIndex(events[i].sensorHandle,
+                                                                        subHalIndex);
+            if (getSensorInfo(sensorHandle).flags &
+                static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) {
+                numWakeupEvents++;
             }
         }
     }
-    size_t numLeft = events.size() - numToWrite;
-    if (numToWrite < events.size() &&
-        mSizePendingWriteEventsQueue + numLeft <= kMaxSizePendingWriteEventsQueue) {
-        std::vector<Event> eventsLeft(events.begin() + numToWrite, events.end());
-        mPendingWriteEventsQueue.push({eventsLeft, numWakeupEvents});
-        mSizePendingWriteEventsQueue += numLeft;
+    if (numWakeupEvents > 0) {
+        ALOG_ASSERT(wakelock.isLocked(),
+                    "Wakeup events posted while wakelock unlocked for subhal"
+                    " w/ index %" PRId32 ".",
+                    subHalIndex);
+    } else {
+        ALOG_ASSERT(!wakelock.isLocked(),
+                    "No Wakeup events posted but wakelock locked for subhal"
+                    " w/ index %" PRId32 ".",
+                    subHalIndex);
+    }
+
+    if (!mPendingWriteEvents.empty()) {
         mMostEventsObservedPendingWriteEventsQueue =
-                std::max(mMostEventsObservedPendingWriteEventsQueue, mSizePendingWriteEventsQueue);
+                std::max(mMostEventsObservedPendingWriteEventsQueue, mPendingWriteEvents.size());
         mEventQueueWriteCV.notify_one();
     }
 }
 
+size_t HalProxy::pushPendingWriteEventsLocked(const Event* events, size_t n,
+                                              int32_t subHalIndex) {
+    size_t numWakeupEvents = 0;
+    for (size_t i = 0; i < n; i++) {
+        Event& event = mPendingWriteEvents.push(events[i]);
+        event.sensorHandle = V2_0::implementation::setSubHalIndex(event.sensorHandle, subHalIndex);
+        if (event.sensorType == V2_1::SensorType::DYNAMIC_SENSOR_META) {
+            event.u.dynamic.sensorHandle = V2_0::implementation::setSubHalIndex(
+                    event.u.dynamic.sensorHandle, subHalIndex);
+        }
+        if (getSensorInfo(event.sensorHandle).flags &
+            static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) {
+            numWakeupEvents++;
+        }
+    }
+    return numWakeupEvents;
+}
+
+bool HalProxy::writePendingEventsLocked() {
+    bool wroteEvents = false;
+    // The queue wraps around at most once, so this takes at most two writes.
+    while (!mPendingWriteEvents.empty()) {
+        auto [events, numEvents] = mPendingWriteEvents.front();
+        size_t numToWrite = std::min(numEvents, mEventQueue->availableToWrite());
+        if (numToWrite == 0 || !mEventQueue->write(events, numToWrite)) {
+            break;
+        }
+        mPendingWriteEvents.pop(numToWrite);
+        wroteEvents = true;
+    }
+    if (wroteEvents) {
+        mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
+    }
+    return mPendingWriteEvents.empty();
+}
+
 bool HalProxy::incrementRefCountAndMaybeAcquireWakelock(size_t delta,
                                                         int64_t* timeoutStart /* = nullptr */) {
     if (!mThreadsRun.load()) return false;
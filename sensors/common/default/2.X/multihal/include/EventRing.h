@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android/hardware/sensors/2.1/types.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/**
+ * A FIFO queue of events stored in a circular buffer. The buffer grows on demand up to maxSize
+ * events and is never shrunk, so once it has grown to the size of the largest burst, pushing and
+ * popping events does not allocate.
+ *
+ * EventRing is not thread safe.
+ */
+class EventRing {
+  public:
+    using Event = ::android::hardware::sensors::V2_1::Event;
+
+    explicit EventRing(size_t maxSize) : mMaxSize(maxSize) {}
+
+    size_t size() const { return mSize; }
+
+    bool empty() const { return mSize == 0; }
+
+    size_t capacity() const { return mEvents.size(); }
+
+    //! The number of events that can be pushed before the ring is full.
+    size_t availableToPush() const { return mMaxSize - mSize; }
+
+    /**
+     * Append a copy of event to the back of the ring. Must only be called when
+     * availableToPush() > 0.
+     *
+     * @param event The event to append.
+     *
+     * @return The appended event, which may be modified in place.
+     */
+    Event& push(const Event& event) {
+        if (mSize == mEvents.size()) {
+            grow();
+        }
+        size_t index = mHead + mSize;
+        if (index >= mEvents.size()) {
+            index -= mEvents.size();
+        }
+        mSize++;
+        return mEvents[index] = event;
+    }
+
+    /**
+     * @return The longest contiguous run of events at the front of the ring and its length.
+     */
+    std::pair<const Event*, size_t> front() const {
+        return {mEvents.data() + mHead, std::min(mSize, mEvents.size() - mHead)};
+    }
+
+    //! Remove n events from the front of the ring.
+    void pop(size_t n) {
+        n = std::min(n, mSize);
+        mSize -= n;
+        mHead = mSize == 0 ? 0 : (mHead + n) % mEvents.size();
+    }
+
+    void clear() {
+        mHead = 0;
+        mSize = 0;
+    }
+
+  private:
+    static constexpr size_t kMinCapacity = 64;
+
+    void grow() {
+        size_t newCapacity = std::min(std::max(mEvents.size() * 2, kMinCapacity), mMaxSize);
+        std::vector<Event> events(newCapacity);
+        auto [first, firstSize] = front();
+        std::copy(first, first + firstSize, events.begin());
+        std::copy(mEvents.begin(), mEvents.begin() + (mSize - firstSize),
+                  events.begin() + firstSize);
+        mEvents = std::move(events);
+        mHead = 0;
+    }
+
+    const size_t mMaxSize;
+    std::vector<Event> mEvents;
+    size_t mHead = 0;
+    size_t mSize = 0;
+};
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -17,6 +17,7 @@
 #pragma once
 
 #include "EventMessageQueueWrapper.h"
+#include "EventRing.h"
 #include "HalProxyCallback.h"
 #include "ISensorsCallbackWrapper.h"
 #include "SubHalWrapper.h"
@@ -37,7 +38,6 @@
 #include <condition_variable>
 #include <map>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <utility>
 
@@ -126,7 +126,7 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
     Return<void> onDynamicSensorsDisconnected(const hidl_vec<int32_t>& dynamicSensorHandlesRemoved,
                                               int32_t subHalIndex) override;
 
-    void postEventsToMessageQueue(const std::vector<Event>& events, size_t numWakeupEvents,
+    void postEventsToMessageQueue(const std::vector<Event>& events, int32_t subHalIndex,
                                   V2_0::implementation::ScopedWakelock wakelock) override;
 
     const SensorInfo& getSensorInfo(int32_t sensorHandle) override {
@@ -201,22 +201,35 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
     //! The bit mask used to get the subhal index from a sensor handle.
     static constexpr int32_t kSensorHandleSubHalIndexMask = 0xFF000000;
 
+    //! The max number of events allowed in the pending write events queue
+    static constexpr size_t kMaxSizePendingWriteEventsQueue = 100000;
+
     /**
-     * A FIFO queue of pairs of vector of events and the number of wakeup events in that vector
-     * which are waiting to be written to the events fmq in the background thread.
+     * The events which are waiting to be written to the events fmq in the background thread.
+     * Posted events are copied into it before being written to the fmq, so it also serves as the
+     * staging buffer for events that are written right away.
      */
-    std::queue<std::pair<std::vector<Event>, size_t>> mPendingWriteEventsQueue;
+    EventRing mPendingWriteEvents{kMaxSizePendingWriteEventsQueue};
+
+    /**
+     * The events taken off mPendingWriteEvents by the background thread for its current blocking
+     * write. Kept across writes so that its storage is reused.
+     */
+    std::vector<Event> mBlockingWriteEvents;
+
+    //! Whether the background thread is in a blocking write to the events fmq.
+    bool mBlockingWriteInProgress = false;
 
     //! The most events observed on the pending write events queue for debug purposes.
     size_t mMostEventsObservedPendingWriteEventsQueue = 0;
 
-    //! The max number of events allowed in the pending write events queue
-    static constexpr size_t kMaxSizePendingWriteEventsQueue = 100000;
+    //! The number of events dropped because the pending write events queue was full.
+    uint64_t mNumEventsDroppedPendingQueueFull = 0;
 
-    //! The number of events in the pending write events queue
-    size_t mSizePendingWriteEventsQueue = 0;
+    //! The number of events dropped because a blocking write to the events fmq timed out.
+    uint64_t mNumEventsDroppedWriteTimeout = 0;
 
-    //! The mutex protecting writing to the fmq and the pending events queue
+    //! The mutex protecting writing to the fmq, the pending events queue and the drop counters
     std::mutex mEventQueueWriteMutex;
 
     //! The condition variable waiting on pending write events to stack up
@@ -366,6 +379,27 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
      */
     size_t countNumWakeupEvents(const std::vector<Event>& events, size_t n);
 
+    /**
+     * Copy events from a subhal onto the back of the pending write events queue, setting the
+     * subhal index of their sensor handles on the way. Must be called with mEventQueueWriteMutex
+     * held and with room for n events on the queue.
+     *
+     * @param events The events as posted by the subhal.
+     * @param n The number of events to copy.
+     * @param subHalIndex The index of the subhal that posted the events.
+     *
+     * @return The number of wakeup events copied.
+     */
+    size_t pushPendingWriteEventsLocked(const Event* events, size_t n, int32_t subHalIndex);
+
+    /**
+     * Write as many events from the front of the pending write events queue to the events fmq as
+     * it has room for. Must be called with mEventQueueWriteMutex held.
+     *
+     * @return true if the pending write events queue is empty afterwards.
+     */
+    bool writePendingEventsLocked();
+
     /*
      * Clear out the subhal index bytes from a sensorHandle.
      *
@@ -31,6 +31,16 @@ namespace sensors {
 namespace V2_0 {
 namespace implementation {
 
+/**
+ * Set the subhal index as first byte of sensor handle and return this modified version.
+ *
+ * @param sensorHandle The sensor handle to modify.
+ * @param subHalIndex The index in the hal proxy of the sub hal this sensor belongs to.
+ *
+ * @return The modified sensor handle.
+ */
+int32_t setSubHalIndex(int32_t sensorHandle, size_t subHalIndex);
+
 /**
  * Interface used to communicate with the HalProxy when subHals interact with their provided
  * callback.
@@ -54,12 +64,15 @@ class ISubHalCallback {
      * remaining events to a background thread for a blocking write with a kPendingWriteTimeoutNs
      * timeout.
      *
+     * The sensor handles of the events are those of the subhal. They are converted to the handles
+     * exposed to the framework as the events are copied out of the list.
+     *
      * @param events The list of events to post to the message queue.
-     * @param numWakeupEvents The number of wakeup events in events.
+     * @param subHalIndex The index of the subhal that generated the events.
      * @param wakelock The wakelock associated with this post of events.
      */
     virtual void postEventsToMessageQueue(const std::vector<V2_1::Event>& events,
-                                          size_t numWakeupEvents,
+                                          int32_t subHalIndex,
                                           V2_0::implementation::ScopedWakelock wakelock) = 0;
 
     /**
@@ -94,10 +107,6 @@ class HalProxyCallbackBase : public VirtualLightRefBase {
     ISubHalCallback* mCallback;
     V2_0::implementation::IScopedWakelockRefCounter* mRefCounter;
     int32_t mSubHalIndex;
-
-  private:
-    std::vector<V2_1::Event> processEvents(const std::vector<V2_1::Event>& events,
-                                           size_t* numWakeupEvents) const;
 };
 
 class HalProxyCallbackV2_0 : public HalProxyCallbackBase,
@@ -0,0 +1,134 @@
+//
+// Copyright (C) 2024 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include "EventRing.h"
+
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+namespace {
+
+Event makeEvent(int64_t timestamp) {
+    Event event;
+    event.timestamp = timestamp;
+    return event;
+}
+
+// Pops every event off the ring and returns their timestamps in order.
+std::vector<int64_t> drain(EventRing& ring) {
+    std::vector<int64_t> timestamps;
+    while (!ring.empty()) {
+        auto [events, numEvents] = ring.front();
+        EXPECT_GT(numEvents, 0);
+        for (size_t i = 0; i < numEvents; i++) {
+            timestamps.push_back(events[i].timestamp);
+        }
+        ring.pop(numEvents);
+    }
+    return timestamps;
+}
+
+}  // namespace
+
+TEST(EventRingTest, PushAndPopInOrder) {
+    EventRing ring(100);
+    for (int64_t i = 0; i < 10; i++) {
+        ring.push(makeEvent(i));
+    }
+
+    EXPECT_EQ(ring.size(), 10);
+    EXPECT_EQ(ring.availableToPush(), 90);
+    EXPECT_EQ(drain(ring), std::vector<int64_t>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+    EXPECT_TRUE(ring.empty());
+}
+
+TEST(EventRingTest, PushedEventCanBeModified) {
+    EventRing ring(1);
+    ring.push(makeEvent(1)).timestamp = 2;
+
+    EXPECT_EQ(ring.front().first->timestamp, 2);
+}
+
+TEST(EventRingTest, FrontSplitsWhenWrapped) {
+    EventRing ring(1000);
+    for (int64_t i = 0; i < 64; i++) {
+        ring.push(makeEvent(i));
+    }
+    size_t capacity = ring.capacity();
+    ring.pop(60);
+    for (int64_t i = 64; i < 70; i++) {
+        ring.push(makeEvent(i));
+    }
+
+    // The ring wrapped around without growing, so the front only covers the events up to the end
+    // of the buffer.
+    EXPECT_EQ(ring.capacity(), capacity);
+    EXPECT_EQ(ring.front().second, 4);
+    EXPECT_EQ(drain(ring), std::vector<int64_t>({60, 61, 62, 63, 64, 65, 66, 67, 68, 69}));
+}
+
+TEST(EventRingTest, GrowKeepsOrderWhenWrapped) {
+    EventRing ring(1000);
+    for (int64_t i = 0; i < 64; i++) {
+        ring.push(makeEvent(i));
+    }
+    ring.pop(60);
+    for (int64_t i = 64; i < 200; i++) {
+        ring.push(makeEvent(i));
+    }
+
+    std::vector<int64_t> expected;
+    for (int64_t i = 60; i < 200; i++) {
+        expected.push_back(i);
+    }
+    EXPECT_EQ(drain(ring), expected);
+}
+
+TEST(EventRingTest, GrowthIsBoundedByMaxSize) {
+    constexpr size_t kMaxSize = 100;
+    EventRing ring(kMaxSize);
+    for (size_t i = 0; i < kMaxSize; i++) {
+        ring.push(makeEvent(i));
+    }
+
+    EXPECT_EQ(ring.availableToPush(), 0);
+    EXPECT_EQ(ring.capacity(), kMaxSize);
+}
+
+TEST(EventRingTest, ClearKeepsCapacity) {
+    EventRing ring(1000);
+    for (int64_t i = 0; i < 100; i++) {
+        ring.push(makeEvent(i));
+    }
+    size_t capacity = ring.capacity();
+    ring.clear();
+
+    EXPECT_TRUE(ring.empty());
+    EXPECT_EQ(ring.capacity(), capacity);
+    EXPECT_EQ(ring.front().second, 0);
+}
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
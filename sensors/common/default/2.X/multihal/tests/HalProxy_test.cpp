@@ -798,6 +798,33 @@ TEST(HalProxyTest, FillAndDrainPendingQueueTest) {
     EXPECT_TRUE(readEventsOutOfQueue(1, eventQueue, eventQueueFlag));
 }
 
+TEST(HalProxyTest, PostEventsBeyondPendingQueueLimitDropsExcess) {
+    constexpr size_t kQueueSize = 5;
+    // TODO: Make this constant linked to same limit in HalProxy.h
+    constexpr size_t kMaxPendingQueueSize = 100000;
+    AllSensorsSubHal<SensorsSubHalV2_0> subhal;
+    std::vector<ISensorsSubHal*> subHals{&subhal};
+
+    std::unique_ptr<EventMessageQueueV2_0> eventQueue = makeEventFMQ(kQueueSize);
+    std::unique_ptr<WakeupMessageQueue> wakeLockQueue = makeWakelockFMQ(kQueueSize);
+    ::android::sp<ISensorsCallbackV2_0> callback = new SensorsCallback();
+    EventFlag* eventQueueFlag;
+    EventFlag::createEventFlag(eventQueue->getEventFlagWord(), &eventQueueFlag);
+    HalProxy proxy(subHals);
+    proxy.initialize(*eventQueue->getDesc(), *wakeLockQueue->getDesc(), callback);
+
+    // Post more events in one go than the event queue and pending queue hold together
+    std::vector<EventV1_0> events =
+            makeMultipleAccelerometerEvents(kQueueSize + kMaxPendingQueueSize + 1);
+    subhal.postEvents(convertToNewEvents(events), false);
+
+    // All but the last event should make it to the event queue
+    for (size_t i = 0; i < kMaxPendingQueueSize + kQueueSize; i += kQueueSize) {
+        ASSERT_TRUE(readEventsOutOfQueue(kQueueSize, eventQueue, eventQueueFlag));
+    }
+    EXPECT_FALSE(readEventsOutOfQueue(1, eventQueue, eventQueueFlag));
+}
+
 TEST(HalProxyTest, PostEventsMultipleSubhalsThreadedV2_1) {
     constexpr size_t kQueueSize = 5;
     constexpr size_t kNumEvents = 2;
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "android.hardware.tv.tuner-service.example-AvMemoryRing"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <utils/Log.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "AvMemoryRing.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+AvMemoryRing::~AvMemoryRing() {
+    reset();
+}
+
+bool AvMemoryRing::init(int fd, size_t size) {
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 /*offset*/);
+    if (base == MAP_FAILED) {
+        ALOGE("[AvMemoryRing] fail to map shared av memory %d", errno);
+        return false;
+    }
+    mBase = static_cast<uint8_t*>(base);
+    mSize = size;
+    return true;
+}
+
+void AvMemoryRing::reset() {
+    if (mBase != nullptr) {
+        munmap(mBase, mSize);
+    }
+    mBase = nullptr;
+    mSize = 0;
+    mTail = 0;
+    mChunkStart = 0;
+    mChunkSize = 0;
+    mHighWaterMark = 0;
+    for (Slot& slot : mSlots) {
+        slot.dataId = 0;
+    }
+    mSlotTail = 0;
+    mSlotHead = 0;
+}
+
+bool AvMemoryRing::append(const uint8_t* data, size_t size) {
+    if (mBase == nullptr) {
+        return false;
+    }
+    reclaimReleasedChunks();
+
+    size_t chunkSize = mChunkSize + size;
+    uint64_t chunkStart = mChunkStart;
+    if (chunkStart % mSize + chunkSize > mSize) {
+        // Keep the chunk contiguous by moving it to the start of the memory.
+        chunkStart += mSize - chunkStart % mSize;
+    }
+    if (chunkStart + chunkSize - mTail > mSize) {
+        return false;
+    }
+
+    if (chunkStart != mChunkStart) {
+        memmove(mBase, mBase + mChunkStart % mSize, mChunkSize);
+        mChunkStart = chunkStart;
+    }
+    memcpy(mBase + mChunkStart % mSize + mChunkSize, data, size);
+    mChunkSize = chunkSize;
+
+    size_t used = mChunkStart + mChunkSize - mTail;
+    if (used > mHighWaterMark) {
+        mHighWaterMark = used;
+    }
+    return true;
+}
+
+bool AvMemoryRing::commit(int64_t dataId, int64_t* offset, int64_t* size) {
+    if (mChunkSize == 0) {
+        return false;
+    }
+    reclaimReleasedChunks();
+
+    uint64_t slotHead = mSlotHead.load(std::memory_order_relaxed);
+    if (slotHead - mSlotTail.load(std::memory_order_relaxed) == kMaxChunks) {
+        ALOGW("[AvMemoryRing] %zu chunks not released, dropping chunk", kMaxChunks);
+        mChunkSize = 0;
+        return false;
+    }
+    Slot& slot = mSlots[slotHead % kMaxChunks];
+    slot.end = mChunkStart + mChunkSize;
+    slot.dataId.store(dataId, std::memory_order_release);
+    mSlotHead.store(slotHead + 1, std::memory_order_release);
+
+    *offset = static_cast<int64_t>(mChunkStart % mSize);
+    *size = static_cast<int64_t>(mChunkSize);
+    mChunkStart += mChunkSize;
+    mChunkSize = 0;
+    return true;
+}
+
+bool AvMemoryRing::release(int64_t dataId) {
+    if (dataId <= 0) {
+        return false;
+    }
+    uint64_t slotHead = mSlotHead.load(std::memory_order_acquire);
+    for (uint64_t i = mSlotTail.load(std::memory_order_acquire); i < slotHead; i++) {
+        int64_t expected = dataId;
+        // Fails if the slot holds another chunk, including one committed after the load of
+        // mSlotHead in place of a reclaimed one.
+        if (mSlots[i % kMaxChunks].dataId.compare_exchange_strong(expected, -dataId,
+                                                                  std::memory_order_acq_rel)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AvMemoryRing::reclaimReleasedChunks() {
+    uint64_t slotTail = mSlotTail.load(std::memory_order_relaxed);
+    uint64_t slotHead = mSlotHead.load(std::memory_order_relaxed);
+    while (slotTail < slotHead) {
+        Slot& slot = mSlots[slotTail % kMaxChunks];
+        if (slot.dataId.load(std::memory_order_acquire) > 0) {
+            break;
+        }
+        mTail = slot.end;
+        slot.dataId.store(0, std::memory_order_relaxed);
+        slotTail++;
+    }
+    mSlotTail.store(slotTail, std::memory_order_release);
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+/**
+ * A ring of media data chunks in the shared AV memory of a media filter.
+ *
+ * The filter thread writes the ES data of each frame directly into the mapped memory and commits
+ * it as a chunk, which is reported to the client by offset and length in a media event. Chunks are
+ * always contiguous, so the client reads them in place. The memory of a chunk is reused once the
+ * client releases its data id with releaseAvHandle; chunks may be released in any order.
+ *
+ * Only one thread may write chunks. release may be called from any thread and does not block the
+ * writer.
+ */
+class AvMemoryRing {
+  public:
+    ~AvMemoryRing();
+
+    /**
+     * Maps size bytes of the memory of fd. The ring must not be initialized yet.
+     */
+    bool init(int fd, size_t size);
+
+    /**
+     * Unmaps the memory and forgets all chunks.
+     */
+    void reset();
+
+    bool isInitialized() const { return mBase != nullptr; }
+
+    /**
+     * Appends data to the chunk being written.
+     *
+     * @return false if the ring has no room for the data. The chunk is left unchanged.
+     */
+    bool append(const uint8_t* data, size_t size);
+
+    /**
+     * Ends the chunk being written and keeps its memory until release is called with dataId.
+     *
+     * @return false if the chunk is empty or too many chunks are not released yet, in which case
+     *         the chunk is dropped.
+     */
+    bool commit(int64_t dataId, int64_t* offset, int64_t* size);
+
+    //! Drops the chunk being written.
+    void discard() { mChunkSize = 0; }
+
+    size_t getChunkSize() const { return mChunkSize; }
+
+    /**
+     * Releases the chunk committed with dataId.
+     *
+     * @return false if no unreleased chunk has dataId.
+     */
+    bool release(int64_t dataId);
+
+    //! The largest number of bytes that were in use, including the chunk being written.
+    size_t getHighWaterMark() const { return mHighWaterMark; }
+
+    //! The number of committed chunks that are not released yet.
+    size_t getInFlightChunks() const { return mSlotHead.load() - mSlotTail.load(); }
+
+  private:
+    // Bounds the number of frames the client may hold.
+    static constexpr size_t kMaxChunks = 256;
+
+    struct Slot {
+        // The data id of the chunk, its negation once released, or 0 when free.
+        std::atomic<int64_t> dataId{0};
+        // Position of the end of the chunk.
+        uint64_t end = 0;
+    };
+
+    void reclaimReleasedChunks();
+
+    uint8_t* mBase = nullptr;
+    size_t mSize = 0;
+
+    // Positions increase monotonically and map to offset position % mSize. Chunks that would
+    // cross the end of the memory start at the next multiple of mSize instead.
+    uint64_t mTail = 0;
+    uint64_t mChunkStart = 0;
+    size_t mChunkSize = 0;
+    std::atomic<size_t> mHighWaterMark = 0;
+
+    std::array<Slot, kMaxChunks> mSlots;
+    // Committed chunks are in the slots from mSlotTail to mSlotHead, modulo kMaxChunks. Only the
+    // writer changes them.
+    std::atomic<uint64_t> mSlotTail = 0;
+    std::atomic<uint64_t> mSlotHead = 0;
+};
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
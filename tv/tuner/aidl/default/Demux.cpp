@@ -21,7 +21,9 @@
 #include <aidl/android/hardware/tv/tuner/Result.h>
 
 #include <fmq/AidlMessageQueue.h>
+#include <inttypes.h>
 #include <utils/Log.h>
+#include <chrono>
 #include <thread>
 #include "Demux.h"
 
@@ -121,10 +123,17 @@ void Demux::setIptvThreadRunning(bool isIptvThreadRunning) {
 }
 
 void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* streamer, void* buf) {
-    Timer *timer, *fullBufferTimer;
+    Timer* timer;
     bool isTuneBytePushedToDvr = false;
+    mIptvChunk.reserve(IPTV_CHUNK_SIZE);
     while (true) {
         std::unique_lock<std::mutex> lock(mIsIptvThreadRunningMutex);
+        if (!mIsIptvReadThreadRunning && !mIsIptvReadThreadTerminated) {
+            // The playback stopped. Send the packets held for reordering now rather than after
+            // the restart, when they would be stale.
+            mIptvJitterBuffer.flush();
+            writeIptvInputToDvr();
+        }
         mIsIptvThreadRunningCv.wait(
                 lock, [this] { return mIsIptvReadThreadRunning || mIsIptvReadThreadTerminated; });
         if (mIsIptvReadThreadTerminated) {
@@ -132,26 +141,25 @@ void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* str
             break;
         }
         if (mIsIptvDvrFMQFull &&
-            fullBufferTimer->get_elapsed_time_ms() > IPTV_PLAYBACK_BUFFER_TIMEOUT) {
+            mIptvFullBufferTimer->get_elapsed_time_ms() > IPTV_PLAYBACK_BUFFER_TIMEOUT) {
             ALOGE("DVR FMQ has not been flushed within timeout of %d ms",
                   IPTV_PLAYBACK_BUFFER_TIMEOUT);
-            delete fullBufferTimer;
+            delete mIptvFullBufferTimer;
+            mIsIptvDvrFMQFull = false;
             break;
         }
-        timer = new Timer();
-        ssize_t bytes_read;
         void* tuneByteBuffer = mFrontend->getTuneByteBuffer();
         if (!isTuneBytePushedToDvr && tuneByteBuffer != nullptr) {
-            memcpy(buf, tuneByteBuffer, 1);
-            char* offsetBuf = (char*)buf + 1;
-            bytes_read = interface->read_stream(streamer, (void*)offsetBuf, IPTV_BUFFER_SIZE - 1,
-                                                IPTV_PLAYBACK_TIMEOUT);
+            // The tune byte goes first, ahead of the TS packets reordered by the jitter buffer.
+            mDvrPlayback->writePlaybackFMQ(tuneByteBuffer, 1);
             isTuneBytePushedToDvr = true;
-        } else {
-            bytes_read =
-                    interface->read_stream(streamer, buf, IPTV_BUFFER_SIZE, IPTV_PLAYBACK_TIMEOUT);
         }
 
+        // Wait for the first datagram, then read the ones already received without waiting, so
+        // that the demux gets larger chunks.
+        timer = new Timer();
+        ssize_t bytes_read =
+                interface->read_stream(streamer, buf, IPTV_BUFFER_SIZE, IPTV_PLAYBACK_TIMEOUT);
         if (bytes_read <= 0) {
             double elapsed_time = timer->get_elapsed_time_ms();
             if (elapsed_time > IPTV_PLAYBACK_TIMEOUT) {
@@ -160,26 +168,52 @@ void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* str
             }
             ALOGE("[Demux] Cannot read data from the socket");
             delete timer;
+            // End of the stream. Send the packets still held for reordering.
+            mIptvJitterBuffer.flush();
+            writeIptvInputToDvr();
             break;
         }
-
         delete timer;
-        ALOGI("Number of bytes read: %zd", bytes_read);
-        int result = mDvrPlayback->writePlaybackFMQ(buf, bytes_read);
+
+        int reads = 0;
+        do {
+            ALOGV("Number of bytes read: %zd", bytes_read);
+            mIptvJitterBuffer.push(static_cast<uint8_t*>(buf), bytes_read, getMonotonicTimeUs());
+            if (++reads == IPTV_MAX_BATCH_READS) {
+                break;
+            }
+            bytes_read = interface->read_stream(streamer, buf, IPTV_BUFFER_SIZE, 0);
+        } while (bytes_read > 0);
+
+        writeIptvInputToDvr();
+    }
+}
+
+void Demux::writeIptvInputToDvr() {
+    while (mIptvJitterBuffer.pop(&mIptvChunk, IPTV_CHUNK_SIZE, getMonotonicTimeUs())) {
+        int result = mDvrPlayback->writePlaybackFMQ(mIptvChunk.data(), mIptvChunk.size());
 
         switch (result) {
             case DVR_WRITE_FAILURE_REASON_FMQ_FULL:
                 if (!mIsIptvDvrFMQFull) {
                     mIsIptvDvrFMQFull = true;
-                    fullBufferTimer = new Timer();
+                    mIptvFullBufferTimer = new Timer();
                 }
                 ALOGI("Waiting for client to flush DVR FMQ.");
+                mIptvDroppedChunks++;
+                mIptvDroppedBytes += mIptvChunk.size();
                 break;
             case DVR_WRITE_FAILURE_REASON_UNKNOWN:
                 ALOGE("Failed to write data into DVR FMQ for unknown reason");
+                mIptvDroppedChunks++;
+                mIptvDroppedBytes += mIptvChunk.size();
                 break;
             case DVR_WRITE_SUCCESS:
-                ALOGI("Wrote %zd bytes to DVR FMQ", bytes_read);
+                if (mIsIptvDvrFMQFull) {
+                    mIsIptvDvrFMQFull = false;
+                    delete mIptvFullBufferTimer;
+                }
+                ALOGV("Wrote %zu bytes to DVR FMQ", mIptvChunk.size());
                 break;
             default:
                 ALOGI("Invalid DVR Status");
@@ -187,6 +221,12 @@ void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* str
     }
 }
 
+int64_t Demux::getMonotonicTimeUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
 ::ndk::ScopedAStatus Demux::setFrontendDataSource(int32_t in_frontendId) {
     ALOGV("%s", __FUNCTION__);
 
@@ -248,6 +288,7 @@ void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* str
         }
         stopIptvFrontendInput();
         mIsIptvReadThreadTerminated = false;
+        mIptvJitterBuffer.reset();
         void* buf = malloc(sizeof(char) * IPTV_BUFFER_SIZE);
         if (buf == nullptr) {
             ALOGE("[Demux] Buffer allocation failed");
@@ -292,6 +333,7 @@ void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* str
         // Only save non-record filters for now. Record filters are saved when the
         // IDvr.attacheFilter is called.
         mPlaybackFilterIds.insert(filterId);
+        updateTsPidTable();
         if (mDvrPlayback != nullptr) {
             result = mDvrPlayback->addPlaybackFilter(filterId, filter);
         }
@@ -381,6 +423,7 @@ void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* str
     mPlaybackFilterIds.clear();
     mRecordFilterIds.clear();
     mFilters.clear();
+    updateTsPidTable();
     mLastUsedFilterId = -1;
     if (mTuner != nullptr) {
         mTuner->removeDemux(mDemuxId);
@@ -413,35 +456,59 @@ void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* str
     mPlaybackFilterIds.erase(filterId);
     mRecordFilterIds.erase(filterId);
     mFilters.erase(filterId);
+    updateTsPidTable();
 
     return ::ndk::ScopedAStatus::ok();
 }
 
-void Demux::startBroadcastTsFilter(vector<int8_t> data) {
-    set<int64_t>::iterator it;
-    uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
+void Demux::startBroadcastTsFilter(const int8_t* data, size_t size, size_t packetSize) {
     if (DEBUG_DEMUX) {
-        ALOGW("[Demux] start ts filter pid: %d", pid);
+        ALOGW("[Demux] start ts filter on %zu bytes", size);
     }
-    for (it = mPlaybackFilterIds.begin(); it != mPlaybackFilterIds.end(); it++) {
-        if (pid == mFilters[*it]->getTpid()) {
-            mFilters[*it]->updateFilterOutput(data);
+    mTsDemux.demux(data, size, packetSize);
+}
+
+void Demux::updateTsPidTable() {
+    vector<std::shared_ptr<TsDemux::Sink>> filters;
+    filters.reserve(mPlaybackFilterIds.size());
+    for (int64_t filterId : mPlaybackFilterIds) {
+        auto it = mFilters.find(filterId);
+        if (it != mFilters.end()) {
+            filters.push_back(it->second);
         }
     }
+    mTsDemux.setFilters(filters);
 }
 
-void Demux::sendFrontendInputToRecord(vector<int8_t> data) {
+void Demux::sendFrontendInputToRecord(const int8_t* data, size_t size) {
     set<int64_t>::iterator it;
     if (DEBUG_DEMUX) {
         ALOGW("[Demux] update record filter output");
     }
+    if (mRecordFilterIds.empty() || mDvrRecord == nullptr) {
+        return;
+    }
+    // The record filters all take the whole input, so a single copy goes to their DVR.
+    switch (mDvrRecord->writeRecordFMQ(data, size)) {
+        case DVR_WRITE_SUCCESS:
+            break;
+        case DVR_WRITE_FAILURE_REASON_FMQ_FULL:
+            // Dropped until the client drains the FMQ, so there is nothing to index.
+            return;
+        default:
+            ALOGD("[Demux] dvr fails to write into record FMQ.");
+            mRecordWriteFailed = true;
+            return;
+    }
+    // Only the data written to the FMQ is indexed, so that the offsets match the recording.
     for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
-        mFilters[*it]->updateRecordOutput(data);
+        mFilters[*it]->indexRecordOutput(data, size);
     }
 }
 
-void Demux::sendFrontendInputToRecord(vector<int8_t> data, uint16_t pid, uint64_t pts) {
-    sendFrontendInputToRecord(data);
+void Demux::sendFrontendInputToRecord(const int8_t* data, size_t size, uint16_t pid,
+                                      uint64_t pts) {
+    sendFrontendInputToRecord(data, size);
     set<int64_t>::iterator it;
     for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
         if (pid == mFilters[*it]->getTpid()) {
@@ -464,15 +531,13 @@ bool Demux::startBroadcastFilterDispatcher() {
 }
 
 bool Demux::startRecordFilterDispatcher() {
-    set<int64_t>::iterator it;
-
-    for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
-        if (!mFilters[*it]->startRecordFilterHandler().isOk()) {
-            return false;
-        }
+    if (mDvrRecord != nullptr) {
+        mDvrRecord->notifyRecordOutput(mDvrPlayback == nullptr ||
+                                       mDvrPlayback->isPlaybackInputDrained());
     }
-
-    return true;
+    bool isWriteFailed = mRecordWriteFailed;
+    mRecordWriteFailed = false;
+    return !isWriteFailed;
 }
 
 ::ndk::ScopedAStatus Demux::startFilterHandler(int64_t filterId) {
@@ -613,6 +678,12 @@ binder_status_t Demux::dump(int fd, const char** args, uint32_t numArgs) {
             mDvrRecord->dump(fd, args, numArgs);
         }
     }
+    if (mFrontend != nullptr && mFrontend->getFrontendType() == FrontendType::IPTV) {
+        dprintf(fd, "  IptvInput:\n");
+        mIptvJitterBuffer.dump(fd);
+        dprintf(fd, "    dropped for a failed DVR write: %" PRIu64 " chunks, %" PRIu64 " bytes\n",
+                mIptvDroppedChunks.load(), mIptvDroppedBytes.load());
+    }
     return STATUS_OK;
 }
 
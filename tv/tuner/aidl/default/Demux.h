@@ -28,8 +28,10 @@
 #include "Dvr.h"
 #include "Filter.h"
 #include "Frontend.h"
+#include "IptvJitterBuffer.h"
 #include "TimeFilter.h"
 #include "Timer.h"
+#include "TsDemux.h"
 #include "Tuner.h"
 #include "dtv_plugin.h"
 
@@ -58,6 +60,13 @@ class Tuner;
 
 const int IPTV_PLAYBACK_TIMEOUT = 20;            // ms
 const int IPTV_PLAYBACK_BUFFER_TIMEOUT = 20000;  // ms
+// RTP packets held at most while waiting for a missing one
+const int IPTV_JITTER_BUFFER_DEPTH = 64;
+const int IPTV_JITTER_BUFFER_MAX_DELAY = 100;  // ms
+// Datagrams already received that are read without waiting after the first one of a batch
+const int IPTV_MAX_BATCH_READS = 32;
+// Largest chunk written to the IPTV DVR FMQ, half of its size
+const int IPTV_CHUNK_SIZE = TS_SIZE * 7 * 4;
 
 class DvrPlaybackCallback : public BnDvrCallback {
   public:
@@ -103,10 +112,17 @@ class Demux : public BnDemux {
     void updateFilterOutput(int64_t filterId, vector<int8_t> data);
     void updateMediaFilterOutput(int64_t filterId, vector<int8_t> data, uint64_t pts);
     uint16_t getFilterTpid(int64_t filterId);
+    /**
+     * Rebuilds the PID lookup table of the broadcast TS demux. Must be called whenever a playback
+     * filter is opened, removed or configured with a new tpid.
+     */
+    void updateTsPidTable();
     void setIsRecording(bool isRecording);
     bool isRecording();
     void startFrontendInputLoop();
     void frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* streamer, void* buf);
+    // Writes the IPTV input released by the jitter buffer to the DVR FMQ.
+    void writeIptvInputToDvr();
 
     /**
      * A dispatcher to read and dispatch input data to all the started filters.
@@ -114,10 +130,21 @@ class Demux : public BnDemux {
      * Note that recording filters are not included.
      */
     bool startBroadcastFilterDispatcher();
-    void startBroadcastTsFilter(vector<int8_t> data);
+    /**
+     * Dispatches the TS packets of packetSize bytes in data to the playback filters of their PID.
+     */
+    void startBroadcastTsFilter(const int8_t* data, size_t size, size_t packetSize);
 
-    void sendFrontendInputToRecord(vector<int8_t> data);
-    void sendFrontendInputToRecord(vector<int8_t> data, uint16_t pid, uint64_t pts);
+    /**
+     * Writes the input once to the record DVR shared by the attached record filters, and has
+     * each of them index it.
+     */
+    void sendFrontendInputToRecord(const int8_t* data, size_t size);
+    void sendFrontendInputToRecord(const int8_t* data, size_t size, uint16_t pid, uint64_t pts);
+    /**
+     * Notifies the record DVR client of the output of the pass. Returns false if the output did
+     * not fit in the record FMQ.
+     */
     bool startRecordFilterDispatcher();
 
     void getDemuxInfo(DemuxInfo* demuxInfo);
@@ -150,6 +177,7 @@ class Demux : public BnDemux {
 
     static void* __threadLoopFrontend(void* user);
     void frontendInputThreadLoop();
+    static int64_t getMonotonicTimeUs();
 
     /**
      * To create a FilterMQ with the next available Filter ID.
@@ -179,12 +207,19 @@ class Demux : public BnDemux {
      * Any removed filter id should be removed from this set.
      */
     set<int64_t> mRecordFilterIds;
+    // Whether record output was dropped since the last startRecordFilterDispatcher()
+    bool mRecordWriteFailed = false;
     /**
      * A list of created Filter sp.
      * The array number is the filter ID.
      */
     std::map<int64_t, std::shared_ptr<Filter>> mFilters;
 
+    /**
+     * Dispatches broadcast TS input to the playback filters by PID.
+     */
+    TsDemux mTsDemux;
+
     /**
      * Local reference to the opened Timer Filter instance.
      */
@@ -202,6 +237,16 @@ class Demux : public BnDemux {
 
     // track whether the DVR FMQ for IPTV Playback is full
     bool mIsIptvDvrFMQFull = false;
+    // Started when the DVR FMQ for IPTV Playback became full
+    Timer* mIptvFullBufferTimer = nullptr;
+    // IPTV input popped from the jitter buffer, and dropped because the DVR write failed
+    vector<int8_t> mIptvChunk;
+    std::atomic<uint64_t> mIptvDroppedChunks = 0;
+    std::atomic<uint64_t> mIptvDroppedBytes = 0;
+
+    // Reorders the RTP packets of the IPTV stream before they are written to the DVR FMQ
+    IptvJitterBuffer mIptvJitterBuffer{IPTV_JITTER_BUFFER_DEPTH,
+                                       IPTV_JITTER_BUFFER_MAX_DELAY * 1000};
 
     /**
      * If a specific filter's writing loop is still running
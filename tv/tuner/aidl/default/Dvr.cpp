@@ -19,8 +19,10 @@
 
 #include <aidl/android/hardware/tv/tuner/DemuxQueueNotifyBits.h>
 #include <aidl/android/hardware/tv/tuner/Result.h>
+#include <pthread.h>
 
 #include <utils/Log.h>
+#include <chrono>
 #include "Dvr.h"
 
 namespace aidl {
@@ -31,6 +33,13 @@ namespace tuner {
 
 #define WAIT_TIMEOUT 3000000000
 
+// The most playback packets read from the FMQ and dispatched to the demux at once.
+static constexpr size_t kMaxPlaybackChunkPackets = 4096;
+// Playback input is filtered once this many packets are available, or after
+// kPlaybackWatermarkTimeoutNs, whichever comes first.
+static constexpr size_t kPlaybackReadWatermarkPackets = 512;
+static constexpr int64_t kPlaybackWatermarkTimeoutNs = 5000000;  // 5 ms
+
 Dvr::Dvr(DvrType type, uint32_t bufferSize, const std::shared_ptr<IDvrCallback>& cb,
          std::shared_ptr<Demux> demux) {
     mType = type;
@@ -114,6 +123,7 @@ Dvr::~Dvr() {
     if (mType == DvrType::PLAYBACK) {
         mDvrThreadRunning = true;
         mDvrThread = std::thread(&Dvr::playbackThreadLoop, this);
+        pthread_setname_np(mDvrThread.native_handle(), "tuner_dvr_play");
     } else if (mType == DvrType::RECORD) {
         mRecordStatus = RecordStatus::DATA_READY;
         mDemux->setIsRecording(mType == DvrType::RECORD);
@@ -134,6 +144,14 @@ Dvr::~Dvr() {
     // thread should always be joinable if it is running,
     // so it should be safe to assume recording stopped.
     mDemux->setIsRecording(false);
+    if (mType == DvrType::RECORD) {
+        // Hand the client the record output still below the low threshold.
+        lock_guard<mutex> lock(mWriteLock);
+        if (mHasPendingRecordOutput) {
+            mDvrEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
+            mHasPendingRecordOutput = false;
+        }
+    }
 
     return ::ndk::ScopedAStatus::ok();
 }
@@ -285,30 +303,130 @@ PlaybackStatus Dvr::checkPlaybackStatusChange(uint32_t availableToWrite, uint32_
 }
 
 bool Dvr::readPlaybackFMQ(bool isVirtualFrontend, bool isRecording) {
-    // Read playback data from the input FMQ
-    size_t size = mDvrMQ->availableToRead();
     int64_t playbackPacketSize = mDvrSettings.get<DvrSettings::Tag::playback>().packetSize;
-    vector<int8_t> dataOutputBuffer;
-    dataOutputBuffer.resize(playbackPacketSize);
-    // Dispatch the packet to the PID matching filter output buffer
-    for (int i = 0; i < size / playbackPacketSize; i++) {
-        if (!mDvrMQ->read(dataOutputBuffer.data(), playbackPacketSize)) {
+    if (playbackPacketSize <= 0) {
+        ALOGE("[Dvr] invalid playback packet size %" PRId64, playbackPacketSize);
+        return false;
+    }
+    size_t packetSize = static_cast<size_t>(playbackPacketSize);
+    bool isTs = mDvrSettings.get<DvrSettings::Tag::playback>().dataFormat == DataFormat::TS;
+
+    waitForPlaybackWatermark(packetSize);
+
+    // Read playback data in chunks directly from the FMQ memory, and dispatch each chunk to the
+    // PID matching filter output buffers at once.
+    size_t maxChunkSize = kMaxPlaybackChunkPackets * packetSize;
+    while (true) {
+        size_t available = mDvrMQ->availableToRead();
+        if (available < packetSize) {
+            break;
+        }
+        size_t chunkSize = std::min(available, maxChunkSize);
+        DvrMQ::MemTransaction tx;
+        if (!mDvrMQ->beginRead(chunkSize, &tx)) {
             return false;
         }
-        if (isVirtualFrontend) {
-            if (isRecording) {
-                mDemux->sendFrontendInputToRecord(dataOutputBuffer);
-            } else {
-                mDemux->startBroadcastTsFilter(dataOutputBuffer);
-            }
-        } else {
-            startTpidFilter(dataOutputBuffer);
+        auto first = tx.getFirstRegion();
+        auto second = tx.getSecondRegion();
+        size_t firstSize = first.getLength();
+        size_t secondSize = second.getLength();
+
+        size_t consumed = dispatchPlaybackPackets(first.getAddress(), firstSize, packetSize, isTs,
+                                                  isVirtualFrontend, isRecording);
+        size_t secondOffset = 0;
+        size_t tailSize = firstSize - consumed;
+        if (tailSize > 0 && tailSize + secondSize >= packetSize) {
+            // A packet wraps around the end of the ring buffer.
+            secondOffset = packetSize - tailSize;
+            mPlaybackWrappedPacket.resize(packetSize);
+            memcpy(mPlaybackWrappedPacket.data(), first.getAddress() + consumed, tailSize);
+            memcpy(mPlaybackWrappedPacket.data() + tailSize, second.getAddress(), secondOffset);
+            dispatchPlaybackData(mPlaybackWrappedPacket.data(), packetSize, packetSize,
+                                 isVirtualFrontend, isRecording);
+            consumed += packetSize;
+        }
+        if (consumed == firstSize + secondOffset) {
+            consumed += dispatchPlaybackPackets(second.getAddress() + secondOffset,
+                                                secondSize - secondOffset, packetSize, isTs,
+                                                isVirtualFrontend, isRecording);
+        }
+
+        if (consumed == 0) {
+            // Only a partial packet is left.
+            break;
+        }
+        if (!mDvrMQ->commitRead(consumed)) {
+            return false;
         }
     }
 
     return true;
 }
 
+void Dvr::waitForPlaybackWatermark(size_t packetSize) {
+    size_t watermark = std::min(kPlaybackReadWatermarkPackets * packetSize,
+                                mDvrMQ->getQuantumCount() / 4);
+    // Each write of the client sets DATA_READY, so keep waiting until enough of them accumulated.
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::nanoseconds(kPlaybackWatermarkTimeoutNs);
+    while (mDvrThreadRunning && mDvrMQ->availableToRead() < watermark) {
+        int64_t timeoutNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    deadline - std::chrono::steady_clock::now())
+                                    .count();
+        if (timeoutNs <= 0) {
+            return;
+        }
+        uint32_t efState = 0;
+        ::android::status_t status = mDvrEventFlag->wait(
+                static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY), &efState, timeoutNs,
+                true /* retry on spurious wake */);
+        if (status != ::android::OK) {
+            // Timed out, or the event flag is unusable.
+            return;
+        }
+    }
+}
+
+size_t Dvr::dispatchPlaybackPackets(const int8_t* data, size_t size, size_t packetSize, bool isTs,
+                                    bool isVirtualFrontend, bool isRecording) {
+    size_t offset = 0;
+    while (offset < size) {
+        if (isTs && data[offset] != TS_SYNC_BYTE) {
+            const void* sync = memchr(data + offset, TS_SYNC_BYTE, size - offset);
+            size_t syncOffset = sync != nullptr
+                                        ? static_cast<const int8_t*>(sync) - data
+                                        : size;
+            if (DEBUG_DVR) {
+                ALOGW("[Dvr] skipped %zu bytes to resync on a TS packet", syncOffset - offset);
+            }
+            offset = syncOffset;
+            continue;
+        }
+        if (offset + packetSize > size) {
+            break;
+        }
+        // Extend the run of packets as long as they stay aligned.
+        size_t end = offset + packetSize;
+        while (end + packetSize <= size && (!isTs || data[end] == TS_SYNC_BYTE)) {
+            end += packetSize;
+        }
+        dispatchPlaybackData(data + offset, end - offset, packetSize, isVirtualFrontend,
+                             isRecording);
+        offset = end;
+    }
+    return offset;
+}
+
+void Dvr::dispatchPlaybackData(const int8_t* data, size_t size, size_t packetSize,
+                               bool isVirtualFrontend, bool isRecording) {
+    if (isVirtualFrontend && isRecording) {
+        mDemux->sendFrontendInputToRecord(data, size);
+    } else {
+        // The playback filters of the dvr are the playback filters of its demux.
+        mDemux->startBroadcastTsFilter(data, size, packetSize);
+    }
+}
+
 bool Dvr::processEsDataOnPlayback(bool isVirtualFrontend, bool isRecording) {
     // Read ES from the DVR FMQ
     // Note that currently we only provides ES with metaData in a specific format to be parsed.
@@ -413,7 +531,8 @@ bool Dvr::processEsDataOnPlayback(bool isVirtualFrontend, bool isRecording) {
                 }
             }
         } else {
-            mDemux->sendFrontendInputToRecord(frameData, pid, static_cast<uint64_t>(esMeta[i].pts));
+            mDemux->sendFrontendInputToRecord(frameData.data(), frameData.size(), pid,
+                                              static_cast<uint64_t>(esMeta[i].pts));
         }
         startFilterDispatcher(isVirtualFrontend, isRecording);
         frameData.clear();
@@ -429,19 +548,6 @@ void Dvr::getMetaDataValue(int& index, int8_t* dataOutputBuffer, int& value) {
     }
 }
 
-void Dvr::startTpidFilter(vector<int8_t> data) {
-    map<int64_t, std::shared_ptr<Filter>>::iterator it;
-    for (it = mFilters.begin(); it != mFilters.end(); it++) {
-        uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
-        if (DEBUG_DVR) {
-            ALOGW("[Dvr] start ts filter pid: %d", pid);
-        }
-        if (pid == mDemux->getFilterTpid(it->first)) {
-            mDemux->updateFilterOutput(it->first, data);
-        }
-    }
-}
-
 bool Dvr::startFilterDispatcher(bool isVirtualFrontend, bool isRecording) {
     if (isVirtualFrontend) {
         if (isRecording) {
@@ -480,20 +586,37 @@ int Dvr::writePlaybackFMQ(void* buf, size_t size) {
     return DVR_WRITE_FAILURE_REASON_UNKNOWN;
 }
 
-bool Dvr::writeRecordFMQ(const vector<int8_t>& data) {
+int Dvr::writeRecordFMQ(const int8_t* data, size_t size) {
     lock_guard<mutex> lock(mWriteLock);
     if (mRecordStatus == RecordStatus::OVERFLOW) {
         ALOGW("[Dvr] stops writing and wait for the client side flushing.");
-        return true;
+        return DVR_WRITE_FAILURE_REASON_FMQ_FULL;
     }
-    if (mDvrMQ->write(data.data(), data.size())) {
-        mDvrEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
-        maySendRecordStatusCallback();
-        return true;
+    if (mDvrMQ->write(data, size)) {
+        mHasPendingRecordOutput = true;
+        return DVR_WRITE_SUCCESS;
     }
+    return DVR_WRITE_FAILURE_REASON_UNKNOWN;
+}
 
+void Dvr::notifyRecordOutput(bool isInputDrained) {
+    {
+        lock_guard<mutex> lock(mWriteLock);
+        // Below the low threshold, the output is left for the next pass to add to, as long as
+        // there is input for that pass. Otherwise it is delivered at the end of this one.
+        if (mHasPendingRecordOutput &&
+            (isInputDrained || mDvrMQ->availableToRead() >=
+                                       mDvrSettings.get<DvrSettings::Tag::record>().lowThreshold)) {
+            mDvrEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
+            mHasPendingRecordOutput = false;
+        }
+    }
     maySendRecordStatusCallback();
-    return false;
+}
+
+bool Dvr::isPlaybackInputDrained() {
+    int64_t packetSize = mDvrSettings.get<DvrSettings::Tag::playback>().packetSize;
+    return mDvrMQ->availableToRead() < static_cast<size_t>(std::max<int64_t>(packetSize, 1));
 }
 
 void Dvr::maySendRecordStatusCallback() {
@@ -48,6 +48,7 @@ const int DVR_WRITE_FAILURE_REASON_FMQ_FULL = 1;
 const int DVR_WRITE_FAILURE_REASON_UNKNOWN = 2;
 
 const int TS_SIZE = 188;
+const int8_t TS_SYNC_BYTE = 0x47;
 const int IPTV_BUFFER_SIZE = TS_SIZE * 7 * 8;  // defined in service_streamer_udp in cbs v3 project
 
 // Thresholds are defined to indicate how full the buffers are.
@@ -94,7 +95,26 @@ class Dvr : public BnDvr {
      */
     bool createDvrMQ();
     int writePlaybackFMQ(void* buf, size_t size);
-    bool writeRecordFMQ(const std::vector<int8_t>& data);
+    /**
+     * Appends record output to the FMQ. The client is not woken up here but by
+     * notifyRecordOutput(), once per dispatch pass. Returns DVR_WRITE_SUCCESS only if the
+     * data was written; while the record status is OVERFLOW the data is dropped and
+     * DVR_WRITE_FAILURE_REASON_FMQ_FULL is returned.
+     */
+    int writeRecordFMQ(const int8_t* data, size_t size);
+    /**
+     * Wakes up the client for the record output written since the last wake-up, and sends the
+     * record status callback if the status changed. Below lowThreshold bytes, the output is left
+     * for the next pass to add to, unless the input is drained.
+     *
+     * @param isInputDrained Whether the pass consumed all the queued input, so that no more
+     *        output follows until the client writes more input.
+     */
+    void notifyRecordOutput(bool isInputDrained);
+    /**
+     * Returns whether less than one packet is left in the playback FMQ.
+     */
+    bool isPlaybackInputDrained();
     bool addPlaybackFilter(int64_t filterId, std::shared_ptr<Filter> filter);
     bool removePlaybackFilter(int64_t filterId);
     bool readPlaybackFMQ(bool isVirtualFrontend, bool isRecording);
@@ -115,6 +135,22 @@ class Dvr : public BnDvr {
     void deleteEventFlag();
     bool readDataFromMQ();
     void getMetaDataValue(int& index, int8_t* dataOutputBuffer, int& value);
+    /**
+     * Waits briefly for the playback FMQ to fill up to the read watermark, so that each round of
+     * filtering handles a large chunk of input rather than the last write of the client.
+     */
+    void waitForPlaybackWatermark(size_t packetSize);
+    /**
+     * Passes the whole packets in data to the demux in as few calls as possible. TS packets are
+     * resynchronized on the sync byte when alignment is lost.
+     *
+     * Returns the number of bytes consumed, which excludes a trailing partial packet. For TS, the
+     * unconsumed bytes start with the sync byte.
+     */
+    size_t dispatchPlaybackPackets(const int8_t* data, size_t size, size_t packetSize, bool isTs,
+                                   bool isVirtualFrontend, bool isRecording);
+    void dispatchPlaybackData(const int8_t* data, size_t size, size_t packetSize,
+                              bool isVirtualFrontend, bool isRecording);
     void maySendPlaybackStatusCallback();
     void maySendIptvPlaybackStatusCallback();
     void maySendRecordStatusCallback();
@@ -122,15 +158,12 @@ class Dvr : public BnDvr {
                                              int64_t highThreshold, int64_t lowThreshold);
     RecordStatus checkRecordStatusChange(uint32_t availableToWrite, uint32_t availableToRead,
                                          int64_t highThreshold, int64_t lowThreshold);
-    /**
-     * A dispatcher to read and dispatch input data to all the started filters.
-     * Each filter handler handles the data filtering/output writing/filterEvent updating.
-     */
-    void startTpidFilter(vector<int8_t> data);
     void playbackThreadLoop();
 
     unique_ptr<DvrMQ> mDvrMQ;
     EventFlag* mDvrEventFlag;
+    // Holds a playback packet that wraps around the end of the FMQ ring buffer.
+    vector<int8_t> mPlaybackWrappedPacket;
     /**
      * Demux callbacks used on filter events or IO buffer status
      */
@@ -143,6 +176,9 @@ class Dvr : public BnDvr {
     // FMQ status local records
     PlaybackStatus mPlaybackStatus;
     RecordStatus mRecordStatus;
+    // Whether record output was written since the client was last woken up, guarded by
+    // mWriteLock
+    bool mHasPendingRecordOutput = false;
     /**
      * If a specific filter's writing loop is still running
      */
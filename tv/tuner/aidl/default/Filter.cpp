@@ -23,6 +23,7 @@
 #include <aidl/android/hardware/tv/tuner/Result.h>
 #include <aidlcommonsupport/NativeHandle.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <utils/Log.h>
 
 #include "Filter.h"
@@ -99,6 +100,7 @@ bool FilterCallbackScheduler::hasCallbackRegistered() const {
 void FilterCallbackScheduler::start() {
     mIsRunning = true;
     mCallbackThread = std::thread(&FilterCallbackScheduler::threadLoop, this);
+    pthread_setname_np(mCallbackThread.native_handle(), "tuner_filter_cb");
 }
 
 void FilterCallbackScheduler::stop() {
@@ -305,6 +307,20 @@ Filter::~Filter() {
     switch (mType.mainType) {
         case DemuxFilterMainType::TS:
             mTpid = in_settings.get<DemuxFilterSettings::Tag::ts>().tpid;
+            {
+                using FilterSettingsTag = DemuxTsFilterSettingsFilterSettings::Tag;
+                const auto& tsFilterSettings =
+                        in_settings.get<DemuxFilterSettings::Tag::ts>().filterSettings;
+                if (tsFilterSettings.getTag() == FilterSettingsTag::section) {
+                    std::lock_guard<std::mutex> lock(mFilterOutputLock);
+                    mSectionFilter.configure(tsFilterSettings.get<FilterSettingsTag::section>());
+                } else if (tsFilterSettings.getTag() == FilterSettingsTag::record) {
+                    std::lock_guard<std::mutex> lock(mRecordIndexerLock);
+                    mRecordIndexer.configure(mTpid,
+                                             tsFilterSettings.get<FilterSettingsTag::record>());
+                }
+            }
+            mDemux->updateTsPidTable();
             break;
         case DemuxFilterMainType::MMTP:
             break;
@@ -325,8 +341,20 @@ Filter::~Filter() {
 ::ndk::ScopedAStatus Filter::start() {
     ALOGV("%s", __FUNCTION__);
     mFilterThreadRunning = true;
+    mFilterEvents.start();
     std::vector<DemuxFilterEvent> events;
 
+    {
+        // A restarted filter delivers the sections of non-repeating filters again.
+        std::lock_guard<std::mutex> lock(mFilterOutputLock);
+        mSectionFilter.reset();
+    }
+    {
+        // Record byte numbers count from the start of the filter output.
+        std::lock_guard<std::mutex> lock(mRecordIndexerLock);
+        mRecordIndexer.reset();
+    }
+
     mFilterCount += 1;
     mDemux->setIptvThreadRunning(true);
 
@@ -374,6 +402,7 @@ Filter::~Filter() {
     }
 
     mFilterThreadRunning = false;
+    mFilterEvents.stop();
     if (mFilterThread.joinable()) {
         mFilterThread.join();
     }
@@ -401,16 +430,24 @@ Filter::~Filter() {
 
     if ((mSharedAvMemHandle != nullptr) && (in_avMemory.fds.size() > 0) &&
         (sameFile(in_avMemory.fds[0].get(), mSharedAvMemHandle->data[0]))) {
+        std::lock_guard<std::mutex> lock(mFilterOutputLock);
         freeSharedAvHandle();
         return ::ndk::ScopedAStatus::ok();
     }
 
-    if (mDataId2Avfd.find(in_avDataId) == mDataId2Avfd.end()) {
+    // A frame in the shared A/V memory, which can now be overwritten.
+    if (mAvMemoryRing.release(in_avDataId)) {
+        return ::ndk::ScopedAStatus::ok();
+    }
+
+    auto it = mDataId2Avfd.find(in_avDataId);
+    if (it == mDataId2Avfd.end()) {
         return ::ndk::ScopedAStatus::fromServiceSpecificError(
                 static_cast<int32_t>(Result::INVALID_ARGUMENT));
     }
 
-    ::close(mDataId2Avfd[in_avDataId]);
+    ::close(it->second);
+    mDataId2Avfd.erase(it);
     return ::ndk::ScopedAStatus::ok();
 }
 
@@ -442,6 +479,7 @@ Filter::~Filter() {
                 static_cast<int32_t>(Result::INVALID_STATE));
     }
 
+    std::lock_guard<std::mutex> lock(mFilterOutputLock);
     if (mSharedAvMemHandle != nullptr) {
         *out_avMemory = ::android::dupToAidl(mSharedAvMemHandle);
         *_aidl_return = BUFFER_SIZE;
@@ -463,6 +501,12 @@ Filter::~Filter() {
                 static_cast<int32_t>(Result::UNKNOWN_ERROR));
     }
     ::close(av_fd);
+    if (!mAvMemoryRing.init(mSharedAvMemHandle->data[0], BUFFER_SIZE)) {
+        freeSharedAvHandle();
+        *_aidl_return = 0;
+        return ::ndk::ScopedAStatus::fromServiceSpecificError(
+                static_cast<int32_t>(Result::OUT_OF_MEMORY));
+    }
     mUsingSharedAvMem = true;
 
     *out_avMemory = ::android::dupToAidl(mSharedAvMemHandle);
@@ -566,6 +610,7 @@ bool Filter::createFilterMQ() {
 
 ::ndk::ScopedAStatus Filter::startFilterLoop() {
     mFilterThread = std::thread(&Filter::filterThreadLoop, this);
+    pthread_setname_np(mFilterThread.native_handle(), "tuner_filter");
     return ::ndk::ScopedAStatus::ok();
 }
 
@@ -581,14 +626,11 @@ void Filter::filterThreadLoop() {
     // For the first time of filter output, implementation needs to send the filter
     // Event Callback without waiting for the DATA_CONSUMED to init the process.
     while (mFilterThreadRunning) {
-        std::unique_lock<std::mutex> lock(mFilterEventsLock);
-        if (mFilterEvents.size() == 0) {
-            lock.unlock();
-            if (DEBUG_FILTER) {
-                ALOGD("[Filter] wait for filter data output.");
-            }
-            usleep(1000 * 1000);
-            continue;
+        if (DEBUG_FILTER) {
+            ALOGD("[Filter] wait for filter data output.");
+        }
+        if (!mFilterEvents.wait()) {
+            break;
         }
 
         // After successfully write, send a callback and wait for the read to be done
@@ -600,8 +642,7 @@ void Filter::filterThreadLoop() {
                 mConfigured = false;
             }
 
-            // lock is still being held
-            for (auto&& event : mFilterEvents) {
+            for (auto&& event : mFilterEvents.take()) {
                 mCallbackScheduler.onFilterEvent(std::move(event));
             }
         } else {
@@ -610,61 +651,43 @@ void Filter::filterThreadLoop() {
             return;
         }
 
-        mFilterEvents.clear();
         mFilterStatus = DemuxFilterStatus::DATA_READY;
         mCallbackScheduler.onFilterStatus(mFilterStatus);
         break;
     }
 
+    // Keep delivering the events of the filter output until the filter is stopped, each round
+    // after the client has read the data of the previous one.
     while (mFilterThreadRunning) {
         uint32_t efState = 0;
-        // We do not wait for the last round of written data to be read to finish the thread
-        // because the VTS can verify the reading itself.
-        for (int i = 0; i < SECTION_WRITE_COUNT; i++) {
-            if (!mFilterThreadRunning) {
-                break;
-            }
-            while (mFilterThreadRunning && mIsUsingFMQ) {
-                ::android::status_t status = mFilterEventsFlag->wait(
-                        static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED), &efState,
-                        WAIT_TIMEOUT, true /* retry on spurious wake */);
-                if (status != ::android::OK) {
-                    ALOGD("[Filter] wait for data consumed");
-                    continue;
-                }
-                break;
+        while (mFilterThreadRunning && mIsUsingFMQ) {
+            ::android::status_t status = mFilterEventsFlag->wait(
+                    static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED), &efState,
+                    WAIT_TIMEOUT, true /* retry on spurious wake */);
+            if (status != ::android::OK) {
+                ALOGD("[Filter] wait for data consumed");
+                continue;
             }
+            break;
+        }
 
-            maySendFilterStatusCallback();
+        maySendFilterStatusCallback();
 
-            while (mFilterThreadRunning) {
-                std::lock_guard<std::mutex> lock(mFilterEventsLock);
-                if (mFilterEvents.size() == 0) {
-                    continue;
-                }
-                // After successfully write, send a callback and wait for the read to be done
-                for (auto&& event : mFilterEvents) {
-                    mCallbackScheduler.onFilterEvent(std::move(event));
-                }
-                mFilterEvents.clear();
-                break;
-            }
-            // We do not wait for the last read to be done
-            // VTS can verify the read result itself.
-            if (i == SECTION_WRITE_COUNT - 1) {
-                ALOGD("[Filter] filter %" PRIu64 " writing done. Ending thread", mFilterId);
-                break;
-            }
+        if (!mFilterEvents.wait()) {
+            break;
+        }
+        for (auto&& event : mFilterEvents.take()) {
+            mCallbackScheduler.onFilterEvent(std::move(event));
         }
-        break;
     }
-    ALOGD("[Filter] filter thread ended.");
+    ALOGD("[Filter] filter %" PRIu64 " thread ended.", mFilterId);
 }
 
 void Filter::freeSharedAvHandle() {
     if (!mIsMediaFilter) {
         return;
     }
+    mAvMemoryRing.reset();
     native_handle_close(mSharedAvMemHandle);
     native_handle_delete(mSharedAvMemHandle);
     mSharedAvMemHandle = nullptr;
@@ -678,6 +701,12 @@ binder_status_t Filter::dump(int fd, const char** /* args */, uint32_t /* numArg
     dprintf(fd, "      mIsRecordFilter: %d\n", mIsRecordFilter);
     dprintf(fd, "      mIsUsingFMQ: %d\n", mIsUsingFMQ);
     dprintf(fd, "      mFilterThreadRunning: %d\n", (bool)mFilterThreadRunning);
+    if (mUsingSharedAvMem) {
+        dprintf(fd, "      Shared av memory high water mark: %zu\n",
+                mAvMemoryRing.getHighWaterMark());
+        dprintf(fd, "      Shared av memory unreleased frames: %zu\n",
+                mAvMemoryRing.getInFlightChunks());
+    }
     return STATUS_OK;
 }
 
@@ -722,14 +751,27 @@ void Filter::updateFilterOutput(vector<int8_t>& data) {
     mFilterOutput.insert(mFilterOutput.end(), data.begin(), data.end());
 }
 
+void Filter::updateFilterOutput(const int8_t* data, const vector<uint32_t>& packetOffsets,
+                                size_t packetSize) {
+    std::lock_guard<std::mutex> lock(mFilterOutputLock);
+    mFilterOutput.reserve(mFilterOutput.size() + packetOffsets.size() * packetSize);
+    for (uint32_t offset : packetOffsets) {
+        mFilterOutput.insert(mFilterOutput.end(), data + offset, data + offset + packetSize);
+    }
+}
+
 void Filter::updatePts(uint64_t pts) {
     std::lock_guard<std::mutex> lock(mFilterOutputLock);
     mPts = pts;
 }
 
-void Filter::updateRecordOutput(vector<int8_t>& data) {
-    std::lock_guard<std::mutex> lock(mRecordFilterOutputLock);
-    mRecordFilterOutput.insert(mRecordFilterOutput.end(), data.begin(), data.end());
+void Filter::indexRecordOutput(const int8_t* data, size_t size) {
+    vector<DemuxFilterEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(mRecordIndexerLock);
+        mRecordIndexer.index(data, size, &events);
+    }
+    mFilterEvents.push(std::move(events));
 }
 
 ::ndk::ScopedAStatus Filter::startFilterHandler() {
@@ -851,10 +893,7 @@ void Filter::updateRecordOutput(vector<int8_t>& data) {
             ALOGD("[Filter] assembled pes data length %d", pesEvent.dataLength);
         }
 
-        {
-            std::lock_guard<std::mutex> lock(mFilterEventsLock);
-            mFilterEvents.push_back(DemuxFilterEvent::make<DemuxFilterEvent::Tag::pes>(pesEvent));
-        }
+        mFilterEvents.push(DemuxFilterEvent::make<DemuxFilterEvent::Tag::pes>(pesEvent));
 
         mPesOutput.clear();
     }
@@ -907,6 +946,7 @@ void Filter::updateRecordOutput(vector<int8_t>& data) {
                 // Location of PES fields from ISO/IEC 13818-1 Section 2.4.3.6
                 mPesSizeLeft = (static_cast<uint8_t>(mFilterOutput[i + 8]) << 8) |
                                static_cast<uint8_t>(mFilterOutput[i + 9]);
+                mDroppingPes = false;
                 bool hasPts = static_cast<uint8_t>(mFilterOutput[i + 11]) & 0x80;
                 uint8_t optionalFieldsLength = static_cast<uint8_t>(mFilterOutput[i + 12]);
                 headerSize += 9 + optionalFieldsLength;
@@ -932,19 +972,33 @@ void Filter::updateRecordOutput(vector<int8_t>& data) {
 
         uint32_t endPoint = min(188u - headerSize, mPesSizeLeft);
         // append data and check size
-        vector<int8_t>::const_iterator first = mFilterOutput.begin() + i + headerSize;
-        vector<int8_t>::const_iterator last = mFilterOutput.begin() + i + headerSize + endPoint;
-        mPesOutput.insert(mPesOutput.end(), first, last);
+        const int8_t* payload = mFilterOutput.data() + i + headerSize;
+        if (!mUsingSharedAvMem) {
+            mPesOutput.insert(mPesOutput.end(), payload, payload + endPoint);
+        } else if (!mDroppingPes) {
+            // The ES data goes straight to the shared A/V memory, where the client reads it.
+            if (!mAvMemoryRing.append(reinterpret_cast<const uint8_t*>(payload), endPoint)) {
+                ALOGW("[Filter] shared av memory is full, dropping pes");
+                mAvMemoryRing.discard();
+                mDroppingPes = true;
+            }
+        }
         // size does not match then continue
         mPesSizeLeft -= endPoint;
         if (DEBUG_FILTER) {
             ALOGD("[Filter] pes data left %d", mPesSizeLeft);
         }
-        if (mPesSizeLeft > 0 || mAvBufferCopyCount++ < 10) {
+        if (mPesSizeLeft > 0) {
             continue;
         }
 
-        result = createMediaFilterEventWithIon(mPesOutput);
+        if (mUsingSharedAvMem) {
+            result = createShareMemMediaEvent();
+        } else if (mAvBufferCopyCount++ < 10) {
+            continue;
+        } else {
+            result = createIndependentMediaEvents(mPesOutput);
+        }
         if (!result.isOk()) {
             mFilterOutput.clear();
             return result;
@@ -968,35 +1022,6 @@ void Filter::updateRecordOutput(vector<int8_t>& data) {
     return createIndependentMediaEvents(output);
 }
 
-::ndk::ScopedAStatus Filter::startRecordFilterHandler() {
-    std::lock_guard<std::mutex> lock(mRecordFilterOutputLock);
-    if (mRecordFilterOutput.empty()) {
-        return ::ndk::ScopedAStatus::ok();
-    }
-
-    if (mDvr == nullptr || !mDvr->writeRecordFMQ(mRecordFilterOutput)) {
-        ALOGD("[Filter] dvr fails to write into record FMQ.");
-        return ::ndk::ScopedAStatus::fromServiceSpecificError(
-                static_cast<int32_t>(Result::UNKNOWN_ERROR));
-    }
-
-    DemuxFilterTsRecordEvent recordEvent;
-    recordEvent = {
-            .byteNumber = static_cast<int64_t>(mRecordFilterOutput.size()),
-            .pts = (mPts == 0) ? static_cast<int64_t>(time(NULL)) * 900000 : mPts,
-            .firstMbInSlice = 0,  // random address
-    };
-
-    {
-        std::lock_guard<std::mutex> lock(mFilterEventsLock);
-        mFilterEvents.push_back(
-                DemuxFilterEvent::make<DemuxFilterEvent::Tag::tsRecord>(recordEvent));
-    }
-
-    mRecordFilterOutput.clear();
-    return ::ndk::ScopedAStatus::ok();
-}
-
 ::ndk::ScopedAStatus Filter::startPcrFilterHandler() {
     // TODO handle starting PCR filter
     return ::ndk::ScopedAStatus::ok();
@@ -1010,70 +1035,47 @@ void Filter::updateRecordOutput(vector<int8_t>& data) {
 // Read PSI (Program Specific Information) Sections from TransportStreams
 // as defined in ISO/IEC 13818-1 Section 2.4.4
 bool Filter::writeSectionsAndCreateEvent(vector<int8_t>& data) {
-    // TODO check how many sections has been read
-    ALOGD("[Filter] section handler");
-
-    // Transport Stream Packets are 188 bytes long, as defined in the
-    // Introduction of ISO/IEC 13818-1
-    for (int i = 0; i < data.size(); i += 188) {
-        if (mSectionSizeLeft == 0) {
-            // Location for sectionSize as defined by Section 2.4.4
-            // Note that the first 4 bytes skipped are the TsHeader
-            mSectionSizeLeft = ((static_cast<uint8_t>(data[i + 5]) & 0x0f) << 8) |
-                               static_cast<uint8_t>(data[i + 6]);
-            mSectionSizeLeft += 3;
-            if (DEBUG_FILTER) {
-                ALOGD("[Filter] section data length %d", mSectionSizeLeft);
-            }
-        }
-
-        // 184 bytes per packet is derived by subtracting the 4 byte length of
-        // the TsHeader from its 188 byte packet size
-        uint32_t endPoint = min(184u, mSectionSizeLeft);
-        // append data and check size
-        vector<int8_t>::const_iterator first = data.begin() + i + 4;
-        vector<int8_t>::const_iterator last = data.begin() + i + 4 + endPoint;
-        mSectionOutput.insert(mSectionOutput.end(), first, last);
-        // size does not match then continue
-        mSectionSizeLeft -= endPoint;
-        if (DEBUG_FILTER) {
-            ALOGD("[Filter] section data left %d", mSectionSizeLeft);
-        }
-        if (mSectionSizeLeft > 0) {
-            continue;
-        }
-
-        if (!writeDataToFilterMQ(mSectionOutput)) {
-            mSectionOutput.clear();
+    vector<DemuxFilterEvent> events;
+    bool writeFailed = false;
+    auto onSection = [&](const uint8_t* section, size_t size) {
+        if (!writeDataToFilterMQ(reinterpret_cast<const int8_t*>(section), size)) {
+            writeFailed = true;
             return false;
         }
-
-        DemuxFilterSectionEvent secEvent;
-        secEvent = {
-                // temp dump meta data
-                .tableId = 0,
-                .version = 1,
-                .sectionNum = 1,
-                .dataLength = static_cast<int32_t>(mSectionOutput.size()),
+        DemuxFilterSectionEvent secEvent{
+                .tableId = SectionFilter::getTableId(section),
+                .version = SectionFilter::getVersion(section),
+                .sectionNum = SectionFilter::getSectionNumber(section),
+                .dataLength = static_cast<int64_t>(size),
         };
         if (DEBUG_FILTER) {
-            ALOGD("[Filter] assembled section data length %" PRIu64, secEvent.dataLength);
+            ALOGD("[Filter] section table id %d, version %d, section number %d, length %zu",
+                  secEvent.tableId, secEvent.version, secEvent.sectionNum, size);
         }
+        events.push_back(DemuxFilterEvent::make<DemuxFilterEvent::Tag::section>(secEvent));
+        return true;
+    };
 
-        {
-            std::lock_guard<std::mutex> lock(mFilterEventsLock);
-            mFilterEvents.push_back(
-                    DemuxFilterEvent::make<DemuxFilterEvent::Tag::section>(secEvent));
+    // Transport Stream Packets are 188 bytes long, as defined in the
+    // Introduction of ISO/IEC 13818-1
+    const uint8_t* packets = reinterpret_cast<const uint8_t*>(data.data());
+    for (size_t i = 0; i + 188 <= data.size(); i += 188) {
+        if (!mSectionFilter.processPacket(packets + i, 188, onSection)) {
+            break;
         }
-        mSectionOutput.clear();
     }
 
-    return true;
+    mFilterEvents.push(std::move(events));
+    return !writeFailed;
 }
 
 bool Filter::writeDataToFilterMQ(const std::vector<int8_t>& data) {
+    return writeDataToFilterMQ(data.data(), data.size());
+}
+
+bool Filter::writeDataToFilterMQ(const int8_t* data, size_t size) {
     std::lock_guard<std::mutex> lock(mWriteLock);
-    if (mFilterMQ->write(data.data(), data.size())) {
+    if (mFilterMQ->write(data, size)) {
         return true;
     }
     return false;
@@ -1144,6 +1146,7 @@ native_handle_t* Filter::createNativeHandle(int fd) {
                 static_cast<int32_t>(Result::UNKNOWN_ERROR));
     }
     memcpy(avBuffer, output.data(), output.size() * sizeof(uint8_t));
+    munmap(avBuffer, output.size());
 
     native_handle_t* nativeHandle = createNativeHandle(av_fd);
     if (nativeHandle == NULL) {
@@ -1166,10 +1169,7 @@ native_handle_t* Filter::createNativeHandle(int fd) {
         mPts = 0;
     }
 
-    {
-        std::lock_guard<std::mutex> lock(mFilterEventsLock);
-        mFilterEvents.push_back(std::move(event));
-    }
+    mFilterEvents.push(std::move(event));
 
     // Clear and log
     native_handle_close(nativeHandle);
@@ -1184,17 +1184,28 @@ native_handle_t* Filter::createNativeHandle(int fd) {
 
 ::ndk::ScopedAStatus Filter::createShareMemMediaEvents(vector<int8_t>& output) {
     // copy the filtered data to the shared buffer
-    uint8_t* sharedAvBuffer =
-            getIonBuffer(mSharedAvMemHandle->data[0], output.size() + mSharedAvMemOffset);
-    if (sharedAvBuffer == NULL) {
+    if (!mAvMemoryRing.append(reinterpret_cast<const uint8_t*>(output.data()), output.size())) {
+        mAvMemoryRing.discard();
         return ::ndk::ScopedAStatus::fromServiceSpecificError(
-                static_cast<int32_t>(Result::UNKNOWN_ERROR));
+                static_cast<int32_t>(Result::OUT_OF_MEMORY));
+    }
+    output.clear();
+    return createShareMemMediaEvent();
+}
+
+::ndk::ScopedAStatus Filter::createShareMemMediaEvent() {
+    // The data stays in the shared buffer until the client releases its dataId
+    uint64_t dataId = mLastUsedDataId++ /*createdUID*/;
+    int64_t offset;
+    int64_t dataLength;
+    if (!mAvMemoryRing.commit(static_cast<int64_t>(dataId), &offset, &dataLength)) {
+        return ::ndk::ScopedAStatus::ok();
     }
-    memcpy(sharedAvBuffer + mSharedAvMemOffset, output.data(), output.size() * sizeof(uint8_t));
 
     // Create a memory handle with numFds == 0
     native_handle_t* nativeHandle = createNativeHandle(-1);
     if (nativeHandle == NULL) {
+        mAvMemoryRing.release(static_cast<int64_t>(dataId));
         return ::ndk::ScopedAStatus::fromServiceSpecificError(
                 static_cast<int32_t>(Result::UNKNOWN_ERROR));
     }
@@ -1203,26 +1214,21 @@ native_handle_t* Filter::createNativeHandle(int fd) {
     auto event = DemuxFilterEvent::make<DemuxFilterEvent::Tag::media>();
     auto& mediaEvent = event.get<DemuxFilterEvent::Tag::media>();
     mediaEvent.avMemory = ::android::dupToAidl(nativeHandle);
-    mediaEvent.offset = mSharedAvMemOffset;
-    mediaEvent.dataLength = static_cast<int64_t>(output.size());
+    mediaEvent.offset = offset;
+    mediaEvent.dataLength = dataLength;
+    mediaEvent.avDataId = static_cast<int64_t>(dataId);
     if (mPts) {
         mediaEvent.pts = mPts;
         mPts = 0;
     }
 
-    {
-        std::lock_guard<std::mutex> lock(mFilterEventsLock);
-        mFilterEvents.push_back(std::move(event));
-    }
-
-    mSharedAvMemOffset += output.size();
+    mFilterEvents.push(std::move(event));
 
     // Clear and log
     native_handle_close(nativeHandle);
     native_handle_delete(nativeHandle);
-    output.clear();
     if (DEBUG_FILTER) {
-        ALOGD("[Filter] shared av data length %d", static_cast<int32_t>(output.size()));
+        ALOGD("[Filter] shared av data offset %" PRId64 " length %" PRId64, offset, dataLength);
     }
     return ::ndk::ScopedAStatus::ok();
 }
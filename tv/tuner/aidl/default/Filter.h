@@ -32,8 +32,13 @@
 #include <thread>
 
 #include "Demux.h"
+#include "AvMemoryRing.h"
 #include "Dvr.h"
+#include "FilterEventQueue.h"
 #include "Frontend.h"
+#include "RecordIndexer.h"
+#include "SectionFilter.h"
+#include "TsDemux.h"
 
 using namespace std;
 
@@ -99,7 +104,7 @@ class FilterCallbackScheduler final {
     int mDataSizeDelayInBytes;
 };
 
-class Filter : public BnFilter {
+class Filter : public BnFilter, public TsDemux::Sink {
     friend class FilterCallbackScheduler;
 
   public:
@@ -135,12 +140,19 @@ class Filter : public BnFilter {
      * Return false is any of the above processes fails.
      */
     bool createFilterMQ();
-    uint16_t getTpid();
+    uint16_t getTpid() override;
     void updateFilterOutput(vector<int8_t>& data);
-    void updateRecordOutput(vector<int8_t>& data);
+    /**
+     * Appends the packets of packetSize bytes at packetOffsets in data to the filter output.
+     */
+    void updateFilterOutput(const int8_t* data, const vector<uint32_t>& packetOffsets,
+                            size_t packetSize) override;
+    /**
+     * Indexes the record output written to the DVR, and queues the resulting events.
+     */
+    void indexRecordOutput(const int8_t* data, size_t size);
     void updatePts(uint64_t pts);
     ::ndk::ScopedAStatus startFilterHandler();
-    ::ndk::ScopedAStatus startRecordFilterHandler();
     void attachFilterToRecord(const std::shared_ptr<Dvr> dvr);
     void detachFilterFromRecord();
     void freeSharedAvHandle();
@@ -166,16 +178,17 @@ class Filter : public BnFilter {
     bool mIsRecordFilter = false;
     DemuxFilterSettings mFilterSettings;
 
-    uint16_t mTpid;
+    // TS PIDs are 13 bits, so no packet matches until the filter is configured.
+    uint16_t mTpid = 0xffff;
     std::shared_ptr<IFilter> mDataSource;
     bool mIsDataSourceDemux = true;
     vector<int8_t> mFilterOutput;
-    vector<int8_t> mRecordFilterOutput;
     int64_t mPts = 0;
     unique_ptr<FilterMQ> mFilterMQ;
     bool mIsUsingFMQ = false;
     EventFlag* mFilterEventsFlag;
-    vector<DemuxFilterEvent> mFilterEvents;
+    // Events created by the filter handlers, for the filter thread to deliver
+    FilterEventQueue mFilterEvents;
 
     // Thread handlers
     std::thread mFilterThread;
@@ -187,12 +200,6 @@ class Filter : public BnFilter {
      */
     std::atomic<bool> mFilterThreadRunning;
 
-    /**
-     * How many times a filter should write
-     * TODO make this dynamic/random/can take as a parameter
-     */
-    const uint16_t SECTION_WRITE_COUNT = 10;
-
     bool DEBUG_FILTER = false;
 
     /**
@@ -210,6 +217,7 @@ class Filter : public BnFilter {
 
     void deleteEventFlag();
     bool writeDataToFilterMQ(const std::vector<int8_t>& data);
+    bool writeDataToFilterMQ(const int8_t* data, size_t size);
     bool readDataFromMQ();
     bool writeSectionsAndCreateEvent(vector<int8_t>& data);
     void maySendFilterStatusCallback();
@@ -229,6 +237,7 @@ class Filter : public BnFilter {
     ::ndk::ScopedAStatus createMediaFilterEventWithIon(vector<int8_t>& output);
     ::ndk::ScopedAStatus createIndependentMediaEvents(vector<int8_t>& output);
     ::ndk::ScopedAStatus createShareMemMediaEvents(vector<int8_t>& output);
+    ::ndk::ScopedAStatus createShareMemMediaEvent();
     bool sameFile(int fd1, int fd2);
 
     void createMediaEvent(vector<DemuxFilterEvent>&, bool isAudioPresentation);
@@ -246,21 +255,18 @@ class Filter : public BnFilter {
      * Lock to protect writes to the FMQs
      */
     std::mutex mWriteLock;
-    /**
-     * Lock to protect writes to the filter event
-     */
-    // TODO make each filter separate event lock
-    std::mutex mFilterEventsLock;
     /**
      * Lock to protect writes to the input status
      */
     std::mutex mFilterStatusLock;
     std::mutex mFilterOutputLock;
-    std::mutex mRecordFilterOutputLock;
+    std::mutex mRecordIndexerLock;
+
+    // Indexing of the recorded stream, guarded by mRecordIndexerLock
+    RecordIndexer mRecordIndexer;
 
-    // handle single Section filter
-    uint32_t mSectionSizeLeft = 0;
-    vector<int8_t> mSectionOutput;
+    // Section assembly and filtering of section filters, guarded by mFilterOutputLock
+    SectionFilter mSectionFilter;
 
     // temp handle single PES filter
     // TODO handle mulptiple Pes filters
@@ -275,7 +281,10 @@ class Filter : public BnFilter {
     // Shared A/V memory handle
     native_handle_t* mSharedAvMemHandle = nullptr;
     bool mUsingSharedAvMem = false;
-    int64_t mSharedAvMemOffset = 0;
+    // Frames written in the shared A/V memory, guarded by mFilterOutputLock except for releases
+    AvMemoryRing mAvMemoryRing;
+    // Set when the shared A/V memory ran out of room for the current PES, which is then dropped
+    bool mDroppingPes = false;
 
     uint32_t mAudioStreamType;
     uint32_t mVideoStreamType;
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FilterEventQueue.h"
+
+#include <iterator>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+void FilterEventQueue::start() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mIsStopped = false;
+}
+
+void FilterEventQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mIsStopped = true;
+    }
+    mCondition.notify_all();
+}
+
+void FilterEventQueue::push(DemuxFilterEvent event) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEvents.push_back(std::move(event));
+    }
+    mCondition.notify_one();
+}
+
+void FilterEventQueue::push(std::vector<DemuxFilterEvent>&& events) {
+    if (events.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEvents.insert(mEvents.end(), std::make_move_iterator(events.begin()),
+                       std::make_move_iterator(events.end()));
+    }
+    mCondition.notify_one();
+}
+
+bool FilterEventQueue::wait() {
+    std::unique_lock<std::mutex> lock(mLock);
+    mCondition.wait(lock, [this] { return !mEvents.empty() || mIsStopped; });
+    return !mIsStopped;
+}
+
+std::vector<DemuxFilterEvent> FilterEventQueue::take() {
+    std::lock_guard<std::mutex> lock(mLock);
+    std::vector<DemuxFilterEvent> events;
+    events.swap(mEvents);
+    return events;
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/tv/tuner/DemuxFilterEvent.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+/**
+ * The events of a filter waiting for its filter thread to deliver them.
+ *
+ * The filter handlers push events, which wake up the filter thread blocked in wait(), so that the
+ * events are delivered as soon as they are created rather than at the next poll. stop() also
+ * wakes the filter thread up, so that it can end. Events left in the queue are kept for a
+ * restarted filter. FilterEventQueue is thread safe.
+ */
+class FilterEventQueue {
+  public:
+    //! Lets wait() block again after stop(), for a restarted filter.
+    void start();
+
+    //! Wakes up wait(), which returns false until start() is called.
+    void stop();
+
+    void push(DemuxFilterEvent event);
+    void push(std::vector<DemuxFilterEvent>&& events);
+
+    /**
+     * Waits until events are queued or the queue is stopped.
+     *
+     * @return false if the queue is stopped.
+     */
+    bool wait();
+
+    //! Removes and returns the queued events, in the order they were pushed.
+    std::vector<DemuxFilterEvent> take();
+
+  private:
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::vector<DemuxFilterEvent> mEvents;
+    bool mIsStopped = false;
+};
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,272 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "android.hardware.tv.tuner-service.example-IptvJitterBuffer"
+
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "IptvJitterBuffer.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+namespace {
+
+constexpr size_t kTsPacketSize = 188;
+constexpr uint8_t kTsSyncByte = 0x47;
+constexpr size_t kRtpHeaderSize = 12;
+constexpr uint8_t kRtpVersion = 2;
+// RTP timestamps of MPEG-2 TS are in units of a 90 kHz clock.
+constexpr int64_t kRtpClockRate = 90000;
+
+size_t getRingSize(size_t depth) {
+    // Leave room for the packets arriving ahead of a missing one until it is declared lost.
+    size_t size = 1;
+    while (size < depth * 2) {
+        size <<= 1;
+    }
+    return size;
+}
+
+}  // namespace
+
+IptvJitterBuffer::IptvJitterBuffer(size_t depth, int64_t maxDelayUs)
+    : mDepth(std::max<size_t>(depth, 1)),
+      mMaxDelayUs(maxDelayUs),
+      mSlots(getRingSize(mDepth)) {}
+
+void IptvJitterBuffer::reset() {
+    for (Slot& slot : mSlots) {
+        slot.isUsed = false;
+    }
+    mHeldPackets = 0;
+    mHasSequence = false;
+    mOutput.clear();
+    mOutputStart = 0;
+    mHasTransit = false;
+    mScaledJitter = 0;
+}
+
+void IptvJitterBuffer::push(const uint8_t* data, size_t size, int64_t arrivalUs) {
+    if (size == 0) {
+        return;
+    }
+    if (data[0] == kTsSyncByte) {
+        // TS packets sent without RTP, which cannot be reordered.
+        mUnencapsulatedBytes += size;
+        appendOutput(data, size);
+        return;
+    }
+
+    uint16_t sequence16;
+    uint32_t timestamp;
+    const uint8_t* payload;
+    size_t payloadSize;
+    if (!parseRtp(data, size, &sequence16, &timestamp, &payload, &payloadSize)) {
+        ALOGV("[IptvJitterBuffer] dropping an invalid datagram of %zu bytes", size);
+        return;
+    }
+    mReceivedPackets++;
+    updateJitter(timestamp, arrivalUs);
+
+    uint32_t sequence = extendSequence(sequence16);
+    if (!mHasSequence) {
+        mHasSequence = true;
+        mNextSequence = sequence;
+        mHighestSequence = sequence;
+    }
+    int64_t offset = static_cast<int32_t>(sequence - mNextSequence);
+    int64_t ringSize = mSlots.size();
+    if (offset < 0 && offset >= -ringSize) {
+        // Already released, or declared lost.
+        mLatePackets++;
+        return;
+    }
+    if (offset < 0 || offset >= ringSize) {
+        // The sequence jumped, e.g. after the sender restarted. Restart from this packet.
+        ALOGV("[IptvJitterBuffer] sequence jump from %" PRIu32 " to %" PRIu32, mNextSequence,
+              sequence);
+        release(arrivalUs, true /* releaseAll */);
+        mNextSequence = sequence;
+        mHighestSequence = sequence;
+    }
+    if (static_cast<int32_t>(sequence - mHighestSequence) > 0) {
+        mHighestSequence = sequence;
+    } else if (sequence != mHighestSequence) {
+        mReorderedPackets++;
+    }
+
+    Slot& slot = getSlot(sequence);
+    if (slot.isUsed) {
+        mDuplicatePackets++;
+        return;
+    }
+    slot.isUsed = true;
+    slot.sequence = sequence;
+    slot.arrivalUs = arrivalUs;
+    slot.payload.assign(payload, payload + payloadSize);
+    mHeldPackets++;
+
+    release(arrivalUs, false /* releaseAll */);
+}
+
+void IptvJitterBuffer::flush() {
+    release(0 /* nowUs */, true /* releaseAll */);
+}
+
+bool IptvJitterBuffer::pop(std::vector<int8_t>* chunk, size_t maxSize, int64_t nowUs) {
+    release(nowUs, false /* releaseAll */);
+
+    size_t available = mOutput.size() - mOutputStart;
+    size_t size = std::min(available, maxSize);
+    if (size < available) {
+        size -= size % kTsPacketSize;
+    }
+    chunk->clear();
+    if (size == 0) {
+        return false;
+    }
+    const uint8_t* start = mOutput.data() + mOutputStart;
+    chunk->insert(chunk->end(), start, start + size);
+    mOutputStart += size;
+    if (mOutputStart == mOutput.size()) {
+        // Keep the capacity for the next packets.
+        mOutput.clear();
+        mOutputStart = 0;
+    }
+    return true;
+}
+
+void IptvJitterBuffer::release(int64_t nowUs, bool releaseAll) {
+    while (mHeldPackets > 0) {
+        Slot& slot = getSlot(mNextSequence);
+        if (slot.isUsed && slot.sequence == mNextSequence) {
+            appendOutput(slot.payload.data(), slot.payload.size());
+            slot.isUsed = false;
+            mHeldPackets--;
+            mNextSequence++;
+            continue;
+        }
+
+        // mNextSequence is missing. Wait for it unless the buffer is full, or the first packet
+        // after it waited too long.
+        uint32_t sequence = mNextSequence + 1;
+        while (!getSlot(sequence).isUsed) {
+            sequence++;
+        }
+        if (!releaseAll && mHeldPackets < mDepth &&
+            nowUs - getSlot(sequence).arrivalUs < mMaxDelayUs) {
+            break;
+        }
+        ALOGV("[IptvJitterBuffer] lost %" PRIu32 " packets from %" PRIu32,
+              sequence - mNextSequence, mNextSequence);
+        mLostPackets += sequence - mNextSequence;
+        mNextSequence = sequence;
+    }
+}
+
+void IptvJitterBuffer::appendOutput(const uint8_t* data, size_t size) {
+    if (mOutputStart > 0 && mOutputStart >= mOutput.size() / 2) {
+        // Drop the bytes already sent, so that the buffer does not grow.
+        mOutput.erase(mOutput.begin(), mOutput.begin() + mOutputStart);
+        mOutputStart = 0;
+    }
+    mOutput.insert(mOutput.end(), data, data + size);
+}
+
+bool IptvJitterBuffer::parseRtp(const uint8_t* data, size_t size, uint16_t* sequence,
+                                uint32_t* timestamp, const uint8_t** payload,
+                                size_t* payloadSize) {
+    if (size < kRtpHeaderSize || (data[0] >> 6) != kRtpVersion) {
+        return false;
+    }
+    bool hasPadding = data[0] & 0x20;
+    bool hasExtension = data[0] & 0x10;
+    size_t csrcCount = data[0] & 0x0f;
+    *sequence = (data[2] << 8) | data[3];
+    *timestamp = (static_cast<uint32_t>(data[4]) << 24) | (static_cast<uint32_t>(data[5]) << 16) |
+                 (static_cast<uint32_t>(data[6]) << 8) | data[7];
+
+    size_t headerSize = kRtpHeaderSize + csrcCount * 4;
+    if (hasExtension) {
+        if (headerSize + 4 > size) {
+            return false;
+        }
+        headerSize += 4 + ((data[headerSize + 2] << 8) | data[headerSize + 3]) * 4;
+    }
+    if (hasPadding) {
+        size_t padding = data[size - 1];
+        if (padding > size) {
+            return false;
+        }
+        size -= padding;
+    }
+    if (headerSize > size) {
+        return false;
+    }
+    *payload = data + headerSize;
+    *payloadSize = size - headerSize;
+    return true;
+}
+
+void IptvJitterBuffer::updateJitter(uint32_t timestamp, int64_t arrivalUs) {
+    // Section 6.4.1 and appendix A.8 of RFC 3550, with the arrival time converted to the RTP
+    // clock.
+    uint32_t transit = static_cast<uint32_t>(arrivalUs * kRtpClockRate / 1000000) - timestamp;
+    if (mHasTransit) {
+        int64_t delta = std::abs(static_cast<int32_t>(transit - mLastTransit));
+        mScaledJitter += delta - ((mScaledJitter + 8) >> 4);
+        mJitterUs = (mScaledJitter >> 4) * 1000000 / kRtpClockRate;
+    }
+    mHasTransit = true;
+    mLastTransit = transit;
+}
+
+uint32_t IptvJitterBuffer::extendSequence(uint16_t sequence) const {
+    if (!mHasSequence) {
+        return sequence;
+    }
+    int16_t delta = static_cast<int16_t>(sequence - static_cast<uint16_t>(mHighestSequence));
+    return mHighestSequence + delta;
+}
+
+void IptvJitterBuffer::dump(int fd) const {
+    dprintf(fd, "    IptvJitterBuffer:\n");
+    dprintf(fd, "      depth: %zu packets, max delay: %" PRId64 " us\n", mDepth, mMaxDelayUs);
+    dprintf(fd, "      received RTP packets: %" PRIu64 "\n", mReceivedPackets.load());
+    dprintf(fd, "      lost: %" PRIu64 "\n", mLostPackets.load());
+    dprintf(fd, "      reordered: %" PRIu64 "\n", mReorderedPackets.load());
+    dprintf(fd, "      late: %" PRIu64 "\n", mLatePackets.load());
+    dprintf(fd, "      duplicates: %" PRIu64 "\n", mDuplicatePackets.load());
+    dprintf(fd, "      jitter: %" PRId64 " us\n", mJitterUs.load());
+    dprintf(fd, "      TS bytes without RTP: %" PRIu64 "\n", mUnencapsulatedBytes.load());
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+/**
+ * Reorders the datagrams of an IPTV stream before they are sent to the demux.
+ *
+ * Each datagram is either an RTP packet carrying TS packets (RFC 2250), or TS packets without
+ * encapsulation, which are passed through as is. RTP packets are held in a ring indexed by their
+ * sequence number and released in sequence order. A missing packet is declared lost once depth
+ * packets are held after it, or once the packet after it has waited for the maximum delay.
+ *
+ * The counters can be read from any thread; the other methods must be called from one thread.
+ */
+class IptvJitterBuffer {
+  public:
+    /**
+     * @param depth The number of RTP packets held at most while waiting for a missing one.
+     * @param maxDelayUs How long a packet may wait for the missing packets before it.
+     */
+    IptvJitterBuffer(size_t depth, int64_t maxDelayUs);
+
+    //! Drops all the held data and restarts the sequence, for a new stream.
+    void reset();
+
+    /**
+     * Adds a datagram read from the stream.
+     *
+     * @param arrivalUs The arrival time of the datagram, in microseconds of a monotonic clock.
+     */
+    void push(const uint8_t* data, size_t size, int64_t arrivalUs);
+
+    /**
+     * Releases all the held packets, declaring the missing ones lost, so that pop() returns all
+     * the data received. For the end of the stream, or when the playback stops.
+     */
+    void flush();
+
+    /**
+     * Moves the TS data that is ready for the demux to chunk, in whole TS packets.
+     *
+     * @param maxSize The largest chunk to return, at least one TS packet.
+     * @param nowUs The current time, to release the packets that waited for the maximum delay.
+     * @return false if no data is ready.
+     */
+    bool pop(std::vector<int8_t>* chunk, size_t maxSize, int64_t nowUs);
+
+    void dump(int fd) const;
+
+    uint64_t getReceivedPackets() const { return mReceivedPackets; }
+    uint64_t getLostPackets() const { return mLostPackets; }
+    uint64_t getReorderedPackets() const { return mReorderedPackets; }
+    uint64_t getLatePackets() const { return mLatePackets; }
+    uint64_t getDuplicatePackets() const { return mDuplicatePackets; }
+    //! The interarrival jitter of RFC 3550, in microseconds.
+    int64_t getJitterUs() const { return mJitterUs; }
+
+  private:
+    struct Slot {
+        bool isUsed = false;
+        uint32_t sequence = 0;
+        int64_t arrivalUs = 0;
+        std::vector<uint8_t> payload;
+    };
+
+    bool parseRtp(const uint8_t* data, size_t size, uint16_t* sequence, uint32_t* timestamp,
+                  const uint8_t** payload, size_t* payloadSize);
+    void updateJitter(uint32_t timestamp, int64_t arrivalUs);
+    // Extends a 16-bit sequence number to the 32-bit sequence closest to the highest one.
+    uint32_t extendSequence(uint16_t sequence) const;
+    void release(int64_t nowUs, bool releaseAll);
+    void appendOutput(const uint8_t* data, size_t size);
+    Slot& getSlot(uint32_t sequence) { return mSlots[sequence & (mSlots.size() - 1)]; }
+
+    const size_t mDepth;
+    const int64_t mMaxDelayUs;
+    std::vector<Slot> mSlots;
+    size_t mHeldPackets = 0;
+    bool mHasSequence = false;
+    // The sequence of the next packet to release, and the highest one received.
+    uint32_t mNextSequence = 0;
+    uint32_t mHighestSequence = 0;
+
+    // TS data in sequence order, not sent to the demux yet.
+    std::vector<uint8_t> mOutput;
+    size_t mOutputStart = 0;
+
+    bool mHasTransit = false;
+    uint32_t mLastTransit = 0;
+    // The jitter in units of the RTP clock, times 16.
+    int64_t mScaledJitter = 0;
+
+    std::atomic<uint64_t> mReceivedPackets = 0;
+    std::atomic<uint64_t> mLostPackets = 0;
+    std::atomic<uint64_t> mReorderedPackets = 0;
+    std::atomic<uint64_t> mLatePackets = 0;
+    std::atomic<uint64_t> mDuplicatePackets = 0;
+    std::atomic<uint64_t> mUnencapsulatedBytes = 0;
+    std::atomic<int64_t> mJitterUs = 0;
+};
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,484 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "android.hardware.tv.tuner-service.example-RecordIndexer"
+
+#include <aidl/android/hardware/tv/tuner/DemuxScAvcIndex.h>
+#include <aidl/android/hardware/tv/tuner/DemuxScHevcIndex.h>
+#include <aidl/android/hardware/tv/tuner/DemuxScIndex.h>
+#include <aidl/android/hardware/tv/tuner/DemuxScVvcIndex.h>
+#include <aidl/android/hardware/tv/tuner/DemuxTsIndex.h>
+#include <utils/Log.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "RecordIndexer.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+namespace {
+
+constexpr size_t kTsPacketSize = 188;
+
+template <typename T>
+uint32_t bit(T index) {
+    return static_cast<uint32_t>(index);
+}
+
+// Reads the Exp-Golomb codes of ITU-T H.264 Section 9.1.
+class BitReader {
+  public:
+    BitReader(const uint8_t* data, size_t size) : mData(data), mSizeBits(size * 8) {}
+
+    bool readUe(uint32_t* value) {
+        int leadingZeros = 0;
+        uint32_t b;
+        while (readBit(&b) && b == 0) {
+            if (++leadingZeros > 31) {
+                return false;
+            }
+        }
+        if (mPos > mSizeBits) {
+            return false;
+        }
+        uint32_t suffix = 0;
+        for (int i = 0; i < leadingZeros; i++) {
+            if (!readBit(&b)) {
+                return false;
+            }
+            suffix = (suffix << 1) | b;
+        }
+        *value = (1u << leadingZeros) - 1 + suffix;
+        return true;
+    }
+
+  private:
+    bool readBit(uint32_t* b) {
+        if (mPos >= mSizeBits) {
+            mPos = mSizeBits + 1;
+            return false;
+        }
+        *b = (mData[mPos / 8] >> (7 - mPos % 8)) & 1;
+        mPos++;
+        return true;
+    }
+
+    const uint8_t* mData;
+    size_t mSizeBits;
+    size_t mPos = 0;
+};
+
+// Whether a PES packet with stream_id has the optional PES header, as in ISO/IEC 13818-1
+// Section 2.4.3.6.
+bool hasOptionalPesHeader(uint8_t streamId) {
+    switch (streamId) {
+        case 0xbc:  // program_stream_map
+        case 0xbe:  // padding_stream
+        case 0xbf:  // private_stream_2
+        case 0xf0:  // ECM_stream
+        case 0xf1:  // EMM_stream
+        case 0xf2:  // DSMCC_stream
+        case 0xf8:  // ITU-T Rec. H.222.1 type E stream
+        case 0xff:  // program_stream_directory
+            return false;
+        default:
+            return true;
+    }
+}
+
+}  // namespace
+
+void RecordIndexer::configure(uint16_t pid, const DemuxFilterRecordSettings& settings) {
+    mPid = pid;
+    mTsIndexMask = settings.tsIndexMask;
+    mScIndexType = settings.scIndexType;
+    switch (settings.scIndexMask.getTag()) {
+        case DemuxFilterScIndexMask::Tag::scIndex:
+            mScIndexMask = settings.scIndexMask.get<DemuxFilterScIndexMask::Tag::scIndex>();
+            break;
+        case DemuxFilterScIndexMask::Tag::scAvc:
+            mScIndexMask = settings.scIndexMask.get<DemuxFilterScIndexMask::Tag::scAvc>();
+            break;
+        case DemuxFilterScIndexMask::Tag::scHevc:
+            mScIndexMask = settings.scIndexMask.get<DemuxFilterScIndexMask::Tag::scHevc>();
+            break;
+        case DemuxFilterScIndexMask::Tag::scVvc:
+            mScIndexMask = settings.scIndexMask.get<DemuxFilterScIndexMask::Tag::scVvc>();
+            break;
+    }
+    reset();
+}
+
+void RecordIndexer::reset() {
+    mByteNumber = 0;
+    mSeenFirstPacket = false;
+    mScramblingControl = 0;
+    mPts = 0;
+    mPesHeaderLeft = 0;
+    mPrevBytes = {0xff, 0xff};
+    mPrevByteNumber = 0;
+    mHasPendingStartCode = false;
+    mPendingHeaderSize = 0;
+}
+
+void RecordIndexer::index(const int8_t* data, size_t size, std::vector<DemuxFilterEvent>* events) {
+    if (mTsIndexMask == 0 && (mScIndexType == DemuxRecordScIndexType::NONE || mScIndexMask == 0)) {
+        mByteNumber += size;
+        return;
+    }
+
+    const uint8_t* packets = reinterpret_cast<const uint8_t*>(data);
+    for (size_t offset = 0; offset + kTsPacketSize <= size; offset += kTsPacketSize) {
+        const uint8_t* packet = packets + offset;
+        uint16_t pid = ((packet[1] & 0x1f) << 8) | packet[2];
+        if (pid == mPid) {
+            indexPacket(packet, mByteNumber + offset, events);
+        }
+    }
+    mByteNumber += size;
+}
+
+void RecordIndexer::indexPacket(const uint8_t* packet, int64_t byteNumber,
+                                std::vector<DemuxFilterEvent>* events) {
+    mPacketByteNumber = byteNumber;
+    mPacketTsIndexes = getTsIndexes(packet) & mTsIndexMask;
+    mPacketHasEvent = false;
+
+    uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+    size_t offset = 4;
+    if (adaptationFieldControl & 0x2) {
+        offset += 1 + packet[4];
+    }
+    if ((adaptationFieldControl & 0x1) && offset < kTsPacketSize) {
+        const uint8_t* payload = packet + offset;
+        size_t payloadSize = kTsPacketSize - offset;
+
+        size_t headerSize = mPesHeaderLeft;
+        if (packet[1] & 0x40) {
+            // A PES packet starts, as defined in ISO/IEC 13818-1 Section 2.4.3.6.
+            headerSize = 0;
+            if (payloadSize >= 9 && payload[0] == 0 && payload[1] == 0 && payload[2] == 1) {
+                headerSize = 6;
+                if (hasOptionalPesHeader(payload[3])) {
+                    headerSize = 9 + payload[8];
+                    if ((payload[7] & 0x80) && payloadSize >= 14) {
+                        mPts = (static_cast<int64_t>(payload[9] & 0x0e) << 29) |
+                               (payload[10] << 22) | ((payload[11] & 0xfe) << 14) |
+                               (payload[12] << 7) | (payload[13] >> 1);
+                    }
+                }
+            } else {
+                // Not a PES packet, nothing to scan.
+                headerSize = payloadSize;
+            }
+        }
+        size_t skipped = std::min(headerSize, payloadSize);
+        mPesHeaderLeft = headerSize - skipped;
+        if (skipped < payloadSize && mScIndexType != DemuxRecordScIndexType::NONE &&
+            mScIndexMask != 0) {
+            scanEs(payload + skipped, payloadSize - skipped, byteNumber, events);
+        }
+    }
+
+    if (mPacketTsIndexes != 0 && !mPacketHasEvent) {
+        addEvent(byteNumber, 0, 0, events);
+    }
+}
+
+uint32_t RecordIndexer::getTsIndexes(const uint8_t* packet) {
+    uint32_t indexes = 0;
+    if (!mSeenFirstPacket) {
+        indexes |= bit(DemuxTsIndex::FIRST_PACKET);
+        mSeenFirstPacket = true;
+    }
+    if (packet[1] & 0x40) {
+        indexes |= bit(DemuxTsIndex::PAYLOAD_UNIT_START_INDICATOR);
+    }
+    if (packet[1] & 0x20) {
+        indexes |= bit(DemuxTsIndex::PRIORITY_INDICATOR);
+    }
+
+    int scramblingControl = packet[3] >> 6;
+    if (scramblingControl != mScramblingControl) {
+        if (scramblingControl == 0) {
+            indexes |= bit(DemuxTsIndex::CHANGE_TO_NOT_SCRAMBLED);
+        } else if (scramblingControl == 2) {
+            indexes |= bit(DemuxTsIndex::CHANGE_TO_EVEN_SCRAMBLED);
+        } else if (scramblingControl == 3) {
+            indexes |= bit(DemuxTsIndex::CHANGE_TO_ODD_SCRAMBLED);
+        }
+        mScramblingControl = scramblingControl;
+    }
+
+    // Flags of the adaptation field, as defined in ISO/IEC 13818-1 Section 2.4.3.4.
+    if ((packet[3] & 0x20) && packet[4] > 0) {
+        uint8_t flags = packet[5];
+        if (flags & 0x80) {
+            indexes |= bit(DemuxTsIndex::DISCONTINUITY_INDICATOR);
+        }
+        if (flags & 0x40) {
+            indexes |= bit(DemuxTsIndex::RANDOM_ACCESS_INDICATOR);
+        }
+        if (flags & 0x10) {
+            indexes |= bit(DemuxTsIndex::PCR_FLAG);
+        }
+        if (flags & 0x08) {
+            indexes |= bit(DemuxTsIndex::OPCR_FLAG);
+        }
+        if (flags & 0x04) {
+            indexes |= bit(DemuxTsIndex::SPLICING_POINT_FLAG);
+        }
+        if (flags & 0x02) {
+            indexes |= bit(DemuxTsIndex::PRIVATE_DATA);
+        }
+        if (flags & 0x01) {
+            indexes |= bit(DemuxTsIndex::ADAPTATION_EXTENSION_FLAG);
+        }
+    }
+    return indexes;
+}
+
+void RecordIndexer::scanEs(const uint8_t* data, size_t size, int64_t byteNumber,
+                           std::vector<DemuxFilterEvent>* events) {
+    if (mHasPendingStartCode) {
+        size_t count = std::min(size, kHeaderSize - mPendingHeaderSize);
+        memcpy(mPendingHeader.data() + mPendingHeaderSize, data, count);
+        mPendingHeaderSize += count;
+        if (mPendingHeaderSize == kHeaderSize) {
+            flushPendingStartCode(events);
+        }
+    }
+
+    // Start codes beginning in the previous ES bytes.
+    if (mPrevBytes[0] == 0 && mPrevBytes[1] == 0 && data[0] == 1) {
+        onStartCode(data + 1, size - 1, mPrevByteNumber, events);
+    } else if (mPrevBytes[1] == 0 && size >= 2 && data[0] == 0 && data[1] == 1) {
+        onStartCode(data + 2, size - 2, mPrevByteNumber, events);
+    }
+
+    // Look for the 01 of each 00 00 01 with memchr, which is vectorized, and only check the two
+    // preceding bytes of its matches.
+    const uint8_t* end = data + size;
+    const uint8_t* p = data + 2;
+    while (p < end) {
+        p = static_cast<const uint8_t*>(memchr(p, 1, end - p));
+        if (p == nullptr) {
+            break;
+        }
+        if (p[-1] == 0 && p[-2] == 0) {
+            onStartCode(p + 1, end - p - 1, byteNumber, events);
+        }
+        p++;
+    }
+
+    if (size >= 2) {
+        mPrevBytes = {data[size - 2], data[size - 1]};
+    } else {
+        mPrevBytes = {mPrevBytes[1], data[0]};
+    }
+    mPrevByteNumber = byteNumber;
+}
+
+void RecordIndexer::onStartCode(const uint8_t* header, size_t size, int64_t byteNumber,
+                                std::vector<DemuxFilterEvent>* events) {
+    // A start code still pending here starts a unit shorter than kHeaderSize, which is complete.
+    flushPendingStartCode(events);
+    if (size >= kHeaderSize) {
+        classifyStartCode(header, byteNumber, events);
+        return;
+    }
+    mHasPendingStartCode = true;
+    memcpy(mPendingHeader.data(), header, size);
+    mPendingHeaderSize = size;
+    mPendingByteNumber = byteNumber;
+}
+
+void RecordIndexer::flushPendingStartCode(std::vector<DemuxFilterEvent>* events) {
+    if (!mHasPendingStartCode) {
+        return;
+    }
+    mHasPendingStartCode = false;
+    if (mPendingHeaderSize == 0) {
+        return;
+    }
+    std::fill(mPendingHeader.begin() + mPendingHeaderSize, mPendingHeader.end(), 0);
+    classifyStartCode(mPendingHeader.data(), mPendingByteNumber, events);
+}
+
+void RecordIndexer::classifyStartCode(const uint8_t* header, int64_t byteNumber,
+                                      std::vector<DemuxFilterEvent>* events) {
+    uint32_t indexes = 0;
+    int32_t firstMbInSlice = 0;
+    switch (mScIndexType) {
+        case DemuxRecordScIndexType::SC:
+            // Start codes of ISO/IEC 13818-2 Section 6.2
+            if (header[0] == 0xb3) {
+                indexes = bit(DemuxScIndex::SEQUENCE);
+            } else if (header[0] == 0x00) {
+                // picture_coding_type follows the 10 bits of temporal_reference.
+                switch ((header[2] >> 3) & 0x7) {
+                    case 1:
+                        indexes = bit(DemuxScIndex::I_FRAME);
+                        break;
+                    case 2:
+                        indexes = bit(DemuxScIndex::P_FRAME);
+                        break;
+                    case 3:
+                        indexes = bit(DemuxScIndex::B_FRAME);
+                        break;
+                }
+            }
+            break;
+        case DemuxRecordScIndexType::SC_AVC: {
+            // Slices of non-IDR and IDR pictures, ITU-T H.264 Section 7.3.3
+            uint8_t nalUnitType = header[0] & 0x1f;
+            if (nalUnitType != 1 && nalUnitType != 5) {
+                break;
+            }
+            BitReader reader(header + 1, kHeaderSize - 1);
+            uint32_t firstMb;
+            uint32_t sliceType;
+            if (!reader.readUe(&firstMb) || !reader.readUe(&sliceType)) {
+                break;
+            }
+            firstMbInSlice = static_cast<int32_t>(firstMb);
+            switch (sliceType % 5) {
+                case 0:
+                    indexes = bit(DemuxScAvcIndex::P_SLICE);
+                    break;
+                case 1:
+                    indexes = bit(DemuxScAvcIndex::B_SLICE);
+                    break;
+                case 2:
+                    indexes = bit(DemuxScAvcIndex::I_SLICE);
+                    break;
+                case 3:
+                    indexes = bit(DemuxScAvcIndex::SP_SLICE);
+                    break;
+                case 4:
+                    indexes = bit(DemuxScAvcIndex::SI_SLICE);
+                    break;
+            }
+            break;
+        }
+        case DemuxRecordScIndexType::SC_HEVC:
+            // NAL unit types of ITU-T H.265 Table 7-1
+            switch ((header[0] >> 1) & 0x3f) {
+                case 0:   // TRAIL_N
+                case 1:   // TRAIL_R
+                case 21:  // CRA_NUT
+                    indexes = bit(DemuxScHevcIndex::SLICE_TRAIL_CRA);
+                    break;
+                case 16:
+                    indexes = bit(DemuxScHevcIndex::SLICE_CE_BLA_W_LP);
+                    break;
+                case 17:
+                    indexes = bit(DemuxScHevcIndex::SLICE_BLA_W_RADL);
+                    break;
+                case 18:
+                    indexes = bit(DemuxScHevcIndex::SLICE_BLA_N_LP);
+                    break;
+                case 19:
+                    indexes = bit(DemuxScHevcIndex::SLICE_IDR_W_RADL);
+                    break;
+                case 20:
+                    indexes = bit(DemuxScHevcIndex::SLICE_IDR_N_LP);
+                    break;
+                case 33:
+                    indexes = bit(DemuxScHevcIndex::SPS);
+                    break;
+                case 35:
+                    indexes = bit(DemuxScHevcIndex::AUD);
+                    break;
+            }
+            break;
+        case DemuxRecordScIndexType::SC_VVC:
+            // NAL unit types of ITU-T H.266 Table 5
+            switch ((header[1] >> 3) & 0x1f) {
+                case 7:
+                    indexes = bit(DemuxScVvcIndex::SLICE_IDR_W_RADL);
+                    break;
+                case 8:
+                    indexes = bit(DemuxScVvcIndex::SLICE_IDR_N_LP);
+                    break;
+                case 9:
+                    indexes = bit(DemuxScVvcIndex::SLICE_CRA);
+                    break;
+                case 10:
+                    indexes = bit(DemuxScVvcIndex::SLICE_GDR);
+                    break;
+                case 14:
+                    indexes = bit(DemuxScVvcIndex::VPS);
+                    break;
+                case 15:
+                    indexes = bit(DemuxScVvcIndex::SPS);
+                    break;
+                case 20:
+                    indexes = bit(DemuxScVvcIndex::AUD);
+                    break;
+            }
+            break;
+        default:
+            break;
+    }
+
+    indexes &= mScIndexMask;
+    if (indexes != 0) {
+        addEvent(byteNumber, indexes, firstMbInSlice, events);
+    }
+}
+
+void RecordIndexer::addEvent(int64_t byteNumber, uint32_t scIndexes, int32_t firstMbInSlice,
+                             std::vector<DemuxFilterEvent>* events) {
+    DemuxFilterTsRecordEvent recordEvent;
+    recordEvent.pid.set<DemuxPid::Tag::tPid>(mPid);
+    // The TS indexes of a packet are reported with its first event.
+    if (byteNumber == mPacketByteNumber && !mPacketHasEvent) {
+        recordEvent.tsIndexMask = static_cast<int32_t>(mPacketTsIndexes);
+        mPacketHasEvent = true;
+    }
+    int32_t scIndexMask = static_cast<int32_t>(scIndexes);
+    switch (mScIndexType) {
+        case DemuxRecordScIndexType::SC_AVC:
+            recordEvent.scIndexMask.set<DemuxFilterScIndexMask::Tag::scAvc>(scIndexMask);
+            break;
+        case DemuxRecordScIndexType::SC_HEVC:
+            recordEvent.scIndexMask.set<DemuxFilterScIndexMask::Tag::scHevc>(scIndexMask);
+            break;
+        case DemuxRecordScIndexType::SC_VVC:
+            recordEvent.scIndexMask.set<DemuxFilterScIndexMask::Tag::scVvc>(scIndexMask);
+            break;
+        default:
+            recordEvent.scIndexMask.set<DemuxFilterScIndexMask::Tag::scIndex>(scIndexMask);
+            break;
+    }
+    recordEvent.byteNumber = byteNumber;
+    recordEvent.pts = mPts;
+    recordEvent.firstMbInSlice = firstMbInSlice;
+    events->push_back(DemuxFilterEvent::make<DemuxFilterEvent::Tag::tsRecord>(recordEvent));
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
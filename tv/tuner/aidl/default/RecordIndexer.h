@@ -0,0 +1,110 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/tv/tuner/DemuxFilterEvent.h>
+#include <aidl/android/hardware/tv/tuner/DemuxFilterRecordSettings.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+/**
+ * Builds the index of a TS record filter while its output is recorded.
+ *
+ * The packets of the filter PID are checked for the TS indexes of DemuxTsIndex, and the ES data
+ * of their PES payloads is scanned for start codes, which are classified according to the
+ * DemuxRecordScIndexType of the settings: MPEG-2 video pictures and sequences, or AVC, HEVC or VVC
+ * NAL units. Each indexed packet or start code that matches the masks of the settings produces a
+ * DemuxFilterTsRecordEvent, with the byte number of its TS packet in the filter output.
+ *
+ * Start codes and their headers may span packets and PES packets. RecordIndexer is not thread
+ * safe.
+ */
+class RecordIndexer {
+  public:
+    void configure(uint16_t pid, const DemuxFilterRecordSettings& settings);
+
+    /**
+     * Restarts the byte numbers and the scan state, for a restarted filter.
+     */
+    void reset();
+
+    /**
+     * Indexes the next bytes of the filter output, which holds TS packets of any PID.
+     *
+     * @param events The events for the indexed packets and start codes are appended to it.
+     */
+    void index(const int8_t* data, size_t size, std::vector<DemuxFilterEvent>* events);
+
+  private:
+    // The bytes following 00 00 01 needed to classify a start code: the start code value or NAL
+    // unit header, then first_mb_in_slice and slice_type of AVC slices.
+    static constexpr size_t kHeaderSize = 9;
+
+    void indexPacket(const uint8_t* packet, int64_t byteNumber,
+                     std::vector<DemuxFilterEvent>* events);
+    uint32_t getTsIndexes(const uint8_t* packet);
+    void scanEs(const uint8_t* data, size_t size, int64_t byteNumber,
+                std::vector<DemuxFilterEvent>* events);
+    void onStartCode(const uint8_t* header, size_t size, int64_t byteNumber,
+                     std::vector<DemuxFilterEvent>* events);
+    void flushPendingStartCode(std::vector<DemuxFilterEvent>* events);
+    void classifyStartCode(const uint8_t* header, int64_t byteNumber,
+                           std::vector<DemuxFilterEvent>* events);
+    void addEvent(int64_t byteNumber, uint32_t scIndexes, int32_t firstMbInSlice,
+                  std::vector<DemuxFilterEvent>* events);
+
+    uint16_t mPid = 0xffff;
+    int32_t mTsIndexMask = 0;
+    DemuxRecordScIndexType mScIndexType = DemuxRecordScIndexType::NONE;
+    int32_t mScIndexMask = 0;
+
+    // Number of filter output bytes indexed so far.
+    int64_t mByteNumber = 0;
+    bool mSeenFirstPacket = false;
+    int mScramblingControl = 0;
+    int64_t mPts = 0;
+    // Remaining bytes of a PES header continuing in the next packet.
+    size_t mPesHeaderLeft = 0;
+    // TS indexes of the current packet, reported with its first event.
+    int64_t mPacketByteNumber = 0;
+    uint32_t mPacketTsIndexes = 0;
+    bool mPacketHasEvent = false;
+
+    // The last ES bytes, to find start codes spanning packets.
+    std::array<uint8_t, 2> mPrevBytes = {0xff, 0xff};
+    int64_t mPrevByteNumber = 0;
+    // A start code whose header continues in the next packet.
+    bool mHasPendingStartCode = false;
+    std::array<uint8_t, kHeaderSize> mPendingHeader;
+    size_t mPendingHeaderSize = 0;
+    int64_t mPendingByteNumber = 0;
+};
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,329 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "android.hardware.tv.tuner-service.example-SectionFilter"
+
+#include <aidl/android/hardware/tv/tuner/Constant.h>
+#include <utils/Log.h>
+
+#include <algorithm>
+#include <array>
+
+#include "SectionFilter.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+namespace {
+
+constexpr uint8_t kTsSyncByte = 0x47;
+constexpr size_t kTsHeaderSize = 4;
+// A table_id of 0xFF is stuffing up to the end of the packet.
+constexpr uint8_t kStuffingTableId = 0xff;
+constexpr size_t kSectionHeaderSize = 3;
+constexpr size_t kCrcSize = 4;
+
+// Lookup tables for the MSB-first CRC32 with polynomial 0x04C11DB7. Table k gives the CRC of a
+// byte followed by k zero bytes.
+using CrcTables = std::array<std::array<uint32_t, 256>, 8>;
+
+CrcTables makeCrcTables() {
+    CrcTables tables;
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+        }
+        tables[0][i] = crc;
+    }
+    for (size_t k = 1; k < tables.size(); k++) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = tables[k - 1][i];
+            tables[k][i] = (crc << 8) ^ tables[0][crc >> 24];
+        }
+    }
+    return tables;
+}
+
+size_t getSectionSize(const uint8_t* header) {
+    return kSectionHeaderSize + (((header[1] & 0x0f) << 8) | header[2]);
+}
+
+}  // namespace
+
+uint32_t sectionCrc32(const uint8_t* data, size_t size) {
+    static const CrcTables kTables = makeCrcTables();
+
+    uint32_t crc = 0xffffffff;
+    while (size >= 8) {
+        crc ^= (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+               (static_cast<uint32_t>(data[2]) << 8) | data[3];
+        crc = kTables[7][crc >> 24] ^ kTables[6][(crc >> 16) & 0xff] ^
+              kTables[5][(crc >> 8) & 0xff] ^ kTables[4][crc & 0xff] ^ kTables[3][data[4]] ^
+              kTables[2][data[5]] ^ kTables[1][data[6]] ^ kTables[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = (crc << 8) ^ kTables[0][(crc >> 24) ^ *data++];
+    }
+    return crc;
+}
+
+void SectionFilter::configure(const DemuxFilterSectionSettings& settings) {
+    mSettings = settings;
+    mMatchBytes.clear();
+    mHasNegativeMatch = false;
+    if (settings.condition.getTag() == DemuxFilterSectionSettingsCondition::Tag::sectionBits) {
+        // As with hardware demuxes, the first filter byte applies to table_id and the following
+        // ones to the bytes after section_length.
+        const auto& bits =
+                settings.condition.get<DemuxFilterSectionSettingsCondition::Tag::sectionBits>();
+        size_t size = std::min(bits.filter.size(), bits.mask.size());
+        for (size_t i = 0; i < size; i++) {
+            uint8_t mask = bits.mask[i];
+            if (mask == 0) {
+                continue;
+            }
+            uint8_t mode = i < bits.mode.size() ? bits.mode[i] : 0;
+            mMatchBytes.push_back({
+                    .offset = static_cast<uint32_t>(i == 0 ? 0 : i + 2),
+                    .filter = static_cast<uint8_t>(bits.filter[i]),
+                    .mask = mask,
+                    .mode = mode,
+            });
+            mHasNegativeMatch |= (mask & mode) != 0;
+        }
+    }
+    reset();
+}
+
+void SectionFilter::reset() {
+    mPartialSection.clear();
+    mHasPartialSection = false;
+    mLastContinuityCounter = -1;
+    mDone = false;
+    mDeliveredVersion = -1;
+    mDeliveredSections.reset();
+}
+
+bool SectionFilter::processPacket(const uint8_t* packet, size_t size,
+                                  const SectionCallback& onSection) {
+    if (size < kTsHeaderSize || packet[0] != kTsSyncByte) {
+        return true;
+    }
+    if (packet[1] & 0x80) {
+        // transport_error_indicator
+        mHasPartialSection = false;
+        return true;
+    }
+    bool payloadUnitStart = packet[1] & 0x40;
+    uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+    int continuityCounter = packet[3] & 0x0f;
+    if (!(adaptationFieldControl & 0x1)) {
+        // No payload, and the continuity counter does not increment.
+        return true;
+    }
+
+    if (mLastContinuityCounter == continuityCounter) {
+        // Duplicate packet.
+        return true;
+    }
+    if (mLastContinuityCounter >= 0 &&
+        continuityCounter != ((mLastContinuityCounter + 1) & 0x0f)) {
+        ALOGV("[SectionFilter] continuity counter discontinuity");
+        mHasPartialSection = false;
+    }
+    mLastContinuityCounter = continuityCounter;
+
+    size_t offset = kTsHeaderSize;
+    if (adaptationFieldControl & 0x2) {
+        if (size <= kTsHeaderSize) {
+            // Truncated before adaptation_field_length.
+            return true;
+        }
+        offset += 1 + packet[kTsHeaderSize];
+    }
+    if (offset >= size) {
+        return true;
+    }
+    const uint8_t* payload = packet + offset;
+    size_t payloadSize = size - offset;
+
+    if (!payloadUnitStart) {
+        if (!mHasPartialSection) {
+            return true;
+        }
+        // A new section only starts in a packet with payload_unit_start_indicator set, so any
+        // bytes after the end of the partial section are stuffing.
+        appendToPartialSection(payload, payloadSize);
+        if (isPartialSectionComplete()) {
+            mHasPartialSection = false;
+            return deliverSection(mPartialSection.data(), mPartialSection.size(), onSection);
+        }
+        return true;
+    }
+
+    // pointer_field gives the number of bytes of the previous section before the first new one.
+    size_t pointer = payload[0];
+    payload++;
+    payloadSize--;
+    if (pointer > payloadSize) {
+        mHasPartialSection = false;
+        return true;
+    }
+    if (mHasPartialSection) {
+        appendToPartialSection(payload, pointer);
+        bool complete = isPartialSectionComplete();
+        mHasPartialSection = false;
+        if (complete && !deliverSection(mPartialSection.data(), mPartialSection.size(),
+                                        onSection)) {
+            return false;
+        }
+    }
+    payload += pointer;
+    payloadSize -= pointer;
+
+    while (payloadSize > 0 && payload[0] != kStuffingTableId) {
+        if (payloadSize < kSectionHeaderSize || getSectionSize(payload) > payloadSize) {
+            // The section continues in the next packet.
+            mPartialSection.clear();
+            mHasPartialSection = true;
+            appendToPartialSection(payload, payloadSize);
+            break;
+        }
+        size_t sectionSize = getSectionSize(payload);
+        if (!deliverSection(payload, sectionSize, onSection)) {
+            return false;
+        }
+        payload += sectionSize;
+        payloadSize -= sectionSize;
+    }
+    return true;
+}
+
+void SectionFilter::appendToPartialSection(const uint8_t* data, size_t size) {
+    if (mPartialSection.size() < kSectionHeaderSize) {
+        size_t count = std::min(size, kSectionHeaderSize - mPartialSection.size());
+        mPartialSection.insert(mPartialSection.end(), data, data + count);
+        data += count;
+        size -= count;
+        if (mPartialSection.size() < kSectionHeaderSize) {
+            return;
+        }
+    }
+    size_t sectionSize = getSectionSize(mPartialSection.data());
+    if (sectionSize > kMaxSectionSize) {
+        ALOGV("[SectionFilter] invalid section size %zu", sectionSize);
+        mHasPartialSection = false;
+        return;
+    }
+    size_t count = std::min(size, sectionSize - mPartialSection.size());
+    mPartialSection.insert(mPartialSection.end(), data, data + count);
+}
+
+bool SectionFilter::isPartialSectionComplete() const {
+    return mHasPartialSection && mPartialSection.size() >= kSectionHeaderSize &&
+           mPartialSection.size() == getSectionSize(mPartialSection.data());
+}
+
+bool SectionFilter::deliverSection(const uint8_t* section, size_t size,
+                                   const SectionCallback& onSection) {
+    if (mDone) {
+        return true;
+    }
+    bool longHeader = hasLongHeader(section);
+    if (longHeader && size < kLongHeaderSize + kCrcSize) {
+        return true;
+    }
+    if (mSettings.isCheckCrc && longHeader && sectionCrc32(section, size) != 0) {
+        ALOGV("[SectionFilter] CRC error in section with table_id %d", getTableId(section));
+        return true;
+    }
+    if (!matches(section, size)) {
+        return true;
+    }
+
+    if (mSettings.isRepeat) {
+        return onSection(section, size);
+    }
+    // The delivery state only changes once the callback accepted the section, so that a section
+    // rejected for lack of room is delivered again when it is repeated in the stream.
+    if (mSettings.condition.getTag() == DemuxFilterSectionSettingsCondition::Tag::sectionBits ||
+        !longHeader) {
+        // Only the first matching section is delivered.
+        if (!onSection(section, size)) {
+            return false;
+        }
+        mDone = true;
+        return true;
+    }
+    // Every section of the table is delivered once. The collection restarts if the table version
+    // changes before it is complete.
+    int32_t version = getVersion(section);
+    if (version != mDeliveredVersion) {
+        mDeliveredVersion = version;
+        mDeliveredSections.reset();
+    }
+    int32_t sectionNumber = getSectionNumber(section);
+    if (mDeliveredSections.test(sectionNumber)) {
+        return true;
+    }
+    if (!onSection(section, size)) {
+        return false;
+    }
+    mDeliveredSections.set(sectionNumber);
+    // last_section_number
+    mDone = mDeliveredSections.count() == section[7] + 1u;
+    return true;
+}
+
+bool SectionFilter::matches(const uint8_t* section, size_t size) const {
+    if (mSettings.condition.getTag() == DemuxFilterSectionSettingsCondition::Tag::tableInfo) {
+        const auto& tableInfo =
+                mSettings.condition.get<DemuxFilterSectionSettingsCondition::Tag::tableInfo>();
+        if (getTableId(section) != tableInfo.tableId) {
+            return false;
+        }
+        return tableInfo.version == static_cast<int32_t>(Constant::INVALID_TABINFO_VERSION) ||
+               getVersion(section) == tableInfo.version;
+    }
+
+    // Bits with mode 0 must equal the filter. If any bit has mode 1, at least one of those must
+    // differ from the filter.
+    bool negativeMatch = false;
+    for (const MatchByte& matchByte : mMatchBytes) {
+        if (matchByte.offset >= size) {
+            return false;
+        }
+        uint8_t diff = (section[matchByte.offset] ^ matchByte.filter) & matchByte.mask;
+        if (diff & ~matchByte.mode) {
+            return false;
+        }
+        negativeMatch |= (diff & matchByte.mode) != 0;
+    }
+    return !mHasNegativeMatch || negativeMatch;
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
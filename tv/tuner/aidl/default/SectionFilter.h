@@ -0,0 +1,117 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/tv/tuner/DemuxFilterSectionSettings.h>
+
+#include <bitset>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+/**
+ * Computes the CRC32 of PSI sections as defined in ISO/IEC 13818-1 Annex A, eight bytes at a
+ * time with sliced lookup tables. The CRC of a whole section including its CRC_32 field is 0.
+ */
+uint32_t sectionCrc32(const uint8_t* data, size_t size);
+
+/**
+ * Assembles the PSI/SI sections carried in the TS packets of one PID, as defined in ISO/IEC
+ * 13818-1 Section 2.4.4, and filters them according to DemuxFilterSectionSettings.
+ *
+ * Adaptation fields, pointer_field, several sections in one packet, stuffing and continuity
+ * counter discontinuities are handled. Sections held within a single packet are passed to the
+ * callback in place; only sections spanning packets are copied.
+ *
+ * SectionFilter is not thread safe.
+ */
+class SectionFilter {
+  public:
+    /**
+     * Called with each complete section that passes the filter. Returns false to stop processing
+     * the current packet.
+     */
+    using SectionCallback = std::function<bool(const uint8_t* section, size_t size)>;
+
+    void configure(const DemuxFilterSectionSettings& settings);
+
+    /**
+     * Drops any partially assembled section and restarts delivery of non-repeating filters.
+     */
+    void reset();
+
+    /**
+     * Processes one TS packet of the filter PID.
+     *
+     * @return false if the callback returned false.
+     */
+    bool processPacket(const uint8_t* packet, size_t size, const SectionCallback& onSection);
+
+    static uint8_t getTableId(const uint8_t* section) { return section[0]; }
+    static bool hasLongHeader(const uint8_t* section) { return section[1] & 0x80; }
+    static int32_t getVersion(const uint8_t* section) {
+        return hasLongHeader(section) ? (section[5] >> 1) & 0x1f : 0;
+    }
+    static int32_t getSectionNumber(const uint8_t* section) {
+        return hasLongHeader(section) ? section[6] : 0;
+    }
+
+  private:
+    // Header bytes up to and including last_section_number.
+    static constexpr size_t kLongHeaderSize = 8;
+    // 3 header bytes followed by a section_length of at most 4093 bytes.
+    static constexpr size_t kMaxSectionSize = 4096;
+
+    struct MatchByte {
+        // Offset of the byte in the section.
+        uint32_t offset;
+        uint8_t filter;
+        uint8_t mask;
+        uint8_t mode;
+    };
+
+    void appendToPartialSection(const uint8_t* data, size_t size);
+    bool isPartialSectionComplete() const;
+    bool deliverSection(const uint8_t* section, size_t size, const SectionCallback& onSection);
+    bool matches(const uint8_t* section, size_t size) const;
+
+    DemuxFilterSectionSettings mSettings;
+    std::vector<MatchByte> mMatchBytes;
+    bool mHasNegativeMatch = false;
+
+    // The section currently spanning packets, if any.
+    std::vector<uint8_t> mPartialSection;
+    bool mHasPartialSection = false;
+    int mLastContinuityCounter = -1;
+
+    // Delivery state of non-repeating filters.
+    bool mDone = false;
+    int32_t mDeliveredVersion = -1;
+    std::bitset<256> mDeliveredSections;
+};
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "android.hardware.tv.tuner-service.example-TsDemux"
+
+#include <utils/Log.h>
+
+#include "TsDemux.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+TsDemux::TsDemux() {
+    mPidToEntry.fill(kNoEntry);
+}
+
+void TsDemux::setFilters(const std::vector<std::shared_ptr<Sink>>& filters) {
+    std::array<int16_t, kNumPids> pidToEntry;
+    pidToEntry.fill(kNoEntry);
+    std::vector<PidEntry> entries;
+    for (const auto& filter : filters) {
+        uint16_t pid = filter->getTpid();
+        if (pid >= kNumPids) {
+            // Not configured with a TS pid yet.
+            continue;
+        }
+        if (pidToEntry[pid] == kNoEntry) {
+            pidToEntry[pid] = static_cast<int16_t>(entries.size());
+            entries.emplace_back();
+        }
+        entries[pidToEntry[pid]].filters.push_back(filter);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mPidToEntry = pidToEntry;
+        mEntries.swap(entries);
+    }
+    // The previous entries are released outside of the lock, as releasing the last reference to a
+    // filter closes it, which removes it from the demux and so calls back into setFilters.
+}
+
+void TsDemux::demux(const int8_t* data, size_t size, size_t packetSize) {
+    if (packetSize < 3) {
+        ALOGE("[TsDemux] invalid packet size %zu", packetSize);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mEntries.empty()) {
+        return;
+    }
+
+    for (size_t offset = 0; offset + packetSize <= size; offset += packetSize) {
+        uint16_t pid = ((data[offset + 1] & 0x1f) << 8) | (data[offset + 2] & 0xff);
+        int16_t index = mPidToEntry[pid];
+        if (index == kNoEntry) {
+            continue;
+        }
+        std::vector<uint32_t>& packetOffsets = mEntries[index].packetOffsets;
+        if (packetOffsets.empty()) {
+            mTouchedEntries.push_back(index);
+        }
+        packetOffsets.push_back(static_cast<uint32_t>(offset));
+    }
+
+    for (int16_t index : mTouchedEntries) {
+        PidEntry& entry = mEntries[index];
+        for (const auto& filter : entry.filters) {
+            filter->updateFilterOutput(data, entry.packetOffsets, packetSize);
+        }
+        entry.packetOffsets.clear();
+    }
+    mTouchedEntries.clear();
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
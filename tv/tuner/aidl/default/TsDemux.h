@@ -0,0 +1,94 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+/**
+ * The software TS demultiplexer used for broadcast input.
+ *
+ * Filters are looked up by PID in a table with one entry per possible PID. Input is handled in
+ * bulk: the packets of a buffer are first grouped by PID, then each filter receives all of its
+ * packets in a single call, so the filters sharing a PID share the grouping work and each filter
+ * output lock is taken once per buffer instead of once per packet.
+ */
+class TsDemux {
+  public:
+    // TS PIDs are 13 bits.
+    static constexpr uint32_t kNumPids = 8192;
+
+    /**
+     * The receiving end of the packets of a PID, implemented by Filter.
+     */
+    class Sink {
+      public:
+        virtual ~Sink() = default;
+
+        // Returns the PID to receive the packets of, or a value of at least kNumPids for none.
+        virtual uint16_t getTpid() = 0;
+        // Receives the packets of packetSize bytes at packetOffsets in data.
+        virtual void updateFilterOutput(const int8_t* data,
+                                        const std::vector<uint32_t>& packetOffsets,
+                                        size_t packetSize) = 0;
+    };
+
+    TsDemux();
+
+    /**
+     * Replaces the filters to dispatch to. Each filter receives the packets of its current tpid.
+     */
+    void setFilters(const std::vector<std::shared_ptr<Sink>>& filters);
+
+    /**
+     * Dispatches the whole packets of packetSize bytes in data to the filters of their PID.
+     * A trailing partial packet is ignored.
+     */
+    void demux(const int8_t* data, size_t size, size_t packetSize);
+
+  private:
+    struct PidEntry {
+        std::vector<std::shared_ptr<Sink>> filters;
+        // Offsets in the current input of the packets with this PID. Kept across calls so that
+        // its storage is reused.
+        std::vector<uint32_t> packetOffsets;
+    };
+
+    static constexpr int16_t kNoEntry = -1;
+
+    std::mutex mLock;
+    // Index in mEntries of the entry of each PID, or kNoEntry if no filter has the PID.
+    std::array<int16_t, kNumPids> mPidToEntry;
+    std::vector<PidEntry> mEntries;
+    // Indices of the entries that received packets from the current input.
+    std::vector<int16_t> mTouchedEntries;
+};
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
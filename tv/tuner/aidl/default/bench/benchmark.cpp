@@ -0,0 +1,950 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the software data path of the default tuner HAL.
+//
+// The HAL objects are created in this process and called without binder. Each benchmark opens a
+// demux with a set of filters, then feeds a TS stream through DVR playback as fast as the HAL
+// consumes it, one pass of the stream per iteration. A client thread drains the filter and record
+// FMQs and releases the A/V frames, so the HAL never waits on the client.
+//
+// Reported counters:
+//   Mbit/s           - TS input consumed per second.
+//   allocs/packet    - heap allocations in the whole process per TS packet fed.
+//   cpu_<stage>      - CPU time per pass of the HAL threads of each stage: the DVR playback
+//                      thread (demux), the filter event threads and the callback threads, and of
+//                      the benchmark feeder and drain threads.
+//   <filter>_events  - filter events delivered per pass.
+//   <filter>_p50_us, <filter>_p99_us - latency from writing a chunk of the stream to the next
+//                      event callback of the filter.
+//
+// The stream is synthesized with video, audio, section and null packets, unless a TS file is given
+// with --ts_file=<path>. Its filtered PIDs can be changed with --video_pid, --audio_pid and
+// --section_pid.
+
+#include <benchmark/benchmark.h>
+
+#include <aidl/android/hardware/tv/tuner/BnDvrCallback.h>
+#include <aidl/android/hardware/tv/tuner/BnFilterCallback.h>
+#include <aidl/android/hardware/tv/tuner/DemuxQueueNotifyBits.h>
+#include <dirent.h>
+#include <fmq/AidlMessageQueue.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SectionFilter.h"
+#include "Tuner.h"
+
+namespace {
+
+std::atomic<uint64_t> gAllocations = 0;
+
+}  // namespace
+
+// Counts the allocations of the HAL and of the benchmark.
+void* operator new(size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        // Built without exceptions, so there is no std::bad_alloc to throw.
+        abort();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+namespace aidl::android::hardware::tv::tuner::bench {
+namespace {
+
+using ::aidl::android::hardware::common::NativeHandle;
+using ::aidl::android::hardware::common::fmq::MQDescriptor;
+using ::aidl::android::hardware::common::fmq::SynchronizedReadWrite;
+using ::android::AidlMessageQueue;
+using ::android::hardware::EventFlag;
+
+using MQ = AidlMessageQueue<int8_t, SynchronizedReadWrite>;
+using MQDesc = MQDescriptor<int8_t, SynchronizedReadWrite>;
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kTsPacketSize = 188;
+constexpr size_t kTsPayloadSize = kTsPacketSize - 4;
+constexpr uint16_t kNullPid = 0x1fff;
+// Carries the section that marks the end of each pass.
+constexpr uint16_t kFencePid = 0x1ffe;
+constexpr uint8_t kFenceTableId = 0x7f;
+constexpr uint8_t kEitTableId = 0x4e;
+
+constexpr int32_t kPlaybackBufferSize = 4 * 1024 * 1024;
+constexpr int32_t kRecordBufferSize = 16 * 1024 * 1024;
+constexpr int32_t kFilterBufferSize = 16 * 1024 * 1024;
+// The DVR playback FMQ is written in chunks of this many packets.
+constexpr size_t kWriteChunkPackets = 348;
+constexpr size_t kMaxLatencySamples = 1 << 16;
+
+enum FilterMask : int64_t {
+    SECTION = 1 << 0,
+    PES = 1 << 1,
+    TS = 1 << 2,
+    AV = 1 << 3,
+    RECORD = 1 << 4,
+};
+
+struct Options {
+    std::string tsFile;
+    size_t streamSize = 8 * 1024 * 1024;
+    uint16_t videoPid = 0x100;
+    uint16_t audioPid = 0x101;
+    uint16_t sectionPid = 0x12;
+};
+
+Options gOptions;
+
+// Packetizes PES packets or sections of one PID into TS packets.
+class Packetizer {
+  public:
+    explicit Packetizer(uint16_t pid, bool isSection) : mPid(pid), mIsSection(isSection) {}
+
+    bool hasData() const { return mPos < mUnit.size(); }
+
+    void setUnit(std::vector<uint8_t> unit) {
+        mUnit = std::move(unit);
+        mPos = 0;
+    }
+
+    void writePacket(uint8_t* packet) {
+        bool unitStart = mPos == 0;
+        size_t header = unitStart && mIsSection ? 1 : 0;
+        size_t size = std::min(mUnit.size() - mPos, kTsPayloadSize - header);
+        size_t stuffing = kTsPayloadSize - header - size;
+
+        packet[0] = 0x47;
+        packet[1] = (unitStart ? 0x40 : 0x00) | (mPid >> 8);
+        packet[2] = mPid & 0xff;
+        uint8_t* payload = packet + 4;
+        if (stuffing > 0 && !mIsSection) {
+            // PES packets are padded with an adaptation field.
+            packet[3] = 0x30 | mContinuityCounter;
+            payload[0] = stuffing - 1;
+            if (stuffing > 1) {
+                payload[1] = 0x00;
+                memset(payload + 2, 0xff, stuffing - 2);
+            }
+            payload += stuffing;
+        } else {
+            packet[3] = 0x10 | mContinuityCounter;
+        }
+        if (header > 0) {
+            // pointer_field
+            *payload++ = 0;
+        }
+        memcpy(payload, mUnit.data() + mPos, size);
+        if (stuffing > 0 && mIsSection) {
+            memset(payload + size, 0xff, stuffing);
+        }
+        mPos += size;
+        mContinuityCounter = (mContinuityCounter + 1) & 0x0f;
+    }
+
+  private:
+    uint16_t mPid;
+    bool mIsSection;
+    uint8_t mContinuityCounter = 0;
+    std::vector<uint8_t> mUnit;
+    size_t mPos = 0;
+};
+
+uint32_t gRandomState = 1;
+
+uint8_t nextNonZeroByte() {
+    gRandomState = gRandomState * 1103515245 + 12345;
+    return 1 + (gRandomState >> 16) % 255;
+}
+
+std::vector<uint8_t> makePes(uint8_t streamId, uint64_t pts, const std::vector<uint8_t>& es) {
+    std::vector<uint8_t> pes = {0x00, 0x00, 0x01, streamId, 0x00, 0x00, 0x80, 0x80, 0x05};
+    pes.push_back(0x21 | ((pts >> 29) & 0x0e));
+    pes.push_back(pts >> 22);
+    pes.push_back(0x01 | ((pts >> 14) & 0xfe));
+    pes.push_back(pts >> 7);
+    pes.push_back(0x01 | ((pts << 1) & 0xfe));
+    size_t length = pes.size() - 6 + es.size();
+    if (length <= 0xffff) {
+        // Video PES packets may leave PES_packet_length unset.
+        pes[4] = length >> 8;
+        pes[5] = length & 0xff;
+    }
+    pes.insert(pes.end(), es.begin(), es.end());
+    return pes;
+}
+
+// An AVC access unit: an access unit delimiter and a slice NAL unit, with an IDR slice every
+// 30 frames.
+std::vector<uint8_t> makeVideoFrame(int frame) {
+    size_t size = frame % 30 == 0 ? 60000 : 12000 + (frame % 7) * 1500;
+    uint8_t sliceNalHeader = frame % 30 == 0 ? 0x65 : 0x41;
+    std::vector<uint8_t> es = {0x00, 0x00, 0x01, 0x09, 0xf0,
+                               0x00, 0x00, 0x01, sliceNalHeader, 0x88};
+    while (es.size() < size) {
+        es.push_back(nextNonZeroByte());
+    }
+    return makePes(0xe0, frame * 3003, es);
+}
+
+std::vector<uint8_t> makeAudioFrame(int frame) {
+    std::vector<uint8_t> es = {0xff, 0xf1};
+    while (es.size() < 768) {
+        es.push_back(nextNonZeroByte());
+    }
+    return makePes(0xc0, frame * 2160, es);
+}
+
+std::vector<uint8_t> makeSection(uint8_t tableId, uint8_t sectionNumber, size_t payloadSize) {
+    size_t sectionLength = 5 + payloadSize + 4;
+    std::vector<uint8_t> section = {tableId,
+                                    static_cast<uint8_t>(0xb0 | (sectionLength >> 8)),
+                                    static_cast<uint8_t>(sectionLength & 0xff),
+                                    0x00,
+                                    0x01,
+                                    0xc1,
+                                    sectionNumber,
+                                    0xff};
+    for (size_t i = 0; i < payloadSize; i++) {
+        section.push_back(nextNonZeroByte());
+    }
+    uint32_t crc = sectionCrc32(section.data(), section.size());
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        section.push_back(crc >> shift);
+    }
+    return section;
+}
+
+// Mixes video, audio, section and null packets in the proportions of a typical SD service.
+std::vector<uint8_t> makeSyntheticStream(size_t size) {
+    Packetizer video(gOptions.videoPid, false);
+    Packetizer audio(gOptions.audioPid, false);
+    Packetizer sections(gOptions.sectionPid, true);
+    int videoFrames = 0;
+    int audioFrames = 0;
+    int sectionCount = 0;
+
+    size_t packets = size / kTsPacketSize;
+    std::vector<uint8_t> stream(packets * kTsPacketSize);
+    for (size_t i = 0; i < packets; i++) {
+        uint8_t* packet = stream.data() + i * kTsPacketSize;
+        size_t slot = i % 100;
+        Packetizer* packetizer = nullptr;
+        if (slot < 70) {
+            if (!video.hasData()) {
+                video.setUnit(makeVideoFrame(videoFrames++));
+            }
+            packetizer = &video;
+        } else if (slot < 78) {
+            if (!audio.hasData()) {
+                audio.setUnit(makeAudioFrame(audioFrames++));
+            }
+            packetizer = &audio;
+        } else if (slot < 85) {
+            if (!sections.hasData()) {
+                sections.setUnit(makeSection(kEitTableId, sectionCount % 8,
+                                             100 + (sectionCount % 5) * 150));
+                sectionCount++;
+            }
+            packetizer = &sections;
+        }
+        if (packetizer != nullptr) {
+            packetizer->writePacket(packet);
+        } else {
+            packet[0] = 0x47;
+            packet[1] = kNullPid >> 8;
+            packet[2] = kNullPid & 0xff;
+            packet[3] = 0x10;
+            memset(packet + 4, 0xff, kTsPayloadSize);
+        }
+    }
+    return stream;
+}
+
+// Keeps the TS packets of the file, skipping any bytes out of sync.
+bool loadStream(const std::string& path, std::vector<uint8_t>* stream) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+    stream->clear();
+    size_t offset = 0;
+    while (offset + kTsPacketSize <= data.size()) {
+        if (data[offset] != 0x47) {
+            offset++;
+            continue;
+        }
+        stream->insert(stream->end(), data.begin() + offset,
+                       data.begin() + offset + kTsPacketSize);
+        offset += kTsPacketSize;
+    }
+    return !stream->empty();
+}
+
+// A TS packet with the fence section of a pass, whose payload is the pass number.
+void makeFencePacket(uint64_t pass, uint8_t continuityCounter, uint8_t* packet) {
+    std::vector<uint8_t> section = {kFenceTableId, 0x30, 0x08};
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        section.push_back(pass >> shift);
+    }
+    packet[0] = 0x47;
+    packet[1] = 0x40 | (kFencePid >> 8);
+    packet[2] = kFencePid & 0xff;
+    packet[3] = 0x10 | (continuityCounter & 0x0f);
+    packet[4] = 0;
+    memcpy(packet + 5, section.data(), section.size());
+    memset(packet + 5 + section.size(), 0xff, kTsPacketSize - 5 - section.size());
+}
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   Clock::now().time_since_epoch())
+            .count();
+}
+
+// Per thread name CPU time of this process, in seconds.
+std::map<std::string, double> getThreadCpuTimes() {
+    std::map<std::string, double> times;
+    DIR* dir = opendir("/proc/self/task");
+    if (dir == nullptr) {
+        return times;
+    }
+    static const double kTicksPerSecond = sysconf(_SC_CLK_TCK);
+    while (dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        std::string path = std::string("/proc/self/task/") + entry->d_name + "/stat";
+        std::ifstream file(path);
+        std::string stat((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        size_t nameStart = stat.find('(');
+        size_t nameEnd = stat.rfind(')');
+        if (nameStart == std::string::npos || nameEnd == std::string::npos) {
+            continue;
+        }
+        std::string name = stat.substr(nameStart + 1, nameEnd - nameStart - 1);
+        // utime and stime are the 12th and 13th fields after the name.
+        const char* fields = stat.c_str() + nameEnd + 2;
+        unsigned long utime = 0;
+        unsigned long stime = 0;
+        if (sscanf(fields, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) ==
+            2) {
+            times[name] += (utime + stime) / kTicksPerSecond;
+        }
+    }
+    closedir(dir);
+    return times;
+}
+
+std::string getStage(const std::string& threadName) {
+    if (threadName == "tuner_dvr_play") {
+        return "cpu_demux";
+    }
+    if (threadName == "tuner_filter") {
+        return "cpu_filter_events";
+    }
+    if (threadName == "tuner_filter_cb") {
+        return "cpu_callbacks";
+    }
+    if (threadName == "bench_drain") {
+        return "cpu_client_drain";
+    }
+    if (threadName == "bench_feeder") {
+        return "cpu_feeder";
+    }
+    return "cpu_other";
+}
+
+struct FilterStats {
+    std::string name;
+    std::atomic<uint64_t> events = 0;
+    // Time of the oldest chunk written since the last event callback, or 0.
+    std::atomic<int64_t> pendingWriteNs = 0;
+    std::mutex latencyLock;
+    std::vector<int64_t> latenciesNs;
+};
+
+class FilterCallback : public BnFilterCallback {
+  public:
+    explicit FilterCallback(FilterStats* stats) : mStats(stats) {}
+
+    void setFilter(std::shared_ptr<IFilter> filter) { mFilter = std::move(filter); }
+
+    ::ndk::ScopedAStatus onFilterEvent(const std::vector<DemuxFilterEvent>& events) override {
+        int64_t writeNs = mStats->pendingWriteNs.exchange(0);
+        if (writeNs != 0) {
+            std::lock_guard<std::mutex> lock(mStats->latencyLock);
+            if (mStats->latenciesNs.size() < kMaxLatencySamples) {
+                mStats->latenciesNs.push_back(nowNs() - writeNs);
+            }
+        }
+        for (const DemuxFilterEvent& event : events) {
+            if (event.getTag() == DemuxFilterEvent::Tag::media) {
+                // Let the HAL reuse the frame memory, as a decoder would once done with it.
+                const auto& media = event.get<DemuxFilterEvent::Tag::media>();
+                if (mFilter != nullptr) {
+                    mFilter->releaseAvHandle(NativeHandle(), media.avDataId);
+                }
+            }
+        }
+        mStats->events += events.size();
+        return ::ndk::ScopedAStatus::ok();
+    }
+
+    ::ndk::ScopedAStatus onFilterStatus(DemuxFilterStatus /*status*/) override {
+        return ::ndk::ScopedAStatus::ok();
+    }
+
+  private:
+    FilterStats* mStats;
+    std::shared_ptr<IFilter> mFilter;
+};
+
+class DvrCallback : public BnDvrCallback {
+  public:
+    ::ndk::ScopedAStatus onRecordStatus(RecordStatus /*status*/) override {
+        return ::ndk::ScopedAStatus::ok();
+    }
+    ::ndk::ScopedAStatus onPlaybackStatus(PlaybackStatus /*status*/) override {
+        return ::ndk::ScopedAStatus::ok();
+    }
+};
+
+// A client side FMQ that is drained by the drain thread.
+struct DrainedQueue {
+    std::unique_ptr<MQ> mq;
+    EventFlag* eventFlag = nullptr;
+    bool isFence = false;
+};
+
+// The demux, DVRs and filters of one benchmark run.
+class Pipeline {
+  public:
+    ~Pipeline() { close(); }
+
+    bool open(int64_t filters) {
+        mTuner = ::ndk::SharedRefBase::make<Tuner>();
+        mTuner->init();
+        if (!mTuner->openDemuxById(0, &mDemux).isOk()) {
+            return false;
+        }
+        mIsRecording = filters & RECORD;
+
+        if (!openDvr(DvrType::PLAYBACK, kPlaybackBufferSize, &mPlayback, &mPlaybackMQ)) {
+            return false;
+        }
+        if (EventFlag::createEventFlag(mPlaybackMQ->getEventFlagWord(), &mPlaybackEventFlag) !=
+            ::android::OK) {
+            return false;
+        }
+
+        if (mIsRecording) {
+            std::unique_ptr<MQ> recordMQ;
+            if (!openDvr(DvrType::RECORD, kRecordBufferSize, &mRecord, &recordMQ)) {
+                return false;
+            }
+            mQueues.push_back({.mq = std::move(recordMQ)});
+            DemuxFilterRecordSettings record{
+                    .tsIndexMask = static_cast<int32_t>(DemuxTsIndex::FIRST_PACKET) |
+                                   static_cast<int32_t>(DemuxTsIndex::PAYLOAD_UNIT_START_INDICATOR),
+                    .scIndexType = DemuxRecordScIndexType::AVC,
+            };
+            record.scIndexMask.set<DemuxFilterScIndexMask::Tag::scAvc>(
+                    static_cast<int32_t>(DemuxScAvcIndex::I_SLICE) |
+                    static_cast<int32_t>(DemuxScAvcIndex::P_SLICE) |
+                    static_cast<int32_t>(DemuxScAvcIndex::B_SLICE));
+            DemuxTsFilterSettingsFilterSettings settings;
+            settings.set<DemuxTsFilterSettingsFilterSettings::Tag::record>(record);
+            std::shared_ptr<IFilter> filter;
+            if (!openFilter("record", DemuxTsFilterType::RECORD, gOptions.videoPid, settings,
+                            false, &filter) ||
+                !mRecord->attachFilter(filter).isOk()) {
+                return false;
+            }
+        } else {
+            if ((filters & SECTION) && !openSectionFilter("section", gOptions.sectionPid,
+                                                          kEitTableId, false)) {
+                return false;
+            }
+            if (filters & PES) {
+                DemuxTsFilterSettingsFilterSettings settings;
+                settings.set<DemuxTsFilterSettingsFilterSettings::Tag::pesData>(
+                        DemuxFilterPesDataSettings{.streamId = 0xc0});
+                if (!openFilter("pes", DemuxTsFilterType::PES, gOptions.audioPid, settings, true,
+                                nullptr)) {
+                    return false;
+                }
+            }
+            if (filters & TS) {
+                DemuxTsFilterSettingsFilterSettings settings;
+                settings.set<DemuxTsFilterSettingsFilterSettings::Tag::noinit>(true);
+                if (!openFilter("ts", DemuxTsFilterType::TS, gOptions.videoPid, settings, true,
+                                nullptr)) {
+                    return false;
+                }
+            }
+            if (filters & AV) {
+                DemuxTsFilterSettingsFilterSettings settings;
+                settings.set<DemuxTsFilterSettingsFilterSettings::Tag::av>(DemuxFilterAvSettings{});
+                std::shared_ptr<IFilter> filter;
+                NativeHandle avMemory;
+                int64_t avMemorySize;
+                if (!openFilter("av", DemuxTsFilterType::VIDEO, gOptions.videoPid, settings, true,
+                                &filter) ||
+                    !filter->getAvSharedHandle(&avMemory, &avMemorySize).isOk()) {
+                    return false;
+                }
+            }
+            // Opened last, so that it is handled after the other filters of the same data.
+            if (!openSectionFilter("fence", kFencePid, kFenceTableId, true)) {
+                return false;
+            }
+        }
+
+        for (auto& filter : mFilters) {
+            if (!filter->start().isOk()) {
+                return false;
+            }
+        }
+        if (mRecord != nullptr && !mRecord->start().isOk()) {
+            return false;
+        }
+        if (!mPlayback->start().isOk()) {
+            return false;
+        }
+
+        mDraining = true;
+        mDrainThread = std::thread(&Pipeline::drainThreadLoop, this);
+        return true;
+    }
+
+    void close() {
+        if (mPlayback != nullptr) {
+            mPlayback->stop();
+            mPlayback->close();
+            mPlayback = nullptr;
+        }
+        if (mRecord != nullptr) {
+            mRecord->stop();
+            mRecord->close();
+            mRecord = nullptr;
+        }
+        for (auto& filter : mFilters) {
+            filter->stop();
+            filter->close();
+        }
+        mFilters.clear();
+        // The queues are drained until the HAL threads are stopped.
+        if (mDrainThread.joinable()) {
+            mDraining = false;
+            mDrainThread.join();
+        }
+        for (DrainedQueue& queue : mQueues) {
+            EventFlag::deleteEventFlag(&queue.eventFlag);
+        }
+        mQueues.clear();
+        if (mPlaybackEventFlag != nullptr) {
+            EventFlag::deleteEventFlag(&mPlaybackEventFlag);
+        }
+        if (mDemux != nullptr) {
+            mDemux->close();
+            mDemux = nullptr;
+        }
+        mTuner = nullptr;
+    }
+
+    // Feeds one pass of the stream and waits until the HAL has filtered all of it.
+    bool feed(const std::vector<uint8_t>& stream, uint64_t pass) {
+        uint8_t fence[kTsPacketSize];
+        makeFencePacket(pass, pass, fence);
+        if (!write(stream.data(), stream.size()) || !write(fence, sizeof(fence))) {
+            return false;
+        }
+        mFedBytes += stream.size() + sizeof(fence);
+
+        auto deadline = Clock::now() + std::chrono::seconds(10);
+        while (!isPassDone(pass)) {
+            if (Clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        return true;
+    }
+
+    std::vector<std::unique_ptr<FilterStats>>& getStats() { return mStats; }
+
+  private:
+    bool openDvr(DvrType type, int32_t bufferSize, std::shared_ptr<IDvr>* dvr,
+                 std::unique_ptr<MQ>* mq) {
+        if (!mDemux->openDvr(type, bufferSize, ::ndk::SharedRefBase::make<DvrCallback>(), dvr)
+                     .isOk()) {
+            return false;
+        }
+        DvrSettings settings;
+        if (type == DvrType::PLAYBACK) {
+            settings.set<DvrSettings::Tag::playback>(PlaybackSettings{
+                    .statusMask = 0xf,
+                    .lowThreshold = bufferSize / 4,
+                    .highThreshold = bufferSize * 3 / 4,
+                    .dataFormat = DataFormat::TS,
+                    .packetSize = kTsPacketSize,
+            });
+        } else {
+            settings.set<DvrSettings::Tag::record>(RecordSettings{
+                    .statusMask = 0xf,
+                    .lowThreshold = bufferSize / 4,
+                    .highThreshold = bufferSize * 3 / 4,
+                    .dataFormat = DataFormat::TS,
+                    .packetSize = kTsPacketSize,
+            });
+        }
+        MQDesc desc;
+        if (!(*dvr)->configure(settings).isOk() || !(*dvr)->getQueueDesc(&desc).isOk()) {
+            return false;
+        }
+        *mq = std::make_unique<MQ>(desc, true /* resetPointers */);
+        return (*mq)->isValid();
+    }
+
+    bool openFilter(const std::string& name, DemuxTsFilterType type, uint16_t pid,
+                    const DemuxTsFilterSettingsFilterSettings& tsSettings, bool hasQueue,
+                    std::shared_ptr<IFilter>* out, bool isFence = false) {
+        auto stats = std::make_unique<FilterStats>();
+        stats->name = name;
+        stats->latenciesNs.reserve(kMaxLatencySamples);
+        auto callback = ::ndk::SharedRefBase::make<FilterCallback>(stats.get());
+
+        DemuxFilterType filterType{.mainType = DemuxFilterMainType::TS};
+        filterType.subType.set<DemuxFilterSubType::Tag::tsFilterType>(type);
+        std::shared_ptr<IFilter> filter;
+        if (!mDemux->openFilter(filterType, kFilterBufferSize, callback, &filter).isOk()) {
+            return false;
+        }
+        callback->setFilter(filter);
+
+        DemuxFilterSettings settings;
+        settings.set<DemuxFilterSettings::Tag::ts>(
+                DemuxTsFilterSettings{.tpid = pid, .filterSettings = tsSettings});
+        if (!filter->configure(settings).isOk()) {
+            return false;
+        }
+        if (hasQueue) {
+            MQDesc desc;
+            if (!filter->getQueueDesc(&desc).isOk()) {
+                return false;
+            }
+            DrainedQueue queue{.mq = std::make_unique<MQ>(desc, true /* resetPointers */),
+                               .isFence = isFence};
+            if (!queue.mq->isValid() ||
+                EventFlag::createEventFlag(queue.mq->getEventFlagWord(), &queue.eventFlag) !=
+                        ::android::OK) {
+                return false;
+            }
+            mQueues.push_back(std::move(queue));
+        }
+
+        mFilters.push_back(filter);
+        if (!isFence) {
+            mStats.push_back(std::move(stats));
+        } else {
+            mFenceStats = std::move(stats);
+        }
+        if (out != nullptr) {
+            *out = filter;
+        }
+        return true;
+    }
+
+    bool openSectionFilter(const std::string& name, uint16_t pid, uint8_t tableId, bool isFence) {
+        DemuxFilterSectionBits bits{
+                .filter = {static_cast<uint8_t>(tableId)},
+                .mask = {0xff},
+                .mode = {0x00},
+        };
+        DemuxFilterSectionSettings section{
+                .isCheckCrc = !isFence,
+                .isRepeat = true,
+        };
+        section.condition.set<DemuxFilterSectionSettingsCondition::Tag::sectionBits>(bits);
+        DemuxTsFilterSettingsFilterSettings settings;
+        settings.set<DemuxTsFilterSettingsFilterSettings::Tag::section>(section);
+        return openFilter(name, DemuxTsFilterType::SECTION, pid, settings, true, nullptr,
+                          isFence);
+    }
+
+    bool write(const uint8_t* data, size_t size) {
+        size_t maxChunk = kWriteChunkPackets * kTsPacketSize;
+        while (size > 0) {
+            size_t chunk = std::min({size, maxChunk, mPlaybackMQ->availableToWrite()});
+            if (chunk == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            if (!mPlaybackMQ->write(reinterpret_cast<const int8_t*>(data), chunk)) {
+                return false;
+            }
+            mPlaybackEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
+
+            int64_t writeNs = nowNs();
+            for (auto& stats : mStats) {
+                int64_t expected = 0;
+                stats->pendingWriteNs.compare_exchange_strong(expected, writeNs);
+            }
+            data += chunk;
+            size -= chunk;
+        }
+        return true;
+    }
+
+    bool isPassDone(uint64_t pass) {
+        if (mIsRecording) {
+            // Everything fed is recorded.
+            return mRecordedBytes.load() >= mFedBytes;
+        }
+        return mFencePass.load() >= pass;
+    }
+
+    void drainThreadLoop() {
+        pthread_setname_np(pthread_self(), "bench_drain");
+        std::vector<int8_t> buffer(kFilterBufferSize);
+        while (mDraining) {
+            bool isIdle = true;
+            for (DrainedQueue& queue : mQueues) {
+                size_t size = queue.mq->availableToRead();
+                if (size == 0 || !queue.mq->read(buffer.data(), size)) {
+                    continue;
+                }
+                isIdle = false;
+                if (queue.eventFlag != nullptr) {
+                    queue.eventFlag->wake(
+                            static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED));
+                } else {
+                    mRecordedBytes += size;
+                }
+                if (queue.isFence && size >= 8) {
+                    // The pass number is the payload of the last fence section.
+                    uint64_t pass = 0;
+                    for (size_t i = size - 8; i < size; i++) {
+                        pass = (pass << 8) | static_cast<uint8_t>(buffer[i]);
+                    }
+                    mFencePass = pass;
+                }
+            }
+            if (isIdle) {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+
+    std::shared_ptr<Tuner> mTuner;
+    std::shared_ptr<IDemux> mDemux;
+    std::shared_ptr<IDvr> mPlayback;
+    std::shared_ptr<IDvr> mRecord;
+    std::unique_ptr<MQ> mPlaybackMQ;
+    EventFlag* mPlaybackEventFlag = nullptr;
+    bool mIsRecording = false;
+    std::vector<std::shared_ptr<IFilter>> mFilters;
+    std::vector<std::unique_ptr<FilterStats>> mStats;
+    std::unique_ptr<FilterStats> mFenceStats;
+
+    std::vector<DrainedQueue> mQueues;
+    std::thread mDrainThread;
+    std::atomic<bool> mDraining = false;
+    uint64_t mFedBytes = 0;
+    std::atomic<uint64_t> mRecordedBytes = 0;
+    std::atomic<uint64_t> mFencePass = 0;
+};
+
+const std::vector<uint8_t>& getStream() {
+    static const std::vector<uint8_t> stream = [] {
+        std::vector<uint8_t> stream;
+        if (!gOptions.tsFile.empty() && !loadStream(gOptions.tsFile, &stream)) {
+            fprintf(stderr, "cannot read TS packets from %s\n", gOptions.tsFile.c_str());
+            exit(EXIT_FAILURE);
+        }
+        if (stream.empty()) {
+            stream = makeSyntheticStream(gOptions.streamSize);
+        }
+        return stream;
+    }();
+    return stream;
+}
+
+int64_t getPercentile(std::vector<int64_t>& values, double percentile) {
+    if (values.empty()) {
+        return 0;
+    }
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(values.size() * percentile));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+void runPipeline(benchmark::State& state) {
+    pthread_setname_np(pthread_self(), "bench_feeder");
+    const std::vector<uint8_t>& stream = getStream();
+    Pipeline pipeline;
+    if (!pipeline.open(state.range(0))) {
+        state.SkipWithError("cannot open the demux, DVRs and filters");
+        return;
+    }
+
+    // Warm up, so that the frame memory and buffers are allocated before measuring.
+    uint64_t pass = 1;
+    if (!pipeline.feed(stream, pass++)) {
+        state.SkipWithError("the HAL did not consume the stream");
+        return;
+    }
+    for (auto& stats : pipeline.getStats()) {
+        std::lock_guard<std::mutex> lock(stats->latencyLock);
+        stats->events = 0;
+        stats->latenciesNs.clear();
+    }
+
+    std::map<std::string, double> startCpuTimes = getThreadCpuTimes();
+    uint64_t startAllocations = gAllocations.load();
+    for (auto _ : state) {
+        if (!pipeline.feed(stream, pass++)) {
+            state.SkipWithError("the HAL did not consume the stream");
+            return;
+        }
+    }
+    uint64_t allocations = gAllocations.load() - startAllocations;
+    std::map<std::string, double> endCpuTimes = getThreadCpuTimes();
+
+    int64_t bytes = state.iterations() * (stream.size() + kTsPacketSize);
+    state.SetBytesProcessed(bytes);
+    state.counters["Mbit/s"] = benchmark::Counter(bytes * 8 / 1e6, benchmark::Counter::kIsRate);
+    state.counters["allocs/packet"] =
+            static_cast<double>(allocations) / (bytes / kTsPacketSize);
+
+    std::map<std::string, double> stageCpuTimes;
+    for (const auto& [name, time] : endCpuTimes) {
+        // Threads started during the measurement have no start time.
+        auto it = startCpuTimes.find(name);
+        stageCpuTimes[getStage(name)] += time - (it != startCpuTimes.end() ? it->second : 0);
+    }
+    for (const auto& [stage, time] : stageCpuTimes) {
+        state.counters[stage] = benchmark::Counter(time, benchmark::Counter::kAvgIterations);
+    }
+
+    for (auto& stats : pipeline.getStats()) {
+        std::lock_guard<std::mutex> lock(stats->latencyLock);
+        state.counters[stats->name + "_events"] =
+                benchmark::Counter(stats->events.load(), benchmark::Counter::kAvgIterations);
+        state.counters[stats->name + "_p50_us"] = getPercentile(stats->latenciesNs, 0.5) / 1e3;
+        state.counters[stats->name + "_p99_us"] = getPercentile(stats->latenciesNs, 0.99) / 1e3;
+    }
+}
+
+void registerBenchmarks() {
+    const std::pair<const char*, int64_t> kConfigurations[] = {
+            {"Section", SECTION},
+            {"Pes", PES},
+            {"Ts", TS},
+            {"Av", AV},
+            {"Broadcast", SECTION | PES | TS | AV},
+            {"Record", RECORD},
+    };
+    for (const auto& [name, filters] : kConfigurations) {
+        benchmark::RegisterBenchmark((std::string("Pipeline/") + name).c_str(), runPipeline)
+                ->Arg(filters)
+                ->Unit(benchmark::kMillisecond)
+                ->UseRealTime();
+    }
+}
+
+bool parseOption(const char* arg, const char* name, std::string* value) {
+    size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0 || arg[length] != '=') {
+        return false;
+    }
+    *value = arg + length + 1;
+    return true;
+}
+
+bool parseOptions(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        std::string value;
+        if (parseOption(argv[i], "--ts_file", &value)) {
+            gOptions.tsFile = value;
+        } else if (parseOption(argv[i], "--stream_size_mb", &value)) {
+            gOptions.streamSize = std::stoul(value) * 1024 * 1024;
+        } else if (parseOption(argv[i], "--video_pid", &value)) {
+            gOptions.videoPid = std::stoul(value, nullptr, 0);
+        } else if (parseOption(argv[i], "--audio_pid", &value)) {
+            gOptions.audioPid = std::stoul(value, nullptr, 0);
+        } else if (parseOption(argv[i], "--section_pid", &value)) {
+            gOptions.sectionPid = std::stoul(value, nullptr, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+}  // namespace aidl::android::hardware::tv::tuner::bench
+
+int main(int argc, char** argv) {
+    ::benchmark::Initialize(&argc, argv);
+    if (!::aidl::android::hardware::tv::tuner::bench::parseOptions(argc, argv)) {
+        return EXIT_FAILURE;
+    }
+    ::aidl::android::hardware::tv::tuner::bench::registerBenchmarks();
+    ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,292 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "AvMemoryRing.h"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+namespace {
+
+constexpr size_t kRingSize = 1000;
+
+class AvMemoryRingTest : public ::testing::Test {
+  protected:
+    void SetUp() override { init(kRingSize); }
+
+    void TearDown() override {
+        if (mMemory != nullptr) {
+            munmap(mMemory, mSize);
+            mMemory = nullptr;
+        }
+        if (mFd >= 0) {
+            close(mFd);
+            mFd = -1;
+        }
+    }
+
+    // Backs the ring with size bytes of memory, also mapped for the test to read chunks back.
+    void init(size_t size) {
+        TearDown();
+        mRing.reset();
+        mSize = size;
+        mFd = memfd_create("AvMemoryRingTest", 0);
+        ASSERT_GE(mFd, 0);
+        ASSERT_EQ(ftruncate(mFd, size), 0);
+        void* memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, mFd, 0);
+        ASSERT_NE(memory, MAP_FAILED);
+        mMemory = static_cast<uint8_t*>(memory);
+        ASSERT_TRUE(mRing.init(mFd, size));
+    }
+
+    bool append(size_t size, uint8_t value) {
+        std::vector<uint8_t> data(size, value);
+        return mRing.append(data.data(), data.size());
+    }
+
+    // Appends a chunk of size bytes of value and commits it, returning its offset or -1.
+    int64_t write(int64_t dataId, size_t size, uint8_t value) {
+        if (!append(size, value)) {
+            return -1;
+        }
+        int64_t offset = -1;
+        int64_t chunkSize = 0;
+        if (!mRing.commit(dataId, &offset, &chunkSize)) {
+            return -1;
+        }
+        EXPECT_EQ(chunkSize, static_cast<int64_t>(size));
+        return offset;
+    }
+
+    // Returns the bytes of the chunk at offset.
+    std::vector<uint8_t> read(int64_t offset, size_t size) const {
+        return std::vector<uint8_t>(mMemory + offset, mMemory + offset + size);
+    }
+
+    AvMemoryRing mRing;
+    int mFd = -1;
+    size_t mSize = 0;
+    uint8_t* mMemory = nullptr;
+};
+
+}  // namespace
+
+TEST_F(AvMemoryRingTest, CommitsChunksBackToBack) {
+    ASSERT_TRUE(append(100, 0x11));
+    ASSERT_TRUE(append(50, 0x22));
+    EXPECT_EQ(mRing.getChunkSize(), 150u);
+    int64_t offset = -1;
+    int64_t size = 0;
+    ASSERT_TRUE(mRing.commit(1, &offset, &size));
+    EXPECT_EQ(offset, 0);
+    EXPECT_EQ(size, 150);
+    std::vector<uint8_t> expected(100, 0x11);
+    expected.resize(150, 0x22);
+    EXPECT_EQ(read(0, 150), expected);
+
+    EXPECT_EQ(write(2, 200, 0x33), 150);
+    EXPECT_EQ(read(150, 200), std::vector<uint8_t>(200, 0x33));
+    EXPECT_EQ(mRing.getInFlightChunks(), 2u);
+    EXPECT_EQ(mRing.getHighWaterMark(), 350u);
+
+    // Empty chunks are not committed.
+    EXPECT_FALSE(mRing.commit(3, &offset, &size));
+}
+
+TEST_F(AvMemoryRingTest, ReleasesInAnyOrder) {
+    for (int64_t dataId = 1; dataId <= 4; dataId++) {
+        ASSERT_EQ(write(dataId, 200, dataId), (dataId - 1) * 200);
+    }
+
+    // Memory is only reused once the oldest chunk is released.
+    EXPECT_TRUE(mRing.release(3));
+    EXPECT_TRUE(mRing.release(2));
+    EXPECT_FALSE(append(250, 5));
+    EXPECT_EQ(mRing.getInFlightChunks(), 4u);
+
+    EXPECT_TRUE(mRing.release(1));
+    EXPECT_EQ(write(5, 250, 5), 0);
+    EXPECT_EQ(mRing.getInFlightChunks(), 2u);
+    // Chunk 4 is untouched.
+    EXPECT_EQ(read(600, 200), std::vector<uint8_t>(200, 4));
+}
+
+TEST_F(AvMemoryRingTest, MovesChunkThatDoesNotFitAtTheEndToTheStart) {
+    ASSERT_EQ(write(1, 600, 1), 0);
+    ASSERT_EQ(write(2, 300, 2), 600);
+    ASSERT_TRUE(mRing.release(1));
+
+    // The chunk starts in the last 100 bytes, then grows past the end of the memory.
+    ASSERT_TRUE(append(60, 3));
+    ASSERT_TRUE(append(80, 4));
+    int64_t offset = -1;
+    int64_t size = 0;
+    ASSERT_TRUE(mRing.commit(3, &offset, &size));
+    EXPECT_EQ(offset, 0);
+    EXPECT_EQ(size, 140);
+    std::vector<uint8_t> expected(60, 3);
+    expected.resize(140, 4);
+    EXPECT_EQ(read(0, 140), expected);
+    EXPECT_EQ(read(600, 300), std::vector<uint8_t>(300, 2));
+
+    // The following chunk goes after it.
+    EXPECT_EQ(write(4, 100, 5), 140);
+}
+
+TEST_F(AvMemoryRingTest, DropsChunkWhenTheRingIsFull) {
+    ASSERT_EQ(write(1, 600, 1), 0);
+    ASSERT_TRUE(append(300, 2));
+
+    // A failed append leaves the chunk as it was, and the caller drops the PES.
+    EXPECT_FALSE(append(200, 3));
+    EXPECT_EQ(mRing.getChunkSize(), 300u);
+    mRing.discard();
+    EXPECT_EQ(mRing.getChunkSize(), 0u);
+    EXPECT_EQ(mRing.getInFlightChunks(), 1u);
+
+    // The memory of the dropped chunk is reused.
+    EXPECT_EQ(write(2, 400, 4), 600);
+    EXPECT_FALSE(append(1, 5));
+    EXPECT_TRUE(mRing.release(1));
+    EXPECT_EQ(write(3, 500, 5), 0);
+}
+
+TEST_F(AvMemoryRingTest, DropsChunkWhenTooManyAreNotReleased) {
+    int64_t dataId = 1;
+    while (write(dataId, 1, 0) >= 0) {
+        dataId++;
+    }
+    // The commit failed, and dropped the chunk.
+    EXPECT_EQ(mRing.getChunkSize(), 0u);
+    size_t maxChunks = dataId - 1;
+    EXPECT_EQ(mRing.getInFlightChunks(), maxChunks);
+    EXPECT_LT(maxChunks, kRingSize);
+
+    EXPECT_TRUE(mRing.release(1));
+    EXPECT_GE(write(dataId, 1, 0), 0);
+}
+
+TEST_F(AvMemoryRingTest, RejectsStaleAndDuplicateReleases) {
+    ASSERT_GE(write(1, 100, 1), 0);
+    ASSERT_GE(write(2, 100, 2), 0);
+
+    EXPECT_FALSE(mRing.release(0));
+    EXPECT_FALSE(mRing.release(-1));
+    EXPECT_FALSE(mRing.release(3));
+    EXPECT_TRUE(mRing.release(2));
+    EXPECT_FALSE(mRing.release(2));
+
+    EXPECT_TRUE(mRing.release(1));
+    // Reclaims both chunks.
+    ASSERT_GE(write(3, 100, 3), 0);
+    EXPECT_EQ(mRing.getInFlightChunks(), 1u);
+    EXPECT_FALSE(mRing.release(1));
+    EXPECT_FALSE(mRing.release(2));
+
+    // A data id can be used again once released.
+    ASSERT_GE(write(1, 100, 1), 0);
+    EXPECT_TRUE(mRing.release(1));
+    EXPECT_TRUE(mRing.release(3));
+}
+
+TEST_F(AvMemoryRingTest, ReleasesConcurrentlyWithWrites) {
+    constexpr int64_t kNumChunks = 20000;
+    constexpr size_t kMaxChunkSize = 4096;
+    init(64 * 1024);
+
+    struct Chunk {
+        int64_t dataId;
+        int64_t offset;
+        int64_t size;
+    };
+    std::mutex lock;
+    std::deque<Chunk> committed;
+    bool done = false;
+
+    // Releases chunks in groups of three in reverse order, after checking their content.
+    std::thread releaser([&] {
+        std::vector<Chunk> held;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (!committed.empty()) {
+                    held.push_back(committed.front());
+                    committed.pop_front();
+                } else if (done) {
+                    break;
+                }
+            }
+            if (held.size() < 3) {
+                std::this_thread::yield();
+                continue;
+            }
+            for (auto it = held.rbegin(); it != held.rend(); ++it) {
+                std::vector<uint8_t> data = read(it->offset, it->size);
+                ASSERT_TRUE(std::all_of(data.begin(), data.end(), [&](uint8_t value) {
+                    return value == static_cast<uint8_t>(it->dataId);
+                })) << it->dataId;
+                ASSERT_TRUE(mRing.release(it->dataId)) << it->dataId;
+            }
+            held.clear();
+        }
+        for (const Chunk& chunk : held) {
+            ASSERT_TRUE(mRing.release(chunk.dataId)) << chunk.dataId;
+        }
+    });
+
+    std::vector<uint8_t> data(kMaxChunkSize);
+    for (int64_t dataId = 1; dataId <= kNumChunks; dataId++) {
+        size_t size = 1 + (dataId * 7919) % kMaxChunkSize;
+        std::fill_n(data.begin(), size, static_cast<uint8_t>(dataId));
+        Chunk chunk = {.dataId = dataId, .offset = -1, .size = 0};
+        while (!mRing.append(data.data(), size) ||
+               !mRing.commit(dataId, &chunk.offset, &chunk.size)) {
+            mRing.discard();
+            std::this_thread::yield();
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        committed.push_back(chunk);
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        done = true;
+    }
+    releaser.join();
+
+    // An empty append reclaims the released chunks.
+    EXPECT_TRUE(mRing.append(data.data(), 0));
+    EXPECT_EQ(mRing.getInFlightChunks(), 0u);
+    EXPECT_LE(mRing.getHighWaterMark(), 64u * 1024);
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "FilterEventQueue.h"
+
+#include <chrono>
+#include <future>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+namespace {
+
+using Tag = DemuxFilterEvent::Tag;
+
+// Long enough for a blocked wait() to be seen as blocked.
+constexpr auto kBlockedTime = std::chrono::milliseconds(50);
+
+DemuxFilterEvent makeEvent(int64_t byteNumber) {
+    DemuxFilterTsRecordEvent event;
+    event.byteNumber = byteNumber;
+    return DemuxFilterEvent::make<Tag::tsRecord>(event);
+}
+
+std::vector<int64_t> getByteNumbers(const std::vector<DemuxFilterEvent>& events) {
+    std::vector<int64_t> byteNumbers;
+    for (const auto& event : events) {
+        byteNumbers.push_back(event.get<Tag::tsRecord>().byteNumber);
+    }
+    return byteNumbers;
+}
+
+}  // namespace
+
+TEST(FilterEventQueueTest, TakesEventsInPushOrder) {
+    FilterEventQueue queue;
+    queue.push(makeEvent(1));
+    queue.push({makeEvent(2), makeEvent(3)});
+    queue.push(std::vector<DemuxFilterEvent>());
+    ASSERT_TRUE(queue.wait());
+    EXPECT_EQ(getByteNumbers(queue.take()), (std::vector<int64_t>{1, 2, 3}));
+    EXPECT_TRUE(queue.take().empty());
+}
+
+TEST(FilterEventQueueTest, PushWakesUpWait) {
+    FilterEventQueue queue;
+    auto waiting = std::async(std::launch::async, [&] { return queue.wait(); });
+    EXPECT_EQ(waiting.wait_for(kBlockedTime), std::future_status::timeout);
+
+    queue.push(makeEvent(1));
+    EXPECT_TRUE(waiting.get());
+    EXPECT_EQ(getByteNumbers(queue.take()), (std::vector<int64_t>{1}));
+}
+
+TEST(FilterEventQueueTest, StopWakesUpWaitUntilRestarted) {
+    FilterEventQueue queue;
+    auto waiting = std::async(std::launch::async, [&] { return queue.wait(); });
+    EXPECT_EQ(waiting.wait_for(kBlockedTime), std::future_status::timeout);
+
+    queue.stop();
+    EXPECT_FALSE(waiting.get());
+    // The events of a stopped filter are kept for its restart.
+    queue.push(makeEvent(1));
+    EXPECT_FALSE(queue.wait());
+
+    queue.start();
+    ASSERT_TRUE(queue.wait());
+    EXPECT_EQ(getByteNumbers(queue.take()), (std::vector<int64_t>{1}));
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,279 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "IptvJitterBuffer.h"
+
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+constexpr size_t kTsPacketSize = 188;
+constexpr size_t kDepth = 4;
+// Longer than the depth at the packet rate, so that each limit can be tested alone.
+constexpr int64_t kMaxDelayUs = 100000;
+// One packet every 10 ms, in microseconds and in units of the 90 kHz RTP clock.
+constexpr int64_t kPacketIntervalUs = 10000;
+constexpr uint32_t kPacketIntervalRtp = 900;
+
+// Returns a TS packet carrying id in its payload.
+Bytes makeTsPacket(uint16_t id) {
+    Bytes packet(kTsPacketSize, 0xff);
+    packet[0] = 0x47;
+    packet[1] = 0x01;
+    packet[2] = 0x00;
+    packet[3] = 0x10;
+    packet[4] = id >> 8;
+    packet[5] = id & 0xff;
+    return packet;
+}
+
+// Returns an RTP packet with sequence, carrying a TS packet with the sequence as its id.
+Bytes makeRtpPacket(uint16_t sequence) {
+    uint32_t timestamp = sequence * kPacketIntervalRtp;
+    Bytes packet = {0x80,
+                    33,  // MP2T
+                    static_cast<uint8_t>(sequence >> 8),
+                    static_cast<uint8_t>(sequence),
+                    static_cast<uint8_t>(timestamp >> 24),
+                    static_cast<uint8_t>(timestamp >> 16),
+                    static_cast<uint8_t>(timestamp >> 8),
+                    static_cast<uint8_t>(timestamp),
+                    0x12,
+                    0x34,
+                    0x56,
+                    0x78};
+    Bytes tsPacket = makeTsPacket(sequence);
+    packet.insert(packet.end(), tsPacket.begin(), tsPacket.end());
+    return packet;
+}
+
+class IptvJitterBufferTest : public ::testing::Test {
+  protected:
+    // Pushes the RTP packet with sequence, arriving at its regular time plus delayUs.
+    void push(uint16_t sequence, int64_t delayUs = 0) {
+        Bytes packet = makeRtpPacket(sequence);
+        mNowUs = sequence * kPacketIntervalUs + delayUs;
+        mBuffer.push(packet.data(), packet.size(), mNowUs);
+    }
+
+    // Returns the ids of the TS packets ready at nowUs.
+    std::vector<uint16_t> pop(int64_t nowUs) {
+        std::vector<uint16_t> ids;
+        std::vector<int8_t> chunk;
+        while (mBuffer.pop(&chunk, 2 * kTsPacketSize, nowUs)) {
+            EXPECT_EQ(chunk.size() % kTsPacketSize, 0u);
+            for (size_t offset = 0; offset + kTsPacketSize <= chunk.size();
+                 offset += kTsPacketSize) {
+                EXPECT_EQ(static_cast<uint8_t>(chunk[offset]), 0x47);
+                ids.push_back((static_cast<uint8_t>(chunk[offset + 4]) << 8) |
+                              static_cast<uint8_t>(chunk[offset + 5]));
+            }
+        }
+        return ids;
+    }
+
+    std::vector<uint16_t> pop() { return pop(mNowUs); }
+
+    IptvJitterBuffer mBuffer{kDepth, kMaxDelayUs};
+    int64_t mNowUs = 0;
+};
+
+}  // namespace
+
+TEST_F(IptvJitterBufferTest, ReleasesPacketsInSequenceOrder) {
+    for (uint16_t sequence = 10; sequence < 15; sequence++) {
+        push(sequence);
+        EXPECT_EQ(pop(), (std::vector<uint16_t>{sequence}));
+    }
+    EXPECT_EQ(mBuffer.getReceivedPackets(), 5u);
+    EXPECT_EQ(mBuffer.getReorderedPackets(), 0u);
+    EXPECT_EQ(mBuffer.getLostPackets(), 0u);
+    // Packets arrive at the pace of their timestamps.
+    EXPECT_EQ(mBuffer.getJitterUs(), 0);
+}
+
+TEST_F(IptvJitterBufferTest, ReordersPackets) {
+    push(1);
+    push(3);
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{1}));
+    push(2, 1000);
+    push(5);
+    push(4, 1000);
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{2, 3, 4, 5}));
+    EXPECT_EQ(mBuffer.getReorderedPackets(), 2u);
+    EXPECT_EQ(mBuffer.getLostPackets(), 0u);
+    EXPECT_GT(mBuffer.getJitterUs(), 0);
+}
+
+TEST_F(IptvJitterBufferTest, DeclaresLossOnceDepthPacketsAreHeld) {
+    push(1);
+    for (uint16_t sequence = 3; sequence < 3 + kDepth - 1; sequence++) {
+        push(sequence);
+    }
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{1}));
+
+    push(3 + kDepth - 1);
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{3, 4, 5, 6}));
+    EXPECT_EQ(mBuffer.getLostPackets(), 1u);
+
+    // The lost packet arrives too late.
+    push(2, 5 * kPacketIntervalUs);
+    EXPECT_TRUE(pop().empty());
+    EXPECT_EQ(mBuffer.getLatePackets(), 1u);
+}
+
+TEST_F(IptvJitterBufferTest, DeclaresLossAfterMaxDelay) {
+    push(1);
+    push(4);
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{1}));
+
+    // Packet 4 waits for 2 and 3 for the maximum delay.
+    int64_t arrivalUs = mNowUs;
+    EXPECT_TRUE(pop(arrivalUs + kMaxDelayUs - 1).empty());
+    EXPECT_EQ(pop(arrivalUs + kMaxDelayUs), (std::vector<uint16_t>{4}));
+    EXPECT_EQ(mBuffer.getLostPackets(), 2u);
+}
+
+TEST_F(IptvJitterBufferTest, FlushReleasesHeldPackets) {
+    push(1);
+    push(3);
+    push(5);
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{1}));
+
+    // At the end of the stream, the packets waiting for the missing ones are released at once.
+    mBuffer.flush();
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{3, 5}));
+    EXPECT_EQ(mBuffer.getLostPackets(), 2u);
+
+    // The stream goes on after the flushed packets.
+    push(6);
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{6}));
+}
+
+TEST_F(IptvJitterBufferTest, ParsesTimestampsWithTheHighBitSet) {
+    // Packets 10 ms apart, with timestamps up to their wrap, arrive at the pace of the timestamps.
+    for (uint16_t sequence = 0; sequence < 3; sequence++) {
+        uint32_t timestamp = 0xfffff800u + sequence * kPacketIntervalRtp;
+        Bytes packet = makeRtpPacket(sequence);
+        packet[4] = timestamp >> 24;
+        packet[5] = timestamp >> 16;
+        packet[6] = timestamp >> 8;
+        packet[7] = timestamp;
+        mBuffer.push(packet.data(), packet.size(), sequence * kPacketIntervalUs);
+    }
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{0, 1, 2}));
+    EXPECT_EQ(mBuffer.getJitterUs(), 0);
+}
+
+TEST_F(IptvJitterBufferTest, ExtendsSequenceNumbersAcrossTheirWrap) {
+    push(65534);
+    push(0);
+    push(65535);
+    push(1);
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{65534, 65535, 0, 1}));
+    EXPECT_EQ(mBuffer.getReorderedPackets(), 1u);
+    EXPECT_EQ(mBuffer.getLostPackets(), 0u);
+
+    push(2);
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{2}));
+    EXPECT_EQ(mBuffer.getLatePackets(), 0u);
+}
+
+TEST_F(IptvJitterBufferTest, DropsDuplicateAndLatePackets) {
+    push(1);
+    push(3);
+    // A copy of a held packet.
+    push(3);
+    EXPECT_EQ(mBuffer.getDuplicatePackets(), 1u);
+    // A copy of a packet already released.
+    push(1);
+    EXPECT_EQ(mBuffer.getLatePackets(), 1u);
+
+    push(2);
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{1, 2, 3}));
+    EXPECT_EQ(mBuffer.getReceivedPackets(), 5u);
+    EXPECT_EQ(mBuffer.getLostPackets(), 0u);
+}
+
+TEST_F(IptvJitterBufferTest, RestartsOnSequenceJump) {
+    push(1);
+    push(3);
+    push(1000);
+    // The held packets are released, and the stream continues from the new sequence.
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{1, 3, 1000}));
+    EXPECT_EQ(mBuffer.getLostPackets(), 1u);
+    push(1001);
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{1001}));
+}
+
+TEST_F(IptvJitterBufferTest, PassesTsWithoutRtpThrough) {
+    Bytes data = makeTsPacket(7);
+    Bytes next = makeTsPacket(8);
+    data.insert(data.end(), next.begin(), next.end());
+    mBuffer.push(data.data(), data.size(), 0);
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{7, 8}));
+    EXPECT_EQ(mBuffer.getReceivedPackets(), 0u);
+}
+
+TEST_F(IptvJitterBufferTest, PopsWholeTsPackets) {
+    for (uint16_t sequence = 1; sequence <= 3; sequence++) {
+        push(sequence);
+    }
+    std::vector<int8_t> chunk;
+    ASSERT_TRUE(mBuffer.pop(&chunk, 2 * kTsPacketSize + 10, mNowUs));
+    EXPECT_EQ(chunk.size(), 2 * kTsPacketSize);
+    ASSERT_TRUE(mBuffer.pop(&chunk, 2 * kTsPacketSize + 10, mNowUs));
+    EXPECT_EQ(chunk.size(), kTsPacketSize);
+    EXPECT_FALSE(mBuffer.pop(&chunk, 2 * kTsPacketSize + 10, mNowUs));
+    EXPECT_TRUE(chunk.empty());
+}
+
+TEST_F(IptvJitterBufferTest, SkipsRtpCsrcsExtensionAndPadding) {
+    Bytes packet = makeRtpPacket(1);
+    Bytes tsPacket(packet.begin() + 12, packet.end());
+    packet.resize(12);
+    // Two CSRCs, then a header extension of one word, the payload and 3 bytes of padding.
+    packet[0] = 0x80 | 0x20 | 0x10 | 2;
+    packet.insert(packet.end(), 8, 0xaa);
+    packet.insert(packet.end(), {0xbe, 0xde, 0x00, 0x01, 0xbb, 0xbb, 0xbb, 0xbb});
+    packet.insert(packet.end(), tsPacket.begin(), tsPacket.end());
+    packet.insert(packet.end(), {0x00, 0x00, 0x03});
+    mBuffer.push(packet.data(), packet.size(), 0);
+    EXPECT_EQ(pop(), (std::vector<uint16_t>{1}));
+
+    // Not RTP version 2.
+    packet = makeRtpPacket(2);
+    packet[0] = 0x40;
+    mBuffer.push(packet.data(), packet.size(), 0);
+    EXPECT_TRUE(pop().empty());
+    EXPECT_EQ(mBuffer.getReceivedPackets(), 1u);
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
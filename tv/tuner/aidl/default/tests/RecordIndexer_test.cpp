@@ -0,0 +1,486 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <aidl/android/hardware/tv/tuner/DemuxScAvcIndex.h>
+#include <aidl/android/hardware/tv/tuner/DemuxScHevcIndex.h>
+#include <aidl/android/hardware/tv/tuner/DemuxScIndex.h>
+#include <aidl/android/hardware/tv/tuner/DemuxScVvcIndex.h>
+#include <aidl/android/hardware/tv/tuner/DemuxTsIndex.h>
+
+#include "RecordIndexer.h"
+
+#include <algorithm>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+constexpr uint16_t kPid = 0x100;
+constexpr uint16_t kOtherPid = 0x200;
+constexpr size_t kTsPacketSize = 188;
+constexpr size_t kTsPayloadSize = 184;
+constexpr int64_t kPts = 900000;
+// The PES header written by makePes, with a PTS.
+constexpr size_t kPesHeaderSize = 14;
+
+template <typename T>
+int32_t bit(T index) {
+    return static_cast<int32_t>(index);
+}
+
+// The fields of a DemuxFilterTsRecordEvent checked by the tests.
+struct Event {
+    int64_t byteNumber;
+    int32_t tsIndexMask;
+    int32_t scIndexMask;
+    int32_t firstMbInSlice = 0;
+    int64_t pts = kPts;
+
+    bool operator==(const Event& other) const {
+        return byteNumber == other.byteNumber && tsIndexMask == other.tsIndexMask &&
+               scIndexMask == other.scIndexMask && firstMbInSlice == other.firstMbInSlice &&
+               pts == other.pts;
+    }
+};
+
+std::ostream& operator<<(std::ostream& os, const Event& event) {
+    return os << "{byteNumber " << event.byteNumber << ", tsIndexMask 0x" << std::hex
+              << event.tsIndexMask << ", scIndexMask 0x" << event.scIndexMask << std::dec
+              << ", firstMbInSlice " << event.firstMbInSlice << ", pts " << event.pts << "}";
+}
+
+struct Packet {
+    uint16_t pid = kPid;
+    bool unitStart = false;
+    bool priority = false;
+    uint8_t scramblingControl = 0;
+    // The flags of the adaptation field, if the packet has one. Packets with a short payload
+    // always have one, for the stuffing.
+    std::optional<uint8_t> adaptationFlags = std::nullopt;
+    Bytes payload = {};
+};
+
+Bytes makeTsPacket(const Packet& packet) {
+    Bytes data(kTsPacketSize, 0xff);
+    data[0] = 0x47;
+    data[1] = (packet.unitStart ? 0x40 : 0) | (packet.priority ? 0x20 : 0) | (packet.pid >> 8);
+    data[2] = packet.pid & 0xff;
+    bool hasAdaptationField =
+            packet.adaptationFlags.has_value() || packet.payload.size() < kTsPayloadSize;
+    data[3] = (packet.scramblingControl << 6) | (hasAdaptationField ? 0x20 : 0) |
+              (packet.payload.empty() ? 0 : 0x10);
+    if (hasAdaptationField) {
+        EXPECT_LE(packet.payload.size(), kTsPayloadSize - (packet.adaptationFlags ? 2 : 1));
+        data[4] = kTsPayloadSize - 1 - packet.payload.size();
+        if (data[4] > 0) {
+            data[5] = packet.adaptationFlags.value_or(0);
+        }
+    }
+    std::copy(packet.payload.begin(), packet.payload.end(), data.end() - packet.payload.size());
+    return data;
+}
+
+// Returns a PES packet of a video stream with a PTS, carrying es.
+Bytes makePes(const Bytes& es, int64_t pts = kPts) {
+    Bytes pes = {0x00, 0x00, 0x01, 0xe0, 0x00, 0x00, 0x80, 0x80, 0x05};
+    pes.push_back(0x21 | ((pts >> 29) & 0x0e));
+    pes.push_back(pts >> 22);
+    pes.push_back(((pts >> 14) & 0xfe) | 1);
+    pes.push_back(pts >> 7);
+    pes.push_back(((pts << 1) & 0xfe) | 1);
+    pes.insert(pes.end(), es.begin(), es.end());
+    return pes;
+}
+
+// Splits pes into TS packets of kPid. All but the last packet have a full payload.
+std::vector<Bytes> packetize(const Bytes& pes) {
+    std::vector<Bytes> packets;
+    for (size_t position = 0; position < pes.size(); position += kTsPayloadSize) {
+        Packet packet;
+        packet.unitStart = position == 0;
+        packet.payload.assign(pes.begin() + position,
+                              pes.begin() + std::min(pes.size(), position + kTsPayloadSize));
+        packets.push_back(makeTsPacket(packet));
+    }
+    return packets;
+}
+
+// Returns the byte number of the packet from packetize holding the ES byte at esOffset.
+int64_t getByteNumber(size_t esOffset) {
+    return static_cast<int64_t>((kPesHeaderSize + esOffset) / kTsPayloadSize * kTsPacketSize);
+}
+
+// Returns the Exp-Golomb codes of values, padded with 1 bits up to a whole byte.
+Bytes encodeUe(const std::vector<uint32_t>& values) {
+    std::vector<bool> bits;
+    for (uint32_t value : values) {
+        uint32_t codeNum = value + 1;
+        int numBits = 32 - __builtin_clz(codeNum);
+        bits.insert(bits.end(), numBits - 1, false);
+        for (int i = numBits - 1; i >= 0; i--) {
+            bits.push_back((codeNum >> i) & 1);
+        }
+    }
+    while (bits.size() % 8 != 0) {
+        bits.push_back(true);
+    }
+    Bytes bytes(bits.size() / 8);
+    for (size_t i = 0; i < bits.size(); i++) {
+        bytes[i / 8] |= bits[i] << (7 - i % 8);
+    }
+    return bytes;
+}
+
+// Appends a NAL unit or start code with header, followed by fillerSize bytes without zeros.
+void appendUnit(Bytes* es, const Bytes& header, size_t fillerSize = 20) {
+    es->insert(es->end(), {0x00, 0x00, 0x01});
+    es->insert(es->end(), header.begin(), header.end());
+    es->insert(es->end(), fillerSize, 0x77);
+}
+
+// Returns the NAL unit header and slice header start of an AVC slice.
+Bytes makeAvcSliceHeader(bool idr, uint32_t firstMbInSlice, uint32_t sliceType) {
+    Bytes header = {static_cast<uint8_t>(idr ? 0x65 : 0x41)};
+    Bytes sliceHeader = encodeUe({firstMbInSlice, sliceType});
+    header.insert(header.end(), sliceHeader.begin(), sliceHeader.end());
+    return header;
+}
+
+class RecordIndexerTest : public ::testing::Test {
+  protected:
+    void configure(int32_t tsIndexMask,
+                   DemuxRecordScIndexType scIndexType = DemuxRecordScIndexType::NONE,
+                   int32_t scIndexMask = 0) {
+        DemuxFilterRecordSettings settings;
+        settings.tsIndexMask = tsIndexMask;
+        settings.scIndexType = scIndexType;
+        switch (scIndexType) {
+            case DemuxRecordScIndexType::SC_AVC:
+                settings.scIndexMask.set<DemuxFilterScIndexMask::Tag::scAvc>(scIndexMask);
+                break;
+            case DemuxRecordScIndexType::SC_HEVC:
+                settings.scIndexMask.set<DemuxFilterScIndexMask::Tag::scHevc>(scIndexMask);
+                break;
+            case DemuxRecordScIndexType::SC_VVC:
+                settings.scIndexMask.set<DemuxFilterScIndexMask::Tag::scVvc>(scIndexMask);
+                break;
+            default:
+                settings.scIndexMask.set<DemuxFilterScIndexMask::Tag::scIndex>(scIndexMask);
+                break;
+        }
+        mScIndexType = scIndexType;
+        mIndexer.configure(kPid, settings);
+    }
+
+    // Indexes packets, passed to the indexer chunkPackets at a time, and returns the events.
+    std::vector<Event> index(const std::vector<Bytes>& packets, size_t chunkPackets = 1) {
+        std::vector<DemuxFilterEvent> filterEvents;
+        for (size_t i = 0; i < packets.size(); i += chunkPackets) {
+            Bytes data;
+            for (size_t j = i; j < std::min(packets.size(), i + chunkPackets); j++) {
+                data.insert(data.end(), packets[j].begin(), packets[j].end());
+            }
+            mIndexer.index(reinterpret_cast<const int8_t*>(data.data()), data.size(),
+                           &filterEvents);
+        }
+
+        std::vector<Event> events;
+        for (const auto& filterEvent : filterEvents) {
+            const auto& recordEvent = filterEvent.get<DemuxFilterEvent::Tag::tsRecord>();
+            EXPECT_EQ(recordEvent.pid.get<DemuxPid::Tag::tPid>(), kPid);
+            events.push_back({.byteNumber = recordEvent.byteNumber,
+                              .tsIndexMask = recordEvent.tsIndexMask,
+                              .scIndexMask = getScIndexMask(recordEvent.scIndexMask),
+                              .firstMbInSlice = recordEvent.firstMbInSlice,
+                              .pts = recordEvent.pts});
+        }
+        return events;
+    }
+
+    int32_t getScIndexMask(const DemuxFilterScIndexMask& mask) const {
+        switch (mScIndexType) {
+            case DemuxRecordScIndexType::SC_AVC:
+                EXPECT_EQ(mask.getTag(), DemuxFilterScIndexMask::Tag::scAvc);
+                return mask.get<DemuxFilterScIndexMask::Tag::scAvc>();
+            case DemuxRecordScIndexType::SC_HEVC:
+                EXPECT_EQ(mask.getTag(), DemuxFilterScIndexMask::Tag::scHevc);
+                return mask.get<DemuxFilterScIndexMask::Tag::scHevc>();
+            case DemuxRecordScIndexType::SC_VVC:
+                EXPECT_EQ(mask.getTag(), DemuxFilterScIndexMask::Tag::scVvc);
+                return mask.get<DemuxFilterScIndexMask::Tag::scVvc>();
+            default:
+                EXPECT_EQ(mask.getTag(), DemuxFilterScIndexMask::Tag::scIndex);
+                return mask.get<DemuxFilterScIndexMask::Tag::scIndex>();
+        }
+    }
+
+    RecordIndexer mIndexer;
+    DemuxRecordScIndexType mScIndexType = DemuxRecordScIndexType::NONE;
+};
+
+}  // namespace
+
+TEST_F(RecordIndexerTest, ReportsTsIndexesOfFilterPidPackets) {
+    std::vector<Packet> packets(9);
+    packets[0] = {.pid = kOtherPid, .unitStart = true, .payload = Bytes(kTsPayloadSize)};
+    packets[1] = {.unitStart = true, .priority = true, .payload = Bytes(kTsPayloadSize)};
+    packets[2] = {.adaptationFlags = 0xc0, .payload = Bytes(10)};
+    packets[3] = {.adaptationFlags = 0x1f, .payload = Bytes(10)};
+    packets[4] = {.scramblingControl = 2, .payload = Bytes(kTsPayloadSize)};
+    packets[5] = {.scramblingControl = 2, .payload = Bytes(kTsPayloadSize)};
+    packets[6] = {.pid = kOtherPid, .scramblingControl = 3, .payload = Bytes(kTsPayloadSize)};
+    packets[7] = {.scramblingControl = 3, .payload = Bytes(kTsPayloadSize)};
+    packets[8] = {.scramblingControl = 0, .payload = Bytes(kTsPayloadSize)};
+    std::vector<Bytes> data;
+    for (const auto& packet : packets) {
+        data.push_back(makeTsPacket(packet));
+    }
+
+    configure(0x1fff);
+    EXPECT_EQ(index(data),
+              (std::vector<Event>{
+                      {.byteNumber = 188,
+                       .tsIndexMask = bit(DemuxTsIndex::FIRST_PACKET) |
+                                      bit(DemuxTsIndex::PAYLOAD_UNIT_START_INDICATOR) |
+                                      bit(DemuxTsIndex::PRIORITY_INDICATOR),
+                       .scIndexMask = 0,
+                       .pts = 0},
+                      {.byteNumber = 2 * 188,
+                       .tsIndexMask = bit(DemuxTsIndex::DISCONTINUITY_INDICATOR) |
+                                      bit(DemuxTsIndex::RANDOM_ACCESS_INDICATOR),
+                       .scIndexMask = 0,
+                       .pts = 0},
+                      {.byteNumber = 3 * 188,
+                       .tsIndexMask = bit(DemuxTsIndex::PCR_FLAG) |
+                                      bit(DemuxTsIndex::OPCR_FLAG) |
+                                      bit(DemuxTsIndex::SPLICING_POINT_FLAG) |
+                                      bit(DemuxTsIndex::PRIVATE_DATA) |
+                                      bit(DemuxTsIndex::ADAPTATION_EXTENSION_FLAG),
+                       .scIndexMask = 0,
+                       .pts = 0},
+                      {.byteNumber = 4 * 188,
+                       .tsIndexMask = bit(DemuxTsIndex::CHANGE_TO_EVEN_SCRAMBLED),
+                       .scIndexMask = 0,
+                       .pts = 0},
+                      {.byteNumber = 7 * 188,
+                       .tsIndexMask = bit(DemuxTsIndex::CHANGE_TO_ODD_SCRAMBLED),
+                       .scIndexMask = 0,
+                       .pts = 0},
+                      {.byteNumber = 8 * 188,
+                       .tsIndexMask = bit(DemuxTsIndex::CHANGE_TO_NOT_SCRAMBLED),
+                       .scIndexMask = 0,
+                       .pts = 0},
+              }));
+
+    // Only the indexes of the mask are reported. Byte numbers restart with configure.
+    configure(bit(DemuxTsIndex::RANDOM_ACCESS_INDICATOR));
+    EXPECT_EQ(index(data, data.size()),
+              (std::vector<Event>{{.byteNumber = 2 * 188,
+                                   .tsIndexMask = bit(DemuxTsIndex::RANDOM_ACCESS_INDICATOR),
+                                   .scIndexMask = 0,
+                                   .pts = 0}}));
+}
+
+TEST_F(RecordIndexerTest, ClassifiesAvcSlices) {
+    const std::vector<uint32_t> firstMbs = {0, 1, 99, 1000};
+    const int32_t sliceTypes[] = {
+            bit(DemuxScAvcIndex::P_SLICE), bit(DemuxScAvcIndex::B_SLICE),
+            bit(DemuxScAvcIndex::I_SLICE), bit(DemuxScAvcIndex::SP_SLICE),
+            bit(DemuxScAvcIndex::SI_SLICE),
+    };
+
+    Bytes es;
+    std::vector<Event> expected;
+    // Access unit delimiter, SPS and PPS are not indexed.
+    appendUnit(&es, {0x09, 0xf0});
+    appendUnit(&es, {0x67, 0x42, 0x00, 0x1e});
+    appendUnit(&es, {0x68, 0xce, 0x38, 0x80});
+    for (uint32_t sliceType = 0; sliceType < 10; sliceType++) {
+        uint32_t firstMb = firstMbs[sliceType % firstMbs.size()];
+        expected.push_back({.byteNumber = getByteNumber(es.size()),
+                            .tsIndexMask = 0,
+                            .scIndexMask = sliceTypes[sliceType % 5],
+                            .firstMbInSlice = static_cast<int32_t>(firstMb)});
+        appendUnit(&es, makeAvcSliceHeader(sliceType == 7, firstMb, sliceType), 100);
+    }
+    expected[0].tsIndexMask = bit(DemuxTsIndex::FIRST_PACKET);
+
+    configure(bit(DemuxTsIndex::FIRST_PACKET), DemuxRecordScIndexType::SC_AVC, 0x1f);
+    EXPECT_EQ(index(packetize(makePes(es))), expected);
+
+    // Only the slice types of the mask are reported.
+    configure(0, DemuxRecordScIndexType::SC_AVC, bit(DemuxScAvcIndex::I_SLICE));
+    expected = {expected[2], expected[7]};
+    expected[0].tsIndexMask = 0;
+    EXPECT_EQ(index(packetize(makePes(es))), expected);
+}
+
+TEST_F(RecordIndexerTest, FindsStartCodesSplitAcrossPackets) {
+    // Each offset of the start codes relative to the packet boundaries, including the 00 00 01
+    // and the slice header being split.
+    for (size_t shift = 0; shift < kTsPayloadSize; shift++) {
+        SCOPED_TRACE(shift);
+        Bytes es(shift, 0x55);
+        std::vector<Event> expected;
+        for (uint32_t firstMb = 0; firstMb < 5; firstMb++) {
+            expected.push_back({.byteNumber = getByteNumber(es.size()),
+                                .tsIndexMask = 0,
+                                .scIndexMask = bit(DemuxScAvcIndex::I_SLICE),
+                                .firstMbInSlice = static_cast<int32_t>(firstMb * 300)});
+            appendUnit(&es, makeAvcSliceHeader(true, firstMb * 300, 7), 37);
+        }
+        std::vector<Bytes> packets = packetize(makePes(es));
+
+        configure(0, DemuxRecordScIndexType::SC_AVC, 0x1f);
+        ASSERT_EQ(index(packets), expected);
+        configure(0, DemuxRecordScIndexType::SC_AVC, 0x1f);
+        ASSERT_EQ(index(packets, packets.size()), expected);
+    }
+}
+
+TEST_F(RecordIndexerTest, ReportsPtsOfEachPes) {
+    Bytes es;
+    appendUnit(&es, makeAvcSliceHeader(true, 0, 7));
+    std::vector<Bytes> packets = packetize(makePes(es, 1000));
+    std::vector<Bytes> next = packetize(makePes(es, 0x1ffffffffll));
+    packets.insert(packets.end(), next.begin(), next.end());
+
+    configure(bit(DemuxTsIndex::PAYLOAD_UNIT_START_INDICATOR), DemuxRecordScIndexType::SC_AVC,
+              bit(DemuxScAvcIndex::I_SLICE));
+    // The TS indexes of a packet come with its first event.
+    EXPECT_EQ(index(packets),
+              (std::vector<Event>{
+                      {.byteNumber = 0,
+                       .tsIndexMask = bit(DemuxTsIndex::PAYLOAD_UNIT_START_INDICATOR),
+                       .scIndexMask = bit(DemuxScAvcIndex::I_SLICE),
+                       .pts = 1000},
+                      {.byteNumber = 188,
+                       .tsIndexMask = bit(DemuxTsIndex::PAYLOAD_UNIT_START_INDICATOR),
+                       .scIndexMask = bit(DemuxScAvcIndex::I_SLICE),
+                       .pts = 0x1ffffffffll},
+              }));
+}
+
+TEST_F(RecordIndexerTest, ClassifiesHevcNalUnitTypes) {
+    const std::vector<std::pair<uint8_t, int32_t>> nalUnitTypes = {
+            {0, bit(DemuxScHevcIndex::SLICE_TRAIL_CRA)},
+            {1, bit(DemuxScHevcIndex::SLICE_TRAIL_CRA)},
+            {16, bit(DemuxScHevcIndex::SLICE_CE_BLA_W_LP)},
+            {17, bit(DemuxScHevcIndex::SLICE_BLA_W_RADL)},
+            {18, bit(DemuxScHevcIndex::SLICE_BLA_N_LP)},
+            {19, bit(DemuxScHevcIndex::SLICE_IDR_W_RADL)},
+            {20, bit(DemuxScHevcIndex::SLICE_IDR_N_LP)},
+            {21, bit(DemuxScHevcIndex::SLICE_TRAIL_CRA)},
+            {32, 0},  // VPS_NUT
+            {33, bit(DemuxScHevcIndex::SPS)},
+            {34, 0},  // PPS_NUT
+            {35, bit(DemuxScHevcIndex::AUD)},
+            {39, 0},  // PREFIX_SEI_NUT
+    };
+
+    Bytes es;
+    std::vector<Event> expected;
+    for (const auto& [nalUnitType, index] : nalUnitTypes) {
+        if (index != 0) {
+            expected.push_back({.byteNumber = getByteNumber(es.size()),
+                                .tsIndexMask = 0,
+                                .scIndexMask = index});
+        }
+        appendUnit(&es, {static_cast<uint8_t>(nalUnitType << 1), 0x01});
+    }
+
+    configure(0, DemuxRecordScIndexType::SC_HEVC, 0xff);
+    EXPECT_EQ(index(packetize(makePes(es))), expected);
+}
+
+TEST_F(RecordIndexerTest, ClassifiesVvcNalUnitTypes) {
+    const std::vector<std::pair<uint8_t, int32_t>> nalUnitTypes = {
+            {0, 0},  // TRAIL_NUT
+            {7, bit(DemuxScVvcIndex::SLICE_IDR_W_RADL)},
+            {8, bit(DemuxScVvcIndex::SLICE_IDR_N_LP)},
+            {9, bit(DemuxScVvcIndex::SLICE_CRA)},
+            {10, bit(DemuxScVvcIndex::SLICE_GDR)},
+            {14, bit(DemuxScVvcIndex::VPS)},
+            {15, bit(DemuxScVvcIndex::SPS)},
+            {16, 0},  // PPS_NUT
+            {20, bit(DemuxScVvcIndex::AUD)},
+    };
+
+    Bytes es;
+    std::vector<Event> expected;
+    for (const auto& [nalUnitType, index] : nalUnitTypes) {
+        if (index != 0) {
+            expected.push_back({.byteNumber = getByteNumber(es.size()),
+                                .tsIndexMask = 0,
+                                .scIndexMask = index});
+        }
+        appendUnit(&es, {0x00, static_cast<uint8_t>((nalUnitType << 3) | 0x01)});
+    }
+
+    configure(0, DemuxRecordScIndexType::SC_VVC, 0x7f);
+    EXPECT_EQ(index(packetize(makePes(es))), expected);
+}
+
+TEST_F(RecordIndexerTest, ClassifiesMpeg2StartCodes) {
+    // picture_coding_type follows the 10 bits of temporal_reference.
+    auto pictureHeader = [](uint16_t temporalReference, uint8_t pictureCodingType) -> Bytes {
+        return {0x00, static_cast<uint8_t>(temporalReference >> 2),
+                static_cast<uint8_t>(((temporalReference & 0x3) << 6) | (pictureCodingType << 3)),
+                0xff};
+    };
+
+    Bytes es;
+    std::vector<Event> expected;
+    expected.push_back(
+            {.byteNumber = 0, .tsIndexMask = 0, .scIndexMask = bit(DemuxScIndex::SEQUENCE)});
+    appendUnit(&es, {0xb3, 0x2d, 0x01, 0xe0});
+    // GOP header
+    appendUnit(&es, {0xb8, 0x00, 0x08, 0x00});
+    const std::vector<std::pair<uint8_t, int32_t>> pictureCodingTypes = {
+            {1, bit(DemuxScIndex::I_FRAME)},
+            {2, bit(DemuxScIndex::P_FRAME)},
+            {3, bit(DemuxScIndex::B_FRAME)},
+            {4, 0},  // D picture
+    };
+    for (const auto& [pictureCodingType, index] : pictureCodingTypes) {
+        if (index != 0) {
+            expected.push_back({.byteNumber = getByteNumber(es.size()),
+                                .tsIndexMask = 0,
+                                .scIndexMask = index});
+        }
+        appendUnit(&es, pictureHeader(0x3ff, pictureCodingType), 200);
+    }
+
+    configure(0, DemuxRecordScIndexType::SC, 0xf);
+    EXPECT_EQ(index(packetize(makePes(es))), expected);
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
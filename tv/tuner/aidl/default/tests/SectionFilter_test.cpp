@@ -0,0 +1,410 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <aidl/android/hardware/tv/tuner/Constant.h>
+
+#include "SectionFilter.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+using Tag = DemuxFilterSectionSettingsCondition::Tag;
+
+constexpr size_t kTsPacketSize = 188;
+constexpr size_t kTsHeaderSize = 4;
+
+// The CRC32 of ISO/IEC 13818-1 Annex A, one bit at a time.
+uint32_t referenceCrc32(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i] << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// Returns a section with the long header and a valid CRC_32, of size bytes in total.
+Bytes makeSection(uint8_t tableId, int version, uint8_t sectionNumber, uint8_t lastSectionNumber,
+                  size_t size) {
+    Bytes section(size);
+    section[0] = tableId;
+    section[1] = 0xb0 | ((size - 3) >> 8);
+    section[2] = (size - 3) & 0xff;
+    section[3] = 0x00;
+    section[4] = 0x01;
+    section[5] = 0xc1 | (version << 1);
+    section[6] = sectionNumber;
+    section[7] = lastSectionNumber;
+    for (size_t i = 8; i < size - 4; i++) {
+        section[i] = i * 7;
+    }
+    uint32_t crc = referenceCrc32(section.data(), size - 4);
+    section[size - 4] = crc >> 24;
+    section[size - 3] = crc >> 16;
+    section[size - 2] = crc >> 8;
+    section[size - 1] = crc;
+    return section;
+}
+
+// Returns a section with the short header, which has no CRC_32.
+Bytes makeShortSection(uint8_t tableId, size_t size) {
+    Bytes section(size, 0x5a);
+    section[0] = tableId;
+    section[1] = 0x70 | ((size - 3) >> 8);
+    section[2] = (size - 3) & 0xff;
+    return section;
+}
+
+DemuxFilterSectionSettings makeSettings(bool isRepeat, bool isCheckCrc = false) {
+    DemuxFilterSectionSettings settings;
+    // Empty section bits match every section.
+    settings.condition = DemuxFilterSectionSettingsCondition::make<Tag::sectionBits>();
+    settings.isRepeat = isRepeat;
+    settings.isCheckCrc = isCheckCrc;
+    return settings;
+}
+
+DemuxFilterSectionSettings makeSectionBitsSettings(const Bytes& filter, const Bytes& mask,
+                                                   const Bytes& mode, bool isRepeat) {
+    DemuxFilterSectionSettings settings = makeSettings(isRepeat);
+    DemuxFilterSectionBits bits;
+    bits.filter = filter;
+    bits.mask = mask;
+    bits.mode = mode;
+    settings.condition = DemuxFilterSectionSettingsCondition::make<Tag::sectionBits>(bits);
+    return settings;
+}
+
+DemuxFilterSectionSettings makeTableInfoSettings(int32_t tableId, int32_t version,
+                                                 bool isRepeat) {
+    DemuxFilterSectionSettings settings = makeSettings(isRepeat);
+    DemuxFilterSectionSettingsConditionTableInfo tableInfo;
+    tableInfo.tableId = tableId;
+    tableInfo.version = version;
+    settings.condition = DemuxFilterSectionSettingsCondition::make<Tag::tableInfo>(tableInfo);
+    return settings;
+}
+
+class SectionFilterTest : public ::testing::Test {
+  protected:
+    // Returns a TS packet with the next continuity counter carrying payload, followed by stuffing.
+    Bytes makePacket(bool unitStart, const Bytes& payload, size_t adaptationFieldSize = 0) {
+        Bytes packet(kTsPacketSize, 0xff);
+        packet[0] = 0x47;
+        packet[1] = (unitStart ? 0x40 : 0x00) | 0x01;
+        packet[2] = 0x00;
+        packet[3] = (adaptationFieldSize > 0 ? 0x30 : 0x10) | (mContinuityCounter++ & 0x0f);
+        size_t offset = kTsHeaderSize;
+        if (adaptationFieldSize > 0) {
+            packet[offset] = adaptationFieldSize - 1;
+            std::fill_n(packet.begin() + offset + 1, adaptationFieldSize - 1, 0);
+            offset += adaptationFieldSize;
+        }
+        EXPECT_LE(offset + payload.size(), kTsPacketSize);
+        std::copy(payload.begin(), payload.end(), packet.begin() + offset);
+        return packet;
+    }
+
+    // Splits sections sent back to back into TS packets. Packets in which a section starts begin
+    // with a pointer_field. With adaptation fields, every third packet carries one.
+    std::vector<Bytes> packetize(const std::vector<Bytes>& sections,
+                                 bool withAdaptationFields = false) {
+        Bytes stream;
+        std::vector<size_t> starts;
+        for (const auto& section : sections) {
+            starts.push_back(stream.size());
+            stream.insert(stream.end(), section.begin(), section.end());
+        }
+
+        std::vector<Bytes> packets;
+        size_t position = 0;
+        while (position < stream.size()) {
+            size_t adaptationFieldSize = withAdaptationFields && packets.size() % 3 == 0 ? 8 : 0;
+            size_t available = kTsPacketSize - kTsHeaderSize - adaptationFieldSize;
+            auto start = std::find_if(starts.begin(), starts.end(), [&](size_t start) {
+                return start >= position && start < position + available - 1;
+            });
+            Bytes payload;
+            if (start != starts.end()) {
+                payload.push_back(*start - position);
+                available--;
+            }
+            size_t count = std::min(available, stream.size() - position);
+            payload.insert(payload.end(), stream.begin() + position,
+                           stream.begin() + position + count);
+            packets.push_back(makePacket(start != starts.end(), payload, adaptationFieldSize));
+            position += count;
+        }
+        return packets;
+    }
+
+    // Processes packets and returns the sections delivered.
+    std::vector<Bytes> process(const std::vector<Bytes>& packets) {
+        std::vector<Bytes> sections;
+        for (const auto& packet : packets) {
+            mFilter.processPacket(packet.data(), packet.size(),
+                                  [&](const uint8_t* section, size_t size) {
+                                      sections.emplace_back(section, section + size);
+                                      return true;
+                                  });
+        }
+        return sections;
+    }
+
+    std::vector<Bytes> filter(const DemuxFilterSectionSettings& settings,
+                              const std::vector<Bytes>& sections) {
+        mFilter.configure(settings);
+        return process(packetize(sections));
+    }
+
+    SectionFilter mFilter;
+    uint8_t mContinuityCounter = 0;
+};
+
+}  // namespace
+
+TEST(SectionCrc32Test, MatchesBitwiseCrc) {
+    Bytes data(1000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = i * 31 + 7;
+    }
+    for (size_t size : {0, 1, 7, 8, 9, 15, 16, 17, 100, 1000}) {
+        EXPECT_EQ(sectionCrc32(data.data(), size), referenceCrc32(data.data(), size)) << size;
+    }
+
+    Bytes section = makeSection(0x4e, 3, 0, 0, 300);
+    EXPECT_EQ(sectionCrc32(section.data(), section.size()), 0u);
+}
+
+TEST_F(SectionFilterTest, AssemblesSectionsSpanningPackets) {
+    std::vector<Bytes> sections = {
+            makeSection(0x4e, 3, 0, 1, 300), makeSection(0x4e, 3, 1, 1, 20),
+            makeSection(0x50, 4, 0, 0, 30),  makeShortSection(0x70, 20),
+            makeSection(0x4f, 2, 0, 0, 1000),
+    };
+    for (bool withAdaptationFields : {false, true}) {
+        SCOPED_TRACE(withAdaptationFields);
+        mFilter.configure(makeSettings(/*isRepeat=*/true, /*isCheckCrc=*/true));
+        EXPECT_EQ(process(packetize(sections, withAdaptationFields)), sections);
+    }
+}
+
+TEST_F(SectionFilterTest, DeliversSeveralSectionsOfOnePacket) {
+    Bytes first = makeSection(0x4e, 3, 0, 0, 20);
+    Bytes second = makeShortSection(0x70, 8);
+    Bytes third = makeSection(0x4f, 3, 0, 0, 40);
+    Bytes payload = {0};
+    for (const Bytes* section : {&first, &second, &third}) {
+        payload.insert(payload.end(), section->begin(), section->end());
+    }
+
+    mFilter.configure(makeSettings(/*isRepeat=*/true));
+    // The rest of the packet is stuffing.
+    EXPECT_EQ(process({makePacket(true, payload)}), (std::vector<Bytes>{first, second, third}));
+}
+
+TEST_F(SectionFilterTest, PointerFieldSkipsTheEndOfAMissedSection) {
+    std::vector<Bytes> sections = {makeSection(0x4e, 3, 0, 0, 300), makeSection(0x4f, 3, 0, 0, 20),
+                                   makeSection(0x50, 3, 0, 0, 30)};
+    std::vector<Bytes> packets = packetize(sections);
+    ASSERT_EQ(packets.size(), 2u);
+    // The second packet starts with the end of the first section, then the other two.
+    EXPECT_EQ(packets[1][4], 300 - (kTsPacketSize - kTsHeaderSize - 1));
+
+    mFilter.configure(makeSettings(/*isRepeat=*/true));
+    EXPECT_EQ(process({packets[1]}), (std::vector<Bytes>{sections[1], sections[2]}));
+}
+
+TEST_F(SectionFilterTest, ContinuityCounterLossDropsThePartialSection) {
+    std::vector<Bytes> sections = {makeSection(0x4e, 3, 0, 0, 300), makeSection(0x4f, 3, 0, 0, 20),
+                                   makeSection(0x50, 3, 0, 0, 400), makeSection(0x51, 3, 0, 0, 30)};
+    std::vector<Bytes> packets = packetize(sections);
+    ASSERT_EQ(packets.size(), 5u);
+
+    // The third packet only holds the middle of the third section.
+    mFilter.configure(makeSettings(/*isRepeat=*/true));
+    EXPECT_EQ(process({packets[0], packets[1], packets[3], packets[4]}),
+              (std::vector<Bytes>{sections[0], sections[1], sections[3]}));
+
+    // Duplicate packets are dropped.
+    mFilter.reset();
+    EXPECT_EQ(process({packets[0], packets[0], packets[1], packets[1], packets[2], packets[3],
+                       packets[4], packets[4]}),
+              sections);
+}
+
+TEST_F(SectionFilterTest, IgnoresTruncatedPackets) {
+    Bytes section = makeSection(0x4e, 3, 0, 0, 20);
+    // Only the header of a packet with an adaptation field and payload.
+    Bytes packet = makePacket(true, Bytes{0}, /*adaptationFieldSize=*/8);
+    packet = Bytes(packet.begin(), packet.begin() + kTsHeaderSize);
+
+    mFilter.configure(makeSettings(/*isRepeat=*/true));
+    EXPECT_TRUE(process({packet}).empty());
+    // The filter still assembles the sections that follow.
+    Bytes payload = {0};
+    payload.insert(payload.end(), section.begin(), section.end());
+    EXPECT_EQ(process({makePacket(true, payload)}), (std::vector<Bytes>{section}));
+}
+
+TEST_F(SectionFilterTest, CrcFailureDropsTheSection) {
+    std::vector<Bytes> sections = {makeSection(0x4e, 3, 0, 0, 300), makeSection(0x4f, 3, 0, 0, 20),
+                                   makeSection(0x50, 3, 0, 0, 30)};
+    std::vector<Bytes> packets = packetize(sections);
+    // A byte in the body of the second section.
+    packets[1][kTsHeaderSize + 1 + 117 + 10] ^= 0x01;
+
+    mFilter.configure(makeSettings(/*isRepeat=*/true, /*isCheckCrc=*/true));
+    EXPECT_EQ(process(packets), (std::vector<Bytes>{sections[0], sections[2]}));
+
+    mFilter.configure(makeSettings(/*isRepeat=*/true, /*isCheckCrc=*/false));
+    std::vector<Bytes> delivered = process(packets);
+    ASSERT_EQ(delivered.size(), 3u);
+    EXPECT_NE(delivered[1], sections[1]);
+}
+
+TEST_F(SectionFilterTest, SectionBitsMatchFilterMaskAndMode) {
+    Bytes a = makeSection(0x4e, 3, 0, 0, 20);
+    Bytes b = makeSection(0x4f, 3, 0, 0, 20);
+    Bytes c = makeSection(0x4e, 5, 0, 0, 20);
+    std::vector<Bytes> sections = {a, b, c};
+
+    // The first byte applies to table_id.
+    EXPECT_EQ(filter(makeSectionBitsSettings({0x4e}, {0xff}, {0x00}, true), sections),
+              (std::vector<Bytes>{a, c}));
+    // Bits outside of the mask are ignored.
+    EXPECT_EQ(filter(makeSectionBitsSettings({0x4e}, {0xfe}, {0x00}, true), sections), sections);
+    // The following bytes apply to the bytes after section_length, here version_number.
+    EXPECT_EQ(filter(makeSectionBitsSettings({0x4e, 0, 0, 3 << 1}, {0xff, 0, 0, 0x3e},
+                                             {0x00, 0, 0, 0x00}, true),
+                     sections),
+              (std::vector<Bytes>{a}));
+    // Mode bits ask for a difference.
+    EXPECT_EQ(filter(makeSectionBitsSettings({0x4e}, {0xff}, {0xff}, true), sections),
+              (std::vector<Bytes>{b}));
+    EXPECT_EQ(filter(makeSectionBitsSettings({0x4e, 0, 0, 3 << 1}, {0xff, 0, 0, 0x3e},
+                                             {0x00, 0, 0, 0x3e}, true),
+                     sections),
+              (std::vector<Bytes>{c}));
+    // Bytes past the end of a section do not match.
+    EXPECT_TRUE(filter(makeSectionBitsSettings({0x70, 0, 0, 0, 0, 0x5a}, {0xff, 0, 0, 0, 0, 0xff},
+                                               {}, true),
+                       {makeShortSection(0x70, 6)})
+                        .empty());
+}
+
+TEST_F(SectionFilterTest, NonRepeatingSectionBitsDeliverTheFirstMatchOnly) {
+    Bytes a = makeSection(0x4e, 3, 0, 1, 20);
+    Bytes b = makeSection(0x4e, 3, 1, 1, 20);
+    std::vector<Bytes> sections = {makeSection(0x4f, 3, 0, 0, 20), a, b, a, b};
+    auto settings = makeSectionBitsSettings({0x4e}, {0xff}, {}, /*isRepeat=*/false);
+
+    EXPECT_EQ(filter(settings, sections), (std::vector<Bytes>{a}));
+    EXPECT_TRUE(process(packetize(sections)).empty());
+
+    // reset restarts delivery.
+    mFilter.reset();
+    EXPECT_EQ(process(packetize(sections)), (std::vector<Bytes>{a}));
+}
+
+TEST_F(SectionFilterTest, NonRepeatingTableInfoDeliversEachSectionOnce) {
+    Bytes s0 = makeSection(0x4e, 3, 0, 2, 20);
+    Bytes s1 = makeSection(0x4e, 3, 1, 2, 20);
+    Bytes s2 = makeSection(0x4e, 3, 2, 2, 20);
+    auto settings = makeTableInfoSettings(
+            0x4e, static_cast<int32_t>(Constant::INVALID_TABINFO_VERSION), /*isRepeat=*/false);
+
+    EXPECT_EQ(filter(settings, {s1, s0, s1, makeSection(0x4f, 3, 2, 2, 20), s2, s0}),
+              (std::vector<Bytes>{s1, s0, s2}));
+    // The table is complete.
+    EXPECT_TRUE(process(packetize({s0, s1, s2})).empty());
+
+    // A new version restarts the collection of sections.
+    Bytes s0v4 = makeSection(0x4e, 4, 0, 1, 20);
+    Bytes s1v4 = makeSection(0x4e, 4, 1, 1, 20);
+    EXPECT_EQ(filter(settings, {makeSection(0x4e, 3, 0, 1, 20), s0v4, s1v4, s0v4}),
+              (std::vector<Bytes>{makeSection(0x4e, 3, 0, 1, 20), s0v4, s1v4}));
+
+    // Sections with the short header have no section number, the first one completes the table.
+    Bytes shortSection = makeShortSection(0x4e, 10);
+    EXPECT_EQ(filter(settings, {shortSection, shortSection}), (std::vector<Bytes>{shortSection}));
+}
+
+TEST_F(SectionFilterTest, RepeatingTableInfoDeliversEveryCopy) {
+    Bytes v3 = makeSection(0x4e, 3, 0, 0, 20);
+    Bytes v4 = makeSection(0x4e, 4, 0, 0, 20);
+    std::vector<Bytes> sections = {v3, makeSection(0x4f, 3, 0, 0, 20), v3, v4, v4};
+
+    EXPECT_EQ(filter(makeTableInfoSettings(
+                             0x4e, static_cast<int32_t>(Constant::INVALID_TABINFO_VERSION), true),
+                     sections),
+              (std::vector<Bytes>{v3, v3, v4, v4}));
+    EXPECT_EQ(filter(makeTableInfoSettings(0x4e, 4, true), sections),
+              (std::vector<Bytes>{v4, v4}));
+}
+
+TEST_F(SectionFilterTest, RejectedSectionIsDeliveredWhenRepeated) {
+    Bytes section = makeSection(0x4e, 3, 0, 0, 20);
+    Bytes payload = {0};
+    payload.insert(payload.end(), section.begin(), section.end());
+    payload.insert(payload.end(), section.begin(), section.end());
+
+    for (const auto& settings :
+         {makeSectionBitsSettings({0x4e}, {0xff}, {}, /*isRepeat=*/false),
+          makeTableInfoSettings(0x4e, static_cast<int32_t>(Constant::INVALID_TABINFO_VERSION),
+                                /*isRepeat=*/false)}) {
+        SCOPED_TRACE(static_cast<int>(settings.condition.getTag()));
+        mFilter.configure(settings);
+        Bytes packet = makePacket(true, payload);
+
+        // A rejected section stops the packet, and does not count as delivered.
+        int calls = 0;
+        EXPECT_FALSE(mFilter.processPacket(packet.data(), packet.size(),
+                                           [&](const uint8_t*, size_t) {
+                                               calls++;
+                                               return false;
+                                           }));
+        EXPECT_EQ(calls, 1);
+
+        packet = makePacket(true, payload);
+        EXPECT_TRUE(mFilter.processPacket(packet.data(), packet.size(),
+                                          [&](const uint8_t*, size_t) {
+                                              calls++;
+                                              return true;
+                                          }));
+        // The second copy in the packet is not delivered again.
+        EXPECT_EQ(calls, 2);
+    }
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "TsDemux.h"
+
+#include <memory>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+namespace {
+
+constexpr size_t kTsPacketSize = 188;
+// The tpid of a filter that is not configured with a TS pid.
+constexpr uint16_t kNoTpid = 0xffff;
+
+// Records the index of each packet it receives, which the packets carry in their fourth byte.
+class RecordingSink : public TsDemux::Sink {
+  public:
+    explicit RecordingSink(uint16_t tpid) : mTpid(tpid) {}
+
+    uint16_t getTpid() override { return mTpid; }
+
+    void updateFilterOutput(const int8_t* data, const std::vector<uint32_t>& packetOffsets,
+                            size_t packetSize) override {
+        calls++;
+        for (uint32_t offset : packetOffsets) {
+            EXPECT_EQ(packetSize, kTsPacketSize);
+            EXPECT_EQ(offset % kTsPacketSize, 0u);
+            packets.push_back(data[offset + 3]);
+        }
+    }
+
+    int calls = 0;
+    std::vector<int8_t> packets;
+
+  private:
+    const uint16_t mTpid;
+};
+
+// Returns TS packets with the given PIDs, each carrying its index.
+std::vector<int8_t> makePackets(const std::vector<uint16_t>& pids) {
+    std::vector<int8_t> data(pids.size() * kTsPacketSize);
+    for (size_t i = 0; i < pids.size(); i++) {
+        int8_t* packet = data.data() + i * kTsPacketSize;
+        packet[0] = 0x47;
+        packet[1] = static_cast<int8_t>((pids[i] >> 8) & 0x1f);
+        packet[2] = static_cast<int8_t>(pids[i] & 0xff);
+        packet[3] = static_cast<int8_t>(i);
+    }
+    return data;
+}
+
+}  // namespace
+
+TEST(TsDemuxTest, RoutesPacketsToTheFiltersOfTheirPid) {
+    TsDemux demux;
+    auto video = std::make_shared<RecordingSink>(0x100);
+    auto audio = std::make_shared<RecordingSink>(0x101);
+    demux.setFilters({video, audio});
+
+    auto data = makePackets({0x100, 0x101, 0x100, 0x1100, 0x101, 0x100});
+    demux.demux(data.data(), data.size(), kTsPacketSize);
+
+    // One call per filter and buffer, with the packets in input order.
+    EXPECT_EQ(video->calls, 1);
+    EXPECT_EQ(video->packets, (std::vector<int8_t>{0, 2, 5}));
+    EXPECT_EQ(audio->calls, 1);
+    EXPECT_EQ(audio->packets, (std::vector<int8_t>{1, 4}));
+}
+
+TEST(TsDemuxTest, FiltersSharingAPidReceiveTheSamePackets) {
+    TsDemux demux;
+    auto first = std::make_shared<RecordingSink>(0x1fff);
+    auto second = std::make_shared<RecordingSink>(0x1fff);
+    demux.setFilters({first, second});
+
+    auto data = makePackets({0x1fff, 0x20, 0x1fff});
+    demux.demux(data.data(), data.size(), kTsPacketSize);
+
+    EXPECT_EQ(first->packets, (std::vector<int8_t>{0, 2}));
+    EXPECT_EQ(second->packets, (std::vector<int8_t>{0, 2}));
+}
+
+TEST(TsDemuxTest, IgnoresPacketsOfOtherPidsAndTrailingPartialPacket) {
+    TsDemux demux;
+    auto filter = std::make_shared<RecordingSink>(0x100);
+    auto unconfigured = std::make_shared<RecordingSink>(kNoTpid);
+    demux.setFilters({filter, unconfigured});
+
+    auto data = makePackets({0x200, 0x300});
+    demux.demux(data.data(), data.size(), kTsPacketSize);
+    // Filters without packets in a buffer are not called.
+    EXPECT_EQ(filter->calls, 0);
+
+    data = makePackets({0x100, 0x100});
+    demux.demux(data.data(), data.size() - 1, kTsPacketSize);
+    EXPECT_EQ(filter->packets, (std::vector<int8_t>{0}));
+    EXPECT_EQ(unconfigured->calls, 0);
+}
+
+TEST(TsDemuxTest, SetFiltersReplacesThePidTable) {
+    TsDemux demux;
+    auto first = std::make_shared<RecordingSink>(0x100);
+    auto second = std::make_shared<RecordingSink>(0x200);
+    demux.setFilters({first});
+
+    auto data = makePackets({0x100, 0x200});
+    demux.demux(data.data(), data.size(), kTsPacketSize);
+    demux.setFilters({second});
+    demux.demux(data.data(), data.size(), kTsPacketSize);
+    demux.demux(data.data(), data.size(), kTsPacketSize);
+
+    // Packet offsets do not leak from one buffer into the next.
+    EXPECT_EQ(first->packets, (std::vector<int8_t>{0}));
+    EXPECT_EQ(second->calls, 2);
+    EXPECT_EQ(second->packets, (std::vector<int8_t>{1, 1}));
+
+    demux.setFilters({});
+    demux.demux(data.data(), data.size(), kTsPacketSize);
+    EXPECT_EQ(second->calls, 2);
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl